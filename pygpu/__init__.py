@@ -6,8 +6,11 @@ def get_include():
 
 from . import gpuarray, elemwise, reduction
 from .gpuarray import (init, set_default_context, get_default_context,
-                       array, zeros, empty, asarray, ascontiguousarray,
-                       asfortranarray, register_dtype)
+                       array, zeros, ones, full, empty, arange,
+                       linspace, asarray, ascontiguousarray,
+                       asfortranarray, register_dtype, pinned_empty,
+                       from_dlpack, from_cuda_array_interface,
+                       load_npy, save_npy)
 from .operations import (split, array_split, hsplit, vsplit, dsplit,
                          concatenate, hstack, vstack, dstack)
 from ._array import ndgpuarray
@@ -37,6 +37,7 @@ cdef extern from "gpuarray/elemwise.h":
 
     cdef int GE_NOADDR64
     cdef int GE_CONVERT_F16
+    cdef int GE_INDEX
 
     cdef int GE_BROADCAST
     cdef int GE_NOCOLLAPSE
@@ -97,9 +98,10 @@ cdef class GpuElemwise:
     cdef unsigned int n
 
     def __cinit__(self, GpuContext ctx, expr, args, unsigned int nd=0,
-                  preamble=b"", bint convert_f16=False):
+                  preamble=b"", bint convert_f16=False, bint index=False):
         cdef gpuelemwise_arg *_args;
         cdef unsigned int i
+        cdef int flags
         cdef arg aa
 
         self.ge = NULL
@@ -135,9 +137,13 @@ cdef class GpuElemwise:
                 else:
                     self.types[i] = GA_BUFFER
 
+            flags = 0
+            if convert_f16:
+                flags |= GE_CONVERT_F16
+            if index:
+                flags |= GE_INDEX
             self.ge = GpuElemwise_new(ctx.ctx, preamble, expr, self.n,
-                                      _args, nd,
-                                      GE_CONVERT_F16 if convert_f16 else 0)
+                                      _args, nd, flags)
         finally:
             free(_args)
         if self.ge is NULL:
@@ -1,29 +1,15 @@
-from string import Template
-from .gpuarray import GpuArray, GpuKernel, SIZE, dtype_to_ctype
+from .elemwise import GpuElemwise, as_argument
 
-def _generate_kernel(ctx, cols, ctype, upper=True):
-    tmpl = Template("""
-    #include "cluda.h"
-    KERNEL void extract_tri(GLOBAL_MEM ${ctype} *a, ga_size a_off, ga_uint N) {
-        a = (GLOBAL_MEM ${ctype} *)(((GLOBAL_MEM char *)a) + a_off);
-        unsigned int idx = GID_1 * LDIM_0 * GDIM_0 +
-                           GID_0 * LDIM_0 + LID_0;
-        unsigned int ix = idx/${cols};
-        unsigned int iy = idx%${cols};
-        if (idx < N) {
-            if (ix ${le} iy)
-                a[idx] = 0.0;
-        }
-    }
-    """)
+
+def _generate_kernel(A, upper=True):
     if upper:
         le = '>'
     else:
         le = '<'
-    src = tmpl.substitute(cols=cols, ctype=ctype, le=le)
-    spec = [GpuArray, SIZE, 'uint32']
-    k = GpuKernel(src, "extract_tri", spec, context=ctx)
-    return k
+    expr = "a = (ga_idx0 %s ga_idx1) ? 0 : a" % (le,)
+    args = [as_argument(A, 'a', read=True, write=True)]
+    return GpuElemwise(A.context, expr, args, nd=2, convert_f16=True,
+                       index=True)
 
 
 def triu(A, inplace=True):
@@ -34,15 +20,8 @@ def triu(A, inplace=True):
 
     if not inplace:
         A = A.copy()
-    if A.flags['F_CONTIGUOUS']:
-        upper = False
-        cols = A.shape[0]
-    else:
-        upper = True
-        cols = A.shape[1]
-    ctype = dtype_to_ctype(A.dtype)
-    k = _generate_kernel(A.context, cols, ctype, upper)
-    k(A, A.offset, A.shape[0] * A.shape[1], n=A.shape[0] * A.shape[1])
+    k = _generate_kernel(A, upper=True)
+    k(A)
     return A
 
 
@@ -54,13 +33,6 @@ def tril(A, inplace=True):
 
     if not inplace:
         A = A.copy()
-    if A.flags['F_CONTIGUOUS']:
-        upper = True
-        cols = A.shape[0]
-    else:
-        upper = False
-        cols = A.shape[1]
-    ctype = dtype_to_ctype(A.dtype)
-    k = _generate_kernel(A.context, cols, ctype, upper)
-    k(A, A.offset, A.shape[0] * A.shape[1], n=A.shape[0] * A.shape[1])
+    k = _generate_kernel(A, upper=False)
+    k(A)
     return A
@@ -0,0 +1,70 @@
+/*
+ * The parts of the DLPack ABI (https://github.com/dmlc/dlpack) that
+ * pygpu uses to exchange arrays with other libraries.
+ */
+#ifndef PYGPU_DLPACK
+#define PYGPU_DLPACK
+
+#include <Python.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define kDLCPU 1
+#define kDLCUDA 2
+
+#define kDLInt 0
+#define kDLUInt 1
+#define kDLFloat 2
+#define kDLComplex 5
+#define kDLBool 6
+
+typedef struct {
+  int32_t device_type;
+  int32_t device_id;
+} DLDevice;
+
+typedef struct {
+  uint8_t code;
+  uint8_t bits;
+  uint16_t lanes;
+} DLDataType;
+
+typedef struct {
+  void *data;
+  DLDevice device;
+  int32_t ndim;
+  DLDataType dtype;
+  int64_t *shape;
+  int64_t *strides; /* in elements, NULL for C contiguous */
+  uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor {
+  DLTensor dl_tensor;
+  void *manager_ctx;
+  void (*deleter)(struct DLManagedTensor *self);
+} DLManagedTensor;
+
+/*
+ * Deleter for the tensors we export.  manager_ctx is a reference to
+ * the exported array and the shape and strides live in the same
+ * allocation as the tensor.  This may be called from any thread.
+ */
+static void pygpu_dlpack_deleter(DLManagedTensor *t) {
+  PyGILState_STATE st = PyGILState_Ensure();
+  Py_XDECREF((PyObject *)t->manager_ctx);
+  PyGILState_Release(st);
+  free(t);
+}
+
+/* Capsule destructor, only frees tensors that were never consumed */
+static void pygpu_dlpack_capsule_free(PyObject *cap) {
+  DLManagedTensor *t;
+  if (!PyCapsule_IsValid(cap, "dltensor"))
+    return;
+  t = (DLManagedTensor *)PyCapsule_GetPointer(cap, "dltensor");
+  if (t->deleter != NULL)
+    t->deleter(t);
+}
+
+#endif
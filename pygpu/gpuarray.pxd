@@ -73,6 +73,10 @@ cdef extern from "gpuarray/buffer.h":
         pass
     ctypedef struct gpukernel:
         pass
+    ctypedef struct gpustream:
+        pass
+    ctypedef struct gpuevent:
+        pass
 
     int gpu_get_platform_count(const char* name, unsigned int* platcount)
     int gpu_get_device_count(const char* name, unsigned int platform, unsigned int* devcount)
@@ -84,6 +88,7 @@ cdef extern from "gpuarray/buffer.h":
     int gpucontext_props_set_single_stream(gpucontext_props *p)
     int gpucontext_props_kernel_cache(gpucontext_props *p, const char *path)
     int gpucontext_props_alloc_cache(gpucontext_props *p, size_t initial, size_t max)
+    int gpucontext_props_transfer_chunk(gpucontext_props *p, size_t sz)
     void gpucontext_props_del(gpucontext_props *p)
 
     int gpucontext_init(gpucontext **res, const char *name, gpucontext_props *p)
@@ -93,8 +98,18 @@ cdef extern from "gpuarray/buffer.h":
     int gpucontext_property(gpucontext *ctx, int prop_id, void *res)
     int gpukernel_property(gpukernel *k, int prop_id, void *res)
     gpucontext *gpudata_context(gpudata *)
+    gpudata *gpudata_alloc(gpucontext *ctx, size_t sz, void *data, int flags,
+                           int *ret)
+    void gpudata_release(gpudata *)
     gpucontext *gpukernel_context(gpukernel *)
 
+    gpuevent *gpuevent_alloc(gpucontext *ctx, int *ret)
+    void gpuevent_free(gpuevent *e)
+    int gpuevent_record(gpuevent *e, gpustream *s)
+    int gpuevent_sync(gpuevent *e)
+    int gpuevent_query(gpuevent *e, int *done)
+    int gpuevent_elapsed(gpuevent *start, gpuevent *end, double *ms)
+
     int GA_CTX_SCHED_AUTO
     int GA_CTX_SCHED_SINGLE
     int GA_CTX_SCHED_MULTI
@@ -115,15 +130,20 @@ cdef extern from "gpuarray/buffer.h":
     int GA_CTX_PROP_LARGEST_MEMBLOCK
 
     int GA_BUFFER_PROP_SIZE
+    int GA_BUFFER_PROP_HOSTPOINTER
+
+    int GA_BUFFER_HOST
 
     int GA_KERNEL_PROP_MAXLSIZE
     int GA_KERNEL_PROP_PREFLSIZE
     int GA_KERNEL_PROP_NUMARGS
     int GA_KERNEL_PROP_TYPES
+    int GA_KERNEL_PROP_NUMREGS
+    int GA_KERNEL_PROP_SHAREDSIZE
 
     cdef enum ga_usefl:
         GA_USE_SMALL, GA_USE_DOUBLE, GA_USE_COMPLEX, GA_USE_HALF,
-        GA_USE_CUDA, GA_USE_OPENCL
+        GA_USE_ATOM64, GA_USE_CUDA, GA_USE_OPENCL
 
 cdef extern from "gpuarray/kernel.h":
     ctypedef struct _GpuKernel "GpuKernel":
@@ -177,6 +197,11 @@ cdef extern from "gpuarray/array.h":
     int GpuArray_index(_GpuArray *r, _GpuArray *a, const ssize_t *starts,
                        const ssize_t *stops, const ssize_t *steps)
     int GpuArray_take1(_GpuArray *r, _GpuArray *a, _GpuArray *i, int check_err)
+    int GpuArray_put1(_GpuArray *a, _GpuArray *v, _GpuArray *i, int check_err)
+    int GpuArray_scatter_add(_GpuArray *a, _GpuArray *v, _GpuArray *i,
+                             int check_err)
+    int GpuArray_scatter_add_sorted(_GpuArray *a, _GpuArray *v, _GpuArray *i,
+                                    int check_err)
     int GpuArray_setarray(_GpuArray *v, _GpuArray *a)
     int GpuArray_reshape(_GpuArray *res, _GpuArray *a, unsigned int nd,
                          const size_t *newdims, ga_order ord, int nocopy)
@@ -193,18 +218,37 @@ cdef extern from "gpuarray/array.h":
     int GpuArray_move(_GpuArray *dst, _GpuArray *src)
     int GpuArray_write(_GpuArray *dst, void *src, size_t src_sz) nogil
     int GpuArray_read(void *dst, size_t dst_sz, _GpuArray *src) nogil
+    int GpuArray_write_strided(_GpuArray *dst, void *src,
+                               const ssize_t *src_strides) nogil
+    int GpuArray_read_strided(void *dst, const ssize_t *dst_strides,
+                              _GpuArray *src) nogil
+    int GpuArray_write_async(_GpuArray *dst, void *src, size_t src_sz,
+                             gpuevent *done) nogil
+    int GpuArray_read_async(void *dst, size_t dst_sz, _GpuArray *src,
+                            gpuevent *done) nogil
     int GpuArray_memset(_GpuArray *a, int data)
+    int GpuArray_fill(_GpuArray *a, const void *value)
+    int GpuArray_arange(_GpuArray *r, gpucontext *ctx, int typecode,
+                        const void *start, const void *step, size_t n)
+    int GpuArray_linspace(_GpuArray *r, gpucontext *ctx, int typecode,
+                          double start, double stop, size_t n, int endpoint)
     int GpuArray_copy(_GpuArray *res, _GpuArray *a, ga_order order)
 
     int GpuArray_transfer(_GpuArray *res, const _GpuArray *a) nogil
     int GpuArray_split(_GpuArray **rs, const _GpuArray *a, size_t n,
                        size_t *p, unsigned int axis)
+    int GpuArray_split_copy(_GpuArray **rs, const _GpuArray *a, size_t n,
+                            size_t *p, unsigned int axis)
     int GpuArray_concatenate(_GpuArray *r, const _GpuArray **as, size_t n,
                              unsigned int axis, int restype)
 
     char *GpuArray_error(_GpuArray *a, int err)
 
     void GpuArray_fprintf(libc.stdio.FILE *fd, _GpuArray *a)
+    int GpuArray_load_npy(_GpuArray *a, gpucontext *ctx,
+                          libc.stdio.FILE *f) nogil
+    int GpuArray_load_npy_into(_GpuArray *a, libc.stdio.FILE *f) nogil
+    int GpuArray_save_npy(libc.stdio.FILE *f, _GpuArray *a) nogil
     bint GpuArray_is_c_contiguous(_GpuArray *a)
     bint GpuArray_is_f_contiguous(_GpuArray *a)
 
@@ -243,6 +287,10 @@ cdef int array_index(GpuArray r, GpuArray a, const ssize_t *starts,
                      const ssize_t *stops, const ssize_t *steps) except -1
 cdef int array_take1(GpuArray r, GpuArray a, GpuArray i,
                      int check_err) except -1
+cdef int array_put1(GpuArray a, GpuArray v, GpuArray i,
+                    int check_err) except -1
+cdef int array_scatter_add(GpuArray a, GpuArray v, GpuArray i,
+                           bint grouped, int check_err) except -1
 cdef int array_setarray(GpuArray v, GpuArray a) except -1
 cdef int array_reshape(GpuArray res, GpuArray a, unsigned int nd,
                        const size_t *newdims, ga_order ord,
@@ -255,7 +303,10 @@ cdef gpucontext *array_context(GpuArray a) except NULL
 cdef int array_move(GpuArray a, GpuArray src) except -1
 cdef int array_write(GpuArray a, void *src, size_t sz) except -1
 cdef int array_read(void *dst, size_t sz, GpuArray src) except -1
+cdef int array_write_strided(GpuArray a, np.ndarray src) except -1
+cdef int array_read_strided(np.ndarray dst, GpuArray src) except -1
 cdef int array_memset(GpuArray a, int data) except -1
+cdef int array_fill(GpuArray a, const void *value) except -1
 cdef int array_copy(GpuArray res, GpuArray a, ga_order order) except -1
 cdef int array_transfer(GpuArray res, GpuArray a) except -1
 
@@ -324,6 +375,19 @@ cdef api class GpuContext [type PyGpuContextType, object PyGpuContextObject]:
     cdef readonly bytes kind
     cdef object __weakref__
 
+cdef class GpuEvent:
+    cdef gpuevent *ev
+    cdef readonly GpuContext context
+
+cdef class GpuTimer:
+    cdef readonly GpuEvent start
+    cdef readonly GpuEvent end
+
+cdef class GpuTransfer:
+    cdef readonly GpuEvent event
+    cdef object result
+    cdef object host
+
 cdef GpuArray new_GpuArray(object cls, GpuContext ctx, object base)
 
 cdef api class GpuArray [type PyGpuArrayType, object PyGpuArrayObject]:
@@ -2,14 +2,21 @@ cimport libc.stdio
 from libc.stdlib cimport malloc, calloc, free
 from cpython.mem cimport PyMem_Malloc, PyMem_Free
 from libc.string cimport strncmp
+from libc.errno cimport errno
 
 cimport numpy as np
 import numpy as np
 
+import os
 import sys
+import time
 
 from cpython cimport Py_INCREF, PyNumber_Index
 from cpython.object cimport Py_EQ, Py_NE
+from cpython.buffer cimport PyBuffer_FillInfo
+from cpython.pycapsule cimport (PyCapsule_New, PyCapsule_IsValid,
+                                PyCapsule_GetPointer, PyCapsule_SetName)
+from libc.stdint cimport int32_t, int64_t, uint8_t, uint16_t, uint64_t
 
 def api_version():
     """api_version()
@@ -339,6 +346,27 @@ cdef int array_take1(GpuArray r, GpuArray a, GpuArray i,
             raise IndexError, GpuArray_error(&r.ga, err)
         raise get_exc(err), GpuArray_error(&r.ga, err)
 
+cdef int array_put1(GpuArray a, GpuArray v, GpuArray i,
+                    int check_err) except -1:
+    cdef int err
+    err = GpuArray_put1(&a.ga, &v.ga, &i.ga, check_err)
+    if err != GA_NO_ERROR:
+        if err == GA_VALUE_ERROR:
+            raise IndexError, GpuArray_error(&a.ga, err)
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
+cdef int array_scatter_add(GpuArray a, GpuArray v, GpuArray i,
+                           bint grouped, int check_err) except -1:
+    cdef int err
+    if grouped:
+        err = GpuArray_scatter_add_sorted(&a.ga, &v.ga, &i.ga, check_err)
+    else:
+        err = GpuArray_scatter_add(&a.ga, &v.ga, &i.ga, check_err)
+    if err != GA_NO_ERROR:
+        if err == GA_VALUE_ERROR:
+            raise IndexError, GpuArray_error(&a.ga, err)
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
 cdef int array_setarray(GpuArray v, GpuArray a) except -1:
     cdef int err
     err = GpuArray_setarray(&v.ga, &a.ga)
@@ -393,12 +421,67 @@ cdef int array_read(void *dst, size_t sz, GpuArray src) except -1:
     if err != GA_NO_ERROR:
         raise get_exc(err), GpuArray_error(&src.ga, err)
 
+cdef int array_write_strided(GpuArray a, np.ndarray src) except -1:
+    cdef void *data = np.PyArray_DATA(src)
+    cdef ssize_t *strides = <ssize_t *>np.PyArray_STRIDES(src)
+    cdef int err
+    with nogil:
+        err = GpuArray_write_strided(&a.ga, data, strides)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
+cdef int array_read_strided(np.ndarray dst, GpuArray src) except -1:
+    cdef void *data = np.PyArray_DATA(dst)
+    cdef ssize_t *strides = <ssize_t *>np.PyArray_STRIDES(dst)
+    cdef int err
+    with nogil:
+        err = GpuArray_read_strided(data, strides, &src.ga)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&src.ga, err)
+
+cdef GpuTransfer array_write_async(GpuArray a, np.ndarray src):
+    cdef GpuTransfer res = GpuTransfer.__new__(GpuTransfer)
+    cdef void *data = np.PyArray_DATA(src)
+    cdef size_t sz = np.PyArray_NBYTES(src)
+    cdef gpuevent *ev
+    cdef int err
+    res.event = GpuEvent(a.context)
+    res.host = src
+    ev = res.event.ev
+    with nogil:
+        err = GpuArray_write_async(&a.ga, data, sz, ev)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+    return res
+
+cdef GpuTransfer array_read_async(np.ndarray dst, GpuArray src):
+    cdef GpuTransfer res = GpuTransfer.__new__(GpuTransfer)
+    cdef void *data = np.PyArray_DATA(dst)
+    cdef size_t sz = np.PyArray_NBYTES(dst)
+    cdef gpuevent *ev
+    cdef int err
+    res.event = GpuEvent(src.context)
+    res.host = dst
+    ev = res.event.ev
+    with nogil:
+        err = GpuArray_read_async(data, sz, &src.ga, ev)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&src.ga, err)
+    res.result = dst
+    return res
+
 cdef int array_memset(GpuArray a, int data) except -1:
     cdef int err
     err = GpuArray_memset(&a.ga, data)
     if err != GA_NO_ERROR:
         raise get_exc(err), GpuArray_error(&a.ga, err)
 
+cdef int array_fill(GpuArray a, const void *value) except -1:
+    cdef int err
+    err = GpuArray_fill(&a.ga, value)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
 cdef int array_copy(GpuArray res, GpuArray a, ga_order order) except -1:
     cdef int err
     err = GpuArray_copy(&res.ga, &a.ga, order)
@@ -419,6 +502,13 @@ cdef int array_split(_GpuArray **res, GpuArray a, size_t n, size_t *p,
     if err != GA_NO_ERROR:
         raise get_exc(err), GpuArray_error(&a.ga, err)
 
+cdef int array_split_copy(_GpuArray **res, GpuArray a, size_t n, size_t *p,
+                          unsigned int axis) except -1:
+    cdef int err
+    err = GpuArray_split_copy(res, &a.ga, n, p, axis)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
 cdef int array_concatenate(GpuArray r, const _GpuArray **a, size_t n,
                            unsigned int axis, int restype) except -1:
     cdef int err
@@ -588,10 +678,12 @@ cdef GpuContext pygpu_init(dev, gpucontext_props *p):
     return res
 
 def init(dev, sched='default', single_stream=False, kernel_cache_path=None,
-         max_cache_size=sys.maxsize, initial_cache_size=0):
+         max_cache_size=sys.maxsize, initial_cache_size=0,
+         transfer_chunk_size=None):
     """
     init(dev, sched='default', single_stream=False, kernel_cache_path=None,
-         max_cache_size=sys.maxsize, initial_cache_size=0)
+         max_cache_size=sys.maxsize, initial_cache_size=0,
+         transfer_chunk_size=None)
 
     Creates a context from a device specifier.
 
@@ -624,6 +716,9 @@ def init(dev, sched='default', single_stream=False, kernel_cache_path=None,
         disable allocation cache (if any)
     single_stream: bool
         enable single stream mode
+    transfer_chunk_size: int
+        chunk size in bytes for transfers to other contexts that go
+        through the host (default: 8M)
 
     """
     cdef gpucontext_props *p = NULL
@@ -652,6 +747,10 @@ def init(dev, sched='default', single_stream=False, kernel_cache_path=None,
             raise get_exc(err), gpucontext_error(NULL, err)
         if single_stream:
             gpucontext_props_set_single_stream(p);
+        if transfer_chunk_size is not None:
+            err = gpucontext_props_transfer_chunk(p, transfer_chunk_size)
+            if err != GA_NO_ERROR:
+                raise get_exc(err), gpucontext_error(NULL, err)
     except:
         gpucontext_props_del(p)
         raise
@@ -683,6 +782,163 @@ def zeros(shape, dtype=GA_DOUBLE, order='C', GpuContext context=None,
     array_memset(res, 0)
     return res
 
+def full(shape, fill_value, dtype=None, order='C', GpuContext context=None,
+         cls=None):
+    """
+    full(shape, fill_value, dtype=None, order='C', context=None, cls=None)
+
+    Returns an array of the requested shape, type and order with all
+    elements set to `fill_value`.
+
+    Parameters
+    ----------
+    shape: iterable of ints
+        number of elements in each dimension
+    fill_value: scalar
+        value of the elements
+    dtype: str, numpy.dtype or int
+        type of the elements (defaults to the type of `fill_value`)
+    order: {'A', 'C', 'F'}
+        layout of the data in memory, one of 'A'ny, 'C' or 'F'ortran
+    context: GpuContext
+        context in which to do the allocation
+    cls: type
+        class of the returned array (must inherit from GpuArray)
+
+    """
+    if dtype is None:
+        dtype = np.asarray(fill_value).dtype
+    res = empty(shape, dtype=dtype, order=order, context=context, cls=cls)
+    res.fill(fill_value)
+    return res
+
+def ones(shape, dtype=GA_DOUBLE, order='C', GpuContext context=None,
+         cls=None):
+    """
+    ones(shape, dtype='float64', order='C', context=None, cls=None)
+
+    Returns an array of ones of the requested shape, type and order.
+
+    Parameters
+    ----------
+    shape: iterable of ints
+        number of elements in each dimension
+    dtype: str, numpy.dtype or int
+        type of the elements
+    order: {'A', 'C', 'F'}
+        layout of the data in memory, one of 'A'ny, 'C' or 'F'ortran
+    context: GpuContext
+        context in which to do the allocation
+    cls: type
+        class of the returned array (must inherit from GpuArray)
+
+    """
+    return full(shape, 1, dtype=dtype, order=order, context=context, cls=cls)
+
+def arange(start, stop=None, step=1, dtype=None, GpuContext context=None,
+           cls=None):
+    """
+    arange(start, stop=None, step=1, dtype=None, context=None, cls=None)
+
+    Returns evenly spaced values in the interval [`start`, `stop`),
+    computed on the device.
+
+    Parameters
+    ----------
+    start: number
+        start of the interval (or its end if `stop` is None)
+    stop: number
+        end of the interval (excluded)
+    step: number
+        spacing between the values
+    dtype: str, numpy.dtype or int
+        type of the elements (defaults to the type numpy would pick)
+    context: GpuContext
+        context in which to do the allocation
+    cls: type
+        class of the returned array (must inherit from GpuArray)
+
+    """
+    cdef GpuArray res
+    cdef np.ndarray s0
+    cdef np.ndarray s1
+    cdef size_t n
+    cdef int typecode
+    cdef int err
+
+    if stop is None:
+        start, stop = 0, start
+    if step == 0:
+        raise ValueError, "step can't be 0"
+    if dtype is None:
+        dtype = np.result_type(start, stop, step)
+    typecode = dtype_to_typecode(dtype)
+    context = ensure_context(context)
+
+    if all(isinstance(v, (int, np.integer)) for v in (start, stop, step)):
+        n = max(0, -((start - stop) // step))
+    else:
+        n = max(0, int(np.ceil((stop - start) / step)))
+
+    # Half values are computed from floats on the device
+    if typecode == GA_HALF:
+        s0 = np.asarray(start, dtype='float32')
+        s1 = np.asarray(step, dtype='float32')
+    else:
+        s0 = np.asarray(start, dtype=typecode_to_dtype(typecode))
+        s1 = np.asarray(step, dtype=typecode_to_dtype(typecode))
+
+    res = new_GpuArray(cls, context, None)
+    err = GpuArray_arange(&res.ga, context.ctx, typecode, np.PyArray_DATA(s0),
+                          np.PyArray_DATA(s1), n)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), gpucontext_error(context.ctx, err)
+    return res
+
+def linspace(start, stop, num=50, endpoint=True, dtype=None,
+             GpuContext context=None, cls=None):
+    """
+    linspace(start, stop, num=50, endpoint=True, dtype=None, context=None, cls=None)
+
+    Returns `num` evenly spaced values over the interval [`start`,
+    `stop`], computed on the device.
+
+    Parameters
+    ----------
+    start: number
+        first value
+    stop: number
+        last value (unless `endpoint` is False)
+    num: int
+        number of values
+    endpoint: bool
+        include `stop` in the values
+    dtype: str, numpy.dtype or int
+        type of the elements (defaults to float64)
+    context: GpuContext
+        context in which to do the allocation
+    cls: type
+        class of the returned array (must inherit from GpuArray)
+
+    """
+    cdef GpuArray res
+    cdef int typecode
+    cdef int err
+
+    if num < 0:
+        raise ValueError, "num must be non-negative"
+    if dtype is None:
+        dtype = GA_DOUBLE
+    typecode = dtype_to_typecode(dtype)
+    context = ensure_context(context)
+
+    res = new_GpuArray(cls, context, None)
+    err = GpuArray_linspace(&res.ga, context.ctx, typecode, start, stop, num,
+                            endpoint)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), gpucontext_error(context.ctx, err)
+    return res
+
 cdef GpuArray pygpu_zeros(unsigned int nd, const size_t *dims, int typecode,
                           ga_order order, GpuContext context, object cls):
     cdef GpuArray res
@@ -765,6 +1021,80 @@ def empty(shape, dtype=GA_DOUBLE, order='C', GpuContext context=None,
     finally:
         free(cdims)
 
+cdef class PinnedBuffer:
+    """
+    Page-locked host memory allocated in a context.
+
+    This exposes the buffer interface and is used as the base of the
+    arrays returned by :func:`pinned_empty`.
+    """
+    cdef gpudata *data
+    cdef void *ptr
+    cdef size_t size
+    cdef readonly GpuContext context
+
+    def __dealloc__(self):
+        if self.data != NULL:
+            gpudata_release(self.data)
+
+    def __cinit__(self, GpuContext context, size_t size):
+        cdef int err = GA_NO_ERROR
+        self.context = context
+        self.size = size
+        self.data = gpudata_alloc(context.ctx, size, NULL, GA_BUFFER_HOST,
+                                  &err)
+        if self.data == NULL:
+            raise get_exc(err), gpucontext_error(context.ctx, err)
+        err = gpudata_property(self.data, GA_BUFFER_PROP_HOSTPOINTER,
+                               &self.ptr)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), gpucontext_error(context.ctx, err)
+
+    def __reduce__(self):
+        raise RuntimeError, "Cannot pickle PinnedBuffer object"
+
+    def __getbuffer__(self, Py_buffer *buf, int flags):
+        PyBuffer_FillInfo(buf, self, self.ptr, self.size, 0, flags)
+
+    def __releasebuffer__(self, Py_buffer *buf):
+        pass
+
+def pinned_empty(shape, dtype=GA_DOUBLE, order='C', GpuContext context=None):
+    """
+    pinned_empty(shape, dtype='float64', order='C', context=None)
+
+    Returns an empty (uninitialized) numpy array in page-locked host
+    memory.
+
+    Transfers between these arrays and GpuArrays of the same context
+    (see :meth:`GpuArray.read_async` and :meth:`GpuArray.write_async`)
+    don't block the host.  The memory comes from a pool of the context
+    so allocating them repeatedly is cheap.  Only supported on CUDA.
+
+    Parameters
+    ----------
+    shape: iterable of ints
+        number of elements in each dimension
+    dtype: str, numpy.dtype or int
+        type of the elements
+    order: {'C', 'F'}
+        layout of the data in memory
+    context: GpuContext
+        context in which to do the allocation
+
+    """
+    cdef np.dtype t = typecode_to_dtype(dtype_to_typecode(dtype))
+    cdef size_t size = t.itemsize
+
+    try:
+        shape = tuple(shape)
+    except TypeError:
+        shape = (shape,)
+    for d in shape:
+        size *= <size_t>d
+    buf = PinnedBuffer(ensure_context(context), size)
+    return np.ndarray(shape, dtype=t, buffer=buf, order=order)
+
 def asarray(a, dtype=None, order='A', GpuContext context=None):
     """
     asarray(a, dtype=None, order='A', context=None)
@@ -1018,6 +1348,19 @@ cdef carray(proto, dtype, copy, order, unsigned int ndmin,
     if order != 'C' and order != 'F':
         order = 'C'
 
+    # Sliced arrays are copied in one pass, without a host temporary
+    if isinstance(proto, np.ndarray):
+        a = proto
+    if (a is not None and not np.PyArray_ISONESEGMENT(a) and
+            (dtype is None or dtype_to_npdtype(dtype) == a.dtype)):
+        if np.PyArray_NDIM(a) < ndmin:
+            a = a.reshape((1,) * (ndmin - np.PyArray_NDIM(a)) + a.shape)
+        res = pygpu_empty(np.PyArray_NDIM(a), <size_t *>np.PyArray_DIMS(a),
+                          dtype_to_typecode(a.dtype), to_ga_order(order),
+                          context, cls)
+        array_write_strided(res, a)
+        return res
+
     a = numpy.array(proto, dtype=dtype_to_npdtype(dtype), order=order,
                     ndmin=ndmin, copy=False)
 
@@ -1187,6 +1530,187 @@ cdef class GpuContext:
             return res
 
 
+cdef class GpuEvent:
+    """
+    GpuEvent(context=None)
+
+    Marker in the work queued on a context.
+
+    Events can be used to wait for part of the work without
+    synchronizing the whole device and to time the work between two
+    of them.
+
+    Parameters
+    ----------
+    context: GpuContext
+        context of the event (default: the default context)
+
+    """
+    def __dealloc__(self):
+        gpuevent_free(self.ev)
+
+    def __reduce__(self):
+        raise RuntimeError, "Cannot pickle GpuEvent object"
+
+    def __cinit__(self, GpuContext context=None):
+        cdef int err = GA_NO_ERROR
+        self.context = ensure_context(context)
+        self.ev = gpuevent_alloc(self.context.ctx, &err)
+        if self.ev == NULL:
+            raise get_exc(err), gpucontext_error(self.context.ctx, err)
+
+    def record(self):
+        """
+        record()
+
+        Place the event after the work currently queued.
+        """
+        cdef int err
+        err = gpuevent_record(self.ev, NULL)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), gpucontext_error(self.context.ctx, err)
+
+    def synchronize(self):
+        """
+        synchronize()
+
+        Wait for the work preceding the event to complete.
+        """
+        cdef int err
+        err = gpuevent_sync(self.ev)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), gpucontext_error(self.context.ctx, err)
+
+    def query(self):
+        """
+        query()
+
+        Return True if the work preceding the event is done.
+        """
+        cdef int err
+        cdef int done
+        err = gpuevent_query(self.ev, &done)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), gpucontext_error(self.context.ctx, err)
+        return bool(done)
+
+    def elapsed(self, GpuEvent end not None):
+        """
+        elapsed(end)
+
+        Time in milliseconds between this event and `end`.
+
+        Both events must be done.
+        """
+        cdef int err
+        cdef double ms
+        err = gpuevent_elapsed(self.ev, end.ev, &ms)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), gpucontext_error(self.context.ctx, err)
+        return ms
+
+
+cdef class GpuTimer:
+    """
+    GpuTimer(context=None)
+
+    Context manager that times the device work queued inside it.
+
+    Only the device time is measured and the host is not blocked
+    until :attr:`elapsed` is read::
+
+        with GpuTimer() as t:
+            k(a, b, n=n)
+        print(t.elapsed)
+
+    Parameters
+    ----------
+    context: GpuContext
+        context to time (default: the default context)
+
+    """
+    def __cinit__(self, GpuContext context=None):
+        self.start = GpuEvent(context)
+        self.end = GpuEvent(self.start.context)
+
+    def __enter__(self):
+        self.start.record()
+        return self
+
+    def __exit__(self, t, v, tb):
+        self.end.record()
+
+    property elapsed:
+        "Time in milliseconds taken by the timed work"
+        def __get__(self):
+            self.end.synchronize()
+            return self.start.elapsed(self.end)
+
+
+cdef class GpuTransfer:
+    """
+    Handle on a transfer started by :meth:`GpuArray.read_async` or
+    :meth:`GpuArray.write_async`.
+
+    The host array of the transfer is kept alive by the handle but
+    must not be used until the transfer is done.  The handle can be
+    waited on or awaited from a coroutine::
+
+        dst = await a.read_async()
+
+    Dropping the handle of an unfinished transfer waits for it.
+
+    """
+    def __dealloc__(self):
+        if self.event is not None:
+            gpuevent_sync(self.event.ev)
+
+    def __reduce__(self):
+        raise RuntimeError, "Cannot pickle GpuTransfer object"
+
+    def done(self):
+        """
+        done()
+
+        Return True if the transfer is over.
+        """
+        return self.event.query()
+
+    def wait(self):
+        """
+        wait()
+
+        Wait for the transfer and return its result (the destination
+        array for reads and None for writes).
+        """
+        self.event.synchronize()
+        return self.result
+
+    def __await__(self):
+        # Poll with a growing delay so a long transfer doesn't spin the
+        # event loop.  asyncio loops sleep between the polls, other
+        # drivers get a bare yield after the host thread slept.
+        delay = 0.00005
+        sleep = _loop_sleep()
+        while not self.event.query():
+            if sleep is not None:
+                yield from sleep(delay).__await__()
+            else:
+                time.sleep(delay)
+                yield
+            delay = min(delay * 2, 0.002)
+        return self.result
+
+
+cdef object _loop_sleep():
+    try:
+        import asyncio
+        asyncio.get_running_loop()
+    except (ImportError, AttributeError, RuntimeError):
+        return None
+    return asyncio.sleep
+
+
 cdef class flags(object):
     cdef int fl
 
@@ -1392,9 +1916,6 @@ cdef np.ndarray pygpu_as_ndarray(GpuArray a):
 cdef np.ndarray _pygpu_as_ndarray(GpuArray a, np.dtype ldtype):
     cdef np.ndarray res
 
-    if not py_ISONESEGMENT(a):
-        a = pygpu_copy(a, GA_ANY_ORDER)
-
     if ldtype is None:
         ldtype = a.dtype
 
@@ -1464,9 +1985,11 @@ cdef int pygpu_transfer(GpuArray res, GpuArray a) except -1:
     array_transfer(res, a)
     return 0
 
-def _split(GpuArray a, ind, unsigned int axis):
+def _split(GpuArray a, ind, unsigned int axis, bint copy=False):
     """
-    _split(a, ind, axis)
+    _split(a, ind, axis, copy=False)
+
+    With `copy`, the pieces are new contiguous arrays instead of views.
     """
     cdef list r = [None] * (len(ind) + 1)
     cdef Py_ssize_t i
@@ -1483,13 +2006,16 @@ def _split(GpuArray a, ind, unsigned int axis):
         raise MemoryError()
     try:
         for i in range(len(r)):
-            r[i] = new_GpuArray(type(a), a.context, a.base)
+            r[i] = new_GpuArray(type(a), a.context, None if copy else a.base)
             rs[i] = &(<GpuArray>r[i]).ga
         for i in range(len(ind)):
             v = ind[i]
             # cap the values to the end of the array
             p[i] = v if v < m else m
-        array_split(rs, a, len(ind), p, axis)
+        if copy:
+            array_split_copy(rs, a, len(ind), p, axis)
+        else:
+            array_split(rs, a, len(ind), p, axis)
         return r
     finally:
         PyMem_Free(p)
@@ -1555,6 +2081,294 @@ def open_ipc_handle(GpuContext c, bytes hpy, size_t l):
         raise GpuArrayException, gpucontext_error(c.ctx, 0)
     return <size_t>d
 
+cdef extern from "dlpack.h":
+    ctypedef struct DLDevice:
+        int32_t device_type
+        int32_t device_id
+    ctypedef struct DLDataType:
+        uint8_t code
+        uint8_t bits
+        uint16_t lanes
+    ctypedef struct DLTensor:
+        void *data
+        DLDevice device
+        int32_t ndim
+        DLDataType dtype
+        int64_t *shape
+        int64_t *strides
+        uint64_t byte_offset
+    ctypedef struct DLManagedTensor:
+        DLTensor dl_tensor
+        void *manager_ctx
+        void (*deleter)(DLManagedTensor *)
+    int kDLCUDA
+    int kDLInt, kDLUInt, kDLFloat, kDLComplex, kDLBool
+    void pygpu_dlpack_deleter(DLManagedTensor *)
+    void pygpu_dlpack_capsule_free(object)
+
+cdef void *(*cuda_get_stream)(gpucontext *)
+cdef int (*cuda_get_device)(gpucontext *)
+cdef gpudata *(*cuda_make_buf)(gpucontext *, size_t, size_t)
+cdef int (*cuda_handoff)(gpudata *, void *)
+cdef int (*cuda_takeover)(gpudata *, void *)
+
+cuda_get_stream = <void *(*)(gpucontext *)>gpuarray_get_extension("cuda_get_stream")
+cuda_get_device = <int (*)(gpucontext *)>gpuarray_get_extension("cuda_get_device")
+cuda_make_buf = <gpudata *(*)(gpucontext *, size_t, size_t)>gpuarray_get_extension("cuda_make_buf")
+cuda_handoff = <int (*)(gpudata *, void *)>gpuarray_get_extension("cuda_handoff")
+cuda_takeover = <int (*)(gpudata *, void *)>gpuarray_get_extension("cuda_takeover")
+
+cdef dict DL_CODES = {'b': kDLBool, 'i': kDLInt, 'u': kDLUInt,
+                      'f': kDLFloat, 'c': kDLComplex}
+
+cdef size_t cuda_stream_handle(GpuContext c):
+    # The interfaces use 1 for the legacy default stream since 0 is
+    # ambiguous.
+    cdef size_t s = <size_t>cuda_get_stream(c.ctx)
+    return s if s != 0 else 1
+
+cdef class _DLPackOwner:
+    """
+    Keeps an imported DLPack tensor alive for the arrays that use it.
+    """
+    cdef DLManagedTensor *tensor
+
+    def __dealloc__(self):
+        if self.tensor != NULL and self.tensor.deleter != NULL:
+            self.tensor.deleter(self.tensor)
+
+cdef GpuArray wrap_cuda_ptr(GpuContext c, size_t ptr, shape, dtype,
+                            strides, object base, bint writable,
+                            size_t stream):
+    cdef gpudata *d
+    cdef GpuArray res
+    cdef ssize_t lo = 0, hi = 0
+    cdef size_t itemsize = dtype.itemsize
+    cdef size_t sz = itemsize
+    cdef int i
+    if c.kind != b"cuda":
+        raise TypeError("This is for CUDA contexts.")
+    if strides is None:
+        strides = [0] * len(shape)
+        for i in range(len(shape) - 1, -1, -1):
+            strides[i] = sz
+            sz *= shape[i]
+    # Extent of the memory covered by the array, relative to ptr
+    if all(n != 0 for n in shape):
+        for i in range(len(shape)):
+            if strides[i] < 0:
+                lo += strides[i] * (shape[i] - 1)
+            else:
+                hi += strides[i] * (shape[i] - 1)
+        hi += itemsize
+    d = cuda_make_buf(c.ctx, ptr + lo, hi - lo)
+    if d == NULL:
+        raise GpuArrayException, gpucontext_error(c.ctx, 0)
+    try:
+        # Work queued on the buffer from now on waits for the producer
+        if cuda_takeover(d, <void *>stream) != GA_NO_ERROR:
+            raise GpuArrayException, gpucontext_error(c.ctx, 0)
+        res = from_gpudata(<size_t>d, -lo, dtype, shape, c, strides=strides,
+                           writable=writable, base=base)
+    finally:
+        gpudata_release(d)
+    return res
+
+def from_dlpack(obj, GpuContext context=None):
+    """
+    from_dlpack(obj, context=None)
+
+    Wrap the CUDA memory of a DLPack tensor into a GpuArray without a
+    copy.
+
+    `obj` is either an object with a `__dlpack__` method or a DLPack
+    capsule that was never consumed.  The producer is asked to order
+    its pending work before the stream of `context`, which must be a
+    CUDA context on the same device.  The producer's memory is kept
+    alive as long as the result (or a view of it) is.
+
+    Parameters
+    ----------
+    obj: object
+        DLPack producer or capsule
+    context: GpuContext
+        context of the memory
+    """
+    cdef DLManagedTensor *t
+    cdef DLTensor *dl
+    cdef _DLPackOwner owner
+    cdef size_t stream
+    cdef int i
+
+    context = ensure_context(context)
+    if context.kind != b"cuda":
+        raise TypeError("This is for CUDA contexts.")
+    stream = cuda_stream_handle(context)
+    if hasattr(obj, '__dlpack__'):
+        obj = obj.__dlpack__(stream=stream)
+    if not PyCapsule_IsValid(obj, "dltensor"):
+        raise ValueError("expected an unused DLPack capsule")
+    t = <DLManagedTensor *>PyCapsule_GetPointer(obj, "dltensor")
+    owner = _DLPackOwner.__new__(_DLPackOwner)
+    owner.tensor = t
+    PyCapsule_SetName(obj, "used_dltensor")
+
+    dl = &t.dl_tensor
+    if dl.device.device_type != kDLCUDA:
+        raise BufferError("DLPack tensor is not in CUDA memory")
+    if dl.device.device_id != cuda_get_device(context.ctx):
+        raise ValueError("DLPack tensor is on another device than the context")
+    if dl.dtype.lanes != 1:
+        raise TypeError("vector DLPack types are not supported")
+    for k, code in DL_CODES.items():
+        if code == dl.dtype.code:
+            dtype = np.dtype('%s%d' % (k, dl.dtype.bits // 8))
+            break
+    else:
+        raise TypeError("unsupported DLPack type code: %d" % dl.dtype.code)
+
+    shape = tuple(dl.shape[i] for i in range(dl.ndim))
+    if dl.strides == NULL:
+        strides = None
+    else:
+        strides = tuple(dl.strides[i] * dtype.itemsize
+                        for i in range(dl.ndim))
+    return wrap_cuda_ptr(context, <size_t>dl.data + dl.byte_offset, shape,
+                         dtype, strides, owner, True, stream)
+
+def from_cuda_array_interface(obj, GpuContext context=None):
+    """
+    from_cuda_array_interface(obj, context=None)
+
+    Wrap the memory of an object exposing `__cuda_array_interface__`
+    into a GpuArray without a copy.
+
+    Work queued on the result waits for the stream given by the
+    producer, if any.  The memory must be on the device of `context`
+    and `obj` is kept alive as long as the result is.
+
+    Parameters
+    ----------
+    obj: object
+        object with a `__cuda_array_interface__` attribute
+    context: GpuContext
+        context of the memory
+    """
+    context = ensure_context(context)
+    cai = obj.__cuda_array_interface__
+    if cai.get('mask') is not None:
+        raise TypeError("masked arrays are not supported")
+    ptr, readonly = cai['data']
+    stream = cai.get('stream')
+    if stream == 0:
+        raise ValueError("invalid stream 0 in __cuda_array_interface__")
+    return wrap_cuda_ptr(context, ptr, tuple(cai['shape']),
+                         np.dtype(cai['typestr']), cai.get('strides'), obj,
+                         not readonly,
+                         cuda_stream_handle(context) if stream is None
+                         else stream)
+
+cdef libc.stdio.FILE *npy_fopen(f, const char *mode) except NULL:
+    cdef libc.stdio.FILE *res
+    cdef bytes path
+    cdef int fd
+    if hasattr(f, 'fileno'):
+        # Work on a duplicate of the descriptor, at the current position
+        f.flush()
+        fd = os.dup(f.fileno())
+        res = libc.stdio.fdopen(fd, mode)
+        if res == NULL:
+            os.close(fd)
+        elif libc.stdio.fseek(res, f.tell(), libc.stdio.SEEK_SET) != 0:
+            libc.stdio.fclose(res)
+            res = NULL
+    else:
+        if isinstance(f, unicode):
+            f = (<unicode>f).encode(sys.getfilesystemencoding())
+        path = f
+        res = libc.stdio.fopen(path, mode)
+    if res == NULL:
+        raise OSError(errno, os.strerror(errno))
+    return res
+
+cdef int npy_fclose(libc.stdio.FILE *fp, f) except -1:
+    cdef long pos = libc.stdio.ftell(fp)
+    if libc.stdio.fclose(fp) != 0:
+        raise OSError(errno, os.strerror(errno))
+    if hasattr(f, 'fileno'):
+        f.seek(pos)
+    return 0
+
+def load_npy(f, GpuArray out=None, GpuContext context=None, cls=None):
+    """
+    load_npy(f, out=None, context=None, cls=None)
+
+    Read an array saved in the numpy .npy format.
+
+    The file is read in chunks that are uploaded while the next one is
+    read, so loading doesn't need a host copy of the whole array.
+
+    Parameters
+    ----------
+    f: str or file
+        path or file object open in binary mode at the start of the
+        array data
+    out: GpuArray
+        read into this array, the file must have the same shape and dtype
+    context: GpuContext
+        context for the new array (ignored if `out` is given)
+    cls: type
+        class of the new array (ignored if `out` is given)
+    """
+    cdef libc.stdio.FILE *fp
+    cdef GpuArray res
+    cdef gpucontext *ctx = NULL
+    cdef int err
+    if out is None:
+        context = ensure_context(context)
+        ctx = context.ctx
+        res = new_GpuArray(cls, context, None)
+    else:
+        res = out
+    fp = npy_fopen(f, b"rb")
+    with nogil:
+        if ctx != NULL:
+            err = GpuArray_load_npy(&res.ga, ctx, fp)
+        else:
+            err = GpuArray_load_npy_into(&res.ga, fp)
+    npy_fclose(fp, f)
+    if err != GA_NO_ERROR:
+        if ctx != NULL:
+            raise get_exc(err), gpucontext_error(ctx, err)
+        raise get_exc(err), GpuArray_error(&res.ga, err)
+    return res
+
+def save_npy(f, GpuArray a not None):
+    """
+    save_npy(f, a)
+
+    Write `a` in the numpy .npy format.
+
+    The data goes through the host in chunks, so saving doesn't need a
+    host copy of the whole array.  The result can be read with
+    :func:`numpy.load`.
+
+    Parameters
+    ----------
+    f: str or file
+        path or file object open in binary mode
+    a: GpuArray
+        array to save
+    """
+    cdef libc.stdio.FILE *fp
+    cdef int err
+    fp = npy_fopen(f, b"wb")
+    with nogil:
+        err = GpuArray_save_npy(fp, &a.ga)
+    npy_fclose(fp, f)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
 cdef class GpuArray:
     """
     Device array
@@ -1626,10 +2440,10 @@ cdef class GpuArray:
         already allocated GpuArray buffer to contain `src` array from host's
         memory. It is required though that the GpuArray and the Numpy array are
         compatible in byte size and data type. It is also needed for the
-        GpuArray to be well behaved and contiguous. If `src` is not aligned or
-        compatible in contiguity it will be copied to a new Numpy array in order
-        to be. It is allowed for this GpuArray and `src` to have different
-        shapes.
+        GpuArray to be well behaved. If `src` has the same shape, it is
+        copied in one pass whatever the strides of either array. Otherwise
+        this GpuArray must be contiguous and `src` is copied to a new Numpy
+        array if it is not aligned or compatible in contiguity.
 
         Parameters
         ----------
@@ -1643,6 +2457,34 @@ cdef class GpuArray:
             not well behaved or contiguous.
 
         """
+        if (self.flags.behaved and self.dtype == src.dtype and
+                self.shape == src.shape):
+            array_write_strided(self, src)
+            return
+        src = self.__write_source(src)
+        array_write(self, np.PyArray_DATA(src), np.PyArray_NBYTES(src))
+
+    def write_async(self, np.ndarray src not None):
+        """
+        write_async(src)
+
+        Start writing a host Numpy array to this GpuArray and return
+        a :class:`GpuTransfer` without waiting.
+
+        The requirements are the same as for :meth:`write`.  `src`
+        must not be modified until the transfer is done and the
+        transfer only overlaps with host work if `src` is in
+        page-locked memory.
+
+        Parameters
+        ----------
+        src: numpy.ndarray
+            source array in host
+
+        """
+        return array_write_async(self, self.__write_source(src))
+
+    def __write_source(self, np.ndarray src):
         if not self.flags.behaved:
             raise ValueError, "Destination GpuArray is not well behaved: aligned and writeable"
         if self.flags.c_contiguous:
@@ -1660,7 +2502,7 @@ cdef class GpuArray:
             sz *= self.ga.dimensions[i]
         if sz != npsz:
             raise ValueError, "GpuArray and Numpy array do not have the same size in bytes"
-        array_write(self, np.PyArray_DATA(src), sz)
+        return src
 
     def read(self, np.ndarray dst not None):
         """
@@ -1673,10 +2515,11 @@ cdef class GpuArray:
         buffer in host's memory to contain device's GpuArray. It uses an
         existing Numpy ndarray as a buffer to get the GpuArray. It is required
         though that the GpuArray and the Numpy array to be compatible in byte
-        size, contiguity and data type. It is also needed for `dst` to be
-        writeable and properly aligned in host's memory and for `self` to be
-        contiguous. It is allowed for this GpuArray and `dst` to have different
-        shapes.
+        size and data type. It is also needed for `dst` to be writeable and
+        properly aligned in host's memory. If `dst` has the same shape, it
+        is filled in one pass whatever the strides of either array.
+        Otherwise they must match in contiguity and `self` must be
+        contiguous.
 
         Parameters
         ----------
@@ -1690,6 +2533,40 @@ cdef class GpuArray:
             is not well behaved.
 
         """
+        if (np.PyArray_ISBEHAVED(dst) and self.dtype == dst.dtype and
+                self.shape == dst.shape):
+            array_read_strided(dst, self)
+            return
+        self.__check_read(dst)
+        array_read(np.PyArray_DATA(dst), np.PyArray_NBYTES(dst), self)
+
+    def read_async(self, np.ndarray dst=None):
+        """
+        read_async(dst=None)
+
+        Start reading this GpuArray into a host Numpy array and return
+        a :class:`GpuTransfer` without waiting.
+
+        The requirements on `dst` are the same as for :meth:`read`.
+        If `dst` is None, a new array of the same shape is used.  The
+        result of the transfer is `dst`, which must not be used until
+        the transfer is done.  The transfer only overlaps with host
+        work if `dst` is in page-locked memory.
+
+        Parameters
+        ----------
+        dst: numpy.ndarray
+            destination array in host
+
+        """
+        if dst is None:
+            dst = np.empty(self.shape, dtype=self.dtype,
+                           order='F' if (self.flags.f_contiguous and
+                                         not self.flags.c_contiguous) else 'C')
+        self.__check_read(dst)
+        return array_read_async(dst, self)
+
+    def __check_read(self, np.ndarray dst):
         if not np.PyArray_ISBEHAVED(dst):
             raise ValueError, "Destination Numpy array is not well behaved: aligned and writeable"
         if (not ((self.flags.c_contiguous and self.flags.aligned and
@@ -1706,7 +2583,6 @@ cdef class GpuArray:
             sz *= self.ga.dimensions[i]
         if sz != npsz:
             raise ValueError, "GpuArray and Numpy array do not have the same size in bytes"
-        array_read(np.PyArray_DATA(dst), sz, self)
 
     def get_ipc_handle(self):
         """
@@ -1776,6 +2652,21 @@ cdef class GpuArray:
         """
         return pygpu_copy(self, to_ga_order(order))
 
+    def fill(self, value):
+        """
+        fill(value)
+
+        Set all the elements of this array to `value`.
+
+        Parameters
+        ----------
+        value: scalar
+            value to store, converted to the type of the array
+
+        """
+        cdef np.ndarray v = np.asarray(value, dtype=self.dtype)
+        array_fill(self, np.PyArray_DATA(v))
+
     def transfer(self, GpuContext new_ctx):
         """
         transfer(new_ctx)
@@ -2112,6 +3003,47 @@ cdef class GpuArray:
         array_take1(res, self, idx, 1)
         return res
 
+    def put1(self, GpuArray idx, GpuArray v):
+        """
+        put1(idx, v)
+
+        Store the rows of `v` at the positions `idx` along the first
+        axis (self[idx] = v).
+
+        """
+        if not v.flags.c_contiguous:
+            v = pygpu_copy(v, GA_C_ORDER)
+        if not idx.flags.c_contiguous:
+            idx = pygpu_copy(idx, GA_C_ORDER)
+        array_put1(self, v, idx, 1)
+
+    def scatter_add(self, GpuArray idx, GpuArray v, grouped=False):
+        """
+        scatter_add(idx, v, grouped=False)
+
+        Add the rows of `v` at the positions `idx` along the first
+        axis.  Repeated indices accumulate all their values, like
+        numpy.add.at(self, idx, v).
+
+        Parameters
+        ----------
+        idx: GpuArray
+            indices (1d)
+        v: GpuArray
+            values, of the same type as this array
+        grouped: bool
+            equal indices are next to each other in `idx` (for example
+            if it is sorted).  Each run is summed by one thread, in
+            pieces of up to 32, which is faster when a few indices
+            repeat a lot.
+
+        """
+        if not v.flags.c_contiguous:
+            v = pygpu_copy(v, GA_C_ORDER)
+        if not idx.flags.c_contiguous:
+            idx = pygpu_copy(idx, GA_C_ORDER)
+        array_scatter_add(self, v, idx, grouped, 1)
+
     def __hash__(self):
         raise TypeError, "unhashable type '%s'" % (self.__class__,)
 
@@ -2255,6 +3187,97 @@ cdef class GpuArray:
             # structure.
             return <size_t>((<void **>self.ga.data)[0]) + self.offset
 
+    property __cuda_array_interface__:
+        """
+        Description of this array for other CUDA libraries (version 3).
+
+        The consumer must order its work after the returned stream,
+        which has all the work queued on this array so far.
+        """
+        def __get__(self):
+            cdef size_t s
+            if self.context.kind != b"cuda":
+                raise AttributeError("This is for CUDA arrays.")
+            s = cuda_stream_handle(self.context)
+            if cuda_handoff(self.ga.data, <void *>s) != GA_NO_ERROR:
+                raise GpuArrayException, gpucontext_error(self.context.ctx, 0)
+            return {'shape': self.shape,
+                    'typestr': self.dtype.str,
+                    'data': (self.gpudata, not self.flags.writeable),
+                    'strides': (None if self.flags.c_contiguous
+                                else self.strides),
+                    'version': 3,
+                    'stream': s}
+
+    def __dlpack_device__(self):
+        """
+        __dlpack_device__()
+
+        Return the DLPack device type and id of this array.
+        """
+        if self.context.kind != b"cuda":
+            raise BufferError("DLPack export is only for CUDA arrays")
+        return (kDLCUDA, cuda_get_device(self.context.ctx))
+
+    def __dlpack__(self, stream=None):
+        """
+        __dlpack__(stream=None)
+
+        Export this array as a DLPack capsule without a copy.
+
+        The capsule keeps this array (and so its memory) alive until
+        the consumer is done with it.  `stream` (the CUDA stream of the
+        consumer, None for the legacy default stream or -1 for no
+        ordering) is made to wait for the work queued on this array.
+        """
+        cdef DLManagedTensor *t
+        cdef int64_t *dims
+        cdef size_t itemsize = gpuarray_get_elsize(self.ga.typecode)
+        cdef unsigned int i
+        if self.context.kind != b"cuda":
+            raise BufferError("DLPack export is only for CUDA arrays")
+        dtype = self.dtype
+        if dtype.kind not in DL_CODES:
+            raise BufferError("%s can't be exported with DLPack" % (dtype,))
+        for i in range(self.ga.nd):
+            if self.ga.strides[i] % <ssize_t>itemsize != 0:
+                raise BufferError("strides are not a multiple of the element size")
+        if stream is None:
+            stream = 1
+        if stream == 0:
+            raise ValueError("stream 0 is ambiguous, use 1 or 2")
+        if stream != -1:
+            if cuda_handoff(self.ga.data, <void *><size_t>stream) != GA_NO_ERROR:
+                raise GpuArrayException, gpucontext_error(self.context.ctx, 0)
+
+        # The shape and strides go after the tensor in the same block
+        t = <DLManagedTensor *>malloc(sizeof(DLManagedTensor) +
+                                      2 * self.ga.nd * sizeof(int64_t))
+        if t == NULL:
+            raise MemoryError
+        dims = <int64_t *>(t + 1)
+        t.dl_tensor.data = (<void **>self.ga.data)[0]
+        t.dl_tensor.byte_offset = self.ga.offset
+        t.dl_tensor.device.device_type = kDLCUDA
+        t.dl_tensor.device.device_id = cuda_get_device(self.context.ctx)
+        t.dl_tensor.ndim = self.ga.nd
+        t.dl_tensor.dtype.code = DL_CODES[dtype.kind]
+        t.dl_tensor.dtype.bits = itemsize * 8
+        t.dl_tensor.dtype.lanes = 1
+        t.dl_tensor.shape = dims
+        t.dl_tensor.strides = dims + self.ga.nd
+        for i in range(self.ga.nd):
+            dims[i] = self.ga.dimensions[i]
+            dims[self.ga.nd + i] = self.ga.strides[i] // <ssize_t>itemsize
+        Py_INCREF(self)
+        t.manager_ctx = <void *>self
+        t.deleter = pygpu_dlpack_deleter
+        try:
+            return PyCapsule_New(t, "dltensor", pygpu_dlpack_capsule_free)
+        except:
+            t.deleter(t)
+            raise
+
     def __str__(self):
         return str(numpy.asarray(self))
 
@@ -2545,3 +3568,17 @@ cdef class GpuKernel:
             kernel_property(self, GA_KERNEL_PROP_NUMARGS, &res)
             return res
 
+
+    property numregs:
+        "Number of registers used by each thread of the kernel"
+        def __get__(self):
+            cdef unsigned int res
+            kernel_property(self, GA_KERNEL_PROP_NUMREGS, &res)
+            return res
+
+    property sharedsize:
+        "Static shared memory used by the kernel"
+        def __get__(self):
+            cdef size_t res
+            kernel_property(self, GA_KERNEL_PROP_SHAREDSIZE, &res)
+            return res
@@ -56,20 +56,20 @@ def atleast_3d(*arys):
         return res
 
 
-def split(ary, indices_or_sections, axis=0):
+def split(ary, indices_or_sections, axis=0, copy=False):
     try:
         len(indices_or_sections)
     except TypeError:
         if ary.shape[axis] % indices_or_sections != 0:
             raise ValueError("array split does not result in an "
                              "equal division")
-    return array_split(ary, indices_or_sections, axis)
+    return array_split(ary, indices_or_sections, axis, copy)
 
 
-def array_split(ary, indices_or_sections, axis=0):
+def array_split(ary, indices_or_sections, axis=0, copy=False):
     try:
         indices = list(indices_or_sections)
-        res = _split(ary, indices, axis)
+        res = _split(ary, indices, axis, copy)
     except TypeError:
         if axis < 0:
             axis += ary.ndim
@@ -84,7 +84,7 @@ def array_split(ary, indices_or_sections, axis=0):
         divs = (list(range(neach + 1, (neach + 1) * extra + 1, neach + 1)) +
                 list(range((neach + 1) * extra + neach,
                            ary.shape[axis], neach)))
-        res = _split(ary, divs, axis)
+        res = _split(ary, divs, axis, copy)
     return res
 
 
@@ -10,7 +10,7 @@ import numpy
 
 from nose.tools import assert_raises
 import pygpu
-from pygpu.gpuarray import GpuArray, GpuKernel
+from pygpu.gpuarray import GpuArray, GpuKernel, GpuEvent, GpuTimer
 
 from .support import (guard_devsup, check_meta, check_flags, check_all,
                       check_content, gen_gpuarray, context as ctx, dtypes_all,
@@ -246,6 +246,65 @@ def test_zero_noparam():
         pass
 
 
+def test_full():
+    for shp in [(), (0,), (5,), (6, 7), (4, 8, 9)]:
+        for order in ["C", "F"]:
+            for dtype in dtypes_all:
+                yield full, shp, order, dtype
+
+
+@guard_devsup
+def full(shp, order, dtype):
+    x = pygpu.full(shp, 3, dtype, order, context=ctx)
+    y = numpy.full(shp, 3, dtype, order)
+    check_all(x, y)
+    x = pygpu.ones(shp, dtype, order, context=ctx)
+    y = numpy.ones(shp, dtype, order)
+    check_all(x, y)
+
+
+def test_fill_strided():
+    for dtype in dtypes_all:
+        yield fill_strided, dtype
+
+
+@guard_devsup
+def fill_strided(dtype):
+    y, x = gen_gpuarray((6, 7), dtype, ctx=ctx)
+    y[::2, 1::3] = 5
+    x[::2, 1::3].fill(5)
+    check_all(x, y)
+
+
+def test_arange():
+    for args in [(10,), (2, 11, 3), (5, -4, -2), (0.5, 3.0, 0.25), (3, 3)]:
+        for dtype in [None, 'float32', 'int32', 'int64']:
+            yield arange, args, dtype
+
+
+@guard_devsup
+def arange(args, dtype):
+    x = pygpu.arange(*args, dtype=dtype, context=ctx)
+    y = numpy.arange(*args, dtype=dtype)
+    check_meta(x, y)
+    assert numpy.allclose(numpy.asarray(x), y)
+
+
+def test_linspace():
+    for num in [0, 1, 7]:
+        for endpoint in [True, False]:
+            for dtype in ['float32', 'float64']:
+                yield linspace, num, endpoint, dtype
+
+
+@guard_devsup
+def linspace(num, endpoint, dtype):
+    x = pygpu.linspace(-1, 2, num, endpoint, dtype, context=ctx)
+    y = numpy.linspace(-1, 2, num, endpoint, dtype=dtype)
+    check_meta(x, y)
+    assert numpy.allclose(numpy.asarray(x), y)
+
+
 def test_empty():
     for shp in [(), (0,), (5,),
                 (0, 0), (1, 0), (0, 1), (6, 7),
@@ -401,10 +460,30 @@ class WriteReadTest(unittest.TestCase):
         self.assertRaises(ValueError, self.gpu.read, self.cpu)
         self.cpu = numpy.ndarray((3, 4, 5), dtype="float64", order='C')
         self.assertRaises(ValueError, self.gpu.read, self.cpu)
-        self.cpu = numpy.ndarray((3, 4, 5), dtype="float32", order='F')
-        self.assertRaises(ValueError, self.gpu.read, self.cpu)
-        self.cpu = numpy.ndarray((3, 4, 2, 5), dtype="float32", order='C')
-        self.assertRaises(ValueError, self.gpu.read, self.cpu[:, :, 0, :])
+
+        # Same shape, any layout
+        res = numpy.asarray(self.gpu)
+        cpu2 = numpy.ndarray((3, 4, 5), dtype="float32", order='F')
+        self.gpu.read(cpu2)
+        assert numpy.allclose(cpu2, res)
+        cpu2 = numpy.zeros((3, 4, 2, 5), dtype="float32")
+        self.gpu.read(cpu2[:, :, 1, :])
+        assert numpy.allclose(cpu2[:, :, 1, :], res)
+        assert numpy.all(cpu2[:, :, 0, :] == 0)
+        self.gpu[:, ::2, ::-1].read(cpu2[::-1, 1::2, 0, :])
+        assert numpy.allclose(cpu2[::-1, 1::2, 0, :], res[:, ::2, ::-1])
+
+    def test_write_strided(self):
+        cpu2 = numpy.random.random((6, 4, 5)).astype('float32')
+        self.gpu.write(cpu2[::2, :, ::-1])
+        assert numpy.allclose(numpy.asarray(self.gpu), cpu2[::2, :, ::-1])
+        self.gpu[:, 1:3, :].write(cpu2[1::2, :2, :])
+        assert numpy.allclose(numpy.asarray(self.gpu[:, 1:3, :]),
+                              cpu2[1::2, :2, :])
+
+        b = pygpu.array(cpu2[:, 1:3, ::2], context=ctx)
+        assert b.flags.c_contiguous
+        assert numpy.allclose(numpy.asarray(b), cpu2[:, 1:3, ::2])
 
 
 def test_copy_view():
@@ -754,6 +833,43 @@ def do_take1(shp, idx, offseted):
     check_content(rg, rc)
 
 
+def test_put1():
+    yield do_put1, (4, 3), [2, 0]
+    yield do_put1, (12, 4, 3), [1, 5, -1, 0]
+
+
+def do_put1(shp, idx):
+    c, g = gen_gpuarray(shp, dtype='float32', ctx=ctx, order='c')
+    vc, vg = gen_gpuarray((len(idx),) + shp[1:], dtype='float32', ctx=ctx,
+                          incr=100)
+    gi = pygpu.asarray(numpy.asarray(idx), context=ctx)
+
+    c[idx] = vc
+    g.put1(gi, vg)
+
+    check_content(g, c)
+
+
+def test_scatter_add():
+    for grouped in [False, True]:
+        for dtype in ['float32', 'float64', 'int32']:
+            yield do_scatter_add, (6, 4), [1, 1, 1, 3, 5, 5], dtype, grouped
+        yield do_scatter_add, (5, 2, 3), [0, 0, 4, 4, 4, 4, 2], 'float32', grouped
+        # A run longer than a piece and -1 next to 4
+        yield do_scatter_add, (5, 3), [0] + [2] * 100 + [-1, 4], 'int32', grouped
+
+
+def do_scatter_add(shp, idx, dtype, grouped):
+    c, g = gen_gpuarray(shp, dtype=dtype, ctx=ctx, order='c')
+    vc, vg = gen_gpuarray((len(idx),) + shp[1:], dtype=dtype, ctx=ctx)
+    gi = pygpu.asarray(numpy.asarray(idx), context=ctx)
+
+    numpy.add.at(c, idx, vc)
+    g.scatter_add(gi, vg, grouped=grouped)
+
+    assert numpy.allclose(numpy.asarray(g), c)
+
+
 def test_flags():
     for fl in ['C', 'F', 'W', 'B', 'O', 'A', 'U', 'CA', 'FA', 'FNC', 'FORC',
                'CARRAY', 'FARRAY', 'FORTRAN', 'BEHAVED', 'OWNDATA', 'ALIGNED',
@@ -782,6 +898,108 @@ def flag_prop(p):
     assert getattr(c3.flags, p) == getattr(g3.flags, p)
 
 
+@guard_devsup
+def test_timer():
+    ac, ag = gen_gpuarray((1000,), 'float32', ctx=ctx)
+    with GpuTimer(context=ctx) as t:
+        ag[:] = 0
+    assert t.elapsed >= 0
+    assert t.end.query()
+
+    e = GpuEvent(context=ctx)
+    e.record()
+    e.synchronize()
+    assert e.query()
+
+
+def test_transfer_async():
+    ac, ag = gen_gpuarray((100, 3), 'float32', ctx=ctx)
+    t = ag.read_async()
+    res = t.wait()
+    assert t.done()
+    numpy.testing.assert_equal(res, ac)
+
+    src = numpy.asarray(numpy.random.rand(100, 3), dtype='float32')
+    t = ag.write_async(src)
+    assert t.wait() is None
+    numpy.testing.assert_equal(numpy.asarray(ag), src)
+
+    if PY3:
+        # What an event loop does when awaiting the transfer
+        it = ag.read_async().__await__()
+        try:
+            while True:
+                next(it)
+        except StopIteration as e:
+            res = e.value
+        numpy.testing.assert_equal(res, src)
+
+
+@guard_devsup
+def test_pinned_empty():
+    a = pygpu.pinned_empty((10, 3), dtype='float32', context=ctx)
+    assert a.shape == (10, 3)
+    assert a.dtype == numpy.float32
+    assert a.flags['C_CONTIGUOUS'] and a.flags['WRITEABLE']
+    a[:] = numpy.random.rand(10, 3)
+    g = pygpu.empty((10, 3), dtype='float32', context=ctx)
+    g.write_async(a).wait()
+    numpy.testing.assert_equal(numpy.asarray(g), a)
+
+    # A plain write is done with the source when it returns
+    b = numpy.array(a)
+    g.write(a)
+    a[:] = 0
+    numpy.testing.assert_equal(numpy.asarray(g), b)
+
+
+def test_dlpack():
+    if ctx.kind != b'cuda':
+        assert not hasattr(pygpu.zeros((2,), context=ctx),
+                           '__cuda_array_interface__')
+        return
+    ac, ag = gen_gpuarray((10, 6), 'float32', ctx=ctx)
+    v = ag[1::2, ::-1]
+    for b in (pygpu.from_dlpack(v, context=ctx),
+              pygpu.from_dlpack(v.__dlpack__(), context=ctx),
+              pygpu.from_cuda_array_interface(v, context=ctx)):
+        assert b.shape == v.shape
+        assert b.strides == v.strides
+        numpy.testing.assert_equal(numpy.asarray(b), ac[1::2, ::-1])
+    # No copy was made
+    b[0, 0] = 42
+    assert numpy.asarray(ag)[1, 5] == 42
+
+    cai = ag.__cuda_array_interface__
+    assert cai['data'][0] == ag.gpudata
+    assert cai['strides'] is None
+    assert cai['version'] == 3
+    assert ag.__dlpack_device__()[0] == 2
+
+
+def test_npy():
+    import tempfile
+    for order in ('c', 'f'):
+        ac, ag = gen_gpuarray((5, 7), 'float32', order=order, ctx=ctx)
+        with tempfile.TemporaryFile() as f:
+            pygpu.save_npy(f, ag)
+            pygpu.save_npy(f, ag[::2, 1:])
+            f.seek(0)
+            numpy.testing.assert_equal(numpy.load(f), ac)
+            numpy.testing.assert_equal(numpy.load(f), ac[::2, 1:])
+            f.seek(0)
+            b = pygpu.load_npy(f, context=ctx)
+            assert b.flags['F_CONTIGUOUS'] == (order == 'f')
+            numpy.testing.assert_equal(numpy.asarray(b), ac)
+            out = pygpu.empty((3, 6), dtype='float32', context=ctx)
+            pygpu.load_npy(f, out=out[:, ::-1])
+            numpy.testing.assert_equal(numpy.asarray(out[:, ::-1]),
+                                       ac[::2, 1:])
+            f.seek(0)
+            with assert_raises(ValueError):
+                pygpu.load_npy(f, out=out)
+
+
 class TestPickle(unittest.TestCase):
     def test_GpuArray(self):
         with self.assertRaises(RuntimeError):
@@ -69,6 +69,41 @@ def test_concatenate():
     numpy.testing.assert_allclose(rc, numpy.asarray(rg))
 
 
+def test_concatenate_many():
+    # More pieces than one launch of the concat kernel handles
+    for axis in (0, 1, 2):
+        for dtype in ('float32', 'complex128', 'int8'):
+            yield concatenate_many, axis, dtype
+
+
+def concatenate_many(axis, dtype):
+    tupc = []
+    tupg = []
+    for i in range(40):
+        shp = [2, 3, 2]
+        shp[axis] = i % 3
+        tc, tg = gen_gpuarray(tuple(shp), dtype, ctx=context)
+        tupc.append(tc)
+        tupg.append(tg)
+    rc = numpy.concatenate(tupc, axis=axis)
+    rg = pygpu.concatenate(tupg, axis=axis)
+
+    numpy.testing.assert_allclose(rc, numpy.asarray(rg))
+
+
+def test_split_copy():
+    xc, xg = gen_gpuarray((3, 40, 2), 'float32', ctx=context)
+    spl = list(range(1, 40, 2)) + [39]
+    rc = numpy.split(xc, spl, axis=1)
+    rg = pygpu.split(xg, spl, axis=1, copy=True)
+
+    assert len(rc) == len(rg)
+    for pc, pg in zip(rc, rg):
+        assert pg.flags.c_contiguous
+        assert not pygpu.gpuarray.may_share_memory(pg, xg)
+        numpy.testing.assert_allclose(pc, numpy.asarray(pg))
+
+
 def test_hstack():
     for shp in [(3,), (3, 1)]:
         yield xstack, 'h', (shp, shp), (), context
@@ -153,7 +153,7 @@ setup(name='pygpu',
       packages=['pygpu', 'pygpu/tests'],
       include_package_data=True,
       package_data={'pygpu': ['gpuarray.h', 'gpuarray_api.h',
-                              'blas_api.h', 'numpy_compat.h',
+                              'blas_api.h', 'numpy_compat.h', 'dlpack.h',
                               'collectives.h', 'collectives_api.h']},
       ext_modules=cythonize(exts),
       install_requires=['mako>=0.7', 'six'],
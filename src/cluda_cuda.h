@@ -88,14 +88,9 @@ static __device__ inline ga_half ga_float2half(float f) {
 #define atom_xchg_Il(a, b) atomicExch(a, b)
 /* ga_long */
 __device__ ga_long atom_add_lg(ga_long *addr, ga_long val) {
-  unsigned long long *waddr = (unsigned long long *)addr;
-  unsigned long long old = *waddr;
-  unsigned long long assumed;
-  do {
-    assumed = old;
-    old = atomicCAS(waddr, assumed, (val + (ga_long)(assumed)));
-  } while (assumed != old);
-  return (ga_long)old;
+  /* Two's complement addition is the same for signed and unsigned */
+  return (ga_long)atomicAdd((unsigned long long *)addr,
+                            (unsigned long long)val);
 }
 #define atom_add_ll(a, b) atom_add_lg(a, b)
 __device__ ga_long atom_xchg_lg(ga_long *addr, ga_long val) {
@@ -15,6 +15,12 @@ extern "C" {
 }
 #endif
 
+/**
+ * Number of dimensions up to which the shape of an array is stored
+ * inside the array structure instead of on the heap.
+ */
+#define GA_INLINE_ND 8
+
 /**
  * Main array structure.
  */
@@ -25,6 +31,9 @@ typedef struct _GpuArray {
   gpudata *data;
   /**
    * Size of each dimension.  The number of elements is #nd.
+   *
+   * This points to #inline_dims when #nd is at most GA_INLINE_ND, so
+   * the structure must not be copied by value.
    */
   size_t *dimensions;
   /**
@@ -47,6 +56,14 @@ typedef struct _GpuArray {
    * Type of the array elements.
    */
   int typecode;
+  /**
+   * Storage for #dimensions for small arrays.  Don't use directly.
+   */
+  size_t inline_dims[GA_INLINE_ND];
+  /**
+   * Storage for #strides for small arrays.  Don't use directly.
+   */
+  ssize_t inline_strides[GA_INLINE_ND];
 
 /**
  * \defgroup aflags Array Flags
@@ -355,6 +372,83 @@ GPUARRAY_PUBLIC int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
 GPUARRAY_PUBLIC int GpuArray_take1(GpuArray *a, const GpuArray *v,
                                    const GpuArray *i, int check_error);
 
+/**
+ * Store the rows of `v` at the positions in `i` along the first axis
+ * of `a`.
+ *
+ * This is the reverse of GpuArray_take1(): `a[i[k], ...] = v[k, ...]`.
+ * The destination array `a` can be of any dimension or strides. The
+ * value and index arrays (`v` and `i` respectively) need to be C
+ * contiguous.
+ *
+ * The dimension 0 of `v` has to match dimension 0 of `i` and the
+ * others have to match their equivalent on `a`. `i` has to have a
+ * single dimension.
+ *
+ * If an index appears more than once, which of the values ends up in
+ * `a` is undefined.
+ *
+ * See GpuArray_take1() for the meaning of `check_error`.
+ *
+ * \param a the destination array (nd)
+ * \param v the value array (nd)
+ * \param i the index array (1d)
+ * \param check_error whether to check for index errors or not
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_put1(GpuArray *a, const GpuArray *v,
+                                  const GpuArray *i, int check_error);
+
+/**
+ * Add the rows of `v` at the positions in `i` along the first axis
+ * of `a`.
+ *
+ * Same as GpuArray_put1() except that `a[i[k], ...] += v[k, ...]` and
+ * repeated indices accumulate all their values.  This uses atomic
+ * adds, so `a` and `v` must have the same type, which must be one of
+ * GA_INT, GA_UINT, GA_LONG, GA_ULONG, GA_HALF, GA_FLOAT or
+ * GA_DOUBLE.  The order of the additions is not specified.
+ *
+ * \param a the destination array (nd)
+ * \param v the value array (nd)
+ * \param i the index array (1d)
+ * \param check_error whether to check for index errors or not
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_scatter_add(GpuArray *a, const GpuArray *v,
+                                         const GpuArray *i, int check_error);
+
+/**
+ * Add the rows of `v` at the positions in `i` along the first axis
+ * of `a`, where equal indices are next to each other in `i`.
+ *
+ * This gives the same result as GpuArray_scatter_add() when equal
+ * indices are adjacent in `i` (for example if it is sorted), but each
+ * run of equal indices is summed by a single thread and written once
+ * without atomics.  Runs longer than 32 are summed in pieces of up to
+ * 32 that are added atomically.  This is faster when a few indices
+ * are repeated a lot and the result is deterministic for runs that
+ * stay within an aligned piece of 32.  The supported types are the
+ * same as for GpuArray_scatter_add().  A negative index and the
+ * positive one it wraps to are considered equal.
+ *
+ * \param a the destination array (nd)
+ * \param v the value array (nd)
+ * \param i the index array (1d, with equal values grouped)
+ * \param check_error whether to check for index errors or not
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_scatter_add_sorted(GpuArray *a,
+                                                const GpuArray *v,
+                                                const GpuArray *i,
+                                                int check_error);
+
 /**
  * Sets the content of an array to the content of another array.
  *
@@ -471,7 +565,10 @@ GPUARRAY_PUBLIC int GpuArray_move(GpuArray *dst, const GpuArray *src);
 /**
  * Copy data from the host memory to the device memory.
  *
- * \param dst destination array (must be contiguous)
+ * If `dst` is not one segment, `src` holds its elements in C order
+ * and must be exactly as big (see GpuArray_write_strided()).
+ *
+ * \param dst destination array
  * \param src source host memory (contiguous block)
  * \param src_sz size of data to copy (in bytes)
  *
@@ -484,9 +581,12 @@ GPUARRAY_PUBLIC int GpuArray_write(GpuArray *dst, const void *src,
 /**
  * Copy data from the device memory to the host memory.
  *
+ * If `src` is not one segment, its elements are written to `dst` in C
+ * order and `dst_sz` must be exactly their size.
+ *
  * \param dst destination host memory (contiguous block)
  * \param dst_sz size of data to copy (in bytes)
- * \param src source array (must be contiguous)
+ * \param src source array
  *
  * \return GA_NO_ERROR if the operation was succesful.
  * \return an error code otherwise
@@ -494,6 +594,77 @@ GPUARRAY_PUBLIC int GpuArray_write(GpuArray *dst, const void *src,
 GPUARRAY_PUBLIC int GpuArray_read(void *dst, size_t dst_sz,
                                   const GpuArray *src);
 
+/**
+ * Copy strided host memory to the device memory.
+ *
+ * `src` points to the first element of a host array with the same
+ * shape and type as `dst` and strides (in bytes, possibly negative)
+ * `src_strides`.  Both sides may be strided; the data moves in one
+ * pass, with a pitched copy when the layouts allow it, or through
+ * page-locked staging buffers in chunks of the context transfer chunk
+ * size otherwise.
+ *
+ * \param dst destination array
+ * \param src source host memory
+ * \param src_strides strides of `src`, one per dimension of `dst`
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_write_strided(GpuArray *dst, const void *src,
+                                           const ssize_t *src_strides);
+
+/**
+ * Copy the device memory to strided host memory.
+ *
+ * This is the reverse of GpuArray_write_strided().
+ *
+ * \param dst destination host memory
+ * \param dst_strides strides of `dst`, one per dimension of `src`
+ * \param src source array
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_read_strided(void *dst,
+                                          const ssize_t *dst_strides,
+                                          const GpuArray *src);
+
+/**
+ * Queue a copy from host memory to the device memory.
+ *
+ * The copy is ordered after the work queued on `dst` and `done` is
+ * recorded after it.  `src` must stay allocated and unmodified until
+ * `done` completes.  See gpudata_write_async().
+ *
+ * \param dst destination array (must be contiguous)
+ * \param src source host memory (contiguous block)
+ * \param src_sz size of data to copy (in bytes)
+ * \param done event recorded after the copy
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_write_async(GpuArray *dst, const void *src,
+                                         size_t src_sz, gpuevent *done);
+
+/**
+ * Queue a copy from the device memory to the host memory.
+ *
+ * `done` is recorded after the copy and `dst` must not be used until
+ * it completes.  See gpudata_read_async().
+ *
+ * \param dst destination host memory (contiguous block)
+ * \param dst_sz size of data to copy (in bytes)
+ * \param src source array (must be contiguous)
+ * \param done event recorded after the copy
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_read_async(void *dst, size_t dst_sz,
+                                        const GpuArray *src, gpuevent *done);
+
 /**
  * Set all of an array's data to a byte pattern.
  *
@@ -505,6 +676,64 @@ GPUARRAY_PUBLIC int GpuArray_read(void *dst, size_t dst_sz,
  */
 GPUARRAY_PUBLIC int GpuArray_memset(GpuArray *a, int data);
 
+/**
+ * Set all the elements of an array to a value.
+ *
+ * Contiguous arrays use the native fill of the backend when the
+ * pattern allows it.  Other cases (strided arrays, 64-bit and wider
+ * patterns) go through a cached generated kernel.
+ *
+ * \param a an array
+ * \param value pointer to one element of the array's type
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_fill(GpuArray *a, const void *value);
+
+/**
+ * Create a new 1-d array holding `start + i * step` for `i` in
+ * `[0, n)`.
+ *
+ * `start` and `step` point to values of type `typecode`, except for
+ * GA_HALF where they are floats.
+ *
+ * \param r the result array (will be initialized)
+ * \param ctx context for the result
+ * \param typecode type of the result (must be a real type)
+ * \param start pointer to the first value
+ * \param step pointer to the increment
+ * \param n number of elements
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_arange(GpuArray *r, gpucontext *ctx,
+                                    int typecode, const void *start,
+                                    const void *step, size_t n);
+
+/**
+ * Create a new 1-d array of `n` evenly spaced values over
+ * `[start, stop]` (or `[start, stop)` if `endpoint` is 0).
+ *
+ * The values are computed in float for GA_FLOAT and GA_HALF and in
+ * double for the other types.
+ *
+ * \param r the result array (will be initialized)
+ * \param ctx context for the result
+ * \param typecode type of the result (must be a real type)
+ * \param start first value
+ * \param stop last value
+ * \param n number of elements
+ * \param endpoint include `stop` as the last value
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_linspace(GpuArray *r, gpucontext *ctx,
+                                      int typecode, double start,
+                                      double stop, size_t n, int endpoint);
+
 /**
  * Make a copy of an array.
  *
@@ -557,9 +786,37 @@ GPUARRAY_PUBLIC int GpuArray_transfer(GpuArray *res, const GpuArray *a);
 GPUARRAY_PUBLIC int GpuArray_split(GpuArray **rs, const GpuArray *a, size_t n,
                                    size_t *p, unsigned int axis);
 
+/**
+ * Split an array into multiple new arrays.
+ *
+ * This is like GpuArray_split() except that the results are new C
+ * contiguous arrays holding a copy of their part of `a`.  When `a` is
+ * C contiguous all the copies are done by a single kernel (one launch
+ * per 16 pieces).  The values in `p` must be increasing.
+ *
+ * If an error occurs partway during the operation, the created arrays
+ * will be cleared before returning.
+ *
+ * \param rs list of array pointers to store results (must be of length n+1)
+ * \param a array to split
+ * \param n number of splits (length of p)
+ * \param p list of split points
+ * \param axis axis to split
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_split_copy(GpuArray **rs, const GpuArray *a,
+                                        size_t n, size_t *p,
+                                        unsigned int axis);
+
 /**
  * Concatenate the arrays in `as` along the axis `axis`.
  *
+ * When the arrays are C contiguous and of type `restype` they are
+ * copied by a single kernel (one launch per 16 arrays) instead of one
+ * copy per array.
+ *
  * If an error occurs during the operation, the result array may be
  * cleared before returning.
  *
@@ -604,6 +861,51 @@ GPUARRAY_PUBLIC void GpuArray_fprintf(FILE *fd, const GpuArray *a);
 
 GPUARRAY_PUBLIC int GpuArray_fdump(FILE *fd, const GpuArray *a);
 
+/**
+ * Read an array stored in the numpy .npy format.
+ *
+ * `a` is allocated in `ctx` with the type, shape and order found in
+ * the file.  The data is read in chunks from `f` and each chunk is
+ * uploaded while the next one is read, so the host memory used
+ * doesn't depend on the size of the array.
+ *
+ * \param a the array to initialize
+ * \param ctx context for the allocation
+ * \param f file positioned at the start of the .npy data
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_load_npy(GpuArray *a, gpucontext *ctx, FILE *f);
+
+/**
+ * Read an array stored in the numpy .npy format into `a`.
+ *
+ * The type and shape in the file must match those of `a`.
+ *
+ * \param a the destination array
+ * \param f file positioned at the start of the .npy data
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_load_npy_into(GpuArray *a, FILE *f);
+
+/**
+ * Write `a` to `f` in the numpy .npy format.
+ *
+ * Fortran-contiguous arrays are stored in fortran order, everything
+ * else in C order.  Like GpuArray_load_npy(), the data goes through
+ * the host in chunks.
+ *
+ * \param f a file open for writing
+ * \param a the array to save
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_save_npy(FILE *f, const GpuArray *a);
+
 /**
  * @brief Computes simultaneously the maxima and the arguments of maxima over
  * specified axes of the tensor.
@@ -43,6 +43,27 @@ struct _gpukernel;
  */
 typedef struct _gpukernel gpukernel;
 
+struct _gpustream;
+
+/**
+ * Opaque struct for stream data.
+ */
+typedef struct _gpustream gpustream;
+
+struct _gpuevent;
+
+/**
+ * Opaque struct for device events.
+ */
+typedef struct _gpuevent gpuevent;
+
+struct _gpugraph;
+
+/**
+ * Opaque struct for recorded launch graphs.
+ */
+typedef struct _gpugraph gpugraph;
+
 /**
  * Gets information about the number of available platforms for the
  * backend specified in `name`.
@@ -177,6 +198,22 @@ GPUARRAY_PUBLIC int gpucontext_props_set_single_stream(gpucontext_props *p);
 GPUARRAY_PUBLIC int gpucontext_props_kernel_cache(gpucontext_props *p,
                                                   const char *path);
 
+/**
+ * Set the chunk size for transfers that go through the host.
+ *
+ * When gpudata_transfer() can't copy directly between two contexts,
+ * the data is moved in chunks of this size through two staging
+ * buffers, so reading a chunk overlaps with writing the previous one.
+ * The chunk size of the source context is used.  The default is 8M.
+ *
+ * \param p properties object
+ * \param sz chunk size in bytes (must not be 0)
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpucontext_props_transfer_chunk(gpucontext_props *p,
+                                                    size_t sz);
+
 /**
  * Configure the allocation cache.
  *
@@ -397,6 +434,15 @@ GPUARRAY_PUBLIC int gpudata_move(gpudata *dst, size_t dstoff,
                                  gpudata *src, size_t srcoff,
                                  size_t sz);
 
+/**
+ * Same as gpudata_move() but the copy is queued on stream `s`.
+ *
+ * A NULL stream means the default stream of the context.
+ */
+GPUARRAY_PUBLIC int gpudata_move_s(gpudata *dst, size_t dstoff,
+                                   gpudata *src, size_t srcoff,
+                                   size_t sz, gpustream *s);
+
 /**
  * Transfer the content of buffer across contexts.
  *
@@ -420,7 +466,8 @@ GPUARRAY_PUBLIC int gpudata_transfer(gpudata *dst, size_t dstoff,
 /**
  * Transfer data from a buffer to memory.
  *
- * The buffer and the memory region must be contiguous.
+ * The buffer and the memory region must be contiguous.  The data is
+ * in `dst` when this returns.
  *
  * \param dst destination in memory
  * \param src source buffer
@@ -433,10 +480,21 @@ GPUARRAY_PUBLIC int gpudata_read(void *dst,
                                  gpudata *src, size_t srcoff,
                                  size_t sz);
 
+/**
+ * Same as gpudata_read() but the transfer is queued on stream `s`.
+ *
+ * A NULL stream means the default transfer stream of the context.
+ */
+GPUARRAY_PUBLIC int gpudata_read_s(void *dst,
+                                   gpudata *src, size_t srcoff,
+                                   size_t sz, gpustream *s);
+
 /**
  * Transfer data from memory to a buffer.
  *
- * The buffer and the memory region must be contiguous.
+ * The buffer and the memory region must be contiguous.  The memory
+ * at `src` can be reused as soon as this returns, even if it is
+ * page-locked.
  *
  * \param dst destination buffer
  * \param dstoff offset inside the destination buffer
@@ -448,6 +506,65 @@ GPUARRAY_PUBLIC int gpudata_read(void *dst,
 GPUARRAY_PUBLIC int gpudata_write(gpudata *dst, size_t dstoff,
                                   const void *src, size_t sz);
 
+/**
+ * Same as gpudata_write() but the transfer is queued on stream `s`.
+ *
+ * A NULL stream means the default transfer stream of the context.
+ */
+GPUARRAY_PUBLIC int gpudata_write_s(gpudata *dst, size_t dstoff,
+                                    const void *src, size_t sz,
+                                    gpustream *s);
+
+/**
+ * Queue a transfer from a buffer to memory and return without
+ * waiting for it.
+ *
+ * `done` is recorded after the transfer.  The memory at `dst` must
+ * stay allocated and must not be read or written until `done`
+ * completes (see gpuevent_sync() and gpuevent_query()).
+ *
+ * The transfer only overlaps with host work when `dst` is page-locked
+ * memory.  With pageable memory some backends wait for the copy
+ * before returning, which is still correct but not asynchronous.
+ *
+ * \param dst destination in memory
+ * \param src source buffer
+ * \param srcoff offset inside the source buffer
+ * \param sz size of data to copy (in bytes)
+ * \param s stream (NULL for the default transfer stream)
+ * \param done event of the same context, recorded after the transfer
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpudata_read_async(void *dst,
+                                       gpudata *src, size_t srcoff,
+                                       size_t sz, gpustream *s,
+                                       gpuevent *done);
+
+/**
+ * Queue a transfer from memory to a buffer and return without
+ * waiting for it.
+ *
+ * `done` is recorded after the transfer.  The memory at `src` must
+ * stay allocated and unmodified until `done` completes.  Work queued
+ * after this call that uses `dst` is ordered after the transfer.
+ *
+ * The same page-locked memory requirement as gpudata_read_async()
+ * applies to overlap host work with the transfer.
+ *
+ * \param dst destination buffer
+ * \param dstoff offset inside the destination buffer
+ * \param src source in memory
+ * \param sz size of data to copy (in bytes)
+ * \param s stream (NULL for the default transfer stream)
+ * \param done event of the same context, recorded after the transfer
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpudata_write_async(gpudata *dst, size_t dstoff,
+                                        const void *src, size_t sz,
+                                        gpustream *s, gpuevent *done);
+
 /**
  * Set a buffer to a byte pattern.
  *
@@ -508,7 +625,8 @@ GPUARRAY_PUBLIC gpucontext *gpudata_context(gpudata *b);
  * \param lengths (optional) length for each string in the table
  * \param fname name of the kernel function (as defined in the code)
  * \param numargs number of kernel arguments
- * \param typecodes the type of each argument
+ * \param typecodes the type of each argument (GA_BUFFER_RO and
+ *        GA_BUFFER_WO can be used to describe buffer access)
  * \param flags flags for compilation (see #ga_usefl)
  * \param ret error return pointer
  * \param err_str returns pointer to debug message from GPU backend
@@ -580,6 +698,16 @@ GPUARRAY_PUBLIC int gpukernel_call(gpukernel *k, unsigned int n,
                                    const size_t *gs, const size_t *ls,
                                    size_t shared, void **args);
 
+/**
+ * Same as gpukernel_call() but the kernel is queued on stream `s`.
+ *
+ * A NULL stream means the default stream of the context.
+ */
+GPUARRAY_PUBLIC int gpukernel_call_s(gpukernel *k, unsigned int n,
+                                     const size_t *gs, const size_t *ls,
+                                     size_t shared, void **args,
+                                     gpustream *s);
+
 /**
  * Fetch a property.
  *
@@ -596,8 +724,226 @@ GPUARRAY_PUBLIC int gpukernel_call(gpukernel *k, unsigned int n,
  */
 GPUARRAY_PUBLIC int gpukernel_property(gpukernel *k, int prop_id, void *res);
 
+/**
+ * Get the number of blocks of a kernel that can be active at the
+ * same time on one compute unit.
+ *
+ * This accounts for the registers and the static and dynamic shared
+ * memory used by the kernel.  On OpenCL devices it is an estimate
+ * based on the local memory use and the work group size.
+ *
+ * \param k kernel
+ * \param ls block size (also known as local size)
+ * \param shared amount of dynamic shared memory per block
+ * \param blocks number of blocks, 0 if the kernel can't run with
+ * this configuration
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpukernel_occupancy(gpukernel *k, size_t ls, size_t shared,
+                                        unsigned int *blocks);
+
 GPUARRAY_PUBLIC gpucontext *gpukernel_context(gpukernel *k);
 
+/**
+ * Create a new stream.
+ *
+ * Work queued on different streams may run concurrently.  Operations
+ * on buffers still see the effects of previous operations on the
+ * same buffers regardless of the stream they were queued on.
+ *
+ * Contexts created with gpucontext_props_set_single_stream() do not
+ * support additional streams.
+ *
+ * \param ctx context to create the stream in
+ * \param ret error return pointer
+ *
+ * \returns A new stream or NULL if an error occured.  `ret` will be
+ * updated with the error code if not NULL.
+ */
+GPUARRAY_PUBLIC gpustream *gpustream_alloc(gpucontext *ctx, int *ret);
+
+/**
+ * Destroy a stream.
+ *
+ * This waits for all the work queued on the stream to complete.
+ *
+ * \param s stream (can be NULL)
+ */
+GPUARRAY_PUBLIC void gpustream_free(gpustream *s);
+
+/**
+ * Wait for all the work queued on a stream to complete.
+ *
+ * \param s stream
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpustream_sync(gpustream *s);
+
+/**
+ * Make a stream wait for the work currently queued on another.
+ *
+ * Work queued on `s` after this call will not start before the work
+ * queued on `other` before this call is done.  This does not block
+ * the host.
+ *
+ * Either stream can be NULL to mean the default stream of the
+ * context, but not both.
+ *
+ * \param s stream that waits
+ * \param other stream to wait for
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpustream_wait(gpustream *s, gpustream *other);
+
+GPUARRAY_PUBLIC gpucontext *gpustream_context(gpustream *s);
+
+/**
+ * Create an event.
+ *
+ * Events mark a point in the work queued on a stream.  They can be
+ * used to wait for part of the work without synchronizing the whole
+ * device and to measure the time taken by the work between two of
+ * them.
+ *
+ * \param ctx context to create the event in
+ * \param ret error return pointer
+ *
+ * \returns A new event or NULL if an error occured.  `ret` will be
+ * updated with the error code if not NULL.
+ */
+GPUARRAY_PUBLIC gpuevent *gpuevent_alloc(gpucontext *ctx, int *ret);
+
+/**
+ * Destroy an event.
+ *
+ * \param e event (can be NULL)
+ */
+GPUARRAY_PUBLIC void gpuevent_free(gpuevent *e);
+
+/**
+ * Record an event after the work currently queued on a stream.
+ *
+ * Recording an event again moves it to the new point.  With a NULL
+ * stream the event also comes after the transfers queued without a
+ * stream, and the default stream waits for them.
+ *
+ * \param e event
+ * \param s stream (NULL for the default stream)
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpuevent_record(gpuevent *e, gpustream *s);
+
+/**
+ * Wait for the work preceding the event to complete.
+ *
+ * Returns immediately if the event was never recorded.
+ *
+ * \param e event
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpuevent_sync(gpuevent *e);
+
+/**
+ * Check if the work preceding the event is done without blocking.
+ *
+ * \param e event
+ * \param done set to 1 if the work is done and 0 otherwise
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpuevent_query(gpuevent *e, int *done);
+
+/**
+ * Get the time elapsed between two recorded events.
+ *
+ * Both events must be from the same context and done.  On OpenCL
+ * this needs a device that supports queue profiling.
+ *
+ * \param start first event
+ * \param end second event
+ * \param ms set to the elapsed time in milliseconds
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpuevent_elapsed(gpuevent *start, gpuevent *end,
+                                     double *ms);
+
+GPUARRAY_PUBLIC gpucontext *gpuevent_context(gpuevent *e);
+
+/**
+ * Start recording the work queued on a context.
+ *
+ * Until gpucontext_capture_end() is called, kernel launches, moves
+ * and memsets on the context are recorded instead of being run.  The
+ * stream they are queued on is ignored: the whole graph runs on the
+ * stream given to gpugraph_launch().
+ *
+ * Operations that need the host (reads, writes, syncs) or go through
+ * vendor libraries (blas, collectives) fail with
+ * #GA_UNSUPPORTED_ERROR while capturing.  Kernels called without an
+ * argument table must have been set up through GpuKernel_setarg().
+ *
+ * \param ctx context
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpucontext_capture_begin(gpucontext *ctx);
+
+/**
+ * Stop recording and return the recorded graph.
+ *
+ * If any operation failed while capturing, the capture is discarded.
+ *
+ * \param ctx context
+ * \param ret error return pointer
+ *
+ * \returns A new graph or NULL if an error occured.  `ret` will be
+ * updated with the error code if not NULL.
+ */
+GPUARRAY_PUBLIC gpugraph *gpucontext_capture_end(gpucontext *ctx, int *ret);
+
+/**
+ * Run all the work recorded in a graph.
+ *
+ * The graph keeps references to the kernels and buffers it uses, and
+ * is ordered like any other operation with respect to those buffers.
+ *
+ * \param g graph
+ * \param s stream to use (NULL for the default stream)
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpugraph_launch(gpugraph *g, gpustream *s);
+
+/**
+ * Make a graph use another buffer in place of one it recorded.
+ *
+ * The new buffer must be at least as large as what the recorded
+ * operations access.  This is meant to be done between launches and
+ * may make the next launch more expensive.
+ *
+ * \param g graph
+ * \param old buffer to replace
+ * \param buf replacement
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpugraph_update(gpugraph *g, gpudata *old, gpudata *buf);
+
+/**
+ * Free a graph.
+ *
+ * \param g graph (can be NULL)
+ */
+GPUARRAY_PUBLIC void gpugraph_free(gpugraph *g);
+
+GPUARRAY_PUBLIC gpucontext *gpugraph_context(gpugraph *g);
+
 /**
  * \defgroup props Properties
  * @{
@@ -763,6 +1109,18 @@ GPUARRAY_PUBLIC gpucontext *gpukernel_context(gpukernel *k);
  */
 #define GA_BUFFER_PROP_SIZE  514
 
+/**
+ * Host pointer to the contents of a buffer allocated with
+ * GA_BUFFER_HOST.
+ *
+ * The memory is page-locked and accessed directly by the device, so
+ * wait for the device work using the buffer before touching it.  Only
+ * supported by the CUDA backend.
+ *
+ * Type: `void *`
+ */
+#define GA_BUFFER_PROP_HOSTPOINTER 515
+
 /* Start at 1024 for GA_KERNEL_PROP_ */
 #define GA_KERNEL_PROP_START     1024
 
@@ -806,6 +1164,22 @@ GPUARRAY_PUBLIC gpucontext *gpukernel_context(gpukernel *k);
  */
 #define GA_KERNEL_PROP_TYPES     1028
 
+/**
+ * Get the number of registers used by each thread of the kernel.
+ *
+ * Not available on OpenCL devices.
+ *
+ * Type: `unsigned int`
+ */
+#define GA_KERNEL_PROP_NUMREGS   1029
+
+/**
+ * Get the amount of shared memory statically allocated by the kernel.
+ *
+ * Type: `size_t`
+ */
+#define GA_KERNEL_PROP_SHAREDSIZE 1030
+
 /**
  * @}
  */
@@ -839,6 +1213,11 @@ typedef enum _ga_usefl {
    * The kernel makes use of half-floats (also known as float16)
    */
   GA_USE_HALF =       0x10,
+  /**
+   * The kernel makes use of 64-bit atomics (atom_add_lg, atom_add_Lg
+   * or atom_add_dg).
+   */
+  GA_USE_ATOM64 =     0x20,
   /* If you add a new flag, don't forget to update both
      gpuarray_buffer_{cuda,opencl}.c with the implementation of your flag */
   /**
@@ -149,6 +149,15 @@ GPUARRAY_PUBLIC int gpucomm_reduce(gpudata* src, size_t offsrc, gpudata* dest,
                                    size_t offdest, size_t count, int typecode,
                                    int opcode, int root, gpucomm* comm);
 
+/**
+ * Same as gpucomm_reduce() but the operation is queued on stream `s`
+ * (NULL means the default stream of the context).
+ */
+GPUARRAY_PUBLIC int gpucomm_reduce_s(gpudata* src, size_t offsrc,
+                                     gpudata* dest, size_t offdest,
+                                     size_t count, int typecode, int opcode,
+                                     int root, gpucomm* comm, gpustream* s);
+
 /**
  * AllReduce collective operation for ranks in a communicator world
  * [buffer level].
@@ -177,6 +186,16 @@ GPUARRAY_PUBLIC int gpucomm_all_reduce(gpudata* src, size_t offsrc,
                                        size_t count, int typecode, int opcode,
                                        gpucomm* comm);
 
+/**
+ * Same as gpucomm_all_reduce() but the operation is queued on stream
+ * `s` (NULL means the default stream of the context).
+ */
+GPUARRAY_PUBLIC int gpucomm_all_reduce_s(gpudata* src, size_t offsrc,
+                                         gpudata* dest, size_t offdest,
+                                         size_t count, int typecode,
+                                         int opcode, gpucomm* comm,
+                                         gpustream* s);
+
 /**
  * ReduceScatter collective operation for ranks in a communicator
  * world [buffer level].
@@ -205,6 +224,16 @@ GPUARRAY_PUBLIC int gpucomm_reduce_scatter(gpudata* src, size_t offsrc,
                                            size_t count, int typecode,
                                            int opcode, gpucomm* comm);
 
+/**
+ * Same as gpucomm_reduce_scatter() but the operation is queued on
+ * stream `s` (NULL means the default stream of the context).
+ */
+GPUARRAY_PUBLIC int gpucomm_reduce_scatter_s(gpudata* src, size_t offsrc,
+                                             gpudata* dest, size_t offdest,
+                                             size_t count, int typecode,
+                                             int opcode, gpucomm* comm,
+                                             gpustream* s);
+
 /**
  * Broadcast collective operation for ranks in a communicator world
  * [buffer level].
@@ -226,6 +255,14 @@ GPUARRAY_PUBLIC int gpucomm_broadcast(gpudata* array, size_t offset,
                                       size_t count, int typecode, int root,
                                       gpucomm* comm);
 
+/**
+ * Same as gpucomm_broadcast() but the operation is queued on stream
+ * `s` (NULL means the default stream of the context).
+ */
+GPUARRAY_PUBLIC int gpucomm_broadcast_s(gpudata* array, size_t offset,
+                                        size_t count, int typecode, int root,
+                                        gpucomm* comm, gpustream* s);
+
 /**
  * AllGather collective operation for ranks in a communicator world.
  *
@@ -250,6 +287,15 @@ GPUARRAY_PUBLIC int gpucomm_all_gather(gpudata* src, size_t offsrc,
                                        size_t count, int typecode,
                                        gpucomm* comm);
 
+/**
+ * Same as gpucomm_all_gather() but the operation is queued on stream
+ * `s` (NULL means the default stream of the context).
+ */
+GPUARRAY_PUBLIC int gpucomm_all_gather_s(gpudata* src, size_t offsrc,
+                                         gpudata* dest, size_t offdest,
+                                         size_t count, int typecode,
+                                         gpucomm* comm, gpustream* s);
+
 #ifdef __cplusplus
 }
 #endif
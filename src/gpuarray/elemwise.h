@@ -83,7 +83,8 @@ typedef struct _gpuelemwise_arg {
  * The expression is a C-like string performing an operation with
  * scalar values named according to the argument descriptors.  All of
  * the indexing and selection of the right values is handled by the
- * GpuElemwise code.
+ * GpuElemwise code.  The position of the element can be exposed
+ * to the expression with the GE_INDEX flag.
  *
  * \param ctx the context in which to run the operations
  * \param preamble code to be inserted before the kernel code
@@ -103,6 +104,97 @@ GPUARRAY_PUBLIC GpuElemwise *GpuElemwise_new(gpucontext *ctx,
                                              unsigned int nd,
                                              int flags);
 
+/**
+ * Reduction clause for GpuElemwise_new_reduce().
+ */
+typedef struct _gpuelemwise_reduce {
+  /**
+   * Index of the argument that receives the reduction, mandatory.
+   *
+   * This must be an array argument marked GE_WRITE and not GE_READ.
+   * The value it holds after the expression is combined over the
+   * reduced axes instead of being stored for each element.
+   */
+  unsigned int arg;
+
+  /**
+   * Reduction operator, mandatory (see \ref redops).
+   */
+  int op;
+
+  /**
+   * Neutral element of the operator as an expression of the type of
+   * the reduction argument.  Optional for sums and products (0 and
+   * 1), mandatory otherwise.
+   */
+  const char *neutral;
+
+/**
+ * \defgroup redops GpuElemwise reduction operators
+ * @{
+ */
+
+  /**
+   * Sum of the values.
+   */
+#define GE_REDUCE_SUM  0
+
+  /**
+   * Product of the values.
+   */
+#define GE_REDUCE_PROD 1
+
+  /**
+   * Maximum of the values.
+   */
+#define GE_REDUCE_MAX  2
+
+  /**
+   * Minimum of the values.
+   */
+#define GE_REDUCE_MIN  3
+
+/**
+ * }@
+ */
+
+} gpuelemwise_reduce;
+
+/**
+ * Create a new GpuElemwise with a fused reduction.
+ *
+ * This works like GpuElemwise_new() except that the argument
+ * designated by `red` is reduced instead of being written
+ * elementwise.  This computes things like sum(x*y) in one pass
+ * without storing the products.
+ *
+ * When calling, the reduction argument must have the same number of
+ * dimensions as the other arrays, with a size of 1 on the axes to
+ * reduce and the full size on the others.  Half-precision reductions
+ * are accumulated in float32.
+ *
+ * GpuElemwise_call_multi() is not supported on these objects.
+ *
+ * \param ctx the context in which to run the operations
+ * \param preamble code to be inserted before the kernel code
+ * \param expr the expression to compute
+ * \param n the number of arguments
+ * \param args the argument descriptors
+ * \param nd the number of dimensions to precompile for
+ * \param flags see \ref elem_flags "GpuElemwise flags"
+ * \param red the reduction clause
+ *
+ * \returns a new GpuElemwise object or NULL
+ */
+GPUARRAY_PUBLIC GpuElemwise *GpuElemwise_new_reduce(gpucontext *ctx,
+                                                    const char *preamble,
+                                                    const char *expr,
+                                                    unsigned int n,
+                                                    gpuelemwise_arg *args,
+                                                    unsigned int nd,
+                                                    int flags,
+                                                    gpuelemwise_reduce *red);
+
 /**
  * \defgroup elem_flags GpuElemwise flags
  * @{
@@ -118,6 +210,20 @@ GPUARRAY_PUBLIC GpuElemwise *GpuElemwise_new(gpucontext *ctx,
  */
 #define GE_CONVERT_F16 0x0002
 
+/**
+ * Make the coordinates of the current element available to the
+ * expression.
+ *
+ * The expression can then use `ga_i`, the flat index of the element
+ * in C order, and `ga_idx0` to `ga_idxN` (with N = nd - 1), its
+ * position along each dimension of the output.  These are read-only.
+ *
+ * Only the kernel for `nd` dimensions is precompiled since the
+ * expression may not be valid for others.  Dimensions are never
+ * collapsed for these operations.
+ */
+#define GE_INDEX       0x0004
+
 /**
  * @}
  */
@@ -139,6 +245,26 @@ GPUARRAY_PUBLIC void GpuElemwise_free(GpuElemwise *ge);
  */
 GPUARRAY_PUBLIC int GpuElemwise_call(GpuElemwise *ge, void **args, int flags);
 
+/**
+ * Run a GpuElemwise on many independent sets of inputs.
+ *
+ * Sets where all arrays are contiguous are batched together and
+ * processed with as few kernel launches as possible, even if their
+ * sizes differ.  The other sets are run with GpuElemwise_call().
+ *
+ * The sets must not depend on each other since there is no ordering
+ * guarantee between them.
+ *
+ * \param ge the GpuElemwise to run
+ * \param nsets number of argument sets
+ * \param args array of `nsets` argument lists, each as would be
+ *             passed to GpuElemwise_call()
+ * \param flags see \ref elem_call_flags "GpuElemwise call flags"
+ */
+GPUARRAY_PUBLIC int GpuElemwise_call_multi(GpuElemwise *ge,
+                                           unsigned int nsets, void ***args,
+                                           int flags);
+
 
 /**
  * \defgroup elem_call_flags GpuElemwise call flags
@@ -161,6 +287,12 @@ GPUARRAY_PUBLIC int GpuElemwise_call(GpuElemwise *ge, void **args, int flags);
  */
 #define GE_PADSHAPE   0x0400
 
+/**
+ * Don't stage transposed inputs through local memory tiles (to
+ * compare with the tiled kernel).
+ */
+#define GE_NOTILE     0x0800
+
 /**
  * @}
  */
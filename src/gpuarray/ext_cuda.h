@@ -16,10 +16,13 @@ static void (*cuda_enter)(gpucontext *);
 static void (*cuda_exit)(gpucontext *);
 static gpucontext *(*cuda_make_ctx)(CUcontext, int);
 static CUstream (*cuda_get_stream)(void *);
+static int (*cuda_get_device)(void *);
 static gpudata *(*cuda_make_buf)(void *, CUdeviceptr, size_t);
 static size_t (*cuda_get_sz)(gpudata *);
 static int (*cuda_wait)(gpudata *, int);
 static int (*cuda_record)(gpudata *, int);
+static int (*cuda_handoff)(gpudata *, CUstream);
+static int (*cuda_takeover)(gpudata *, CUstream);
 static CUipcMemHandle (*cuda_get_ipc_handle)(gpudata *d);
 static gpudata *(*cuda_open_ipc_handle)(gpucontext *c, CUipcMemHandle h,
                                         size_t sz);
@@ -31,10 +34,13 @@ static void setup_ext_cuda(void) {
   cuda_exit = (void (*)(gpucontext *))gpuarray_get_extension("cuda_exit");
   cuda_make_ctx = (gpucontext *(*)(CUcontext, int))gpuarray_get_extension("cuda_make_ctx");
   cuda_get_stream = (CUstream (*)(void *))gpuarray_get_extension("cuda_get_stream");
+  cuda_get_device = (int (*)(void *))gpuarray_get_extension("cuda_get_device");
   cuda_make_buf = (gpudata *(*)(void *, CUdeviceptr, size_t))gpuarray_get_extension("cuda_make_buf");
   cuda_get_sz = (size_t (*)(gpudata *))gpuarray_get_extension("cuda_get_sz");
   cuda_wait = (int (*)(gpudata *, int))gpuarray_get_extension("cuda_wait");
   cuda_record = (int (*)(gpudata *, int))gpuarray_get_extension("cuda_record");
+  cuda_handoff = (int (*)(gpudata *, CUstream))gpuarray_get_extension("cuda_handoff");
+  cuda_takeover = (int (*)(gpudata *, CUstream))gpuarray_get_extension("cuda_takeover");
   cuda_get_ipc_handle = (CUipcMemHandle (*)(gpudata *))gpuarray_get_extension("cuda_get_ipc_handle");
   cuda_open_ipc_handle = (gpudata *(*)(gpucontext *c, CUipcMemHandle h, size_t sz))gpuarray_get_extension("cuda_open_ipc_handle");
 }
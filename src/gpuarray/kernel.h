@@ -26,6 +26,16 @@ typedef struct _GpuKernel {
    * Argument buffer.
    */
   void **args;
+  /**
+   * Block size picked by GpuKernel_sched_shared() for `sched_shared`
+   * bytes of shared memory (0 if not computed yet).
+   */
+  size_t sched_ls;
+  size_t sched_shared;
+  /**
+   * Active blocks per compute unit for `sched_ls`.
+   */
+  unsigned int sched_blocks;
 } GpuKernel;
 
 /**
@@ -82,7 +92,9 @@ GPUARRAY_PUBLIC int GpuKernel_setarg(GpuKernel *k, unsigned int i, void *val);
  * This function will find an optimal grid and block size for the
  * number of elements specified in n when running kernel k.  The
  * parameters may run a bit more instances than n for efficiency
- * reasons, so your kernel must be ready to deal with that.
+ * reasons, so your kernel must be ready to deal with that.  They may
+ * also run less instances than n, so the kernel must loop over the
+ * elements.
  *
  * If either gs or ls is not 0 on entry its value will not be altered
  * and will be taken into account when choosing the other value.
@@ -95,6 +107,26 @@ GPUARRAY_PUBLIC int GpuKernel_setarg(GpuKernel *k, unsigned int i, void *val);
 GPUARRAY_PUBLIC int GpuKernel_sched(GpuKernel *k, size_t n,
                                     size_t *gs, size_t *ls);
 
+/**
+ * Same as GpuKernel_sched() for a call that uses dynamic shared
+ * memory.
+ *
+ * The block size is the one that keeps the most threads active on
+ * each compute unit given the registers and shared memory used by
+ * the kernel, and the grid is sized to fill the device once.  The
+ * search is remembered in the kernel structure for the last shared
+ * size used.
+ *
+ * \param k the kernel to schedule for
+ * \param n number of elements to handle
+ * \param shared amount of dynamic shared memory per block
+ * \param gs grid size (in/out)
+ * \param ls local size (in/out)
+ */
+GPUARRAY_PUBLIC int GpuKernel_sched_shared(GpuKernel *k, size_t n,
+                                           size_t shared,
+                                           size_t *gs, size_t *ls);
+
 /**
  * Launch the execution of a kernel.
  *
@@ -109,6 +141,22 @@ GPUARRAY_PUBLIC int GpuKernel_call(GpuKernel *k, unsigned int n,
                                    const size_t *gs, const size_t *ls,
                                    size_t shared, void **args);
 
+/**
+ * Launch the execution of a kernel on a specific stream.
+ *
+ * \param k the kernel to launch
+ * \param n dimensionality of the grid/blocks
+ * \param gs sizes of launch grid
+ * \param ls sizes of launch blocks
+ * \param shared amount of dynamic shared memory to allocate
+ * \param args table of pointers to arguments
+ * \param s stream to use (NULL for the default stream)
+ */
+GPUARRAY_PUBLIC int GpuKernel_call_s(GpuKernel *k, unsigned int n,
+                                     const size_t *gs, const size_t *ls,
+                                     size_t shared, void **args,
+                                     gpustream *s);
+
 GPUARRAY_PUBLIC const char *GpuKernel_error(const GpuKernel *k, int err);
 
 #ifdef __cplusplus
@@ -0,0 +1,52 @@
+#ifndef GPUARRAY_TRACE_H
+#define GPUARRAY_TRACE_H
+/** \file gpuarray/trace.h
+ *  \brief Built-in tracer.
+ *
+ * When tracing is on, allocations, transfers, kernel compiles and
+ * launches, blas calls and collectives are recorded with their
+ * timestamps and written as a Chrome trace (viewable in
+ * chrome://tracing or Perfetto) when tracing stops.
+ *
+ * Setting the environment variable GPUARRAY_TRACE to a file path
+ * starts tracing when the first context is created and writes the
+ * file at exit.
+ */
+
+#include <gpuarray/config.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef CONFUSE_EMACS
+}
+#endif
+
+/**
+ * Start recording events.
+ *
+ * Each thread records in its own ring buffer, so very long traces
+ * only keep the most recent events of each thread.
+ *
+ * \param path file where the trace will be written
+ *
+ * \returns GA_NO_ERROR or an error code if tracing is already on or
+ * memory could not be allocated.
+ */
+GPUARRAY_PUBLIC int gputrace_start(const char *path);
+
+/**
+ * Stop recording events and write the trace file.
+ *
+ * No other thread should be using the library while this runs.
+ *
+ * \returns GA_NO_ERROR or an error code if tracing is not on or the
+ * file could not be written.
+ */
+GPUARRAY_PUBLIC int gputrace_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -43,6 +43,18 @@ typedef struct _gpuarray_type {
  * List of all built-in types.
  */
 enum GPUARRAY_TYPES {
+/**
+ * Kernel buffer argument that is only written to.  This and
+ * GA_BUFFER_RO are only valid in the argument types for
+ * gpukernel_init() where they let the backend skip some of the
+ * synchronization that GA_BUFFER requires.  They are reported as
+ * GA_BUFFER afterwards.
+ */
+  GA_BUFFER_WO = -3,
+/**
+ * Kernel buffer argument that is only read from.
+ */
+  GA_BUFFER_RO = -2,
   GA_BUFFER = -1,
   GA_BOOL = 0,
   GA_BYTE = 1,
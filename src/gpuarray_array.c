@@ -39,35 +39,36 @@ static uint32_t extcopy_hash(cache_key_t k) {
   return XXH32(k, sizeof(struct extcopy_args), 42);
 }
 
-static int ga_extcopy(GpuArray *dst, const GpuArray *src) {
+/* Input types for the other kernels that share the extcopy cache */
+#define EXTCOPY_FILL     -2
+#define EXTCOPY_ARANGE   -3
+#define EXTCOPY_LINSPACE -4
+
+/*
+ * Get the kernel for `itype` and `otype` from the extcopy cache of
+ * `ctx`, building it with the other arguments if it isn't there.
+ */
+static GpuElemwise *extcopy_kernel(gpucontext *ctx, int itype, int otype,
+                                   const char *expr, unsigned int n,
+                                   gpuelemwise_arg *args, unsigned int nd,
+                                   int flags) {
   struct extcopy_args a, *aa;
-  gpucontext *ctx = GpuArray_context(dst);
   GpuElemwise *k = NULL;
-  void *args[2];
-
-  if (ctx != GpuArray_context(src))
-    return error_set(ctx->err, GA_INVALID_ERROR, "src and dst context differ");
 
-  a.itype = src->typecode;
-  a.otype = dst->typecode;
+  a.itype = itype;
+  a.otype = otype;
 
   if (ctx->extcopy_cache != NULL)
     k = cache_get(ctx->extcopy_cache, &a);
   if (k == NULL) {
-    gpuelemwise_arg gargs[2];
-    gargs[0].name = "src";
-    gargs[0].typecode = src->typecode;
-    gargs[0].flags = GE_READ;
-    gargs[1].name = "dst";
-    gargs[1].typecode = dst->typecode;
-    gargs[1].flags = GE_WRITE;
-    k = GpuElemwise_new(ctx, "", "dst = src", 2, gargs, 0, GE_CONVERT_F16);
+    k = GpuElemwise_new(ctx, "", expr, n, args, nd, flags);
     if (k == NULL)
-      return ctx->err->code;
+      return NULL;
     aa = memdup(&a, sizeof(a));
     if (aa == NULL) {
       GpuElemwise_free(k);
-      return error_sys(ctx->err, "memdup");
+      error_sys(ctx->err, "memdup");
+      return NULL;
     }
     if (ctx->extcopy_cache == NULL)
       ctx->extcopy_cache = cache_twoq(4, 8, 8, 2, extcopy_eq, extcopy_hash,
@@ -75,11 +76,144 @@ static int ga_extcopy(GpuArray *dst, const GpuArray *src) {
                                       (cache_freev_fn)GpuElemwise_free,
                                       ctx->err);
     if (ctx->extcopy_cache == NULL)
-      return ctx->err->code;
-    if (cache_add(ctx->extcopy_cache, aa, k) != 0)
-      return error_set(ctx->err, GA_MISC_ERROR,
-                       "Could not store GpuElemwise copy kernel in context cache");
+      return NULL;
+    if (cache_add(ctx->extcopy_cache, aa, k) != 0) {
+      error_set(ctx->err, GA_MISC_ERROR,
+                "Could not store GpuElemwise copy kernel in context cache");
+      return NULL;
+    }
+  }
+  return k;
+}
+
+/* Most non-trivial dimensions a layout can have before merging */
+#define RECT_MAX_ND 16
+
+/* Fill the pitches of one side of a merged layout of n dimensions */
+static int rect_pitch(unsigned int n, const ssize_t *str,
+                      const size_t *region, ga_rect *r) {
+  r->pitch = n > 1 ? (size_t)str[n-2] : region[0];
+  r->slice = n > 2 ? (size_t)str[n-3] : r->pitch * region[1];
+  if (r->pitch < region[0] || r->slice % r->pitch != 0 ||
+      r->slice < r->pitch * region[1])
+    return -1;
+  return 0;
+}
+
+/*
+ * Try to describe a copy between two layouts of the same shape as a
+ * rectangular copy of at most 3 dimensions.
+ *
+ * Dimensions are ordered by decreasing destination stride and merged
+ * when they are contiguous on both sides.  What remains must be
+ * contiguous rows of `region[0]` bytes, `region[1]` rows to a slice
+ * and `region[2]` slices, with pitches the copy engines accept.
+ *
+ * Returns 0 if the layout fits and -1 otherwise.
+ */
+static int rect_layout(unsigned int nd, const size_t *dims,
+                       const ssize_t *dstr, const ssize_t *sstr,
+                       size_t elsize, size_t *region, ga_rect *dr,
+                       ga_rect *sr) {
+  size_t d[RECT_MAX_ND];
+  ssize_t ds[RECT_MAX_ND], ss[RECT_MAX_ND];
+  unsigned int i, j, n = 0;
+
+  for (i = 0; i < nd; i++) {
+    if (dims[i] == 0) return -1;
+    if (dims[i] == 1) continue;
+    if (n == RECT_MAX_ND || dstr[i] <= 0 || sstr[i] <= 0) return -1;
+    /* Insertion sort by decreasing destination stride */
+    for (j = n; j > 0 && ds[j-1] < dstr[i]; j--) {
+      d[j] = d[j-1];
+      ds[j] = ds[j-1];
+      ss[j] = ss[j-1];
+    }
+    d[j] = dims[i];
+    ds[j] = dstr[i];
+    ss[j] = sstr[i];
+    n++;
   }
+
+  /* Merge inner dimensions into outer ones when contiguous */
+  j = 0;
+  for (i = 1; i < n; i++) {
+    if (ds[j] == ds[i] * (ssize_t)d[i] && ss[j] == ss[i] * (ssize_t)d[i]) {
+      d[j] *= d[i];
+      ds[j] = ds[i];
+      ss[j] = ss[i];
+    } else {
+      j++;
+      d[j] = d[i];
+      ds[j] = ds[i];
+      ss[j] = ss[i];
+    }
+  }
+  if (n > 0) n = j + 1;
+
+  if (n == 0) {
+    region[0] = elsize;
+    region[1] = 1;
+    region[2] = 1;
+  } else {
+    if (n > 3 || (size_t)ds[n-1] != elsize || (size_t)ss[n-1] != elsize)
+      return -1;
+    region[0] = d[n-1] * elsize;
+    region[1] = n > 1 ? d[n-2] : 1;
+    region[2] = n > 2 ? d[n-3] : 1;
+  }
+
+  if (rect_pitch(n, ds, region, dr) != 0 ||
+      rect_pitch(n, ss, region, sr) != 0)
+    return -1;
+  return 0;
+}
+
+static int same_shape(const GpuArray *a, const GpuArray *b) {
+  unsigned int i;
+  if (a->nd != b->nd) return 0;
+  for (i = 0; i < a->nd; i++)
+    if (a->dimensions[i] != b->dimensions[i]) return 0;
+  return 1;
+}
+
+static int ga_extcopy(GpuArray *dst, const GpuArray *src) {
+  gpucontext *ctx = GpuArray_context(dst);
+  gpuelemwise_arg gargs[2];
+  GpuElemwise *k;
+  ga_rect dr, sr;
+  size_t region[3];
+  void *args[2];
+
+  if (ctx != GpuArray_context(src))
+    return error_set(ctx->err, GA_INVALID_ERROR, "src and dst context differ");
+
+  /* Strided slices that map onto a pitched copy skip the kernel.  The
+     driver may still refuse the pitches, the kernel handles those. */
+  if (src->typecode == dst->typecode && ctx->capture == NULL &&
+      ctx->ops->buffer_copy_rect != NULL && same_shape(dst, src) &&
+      rect_layout(dst->nd, dst->dimensions, dst->strides, src->strides,
+                  GpuArray_ITEMSIZE(dst), region, &dr, &sr) == 0) {
+    dr.buf = dst->data;
+    dr.host = NULL;
+    dr.off = dst->offset;
+    sr.buf = src->data;
+    sr.host = NULL;
+    sr.off = src->offset;
+    if (gpudata_copy_rect(&dr, &sr, region, NULL) == GA_NO_ERROR)
+      return GA_NO_ERROR;
+  }
+
+  gargs[0].name = "src";
+  gargs[0].typecode = src->typecode;
+  gargs[0].flags = GE_READ;
+  gargs[1].name = "dst";
+  gargs[1].typecode = dst->typecode;
+  gargs[1].flags = GE_WRITE;
+  k = extcopy_kernel(ctx, src->typecode, dst->typecode, "dst = src", 2,
+                     gargs, 0, GE_CONVERT_F16);
+  if (k == NULL)
+    return ctx->err->code;
   args[0] = (void *)src;
   args[1] = (void *)dst;
   return GpuElemwise_call(k, args, GE_BROADCAST);
@@ -97,8 +231,57 @@ void GpuArray_fix_flags(GpuArray *a) {
   if (GpuArray_is_aligned(a)) a->flags |= GA_ALIGNED;
 }
 
-int GpuArray_empty(GpuArray *a, gpucontext *ctx, int typecode,
-                   unsigned int nd, const size_t *dims, ga_order ord) {
+/*
+ * Get storage for the shape of `a` with `nd` dimensions, inside the
+ * structure if it fits.  The previous storage is not released.
+ */
+static int ga_shape_init(GpuArray *a, unsigned int nd) {
+  if (nd <= GA_INLINE_ND) {
+    a->dimensions = a->inline_dims;
+    a->strides = a->inline_strides;
+    return GA_NO_ERROR;
+  }
+  a->dimensions = calloc(nd, sizeof(size_t));
+  a->strides = calloc(nd, sizeof(ssize_t));
+  if (a->dimensions == NULL || a->strides == NULL) {
+    free(a->dimensions);
+    free(a->strides);
+    a->dimensions = NULL;
+    a->strides = NULL;
+    return GA_MEMORY_ERROR;
+  }
+  return GA_NO_ERROR;
+}
+
+static void ga_shape_free(GpuArray *a) {
+  if (a->dimensions != a->inline_dims)
+    free(a->dimensions);
+  if (a->strides != a->inline_strides)
+    free(a->strides);
+}
+
+/*
+ * Replace the shape of `a` with the `nd` dimensions computed in `t`
+ * (from ga_shape_init()), which gives up its storage.
+ */
+static void ga_shape_move(GpuArray *a, GpuArray *t, unsigned int nd) {
+  ga_shape_free(a);
+  if (t->dimensions == t->inline_dims) {
+    memcpy(a->inline_dims, t->inline_dims, nd*sizeof(size_t));
+    memcpy(a->inline_strides, t->inline_strides, nd*sizeof(ssize_t));
+    a->dimensions = a->inline_dims;
+    a->strides = a->inline_strides;
+  } else {
+    a->dimensions = t->dimensions;
+    a->strides = t->strides;
+  }
+  a->nd = nd;
+}
+
+/* Allocate from the scratch arena of `ctx` if `scratch` is set */
+static int ga_empty(GpuArray *a, gpucontext *ctx, int typecode,
+                    unsigned int nd, const size_t *dims, ga_order ord,
+                    int scratch) {
   size_t size = gpuarray_get_elsize(typecode);
   unsigned int i;
   int res = GA_NO_ERROR;
@@ -127,24 +310,28 @@ int GpuArray_empty(GpuArray *a, gpucontext *ctx, int typecode,
   size += 64;
 #endif
 
-  a->data = gpudata_alloc(ctx, size, NULL, 0, &res);
-  if (a->data == NULL) return ctx->err->code;
+  if (scratch) {
+    res = gpudata_scratch_alloc(ctx, NULL, size, NULL, &a->data, &a->offset);
+    if (res != GA_NO_ERROR) return res;
+  } else {
+    a->data = gpudata_alloc(ctx, size, NULL, 0, &res);
+    if (a->data == NULL) return ctx->err->code;
+    a->offset = 0;
+  }
   a->nd = nd;
 #ifdef DEBUG
-  a->offset = 64;
-#else
-  a->offset = 0;
+  a->offset += 64;
 #endif
   a->typecode = typecode;
-  a->dimensions = calloc(nd, sizeof(size_t));
-  a->strides = calloc(nd, sizeof(ssize_t));
   /* F/C distinction comes later */
   a->flags = GA_BEHAVED;
-  if (a->dimensions == NULL || a->strides == NULL) {
-    GpuArray_clear(a);
+  if (ga_shape_init(a, nd) != GA_NO_ERROR) {
+    if (scratch)
+      GpuArray_scratch_clear(a);
+    else
+      GpuArray_clear(a);
     return error_sys(ctx->err, "calloc");
   }
-  /* Mult will not overflow since calloc succeded */
   memcpy(a->dimensions, dims, sizeof(size_t)*nd);
 
   size = gpuarray_get_elsize(typecode);
@@ -174,6 +361,11 @@ int GpuArray_empty(GpuArray *a, gpucontext *ctx, int typecode,
   return GA_NO_ERROR;
 }
 
+int GpuArray_empty(GpuArray *a, gpucontext *ctx, int typecode,
+                   unsigned int nd, const size_t *dims, ga_order ord) {
+  return ga_empty(a, ctx, typecode, nd, dims, ord, 0);
+}
+
 int GpuArray_zeros(GpuArray *a, gpucontext *ctx,
                    int typecode, unsigned int nd, const size_t *dims,
                    ga_order ord) {
@@ -202,10 +394,8 @@ int GpuArray_fromdata(GpuArray *a, gpudata *data, size_t offset, int typecode,
   a->nd = nd;
   a->offset = offset;
   a->typecode = typecode;
-  a->dimensions = calloc(nd, sizeof(size_t));
-  a->strides = calloc(nd, sizeof(ssize_t));
   a->flags = (writeable ? GA_WRITEABLE : 0);
-  if (a->dimensions == NULL || a->strides == NULL) {
+  if (ga_shape_init(a, nd) != GA_NO_ERROR) {
     GpuArray_clear(a);
     return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
   }
@@ -225,9 +415,7 @@ int GpuArray_view(GpuArray *v, const GpuArray *a) {
   v->offset = a->offset;
   v->typecode = a->typecode;
   v->flags = a->flags;
-  v->dimensions = calloc(v->nd, sizeof(size_t));
-  v->strides = calloc(v->nd, sizeof(ssize_t));
-  if (v->dimensions == NULL || v->strides == NULL) {
+  if (ga_shape_init(v, v->nd) != GA_NO_ERROR) {
     GpuArray_clear(v);
     return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
   }
@@ -245,6 +433,7 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
   gpucontext *ctx = GpuArray_context(a);
   unsigned int i, new_i;
   unsigned int new_nd = a->nd;
+  GpuArray t;
   size_t *newdims;
   ssize_t *newstrs;
   size_t new_offset = a->offset;
@@ -255,20 +444,16 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
   for (i = 0; i < a->nd; i++) {
     if (steps[i] == 0) new_nd -= 1;
   }
-  newdims = calloc(new_nd, sizeof(size_t));
-  newstrs = calloc(new_nd, sizeof(ssize_t));
-  if (newdims == NULL || newstrs == NULL) {
-    free(newdims);
-    free(newstrs);
+  if (ga_shape_init(&t, new_nd) != GA_NO_ERROR)
     return error_sys(ctx->err, "calloc");
-  }
+  newdims = t.dimensions;
+  newstrs = t.strides;
 
   new_i = 0;
   for (i = 0; i < a->nd; i++) {
     if (starts[i] < -1 || (starts[i] > 0 &&
                            (size_t)starts[i] > a->dimensions[i])) {
-      free(newdims);
-      free(newstrs);
+      ga_shape_free(&t);
       return error_fmt(ctx->err, GA_VALUE_ERROR,
                        "Invalid slice value: slice(%lld, %lld, %lld) when "
                        "indexing array on dimension %u of length %lld",
@@ -276,8 +461,7 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
     }
     if (steps[i] == 0 &&
         (starts[i] == -1 || (size_t)starts[i] >= a->dimensions[i])) {
-      free(newdims);
-      free(newstrs);
+      ga_shape_free(&t);
       return error_fmt(ctx->err, GA_VALUE_ERROR,
                        "Invalid slice value: slice(%lld, %lld, %lld) when "
                        "indexing array on dimension %u of length %lld",
@@ -288,8 +472,7 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
       if ((stops[i] < -1 || (stops[i] > 0 &&
                              (size_t)stops[i] > a->dimensions[i])) ||
           (stops[i]-starts[i])/steps[i] < 0) {
-        free(newdims);
-        free(newstrs);
+        ga_shape_free(&t);
         return error_fmt(ctx->err, GA_VALUE_ERROR,
                          "Invalid slice value: slice(%lld, %lld, %lld) when "
                          "indexing array on dimension %u of length %lld",
@@ -301,12 +484,8 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
       new_i++;
     }
   }
-  a->nd = new_nd;
   a->offset = new_offset;
-  free(a->dimensions);
-  a->dimensions = newdims;
-  free(a->strides);
-  a->strides = newstrs;
+  ga_shape_move(a, &t, new_nd);
   GpuArray_fix_flags(a);
 
   return GA_NO_ERROR;
@@ -353,9 +532,9 @@ static int gen_take1_kernel(GpuKernel *k, gpucontext *ctx, char **err_str,
                "GLOBAL_MEM const %s *v, ga_size v_off,",
                gpuarray_get_type(a->typecode)->cluda_name,
                gpuarray_get_type(v->typecode)->cluda_name);
-  atypes[apos++] = GA_BUFFER;
+  atypes[apos++] = GA_BUFFER_WO;
   atypes[apos++] = GA_SIZE;
-  atypes[apos++] = GA_BUFFER;
+  atypes[apos++] = GA_BUFFER_RO;
   atypes[apos++] = GA_SIZE;
   for (i = 0; i < v->nd; i++) {
     strb_appendf(&sb, " ga_ssize s%u, ga_size d%u,", i, i);
@@ -365,7 +544,7 @@ static int gen_take1_kernel(GpuKernel *k, gpucontext *ctx, char **err_str,
   strb_appendf(&sb, " GLOBAL_MEM const %s *ind, ga_size i_off, "
                "ga_size n0, ga_size n1, GLOBAL_MEM int* err) {\n",
                gpuarray_get_type(ind->typecode)->cluda_name);
-  atypes[apos++] = GA_BUFFER;
+  atypes[apos++] = GA_BUFFER_RO;
   atypes[apos++] = GA_SIZE;
   atypes[apos++] = GA_SIZE;
   atypes[apos++] = GA_SIZE;
@@ -547,6 +726,354 @@ out:
   return err;
 }
 
+/* Kinds of scatter: plain store, atomic add, add over sorted indices */
+#define SCATTER_PUT 0
+#define SCATTER_ADD 1
+#define SCATTER_ADD_SORTED 2
+
+/*
+ * Longest piece of a run of equal indices summed by one thread in the
+ * sorted scatter-add.  Longer runs are cut at multiples of this and
+ * the pieces are added atomically.
+ */
+#define SCATTER_PIECE 32
+
+/* Suffix of the atom_add_* helper for a type, 0 if there is none */
+static char atom_add_suffix(int typecode) {
+  switch (typecode) {
+  case GA_INT: return 'i';
+  case GA_UINT: return 'I';
+  case GA_LONG: return 'l';
+  case GA_ULONG: return 'L';
+  case GA_FLOAT: return 'f';
+  case GA_DOUBLE: return 'd';
+  case GA_HALF: return 'e';
+  default: return 0;
+  }
+}
+
+static int gen_scatter_kernel(GpuKernel *k, gpucontext *ctx, char **err_str,
+                              GpuArray *a, const GpuArray *v,
+                              const GpuArray *ind, int addr32, int kind) {
+  strb sb = STRB_STATIC_INIT;
+  int *atypes;
+  const char *atype = gpuarray_get_type(a->typecode)->cluda_name;
+  const char *vtype = gpuarray_get_type(v->typecode)->cluda_name;
+  const char *itype = gpuarray_get_type(ind->typecode)->cluda_name;
+  char *sz, *ssz;
+  unsigned int i, i2;
+  unsigned int nargs, apos;
+  int flags = 0;
+  int res;
+
+  nargs = 9 + 2 * a->nd;
+
+  atypes = calloc(nargs, sizeof(int));
+  if (atypes == NULL)
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+
+  if (addr32) {
+    sz = "ga_uint";
+    ssz = "ga_int";
+  } else {
+    sz = "ga_size";
+    ssz = "ga_ssize";
+  }
+
+  apos = 0;
+  strb_appendf(&sb, "#include \"cluda.h\"\n"
+               "KERNEL void scatter(GLOBAL_MEM %s *a, ga_size a_off,",
+               atype);
+  atypes[apos++] = kind == SCATTER_PUT ? GA_BUFFER_WO : GA_BUFFER;
+  atypes[apos++] = GA_SIZE;
+  for (i = 0; i < a->nd; i++) {
+    strb_appendf(&sb, " ga_ssize s%u, ga_size d%u,", i, i);
+    atypes[apos++] = GA_SSIZE;
+    atypes[apos++] = GA_SIZE;
+  }
+  strb_appendf(&sb, " GLOBAL_MEM const %s *v, ga_size v_off,"
+               " GLOBAL_MEM const %s *ind, ga_size i_off, "
+               "ga_size n0, ga_size n1, GLOBAL_MEM int* err) {\n",
+               vtype, itype);
+  atypes[apos++] = GA_BUFFER_RO;
+  atypes[apos++] = GA_SIZE;
+  atypes[apos++] = GA_BUFFER_RO;
+  atypes[apos++] = GA_SIZE;
+  atypes[apos++] = GA_SIZE;
+  atypes[apos++] = GA_SIZE;
+  atypes[apos++] = GA_BUFFER;
+  assert(apos == nargs);
+  strb_appendf(&sb, "  const %s idx0 = LDIM_0 * GID_0 + LID_0;\n"
+               "  const %s numThreads0 = LDIM_0 * GDIM_0;\n"
+               "  const %s idx1 = LDIM_1 * GID_1 + LID_1;\n"
+               "  const %s numThreads1 = LDIM_1 * GDIM_1;\n"
+               "  %s i0, i1;\n", sz, sz, sz, sz, sz);
+  strb_appends(&sb, "  if (idx0 >= n0 || idx1 >= n1) return;\n");
+  strb_appendf(&sb, "  v = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)v) + v_off);\n"
+               "  ind = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)ind) + i_off);\n",
+               vtype, itype);
+  strb_appendf(&sb, "  for (i0 = idx0; i0 < n0; i0 += numThreads0) {\n"
+               "    %s ii0 = ind[i0];\n"
+               "    %s pos0 = a_off;\n", ssz, sz);
+  strb_appends(&sb, "    if (ii0 < 0) ii0 += d0;\n");
+  /*
+   * Only the first of a piece of a run of equal indices does the
+   * work.  It sums the rows up to the end of the run or of the piece
+   * and uses an atomic add only if the run goes on in another piece.
+   * Indices are compared after wrapping.
+   */
+  if (kind == SCATTER_ADD_SORTED)
+    strb_appendf(&sb, "    %s e0 = i0 - i0 %% %u + %u, j0;\n"
+                 "    %s ie;\n"
+                 "    int shared = 0;\n"
+                 "    if (i0 > 0) {\n"
+                 "      ie = ind[i0 - 1];\n"
+                 "      if (ie < 0) ie += d0;\n"
+                 "      if (ie == ii0) {\n"
+                 "        if (i0 %% %u != 0) continue;\n"
+                 "        shared = 1;\n"
+                 "      }\n"
+                 "    }\n"
+                 "    if (e0 > n0) e0 = n0;\n"
+                 "    for (j0 = i0 + 1; j0 < e0; j0++) {\n"
+                 "      ie = ind[j0];\n"
+                 "      if (ie < 0) ie += d0;\n"
+                 "      if (ie != ii0) break;\n"
+                 "    }\n"
+                 "    if (j0 == e0 && e0 < n0) {\n"
+                 "      ie = ind[e0];\n"
+                 "      if (ie < 0) ie += d0;\n"
+                 "      if (ie == ii0) shared = 1;\n"
+                 "    }\n"
+                 "    e0 = j0;\n",
+                 sz, SCATTER_PIECE, SCATTER_PIECE, ssz, SCATTER_PIECE);
+  strb_appendf(&sb, "    if ((ii0 < 0) || (ii0 >= (%s)d0)) {\n"
+               "      *err = -1;\n"
+               "      continue;\n"
+               "    }\n"
+               "    pos0 += ii0 * (%s)s0;\n"
+               "    for (i1 = idx1; i1 < n1; i1 += numThreads1) {\n"
+               "      %s p = pos0;\n"
+               "      GLOBAL_MEM %s *dst;\n", ssz, sz, sz, atype);
+  if (a->nd > 1) {
+    strb_appendf(&sb, "      %s pos, ii = i1;\n", sz);
+    for (i2 = a->nd; i2 > 1; i2--) {
+      i = i2 - 1;
+      if (i > 1)
+        strb_appendf(&sb, "      pos = ii %% (%s)d%u;\n"
+                     "      ii /= (%s)d%u;\n", sz, i, sz, i);
+      else
+        strb_appends(&sb, "      pos = ii;\n");
+      strb_appendf(&sb, "      p += pos * (%s)s%u;\n", ssz, i);
+    }
+  }
+  strb_appendf(&sb, "      dst = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)a) + p);\n",
+               atype);
+  switch (kind) {
+  case SCATTER_PUT:
+    strb_appendf(&sb, "      *dst = v[i0*((%s)n1) + i1];\n", sz);
+    break;
+  case SCATTER_ADD:
+    strb_appendf(&sb, "      atom_add_%cg(dst, v[i0*((%s)n1) + i1]);\n",
+                 atom_add_suffix(a->typecode), sz);
+    break;
+  case SCATTER_ADD_SORTED:
+    /* Half values are summed as floats */
+    if (a->typecode == GA_HALF)
+      strb_appendf(&sb, "      ga_float s = ga_half2float(v[i0*((%s)n1) + i1]);\n"
+                   "      %s j;\n"
+                   "      for (j = i0 + 1; j < e0; j++)\n"
+                   "        s += ga_half2float(v[j*((%s)n1) + i1]);\n"
+                   "      if (shared)\n"
+                   "        atom_add_eg(dst, ga_float2half(s));\n"
+                   "      else\n"
+                   "        *dst = ga_float2half(ga_half2float(*dst) + s);\n",
+                   sz, sz, sz);
+    else
+      strb_appendf(&sb, "      %s s = v[i0*((%s)n1) + i1];\n"
+                   "      %s j;\n"
+                   "      for (j = i0 + 1; j < e0; j++)\n"
+                   "        s += v[j*((%s)n1) + i1];\n"
+                   "      if (shared)\n"
+                   "        atom_add_%cg(dst, s);\n"
+                   "      else\n"
+                   "        *dst += s;\n",
+                   atype, sz, sz, sz, atom_add_suffix(a->typecode));
+    break;
+  }
+  strb_appends(&sb, "    }\n"
+               "  }\n"
+               "}\n");
+  if (strb_error(&sb)) {
+    res = error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+    goto bail;
+  }
+  flags |= gpuarray_type_flags(a->typecode, v->typecode, GA_BYTE, -1);
+  /* Lets the backend refuse the kernel before trying to build it */
+  if (kind != SCATTER_PUT && gpuarray_get_elsize(a->typecode) == 8)
+    flags |= GA_USE_ATOM64;
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "scatter",
+                       nargs, atypes, flags, err_str);
+bail:
+  free(atypes);
+  strb_clear(&sb);
+  return res;
+}
+
+static int ga_scatter(GpuArray *a, const GpuArray *v, const GpuArray *i,
+                      int check_error, int kind) {
+  gpucontext *ctx = GpuArray_context(a);
+  size_t n[2], ls[2] = {0, 0}, gs[2] = {0, 0};
+  size_t pl;
+  gpudata *errbuf;
+#if DEBUG
+  char *errstr = NULL;
+#endif
+  GpuKernel k;
+  unsigned int j;
+  unsigned int argp;
+  int err, kerr = 0;
+  int addr32 = 0;
+
+  if (!GpuArray_ISWRITEABLE(a))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination array not writeable");
+
+  if (!GpuArray_ISALIGNED(a) || !GpuArray_ISALIGNED(v) ||
+      !GpuArray_ISALIGNED(i))
+    return error_fmt(ctx->err, GA_UNALIGNED_ERROR,
+                     "Not all arrays are aligned: a (%d), v (%d), i (%d)",
+                     GpuArray_ISALIGNED(a), GpuArray_ISALIGNED(v), GpuArray_ISALIGNED(i));
+
+  if (kind != SCATTER_PUT) {
+    if (a->typecode != v->typecode)
+      return error_set(ctx->err, GA_INVALID_ERROR,
+                       "Destination (a) and values (v) must have the same type");
+    /* Long runs in the sorted case also need atomics */
+    if (atom_add_suffix(a->typecode) == 0)
+      return error_fmt(ctx->err, GA_UNSUPPORTED_ERROR,
+                       "No atomic add for type %s",
+                       gpuarray_get_type(a->typecode)->cluda_name);
+  }
+
+  /* v and i have to be C contiguous */
+  if (!GpuArray_IS_C_CONTIGUOUS(v))
+    return error_set(ctx->err, GA_INVALID_ERROR, "Value array (v) not C-contiguous");
+  if (!GpuArray_IS_C_CONTIGUOUS(i))
+    return error_set(ctx->err, GA_INVALID_ERROR, "Index array (i) not C-contiguous");
+
+  /* Check that the dimensions match namely v[0] == i[0] and v[>0] == a[>0] */
+  if (v->nd == 0 || a->nd == 0 || i->nd != 1 || a->nd != v->nd)
+    return error_fmt(ctx->err, GA_INVALID_ERROR, "Dimension mismatch. "
+                     "v->nd = %llu, a->nd = %llu, i->nd = %llu",
+                     v->nd, a->nd, i->nd);
+  if (v->dimensions[0] != i->dimensions[0])
+    return error_fmt(ctx->err, GA_INVALID_ERROR, "Dimension mismatch. "
+                     "v->dimensions[0] = %llu, i->dimensions[0] = %llu",
+                     v->dimensions[0], i->dimensions[0]);
+
+  n[0] = i->dimensions[0];
+  n[1] = 1;
+
+  for (j = 1; j < a->nd; j++) {
+    if (a->dimensions[j] != v->dimensions[j])
+      return error_fmt(ctx->err, GA_INVALID_ERROR, "Dimension mismatch. "
+                       "a->dimensions[%llu] = %llu, v->dimensions[%llu] = %llu",
+                       j, a->dimensions[j], j, v->dimensions[j]);
+    n[1] *= a->dimensions[j];
+  }
+
+  if (n[0] * n[1] == 0)
+    return GA_NO_ERROR;
+
+  if (n[0] * n[1] < SADDR32_MAX) {
+    addr32 = 1;
+  }
+
+  err = gpudata_property(a->data, GA_CTX_PROP_ERRBUF, &errbuf);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  err = gen_scatter_kernel(&k, ctx,
+#if DEBUG
+                           &errstr,
+#else
+                           NULL,
+#endif
+                           a, v, i, addr32, kind);
+#if DEBUG
+  if (errstr != NULL) {
+    fprintf(stderr, "%s\n", errstr);
+    free(errstr);
+  }
+#endif
+  if (err != GA_NO_ERROR)
+    return err;
+
+  err = GpuKernel_sched(&k, n[0]*n[1], &gs[1], &ls[1]);
+  if (err != GA_NO_ERROR)
+    goto out;
+
+  /* Same scheduling as take1 */
+  err = gpukernel_property(k.k, GA_KERNEL_PROP_PREFLSIZE, &pl);
+  ls[0] = ls[1] / pl;
+  ls[1] = pl;
+  if (n[1] > n[0]) {
+    pl = ls[0];
+    ls[0] = ls[1];
+    ls[1] = pl;
+    gs[0] = 1;
+  } else {
+    gs[0] = gs[1];
+    gs[1] = 1;
+  }
+
+  argp = 0;
+  GpuKernel_setarg(&k, argp++, a->data);
+  GpuKernel_setarg(&k, argp++, (void *)&a->offset);
+  for (j = 0; j < a->nd; j++) {
+    GpuKernel_setarg(&k, argp++, &a->strides[j]);
+    GpuKernel_setarg(&k, argp++, &a->dimensions[j]);
+  }
+  GpuKernel_setarg(&k, argp++, v->data);
+  /* The casts are to avoid a warning about const */
+  GpuKernel_setarg(&k, argp++, (void *)&v->offset);
+  GpuKernel_setarg(&k, argp++, i->data);
+  GpuKernel_setarg(&k, argp++, (void *)&i->offset);
+  GpuKernel_setarg(&k, argp++, &n[0]);
+  GpuKernel_setarg(&k, argp++, &n[1]);
+  GpuKernel_setarg(&k, argp++, errbuf);
+
+  err = GpuKernel_call(&k, 2, gs, ls, 0, NULL);
+  if (check_error && err == GA_NO_ERROR) {
+    err = gpudata_read(&kerr, errbuf, 0, sizeof(int));
+    if (err == GA_NO_ERROR && kerr != 0) {
+      err = error_set(ctx->err, GA_VALUE_ERROR, "Index out of bounds");
+      kerr = 0;
+      /* We suppose this will not fail */
+      gpudata_write(errbuf, 0, &kerr, sizeof(int));
+    }
+  }
+
+out:
+  GpuKernel_clear(&k);
+  return err;
+}
+
+int GpuArray_put1(GpuArray *a, const GpuArray *v, const GpuArray *i,
+                  int check_error) {
+  return ga_scatter(a, v, i, check_error, SCATTER_PUT);
+}
+
+int GpuArray_scatter_add(GpuArray *a, const GpuArray *v, const GpuArray *i,
+                         int check_error) {
+  return ga_scatter(a, v, i, check_error, SCATTER_ADD);
+}
+
+int GpuArray_scatter_add_sorted(GpuArray *a, const GpuArray *v,
+                                const GpuArray *i, int check_error) {
+  return ga_scatter(a, v, i, check_error, SCATTER_ADD_SORTED);
+}
+
 int GpuArray_setarray(GpuArray *a, const GpuArray *v) {
   gpucontext *ctx = GpuArray_context(a);
   GpuArray tv;
@@ -627,6 +1154,7 @@ int GpuArray_reshape(GpuArray *res, const GpuArray *a, unsigned int nd,
 int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
                              const size_t *newdims, ga_order ord) {
   gpucontext *ctx = GpuArray_context(a);
+  GpuArray t;
   ssize_t *newstrides;
   size_t *tmpdims;
   size_t np;
@@ -666,9 +1194,9 @@ int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
     goto do_final_copy;
   }
 
-  newstrides = calloc(nd, sizeof(ssize_t));
-  if (newstrides == NULL)
+  if (ga_shape_init(&t, nd) != GA_NO_ERROR)
     return error_sys(ctx->err, "calloc");
+  newstrides = t.strides;
 
   if (newsize != 0) {
     while (ni < nd && oi < a->nd) {
@@ -720,32 +1248,19 @@ int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
     }
   }
 
-  /* We can reuse newstrides since it was allocated in this function.
-     Can't do the same with newdims (which is a parameter). */
-  tmpdims = calloc(nd, sizeof(size_t));
-  if (tmpdims == NULL) {
-    return error_sys(ctx->err, "calloc");
-  }
-  memcpy(tmpdims, newdims, nd*sizeof(size_t));
-  a->nd = nd;
-  free(a->dimensions);
-  free(a->strides);
-  a->dimensions = tmpdims;
-  a->strides = newstrides;
+  memcpy(t.dimensions, newdims, nd*sizeof(size_t));
+  ga_shape_move(a, &t, nd);
 
   goto fix_flags;
  need_copy:
-  free(newstrides);
+  ga_shape_free(&t);
   return error_set(ctx->err, GA_COPY_ERROR, "Copy is needed but disallowed by parameters");
 
  do_final_copy:
-  tmpdims = calloc(nd, sizeof(size_t));
-  newstrides = calloc(nd, sizeof(ssize_t));
-  if (tmpdims == NULL || newstrides == NULL) {
-    free(tmpdims);
-    free(newstrides);
+  if (ga_shape_init(&t, nd) != GA_NO_ERROR)
     return error_sys(ctx->err, "calloc");
-  }
+  tmpdims = t.dimensions;
+  newstrides = t.strides;
   memcpy(tmpdims, newdims, nd*sizeof(size_t));
   if (nd > 0) {
     if (ord == GA_F_ORDER) {
@@ -760,11 +1275,7 @@ int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
       }
     }
   }
-  free(a->dimensions);
-  free(a->strides);
-  a->nd = nd;
-  a->dimensions = tmpdims;
-  a->strides = newstrides;
+  ga_shape_move(a, &t, nd);
 
  fix_flags:
   GpuArray_fix_flags(a);
@@ -784,19 +1295,17 @@ int GpuArray_transpose(GpuArray *res, const GpuArray *a,
 
 int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
   gpucontext *ctx = GpuArray_context(a);
+  GpuArray t;
   size_t *newdims;
   ssize_t *newstrs;
   unsigned int i;
   unsigned int j;
   unsigned int k;
 
-  newdims = calloc(a->nd, sizeof(size_t));
-  newstrs = calloc(a->nd, sizeof(ssize_t));
-  if (newdims == NULL || newstrs == NULL) {
-    free(newdims);
-    free(newstrs);
+  if (ga_shape_init(&t, a->nd) != GA_NO_ERROR)
     return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
-  }
+  newdims = t.dimensions;
+  newstrs = t.strides;
 
   for (i = 0; i < a->nd; i++) {
     if (new_axes == NULL) {
@@ -806,8 +1315,7 @@ int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
       // Repeated axes will lead to a broken output
       for (k = 0; k < i; k++)
         if (j == new_axes[k]) {
-          free(newdims);
-          free(newstrs);
+          ga_shape_free(&t);
           return error_fmt(ctx->err, GA_VALUE_ERROR,
                            "Repeated axes in transpose: new_axes[%u] == new_axes[%u] == %u",
                            i, k, j);
@@ -817,10 +1325,7 @@ int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
     newstrs[i] = a->strides[j];
   }
 
-  free(a->dimensions);
-  free(a->strides);
-  a->dimensions = newdims;
-  a->strides = newstrs;
+  ga_shape_move(a, &t, a->nd);
 
   GpuArray_fix_flags(a);
 
@@ -830,8 +1335,7 @@ int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
 void GpuArray_clear(GpuArray *a) {
   if (a->data)
     gpudata_release(a->data);
-  free(a->dimensions);
-  free(a->strides);
+  ga_shape_free(a);
   memset(a, 0, sizeof(*a));
 }
 
@@ -876,20 +1380,241 @@ int GpuArray_move(GpuArray *dst, const GpuArray *src) {
   return gpudata_move(dst->data, dst->offset, src->data, src->offset, sz);
 }
 
+/*
+ * Pack (or unpack) `count` elements of a strided host layout, starting
+ * from element `first` in C order, to (or from) `buf`.  `idx` is
+ * scratch space for `nd` indexes.
+ */
+static void host_pack(char *host, const ssize_t *hstr, unsigned int nd,
+                      const size_t *dims, size_t elsize, size_t first,
+                      size_t count, char *buf, size_t *idx, int pack) {
+  char *p = host;
+  size_t run;
+  unsigned int i;
+
+  for (i = nd; i > 0; i--) {
+    idx[i-1] = first % dims[i-1];
+    first /= dims[i-1];
+    p += (ssize_t)idx[i-1] * hstr[i-1];
+  }
+  while (count > 0) {
+    run = 1;
+    if (nd > 0 && hstr[nd-1] == (ssize_t)elsize) {
+      run = dims[nd-1] - idx[nd-1];
+      if (run > count) run = count;
+    }
+    if (pack)
+      memcpy(buf, p, run * elsize);
+    else
+      memcpy(p, buf, run * elsize);
+    buf += run * elsize;
+    count -= run;
+    if (nd == 0) break;
+    idx[nd-1] += run;
+    p += (ssize_t)run * hstr[nd-1];
+    for (i = nd; i > 0 && idx[i-1] == dims[i-1]; i--) {
+      p -= hstr[i-1] * (ssize_t)dims[i-1];
+      idx[i-1] = 0;
+      if (i > 1) {
+        idx[i-2]++;
+        p += hstr[i-2];
+      }
+    }
+  }
+}
+
+struct host_pack_args {
+  char *host;
+  const ssize_t *hstr;
+  const size_t *dims;
+  size_t *idx;
+  size_t elsize;
+  unsigned int nd;
+  int pack;
+};
+
+static int host_pack_stage(char *stage, size_t pos, size_t len, void *arg) {
+  struct host_pack_args *p = arg;
+  host_pack(p->host, p->hstr, p->nd, p->dims, p->elsize, pos / p->elsize,
+            len / p->elsize, stage, p->idx, p->pack);
+  return GA_NO_ERROR;
+}
+
+/*
+ * Copy between an array and host memory with strides `hstr` (in bytes,
+ * for the same shape as the array).
+ *
+ * Layouts that fit are a single rectangular copy.  Otherwise the host
+ * side is packed in chunks by gpudata_stream() so that packing a chunk
+ * overlaps the transfer of the previous one.  An array that is neither
+ * C nor F contiguous goes through a contiguous temporary on the device.
+ */
+static int ga_host_copy(GpuArray *a, char *host, const ssize_t *hstr,
+                        int write) {
+  gpucontext *ctx = GpuArray_context(a);
+  struct host_pack_args pk;
+  GpuArray tmp;
+  GpuArray *dev = a;
+  ga_rect ar, hr;
+  size_t region[3];
+  size_t *dims = NULL;
+  ssize_t *hs = NULL;
+  size_t *idx = NULL;
+  size_t elsize = GpuArray_ITEMSIZE(a);
+  size_t nel = 1;
+  unsigned int i;
+  int fort;
+  int res = GA_NO_ERROR;
+
+  for (i = 0; i < a->nd; i++) nel *= a->dimensions[i];
+  if (nel == 0) return GA_NO_ERROR;
+
+  if (ctx->capture == NULL && ctx->ops->buffer_copy_rect != NULL &&
+      rect_layout(a->nd, a->dimensions, a->strides, hstr, elsize,
+                  region, &ar, &hr) == 0) {
+    ar.buf = a->data;
+    ar.host = NULL;
+    ar.off = a->offset;
+    hr.buf = NULL;
+    hr.host = host;
+    hr.off = 0;
+    if (write)
+      return gpudata_copy_rect(&ar, &hr, region, NULL);
+    return gpudata_copy_rect(&hr, &ar, region, NULL);
+  }
+
+  memset(&tmp, 0, sizeof(tmp));
+  fort = GpuArray_IS_F_CONTIGUOUS(a) && !GpuArray_IS_C_CONTIGUOUS(a);
+  if (!GpuArray_ISONESEGMENT(a)) {
+    res = GpuArray_empty(&tmp, ctx, a->typecode, a->nd, a->dimensions,
+                         GA_C_ORDER);
+    if (res != GA_NO_ERROR) goto out;
+    if (!write) {
+      res = GpuArray_move(&tmp, a);
+      if (res != GA_NO_ERROR) goto out;
+    }
+    dev = &tmp;
+  }
+
+  /* Walk the host in the memory order of the device side */
+  dims = calloc(a->nd + 1, sizeof(size_t));
+  hs = calloc(a->nd + 1, sizeof(ssize_t));
+  idx = calloc(a->nd + 1, sizeof(size_t));
+  if (dims == NULL || hs == NULL || idx == NULL) {
+    res = error_sys(ctx->err, "calloc");
+    goto out;
+  }
+  for (i = 0; i < a->nd; i++) {
+    dims[i] = a->dimensions[fort ? a->nd - 1 - i : i];
+    hs[i] = hstr[fort ? a->nd - 1 - i : i];
+  }
+
+  pk.host = host;
+  pk.hstr = hs;
+  pk.dims = dims;
+  pk.idx = idx;
+  pk.elsize = elsize;
+  pk.nd = a->nd;
+  pk.pack = write;
+  res = gpudata_stream(dev->data, dev->offset, nel * elsize, elsize, write,
+                       host_pack_stage, &pk);
+  if (res == GA_NO_ERROR && write && dev != a)
+    res = GpuArray_move(a, dev);
+
+ out:
+  free(dims);
+  free(hs);
+  free(idx);
+  GpuArray_clear(&tmp);
+  return res;
+}
+
+/* Host strides of a C-contiguous block holding the elements of `a` */
+static ssize_t *host_c_strides(const GpuArray *a, size_t host_sz) {
+  gpucontext *ctx = GpuArray_context(a);
+  ssize_t *hstr;
+  size_t sz = GpuArray_ITEMSIZE(a);
+  unsigned int i;
+
+  for (i = 0; i < a->nd; i++) sz *= a->dimensions[i];
+  if (host_sz != sz) {
+    error_fmt(ctx->err, GA_VALUE_ERROR,
+              "Host size (%llu) differs from the array size (%llu)",
+              (unsigned long long)host_sz, (unsigned long long)sz);
+    return NULL;
+  }
+  hstr = calloc(a->nd + 1, sizeof(ssize_t));
+  if (hstr == NULL) {
+    error_sys(ctx->err, "calloc");
+    return NULL;
+  }
+  sz = GpuArray_ITEMSIZE(a);
+  for (i = a->nd; i > 0; i--) {
+    hstr[i-1] = sz;
+    sz *= a->dimensions[i-1];
+  }
+  return hstr;
+}
+
 int GpuArray_write(GpuArray *dst, const void *src, size_t src_sz) {
   gpucontext *ctx = GpuArray_context(dst);
+  ssize_t *hstr;
+  int res;
   if (!GpuArray_ISWRITEABLE(dst))
     return error_set(ctx->err, GA_VALUE_ERROR, "Destination array (dst) not writeable");
-  if (!GpuArray_ISONESEGMENT(dst))
-    return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Destination array (dst) not one segment");
+  if (!GpuArray_ISONESEGMENT(dst)) {
+    hstr = host_c_strides(dst, src_sz);
+    if (hstr == NULL) return ctx->err->code;
+    res = ga_host_copy(dst, (char *)src, hstr, 1);
+    free(hstr);
+    return res;
+  }
   return gpudata_write(dst->data, dst->offset, src, src_sz);
 }
 
 int GpuArray_read(void *dst, size_t dst_sz, const GpuArray *src) {
   gpucontext *ctx = GpuArray_context(src);
+  ssize_t *hstr;
+  int res;
+  if (!GpuArray_ISONESEGMENT(src)) {
+    hstr = host_c_strides(src, dst_sz);
+    if (hstr == NULL) return ctx->err->code;
+    res = ga_host_copy((GpuArray *)src, dst, hstr, 0);
+    free(hstr);
+    return res;
+  }
+  return gpudata_read(dst, src->data, src->offset, dst_sz);
+}
+
+int GpuArray_write_strided(GpuArray *dst, const void *src,
+                           const ssize_t *src_strides) {
+  gpucontext *ctx = GpuArray_context(dst);
+  if (!GpuArray_ISWRITEABLE(dst))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination array (dst) not writeable");
+  return ga_host_copy(dst, (char *)src, src_strides, 1);
+}
+
+int GpuArray_read_strided(void *dst, const ssize_t *dst_strides,
+                          const GpuArray *src) {
+  return ga_host_copy((GpuArray *)src, dst, dst_strides, 0);
+}
+
+int GpuArray_write_async(GpuArray *dst, const void *src, size_t src_sz,
+                         gpuevent *done) {
+  gpucontext *ctx = GpuArray_context(dst);
+  if (!GpuArray_ISWRITEABLE(dst))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination array (dst) not writeable");
+  if (!GpuArray_ISONESEGMENT(dst))
+    return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Destination array (dst) not one segment");
+  return gpudata_write_async(dst->data, dst->offset, src, src_sz, NULL, done);
+}
+
+int GpuArray_read_async(void *dst, size_t dst_sz, const GpuArray *src,
+                        gpuevent *done) {
+  gpucontext *ctx = GpuArray_context(src);
   if (!GpuArray_ISONESEGMENT(src))
     return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Array (src) not one segment");
-  return gpudata_read(dst, src->data, src->offset, dst_sz);
+  return gpudata_read_async(dst, src->data, src->offset, dst_sz, NULL, done);
 }
 
 int GpuArray_memset(GpuArray *a, int data) {
@@ -899,6 +1624,207 @@ int GpuArray_memset(GpuArray *a, int data) {
   return gpudata_memset(a->data, a->offset, data);
 }
 
+/*
+ * Smallest power of two that the `sz` bytes at `p` repeat with, so
+ * that the backends can use their narrowest native fill.
+ */
+static size_t pattern_period(const void *p, size_t sz) {
+  const unsigned char *b = p;
+  size_t per, i;
+
+  for (per = 1; per < sz && sz % per == 0; per *= 2) {
+    for (i = per; i < sz; i++)
+      if (b[i] != b[i - per]) break;
+    if (i == sz) return per;
+  }
+  return sz;
+}
+
+/*
+ * Fill `a` with a kernel that stores the value in pieces of the
+ * largest unsigned type that divides the element size.
+ */
+static int ga_fill_kernel(GpuArray *a, const void *value) {
+  gpucontext *ctx = GpuArray_context(a);
+  size_t elsize = GpuArray_ITEMSIZE(a);
+  gpuelemwise_arg gargs[2];
+  GpuElemwise *k;
+  GpuArray piece;
+  void *args[2];
+  uint64_t v;
+  size_t unit, i;
+  int typecode;
+  int err = GA_NO_ERROR;
+
+  for (unit = 8; elsize % unit != 0; unit /= 2);
+  switch (unit) {
+  case 8: typecode = GA_ULONG; break;
+  case 4: typecode = GA_UINT; break;
+  case 2: typecode = GA_USHORT; break;
+  default: typecode = GA_UBYTE;
+  }
+
+  gargs[0].name = "dst";
+  gargs[0].typecode = typecode;
+  gargs[0].flags = GE_WRITE;
+  gargs[1].name = "v";
+  gargs[1].typecode = typecode;
+  gargs[1].flags = GE_SCALAR;
+  k = extcopy_kernel(ctx, EXTCOPY_FILL, typecode, "dst = v", 2, gargs, 0, 0);
+  if (k == NULL)
+    return ctx->err->code;
+
+  GA_CHECK(GpuArray_view(&piece, a));
+  piece.typecode = typecode;
+  args[0] = &piece;
+  args[1] = &v;
+  for (i = 0; i < elsize; i += unit) {
+    piece.offset = a->offset + i;
+    GpuArray_fix_flags(&piece);
+    memcpy(&v, (const char *)value + i, unit);
+    err = GpuElemwise_call(k, args, 0);
+    if (err != GA_NO_ERROR) break;
+  }
+  GpuArray_clear(&piece);
+  return err;
+}
+
+int GpuArray_fill(GpuArray *a, const void *value) {
+  gpucontext *ctx = GpuArray_context(a);
+  size_t elsize = GpuArray_ITEMSIZE(a);
+  size_t n = 1;
+  unsigned int i;
+  int err;
+
+  if (!GpuArray_ISWRITEABLE(a))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination array not writeable");
+  for (i = 0; i < a->nd; i++) n *= a->dimensions[i];
+  if (n == 0) return GA_NO_ERROR;
+
+  if (GpuArray_ISONESEGMENT(a)) {
+    err = gpudata_fill(a->data, a->offset, n * elsize, value,
+                       pattern_period(value, elsize));
+    if (err != GA_UNSUPPORTED_ERROR) return err;
+  }
+  return ga_fill_kernel(a, value);
+}
+
+/*
+ * Types that can hold a range: the real ones supported by devices.
+ * The 128-bit integers are left out since the kernels compute in 64
+ * bits.
+ */
+static int range_type(int typecode) {
+  return (typecode >= GA_BOOL && typecode <= GA_DOUBLE &&
+          typecode != GA_LONGLONG && typecode != GA_ULONGLONG) ||
+    typecode == GA_HALF;
+}
+
+int GpuArray_arange(GpuArray *r, gpucontext *ctx, int typecode,
+                    const void *start, const void *step, size_t n) {
+  int stype = typecode == GA_HALF ? GA_FLOAT : typecode;
+  gpuelemwise_arg gargs[3];
+  GpuElemwise *k;
+  void *args[3];
+  int err;
+
+  if (!range_type(typecode))
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Ranges need a real type");
+
+  GA_CHECK(GpuArray_empty(r, ctx, typecode, 1, &n, GA_C_ORDER));
+  if (n == 0) return GA_NO_ERROR;
+
+  gargs[0].name = "r";
+  gargs[0].typecode = typecode;
+  gargs[0].flags = GE_WRITE;
+  gargs[1].name = "start";
+  gargs[1].typecode = stype;
+  gargs[1].flags = GE_SCALAR;
+  gargs[2].name = "step";
+  gargs[2].typecode = stype;
+  gargs[2].flags = GE_SCALAR;
+  k = extcopy_kernel(ctx, EXTCOPY_ARANGE, typecode,
+                     "r = start + ga_i * step", 3, gargs, 1,
+                     GE_INDEX|GE_CONVERT_F16);
+  if (k == NULL) {
+    GpuArray_clear(r);
+    return ctx->err->code;
+  }
+  args[0] = r;
+  args[1] = (void *)start;
+  args[2] = (void *)step;
+  err = GpuElemwise_call(k, args, 0);
+  if (err != GA_NO_ERROR)
+    GpuArray_clear(r);
+  return err;
+}
+
+int GpuArray_linspace(GpuArray *r, gpucontext *ctx, int typecode,
+                      double start, double stop, size_t n, int endpoint) {
+  /* Don't require double support for the float types */
+  int stype = (typecode == GA_FLOAT || typecode == GA_HALF) ?
+    GA_FLOAT : GA_DOUBLE;
+  size_t div = endpoint ? n - 1 : n;
+  union { double d; float f; } v[3];
+  gpuelemwise_arg gargs[5];
+  GpuElemwise *k;
+  void *args[5];
+  size_t last;
+  int err;
+
+  if (!range_type(typecode))
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Ranges need a real type");
+
+  GA_CHECK(GpuArray_empty(r, ctx, typecode, 1, &n, GA_C_ORDER));
+  if (n == 0) return GA_NO_ERROR;
+
+  /* The last point is exactly stop, like numpy does */
+  last = (endpoint && n > 1) ? n - 1 : n;
+  if (stype == GA_FLOAT) {
+    v[0].f = (float)start;
+    v[1].f = (float)stop;
+    v[2].f = div > 0 ? (float)((stop - start) / div) : 0.0f;
+  } else {
+    v[0].d = start;
+    v[1].d = stop;
+    v[2].d = div > 0 ? (stop - start) / div : 0.0;
+  }
+
+  gargs[0].name = "r";
+  gargs[0].typecode = typecode;
+  gargs[0].flags = GE_WRITE;
+  gargs[1].name = "start";
+  gargs[1].typecode = stype;
+  gargs[1].flags = GE_SCALAR;
+  gargs[2].name = "stop";
+  gargs[2].typecode = stype;
+  gargs[2].flags = GE_SCALAR;
+  gargs[3].name = "step";
+  gargs[3].typecode = stype;
+  gargs[3].flags = GE_SCALAR;
+  gargs[4].name = "last";
+  gargs[4].typecode = GA_SIZE;
+  gargs[4].flags = GE_SCALAR;
+  k = extcopy_kernel(ctx, EXTCOPY_LINSPACE, typecode,
+                     "r = ga_i == last ? stop : start + ga_i * step", 5,
+                     gargs, 1, GE_INDEX|GE_CONVERT_F16);
+  if (k == NULL) {
+    GpuArray_clear(r);
+    return ctx->err->code;
+  }
+  args[0] = r;
+  args[1] = &v[0];
+  args[2] = &v[1];
+  args[3] = &v[2];
+  args[4] = &last;
+  err = GpuElemwise_call(k, args, 0);
+  if (err != GA_NO_ERROR)
+    GpuArray_clear(r);
+  return err;
+}
+
 int GpuArray_copy(GpuArray *res, const GpuArray *a, ga_order order) {
   int err;
   err = GpuArray_empty(res, GpuArray_context(a), a->typecode,
@@ -910,6 +1836,30 @@ int GpuArray_copy(GpuArray *res, const GpuArray *a, ga_order order) {
   return err;
 }
 
+int GpuArray_scratch_copy(GpuArray *res, const GpuArray *a, ga_order order) {
+  int err;
+  err = ga_empty(res, GpuArray_context(a), a->typecode, a->nd, a->dimensions,
+                 order, 1);
+  if (err != GA_NO_ERROR) return err;
+  err = GpuArray_move(res, a);
+  if (err != GA_NO_ERROR)
+    GpuArray_scratch_clear(res);
+  return err;
+}
+
+void GpuArray_scratch_clear(GpuArray *a) {
+  gpudata *b = a->data;
+  size_t off = a->offset;
+#ifdef DEBUG
+  off -= 64;
+#endif
+  /* The reference of the array is the one of the temporary */
+  a->data = NULL;
+  GpuArray_clear(a);
+  if (b != NULL)
+    gpudata_scratch_free(gpudata_context(b), NULL, b, off);
+}
+
 int GpuArray_transfer(GpuArray *res, const GpuArray *a) {
   gpucontext *ctx = GpuArray_context(res);
   size_t sz;
@@ -929,6 +1879,228 @@ int GpuArray_transfer(GpuArray *res, const GpuArray *a) {
  return gpudata_transfer(res->data, res->offset, a->data, a->offset, sz);
 }
 
+/*
+ * Pieces per launch of the concat kernel.  This keeps the kernel
+ * arguments well under the 1024 bytes that all OpenCL devices accept.
+ */
+#define CONCAT_SLOTS 16
+#define CONCAT_BLOCK 256
+#define CONCAT_CHUNK 4
+
+/*
+ * Kernel that copies up to `slots` contiguous pieces to (or from, if
+ * `split` is set) their place in a C contiguous array, all in one
+ * launch.  Seen from the concatenation axis, the big array is made of
+ * rows of `rrow` elements and each piece is made of rows of `seg`
+ * elements that start at column `col`.  Blocks find their piece with
+ * gen_slot_select() like the multi kernel of GpuElemwise_call_multi().
+ *
+ * Arguments are nblocks, chunk, r, r_off, rrow and then for each
+ * slot: n, seg, col, start, data and offset.
+ */
+static int gen_concat_kernel(GpuKernel *k, gpucontext *ctx, int typecode,
+                             unsigned int slots, int split) {
+  strb sb = STRB_STATIC_INIT;
+  const char *t = gpuarray_get_type(typecode)->cluda_name;
+  int atypes[5 + 6 * CONCAT_SLOTS];
+  unsigned int s, _s, p;
+  int res;
+
+  p = 0;
+  strb_appendf(&sb, "#include \"cluda.h\"\n"
+               "KERNEL void concat(const ga_size nblocks, const ga_size chunk,"
+               " GLOBAL_MEM %s *r, const ga_size r_off, const ga_size rrow",
+               t);
+  atypes[p++] = GA_SIZE;
+  atypes[p++] = GA_SIZE;
+  atypes[p++] = split ? GA_BUFFER_RO : GA_BUFFER_WO;
+  atypes[p++] = GA_SIZE;
+  atypes[p++] = GA_SIZE;
+  for (s = 0; s < slots; s++) {
+    strb_appendf(&sb, ", const ga_size s%u_n, const ga_size s%u_seg,"
+                 " const ga_size s%u_col, const ga_size s%u_start,"
+                 " GLOBAL_MEM %s *s%u_data, const ga_size s%u_off",
+                 s, s, s, s, t, s, s);
+    atypes[p++] = GA_SIZE;
+    atypes[p++] = GA_SIZE;
+    atypes[p++] = GA_SIZE;
+    atypes[p++] = GA_SIZE;
+    atypes[p++] = split ? GA_BUFFER_WO : GA_BUFFER_RO;
+    atypes[p++] = GA_SIZE;
+  }
+  strb_appendf(&sb, ") {\n"
+               "  ga_size blk, i, end, n, seg, col;\n"
+               "  GLOBAL_MEM %s *p;\n"
+               "  r = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)r) + r_off);\n"
+               "  for (blk = GID_0; blk < nblocks; blk += GDIM_0) {\n",
+               t, t);
+  /* Unused slots start at nblocks so they are never picked */
+  for (_s = slots; _s > 0; _s--) {
+    s = _s - 1;
+    gen_slot_select(&sb, "s", s, slots);
+    strb_appendf(&sb, "      n = s%u_n; seg = s%u_seg; col = s%u_col;\n"
+                 "      p = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)s%u_data) + s%u_off);\n",
+                 s, s, s, t, s, s);
+  }
+  strb_appends(&sb, "    }\n"
+               "    end = i + chunk;\n"
+               "    if (end > n) end = n;\n"
+               "    for (i += LID_0; i < end; i += LDIM_0)\n");
+  if (split)
+    strb_appends(&sb, "      p[i] = r[(i / seg) * rrow + col + i % seg];\n");
+  else
+    strb_appends(&sb, "      r[(i / seg) * rrow + col + i % seg] = p[i];\n");
+  strb_appends(&sb, "  }\n}\n");
+
+  if (strb_error(&sb)) {
+    res = error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+    goto bail;
+  }
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "concat",
+                       p, atypes, 0, NULL);
+bail:
+  strb_clear(&sb);
+  return res;
+}
+
+/*
+ * Size of the unsigned type the concat kernel can move the data of
+ * `r` and the pieces with, or 0 if it can't handle them.  They all
+ * need to have the same type and be C contiguous.
+ */
+static size_t concat_unit(const GpuArray *r, const GpuArray **ps,
+                          size_t n) {
+  size_t elsize = GpuArray_ITEMSIZE(r);
+  size_t unit = 8;
+  size_t i;
+
+  if (!GpuArray_IS_C_CONTIGUOUS(r) || !GpuArray_ISALIGNED(r))
+    return 0;
+  for (i = 0; i < n; i++) {
+    if (ps[i]->typecode != r->typecode || ps[i]->nd != r->nd ||
+        !GpuArray_IS_C_CONTIGUOUS(ps[i]) || !GpuArray_ISALIGNED(ps[i]))
+      return 0;
+  }
+  while (elsize % unit != 0 || r->offset % unit != 0)
+    unit /= 2;
+  for (i = 0; i < n; i++)
+    while (ps[i]->offset % unit != 0)
+      unit /= 2;
+  return unit;
+}
+
+static int concat_call(GpuKernel *k, size_t *vals, unsigned int used,
+                       const GpuArray *fill, size_t ls, size_t max_g) {
+  size_t gs;
+  unsigned int s, p;
+
+  /* Fill the unused slots with empty pieces */
+  for (s = used; s < CONCAT_SLOTS; s++) {
+    vals[2 + 4 * s] = 0;
+    vals[2 + 4 * s + 1] = 1;
+    vals[2 + 4 * s + 2] = 0;
+    vals[2 + 4 * s + 3] = vals[0];
+    p = 5 + 6 * s;
+    GpuKernel_setarg(k, p++, &vals[2 + 4 * s]);
+    GpuKernel_setarg(k, p++, &vals[2 + 4 * s + 1]);
+    GpuKernel_setarg(k, p++, &vals[2 + 4 * s + 2]);
+    GpuKernel_setarg(k, p++, &vals[2 + 4 * s + 3]);
+    GpuKernel_setarg(k, p++, fill->data);
+    GpuKernel_setarg(k, p++, (void *)&fill->offset);
+  }
+  GpuKernel_setarg(k, 0, &vals[0]);
+  GpuKernel_setarg(k, 1, &vals[1]);
+  gs = vals[0];
+  if (gs > max_g) gs = max_g;
+  return GpuKernel_call(k, 1, &gs, &ls, 0, NULL);
+}
+
+/*
+ * Copy the pieces in `ps` into `r` (or `r` into the pieces if `split`
+ * is set) along `axis` with as few launches as possible.  Piece i
+ * starts at starts[i] along the axis, or right after the previous
+ * one if `starts` is NULL.  `unit` comes from concat_unit().
+ */
+static int concat_kernel_copy(const GpuArray *r, const GpuArray **ps,
+                              size_t n, unsigned int axis,
+                              const size_t *starts, size_t unit,
+                              int split) {
+  gpucontext *ctx = GpuArray_context(r);
+  GpuKernel k;
+  size_t vals[2 + 4 * CONCAT_SLOTS];
+  size_t outer = 1, inner, rrow, seg, col = 0;
+  size_t ls, max_g, i, first = 0;
+  unsigned int j, s, used = 0;
+  int typecode;
+  int err;
+
+  switch (unit) {
+  case 8: typecode = GA_ULONG; break;
+  case 4: typecode = GA_UINT; break;
+  case 2: typecode = GA_USHORT; break;
+  default: typecode = GA_UBYTE;
+  }
+
+  inner = GpuArray_ITEMSIZE(r) / unit;
+  for (j = axis + 1; j < r->nd; j++) inner *= r->dimensions[j];
+  for (j = 0; j < axis; j++) outer *= r->dimensions[j];
+  rrow = r->dimensions[axis] * inner;
+  if (outer == 0 || rrow == 0)
+    return GA_NO_ERROR;
+
+  err = gen_concat_kernel(&k, ctx, typecode, CONCAT_SLOTS, split);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  err = gpukernel_property(k.k, GA_KERNEL_PROP_MAXLSIZE, &ls);
+  if (err != GA_NO_ERROR) goto out;
+  if (ls > CONCAT_BLOCK) ls = CONCAT_BLOCK;
+  err = gpukernel_property(k.k, GA_CTX_PROP_MAXGSIZE0, &max_g);
+  if (err != GA_NO_ERROR) goto out;
+
+  GpuKernel_setarg(&k, 2, r->data);
+  GpuKernel_setarg(&k, 3, (void *)&r->offset);
+  GpuKernel_setarg(&k, 4, &rrow);
+
+  vals[0] = 0;
+  vals[1] = ls * CONCAT_CHUNK;
+  for (i = 0; i < n; i++) {
+    if (starts != NULL)
+      col = starts[i] * inner;
+    seg = ps[i]->dimensions[axis] * inner;
+    if (seg == 0) continue;
+    s = used;
+    vals[2 + 4 * s] = outer * seg;
+    vals[2 + 4 * s + 1] = seg;
+    vals[2 + 4 * s + 2] = col;
+    vals[2 + 4 * s + 3] = vals[0];
+    j = 5 + 6 * s;
+    GpuKernel_setarg(&k, j++, &vals[2 + 4 * s]);
+    GpuKernel_setarg(&k, j++, &vals[2 + 4 * s + 1]);
+    GpuKernel_setarg(&k, j++, &vals[2 + 4 * s + 2]);
+    GpuKernel_setarg(&k, j++, &vals[2 + 4 * s + 3]);
+    GpuKernel_setarg(&k, j++, ps[i]->data);
+    GpuKernel_setarg(&k, j++, (void *)&ps[i]->offset);
+    if (used == 0) first = i;
+    vals[0] += (outer * seg + vals[1] - 1) / vals[1];
+    col += seg;
+    used++;
+
+    if (used == CONCAT_SLOTS) {
+      err = concat_call(&k, vals, used, ps[first], ls, max_g);
+      if (err != GA_NO_ERROR) goto out;
+      vals[0] = 0;
+      used = 0;
+    }
+  }
+  if (used > 0)
+    err = concat_call(&k, vals, used, ps[first], ls, max_g);
+
+out:
+  GpuKernel_clear(&k);
+  return err;
+}
+
 int GpuArray_split(GpuArray **rs, const GpuArray *a, size_t n, size_t *p,
                    unsigned int axis) {
   gpucontext *ctx = GpuArray_context(a);
@@ -979,11 +2151,93 @@ int GpuArray_split(GpuArray **rs, const GpuArray *a, size_t n, size_t *p,
   return err;
 }
 
+int GpuArray_split_copy(GpuArray **rs, const GpuArray *a, size_t n,
+                        size_t *p, unsigned int axis) {
+  gpucontext *ctx = GpuArray_context(a);
+  GpuArray *views = NULL;
+  GpuArray **vs = NULL;
+  size_t *dims, *starts;
+  size_t i, ii, unit;
+  int err = GA_NO_ERROR;
+
+  if (axis >= a->nd)
+    return error_fmt(ctx->err, GA_VALUE_ERROR, "Invalid axis. "
+                     "axis = %u, a->nd = %llu", axis, a->nd);
+  for (i = 0; i < n; i++) {
+    if (p[i] > a->dimensions[axis] || (i > 0 && p[i] < p[i-1]))
+      return error_fmt(ctx->err, GA_VALUE_ERROR, "Invalid split point. "
+                       "p[%llu] = %llu, a->dimensions[%u] = %llu",
+                       i, p[i], axis, a->dimensions[axis]);
+  }
+
+  dims = calloc(a->nd, sizeof(size_t));
+  starts = calloc(n + 1, sizeof(size_t));
+  if (dims == NULL || starts == NULL) {
+    free(dims);
+    free(starts);
+    return error_sys(ctx->err, "calloc");
+  }
+  memcpy(dims, a->dimensions, a->nd * sizeof(size_t));
+
+  for (i = 0; i <= n; i++) {
+    starts[i] = i > 0 ? p[i-1] : 0;
+    dims[axis] = (i < n ? p[i] : a->dimensions[axis]) - starts[i];
+    err = GpuArray_empty(rs[i], ctx, a->typecode, a->nd, dims, GA_C_ORDER);
+    if (err != GA_NO_ERROR)
+      break;
+  }
+  free(dims);
+  if (err != GA_NO_ERROR)
+    goto fail;
+
+  unit = concat_unit(a, (const GpuArray **)rs, n + 1);
+  if (unit != 0) {
+    err = concat_kernel_copy(a, (const GpuArray **)rs, n + 1, axis, starts,
+                             unit, 1);
+    if (err != GA_NO_ERROR)
+      goto fail;
+    free(starts);
+    return GA_NO_ERROR;
+  }
+
+  /* Otherwise copy the views one at a time */
+  views = calloc(n + 1, sizeof(GpuArray));
+  vs = calloc(n + 1, sizeof(GpuArray *));
+  if (views == NULL || vs == NULL) {
+    err = error_sys(ctx->err, "calloc");
+    goto fail;
+  }
+  for (ii = 0; ii <= n; ii++)
+    vs[ii] = &views[ii];
+  err = GpuArray_split(vs, a, n, p, axis);
+  if (err != GA_NO_ERROR) {
+    free(vs);
+    vs = NULL;
+    goto fail;
+  }
+  for (ii = 0; ii <= n; ii++) {
+    if (err == GA_NO_ERROR)
+      err = GpuArray_move(rs[ii], vs[ii]);
+    GpuArray_clear(vs[ii]);
+  }
+  if (err == GA_NO_ERROR)
+    goto out;
+
+ fail:
+  for (ii = 0; ii < i && ii <= n; ii++)
+    GpuArray_clear(rs[ii]);
+ out:
+  free(views);
+  free(vs);
+  free(starts);
+  return err;
+}
+
 int GpuArray_concatenate(GpuArray *r, const GpuArray **as, size_t n,
                          unsigned int axis, int restype) {
   gpucontext *ctx = GpuArray_context(as[0]);
   size_t *dims, *res_dims;
-  size_t i, res_off;
+  size_t i, res_off, unit;
   unsigned int p;
   int res_flags;
   int err = GA_NO_ERROR;
@@ -1041,6 +2295,15 @@ int GpuArray_concatenate(GpuArray *r, const GpuArray **as, size_t n,
     return err;
   }
 
+  /* Copy all the pieces with one kernel if their layout allows it */
+  unit = concat_unit(r, as, n);
+  if (unit != 0) {
+    err = concat_kernel_copy(r, as, n, axis, NULL, unit, 0);
+    if (err != GA_NO_ERROR)
+      goto fail;
+    return GA_NO_ERROR;
+  }
+
   res_off = r->offset;
   res_dims = r->dimensions;
   res_flags = r->flags;
@@ -44,7 +44,7 @@ int GpuArray_rdot(GpuArray *X, GpuArray *Y,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Copy required for X");
     else {
-      err = GpuArray_copy(&copyX, X, GA_ANY_ORDER);
+      err = GpuArray_scratch_copy(&copyX, X, GA_ANY_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Xp = &copyX;
@@ -54,7 +54,7 @@ int GpuArray_rdot(GpuArray *X, GpuArray *Y,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Copy required for Y");
     else {
-      err = GpuArray_copy(&copyY, Y, GA_ANY_ORDER);
+      err = GpuArray_scratch_copy(&copyY, Y, GA_ANY_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Yp = &copyY;
@@ -89,10 +89,10 @@ int GpuArray_rdot(GpuArray *X, GpuArray *Y,
           break;
   }
   cleanup:
-   if (Xp == &copyX)
-       GpuArray_clear(&copyX);
    if (Yp == &copyY)
-       GpuArray_clear(&copyY);
+       GpuArray_scratch_clear(&copyY);
+   if (Xp == &copyX)
+       GpuArray_scratch_clear(&copyX);
    return err;
 }
 
@@ -145,7 +145,7 @@ int GpuArray_rgemv(cb_transpose transA, double alpha, GpuArray *A,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Copy required for A");
     else {
-      err = GpuArray_copy(&copyA, A, GA_F_ORDER);
+      err = GpuArray_scratch_copy(&copyA, A, GA_F_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Ap = &copyA;
@@ -155,7 +155,7 @@ int GpuArray_rgemv(cb_transpose transA, double alpha, GpuArray *A,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Copy required for X");
     else {
-      err = GpuArray_copy(&copyX, X, GA_ANY_ORDER);
+      err = GpuArray_scratch_copy(&copyX, X, GA_ANY_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Xp = &copyX;
@@ -194,10 +194,10 @@ int GpuArray_rgemv(cb_transpose transA, double alpha, GpuArray *A,
     break;
   }
  cleanup:
-  if (Ap == &copyA)
-    GpuArray_clear(&copyA);
   if (Xp == &copyX)
-    GpuArray_clear(&copyX);
+    GpuArray_scratch_clear(&copyX);
+  if (Ap == &copyA)
+    GpuArray_scratch_clear(&copyA);
   return err;
 }
 
@@ -257,7 +257,7 @@ int GpuArray_rgemm(cb_transpose transA, cb_transpose transB, double alpha,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Need copy for A");
     else {
-      err = GpuArray_copy(&copyA, A, GA_F_ORDER);
+      err = GpuArray_scratch_copy(&copyA, A, GA_F_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Ap = &copyA;
@@ -267,7 +267,7 @@ int GpuArray_rgemm(cb_transpose transA, cb_transpose transB, double alpha,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Need copy for B");
     else {
-      err = GpuArray_copy(&copyB, B, GA_F_ORDER);
+      err = GpuArray_scratch_copy(&copyB, B, GA_F_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Bp = &copyB;
@@ -347,10 +347,10 @@ int GpuArray_rgemm(cb_transpose transA, cb_transpose transB, double alpha,
   }
 
  cleanup:
-  if (Ap == &copyA)
-    GpuArray_clear(&copyA);
   if (Bp == &copyB)
-    GpuArray_clear(&copyB);
+    GpuArray_scratch_clear(&copyB);
+  if (Ap == &copyA)
+    GpuArray_scratch_clear(&copyA);
   return err;
 }
 
@@ -393,7 +393,7 @@ int GpuArray_rger(double alpha, GpuArray *X, GpuArray *Y, GpuArray *A,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Need copy for X");
     else {
-      err = GpuArray_copy(&copyX, X, GA_ANY_ORDER);
+      err = GpuArray_scratch_copy(&copyX, X, GA_ANY_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Xp = &copyX;
@@ -403,7 +403,7 @@ int GpuArray_rger(double alpha, GpuArray *X, GpuArray *Y, GpuArray *A,
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Need copy for Y");
     else {
-      err = GpuArray_copy(&copyY, Y, GA_ANY_ORDER);
+      err = GpuArray_scratch_copy(&copyY, Y, GA_ANY_ORDER);
       if (err != GA_NO_ERROR)
         goto cleanup;
       Yp = &copyY;
@@ -444,10 +444,10 @@ int GpuArray_rger(double alpha, GpuArray *X, GpuArray *Y, GpuArray *A,
   }
 
  cleanup:
-  if (Xp == &copyX)
-    GpuArray_clear(&copyX);
   if (Yp == &copyY)
-    GpuArray_clear(&copyY);
+    GpuArray_scratch_clear(&copyY);
+  if (Xp == &copyX)
+    GpuArray_scratch_clear(&copyX);
   return err;
 }
 
@@ -529,7 +529,7 @@ int GpuArray_rgemmBatch_3d(cb_transpose transA, cb_transpose transB, double alph
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Need copy for A");
     else {
-      err = GpuArray_copy(&copyA, A, GA_C_ORDER);
+      err = GpuArray_scratch_copy(&copyA, A, GA_C_ORDER);
       cA = 1;
       if (err != GA_NO_ERROR)
         goto cleanup;
@@ -541,7 +541,7 @@ int GpuArray_rgemmBatch_3d(cb_transpose transA, cb_transpose transB, double alph
     if (nocopy)
       return error_set(ctx->err, GA_COPY_ERROR, "Need copy for B");
     else {
-      err = GpuArray_copy(&copyB, B, GA_C_ORDER);
+      err = GpuArray_scratch_copy(&copyB, B, GA_C_ORDER);
       cB = 1;
       if (err != GA_NO_ERROR)
         goto cleanup;
@@ -706,9 +706,9 @@ int GpuArray_rgemmBatch_3d(cb_transpose transA, cb_transpose transB, double alph
   }
 
   cleanup:
-  if (Ap == &copyA)
-    GpuArray_clear(&copyA);
   if (Bp == &copyB)
-    GpuArray_clear(&copyB);
+    GpuArray_scratch_clear(&copyB);
+  if (Ap == &copyA)
+    GpuArray_scratch_clear(&copyA);
   return err;
 }
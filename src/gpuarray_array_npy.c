@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpuarray/array.h"
+#include "gpuarray/error.h"
+#include "gpuarray/util.h"
+
+#include "private.h"
+#include "util/error.h"
+#include "util/strb.h"
+
+/*
+ * Reading and writing arrays in the numpy .npy format.
+ *
+ * The format is a magic string, a version, the length of the header,
+ * the header which is a python dict literal describing the type,
+ * shape and order of the data and then the raw data.  The data is
+ * streamed between the file and the array by gpudata_stream() so that
+ * reading (or writing) a chunk overlaps the transfer of the previous
+ * one and the host memory used doesn't depend on the array size.
+ */
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_LEN 6
+/* Bigger headers are certainly not from numpy */
+#define NPY_MAX_HEADER (1 << 20)
+
+static const struct {
+  char kind;
+  unsigned int size;
+  int typecode;
+} npy_types[] = {
+  {'b', 1, GA_BOOL},
+  {'i', 1, GA_BYTE},
+  {'u', 1, GA_UBYTE},
+  {'i', 2, GA_SHORT},
+  {'u', 2, GA_USHORT},
+  {'i', 4, GA_INT},
+  {'u', 4, GA_UINT},
+  {'i', 8, GA_LONG},
+  {'u', 8, GA_ULONG},
+  {'f', 2, GA_HALF},
+  {'f', 4, GA_FLOAT},
+  {'f', 8, GA_DOUBLE},
+  {'c', 8, GA_CFLOAT},
+  {'c', 16, GA_CDOUBLE},
+};
+
+#define NPY_NTYPES (sizeof(npy_types)/sizeof(npy_types[0]))
+
+typedef struct _npy_header {
+  int typecode;
+  unsigned int nd;
+  size_t *dims;
+  int fortran;
+} npy_header;
+
+static char native_order(void) {
+  unsigned int one = 1;
+  return *(char *)&one == 1 ? '<' : '>';
+}
+
+/* Find the value of `key` in the header dict */
+static const char *npy_value(const char *h, const char *key) {
+  const char *p = strstr(h, key);
+  if (p == NULL) return NULL;
+  p += strlen(key);
+  /* Skip the closing quote of the key */
+  if (*p == '\'' || *p == '"') p++;
+  while (*p == ' ') p++;
+  if (*p != ':') return NULL;
+  p++;
+  while (*p == ' ') p++;
+  return p;
+}
+
+static int npy_parse_descr(error *e, const char *p, npy_header *h) {
+  char q = *p;
+  char kind, order;
+  unsigned long size;
+  char *end;
+  unsigned int i;
+
+  if (q != '\'' && q != '"')
+    return error_set(e, GA_VALUE_ERROR, "Invalid .npy descr");
+  order = p[1];
+  kind = p[2];
+  size = strtoul(p + 3, &end, 10);
+  if (*end != q)
+    return error_set(e, GA_VALUE_ERROR, "Unsupported .npy descr");
+  if (size > 1 && order != '|' && order != '=' && order != native_order())
+    return error_set(e, GA_VALUE_ERROR,
+                     "Byte-swapped .npy data is not supported");
+  for (i = 0; i < NPY_NTYPES; i++) {
+    if (npy_types[i].kind == kind && npy_types[i].size == size) {
+      h->typecode = npy_types[i].typecode;
+      return GA_NO_ERROR;
+    }
+  }
+  return error_fmt(e, GA_VALUE_ERROR, "Unsupported .npy type %c%lu",
+                   kind, size);
+}
+
+static int npy_parse_shape(error *e, const char *p, npy_header *h) {
+  const char *q;
+  char *end;
+  unsigned int n = 0;
+
+  if (*p != '(')
+    return error_set(e, GA_VALUE_ERROR, "Invalid .npy shape");
+  for (q = p + 1; *q != ')' && *q != '\0'; q++)
+    if (*q == ',') n++;
+  /* (3,) has as many commas as dimensions, (3, 4) has one less */
+  if (*q != ')')
+    return error_set(e, GA_VALUE_ERROR, "Invalid .npy shape");
+  h->dims = calloc(n + 1, sizeof(size_t));
+  if (h->dims == NULL)
+    return error_sys(e, "calloc");
+  h->nd = 0;
+  p++;
+  for (;;) {
+    while (*p == ' ') p++;
+    if (*p == ')') break;
+    h->dims[h->nd] = strtoul(p, &end, 10);
+    if (end == p)
+      return error_set(e, GA_VALUE_ERROR, "Invalid .npy shape");
+    h->nd++;
+    p = end;
+    while (*p == ' ') p++;
+    if (*p == ',') p++;
+    else if (*p != ')')
+      return error_set(e, GA_VALUE_ERROR, "Invalid .npy shape");
+  }
+  return GA_NO_ERROR;
+}
+
+static int npy_read_header(FILE *f, error *e, npy_header *h) {
+  unsigned char pre[NPY_MAGIC_LEN + 2 + 4];
+  size_t len, lsz;
+  char *buf;
+  const char *p;
+  int err;
+
+  h->dims = NULL;
+  if (fread(pre, 1, NPY_MAGIC_LEN + 2, f) != NPY_MAGIC_LEN + 2 ||
+      memcmp(pre, NPY_MAGIC, NPY_MAGIC_LEN) != 0)
+    return error_set(e, GA_VALUE_ERROR, "Not a .npy file");
+  lsz = pre[NPY_MAGIC_LEN] == 1 ? 2 : 4;
+  if (pre[NPY_MAGIC_LEN] < 1 || pre[NPY_MAGIC_LEN] > 3)
+    return error_fmt(e, GA_VALUE_ERROR, "Unsupported .npy version %d",
+                     pre[NPY_MAGIC_LEN]);
+  if (fread(pre + NPY_MAGIC_LEN + 2, 1, lsz, f) != lsz)
+    return error_set(e, GA_VALUE_ERROR, "Truncated .npy header");
+  p = (const char *)pre + NPY_MAGIC_LEN + 2;
+  len = (unsigned char)p[0] | ((unsigned char)p[1] << 8);
+  if (lsz == 4)
+    len |= ((size_t)(unsigned char)p[2] << 16) |
+      ((size_t)(unsigned char)p[3] << 24);
+  if (len > NPY_MAX_HEADER)
+    return error_set(e, GA_VALUE_ERROR, ".npy header is too big");
+
+  buf = malloc(len + 1);
+  if (buf == NULL)
+    return error_sys(e, "malloc");
+  if (fread(buf, 1, len, f) != len) {
+    free(buf);
+    return error_set(e, GA_VALUE_ERROR, "Truncated .npy header");
+  }
+  buf[len] = '\0';
+
+  p = npy_value(buf, "descr");
+  err = p ? npy_parse_descr(e, p, h) :
+    error_set(e, GA_VALUE_ERROR, "No descr in .npy header");
+  if (err != GA_NO_ERROR) goto out;
+
+  p = npy_value(buf, "fortran_order");
+  if (p == NULL || (strncmp(p, "True", 4) != 0 &&
+                    strncmp(p, "False", 5) != 0)) {
+    err = error_set(e, GA_VALUE_ERROR, "No fortran_order in .npy header");
+    goto out;
+  }
+  h->fortran = p[0] == 'T';
+
+  p = npy_value(buf, "shape");
+  err = p ? npy_parse_shape(e, p, h) :
+    error_set(e, GA_VALUE_ERROR, "No shape in .npy header");
+
+ out:
+  free(buf);
+  if (err != GA_NO_ERROR) {
+    free(h->dims);
+    h->dims = NULL;
+  }
+  return err;
+}
+
+static int npy_write_header(FILE *f, error *e, const GpuArray *a,
+                            int fortran) {
+  strb sb = STRB_STATIC_INIT;
+  unsigned char pre[NPY_MAGIC_LEN + 2 + 4];
+  size_t elsize = GpuArray_ITEMSIZE(a);
+  size_t lsz, len;
+  unsigned int i;
+  int err = GA_NO_ERROR;
+
+  for (i = 0; i < NPY_NTYPES; i++)
+    if (npy_types[i].typecode == a->typecode) break;
+  if (i == NPY_NTYPES)
+    return error_fmt(e, GA_VALUE_ERROR, "Can't save type %s as .npy",
+                     gpuarray_get_type(a->typecode)->cluda_name);
+
+  strb_appendf(&sb, "{'descr': '%c%c%u', 'fortran_order': %s, 'shape': (",
+               elsize == 1 ? '|' : native_order(), npy_types[i].kind,
+               npy_types[i].size, fortran ? "True" : "False");
+  for (i = 0; i < a->nd; i++)
+    strb_appendf(&sb, i == 0 ? "%llu" : ", %llu",
+                 (unsigned long long)a->dimensions[i]);
+  if (a->nd == 1)
+    strb_appendc(&sb, ',');
+  strb_appends(&sb, "), }");
+
+  /* The data starts on a 64 byte boundary */
+  lsz = sb.l + 1 + NPY_MAGIC_LEN + 2 + 2 > 0xffff ? 4 : 2;
+  while ((NPY_MAGIC_LEN + 2 + lsz + sb.l + 1) % 64 != 0)
+    strb_appendc(&sb, ' ');
+  strb_appendc(&sb, '\n');
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return error_sys(e, "strb");
+  }
+
+  len = sb.l;
+  memcpy(pre, NPY_MAGIC, NPY_MAGIC_LEN);
+  pre[NPY_MAGIC_LEN] = lsz == 2 ? 1 : 2;
+  pre[NPY_MAGIC_LEN + 1] = 0;
+  pre[NPY_MAGIC_LEN + 2] = len & 0xff;
+  pre[NPY_MAGIC_LEN + 3] = (len >> 8) & 0xff;
+  if (lsz == 4) {
+    pre[NPY_MAGIC_LEN + 4] = (len >> 16) & 0xff;
+    pre[NPY_MAGIC_LEN + 5] = (len >> 24) & 0xff;
+  }
+  if (fwrite(pre, 1, NPY_MAGIC_LEN + 2 + lsz, f) != NPY_MAGIC_LEN + 2 + lsz ||
+      fwrite(sb.s, 1, len, f) != len)
+    err = error_sys(e, "fwrite");
+  strb_clear(&sb);
+  return err;
+}
+
+struct npy_file {
+  FILE *f;
+  error *e;
+};
+
+static int npy_fread(char *stage, size_t pos, size_t len, void *arg) {
+  struct npy_file *nf = arg;
+  (void)pos;
+  if (fread(stage, 1, len, nf->f) != len) {
+    if (ferror(nf->f))
+      return error_sys(nf->e, "fread");
+    return error_set(nf->e, GA_VALUE_ERROR, "Truncated .npy data");
+  }
+  return GA_NO_ERROR;
+}
+
+static int npy_fwrite(char *stage, size_t pos, size_t len, void *arg) {
+  struct npy_file *nf = arg;
+  (void)pos;
+  if (fwrite(stage, 1, len, nf->f) != len)
+    return error_sys(nf->e, "fwrite");
+  return GA_NO_ERROR;
+}
+
+static int npy_read_data(GpuArray *a, FILE *f, const npy_header *h) {
+  gpucontext *ctx = GpuArray_context(a);
+  struct npy_file nf;
+  GpuArray tmp;
+  GpuArray *dev = a;
+  size_t sz = GpuArray_ITEMSIZE(a);
+  unsigned int i;
+  int err;
+
+  for (i = 0; i < a->nd; i++) sz *= a->dimensions[i];
+
+  /* The data must land contiguously in the order of the file */
+  memset(&tmp, 0, sizeof(tmp));
+  if (!(h->fortran ? GpuArray_IS_F_CONTIGUOUS(a) :
+        GpuArray_IS_C_CONTIGUOUS(a))) {
+    GA_CHECK(GpuArray_empty(&tmp, ctx, a->typecode, a->nd, a->dimensions,
+                            h->fortran ? GA_F_ORDER : GA_C_ORDER));
+    dev = &tmp;
+  }
+
+  nf.f = f;
+  nf.e = ctx->err;
+  err = gpudata_stream(dev->data, dev->offset, sz, GpuArray_ITEMSIZE(a), 1,
+                       npy_fread, &nf);
+  if (err == GA_NO_ERROR && dev != a)
+    err = GpuArray_move(a, dev);
+  GpuArray_clear(&tmp);
+  return err;
+}
+
+int GpuArray_load_npy(GpuArray *a, gpucontext *ctx, FILE *f) {
+  npy_header h;
+  int err;
+
+  GA_CHECK(npy_read_header(f, ctx->err, &h));
+  err = GpuArray_empty(a, ctx, h.typecode, h.nd, h.dims,
+                       h.fortran ? GA_F_ORDER : GA_C_ORDER);
+  if (err == GA_NO_ERROR) {
+    err = npy_read_data(a, f, &h);
+    if (err != GA_NO_ERROR)
+      GpuArray_clear(a);
+  }
+  free(h.dims);
+  return err;
+}
+
+int GpuArray_load_npy_into(GpuArray *a, FILE *f) {
+  gpucontext *ctx = GpuArray_context(a);
+  npy_header h;
+  unsigned int i;
+  int err = GA_NO_ERROR;
+
+  if (!GpuArray_ISWRITEABLE(a))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination array (a) not writeable");
+  GA_CHECK(npy_read_header(f, ctx->err, &h));
+  if (h.typecode != a->typecode || h.nd != a->nd)
+    err = error_set(ctx->err, GA_VALUE_ERROR,
+                    ".npy data doesn't match the array type or shape");
+  for (i = 0; err == GA_NO_ERROR && i < a->nd; i++)
+    if (h.dims[i] != a->dimensions[i])
+      err = error_fmt(ctx->err, GA_VALUE_ERROR,
+                      ".npy shape differs from the array in dimension %u",
+                      i);
+  if (err == GA_NO_ERROR)
+    err = npy_read_data(a, f, &h);
+  free(h.dims);
+  return err;
+}
+
+int GpuArray_save_npy(FILE *f, const GpuArray *a) {
+  gpucontext *ctx = GpuArray_context(a);
+  struct npy_file nf;
+  GpuArray tmp;
+  const GpuArray *dev = a;
+  size_t sz = GpuArray_ITEMSIZE(a);
+  unsigned int i;
+  int fortran;
+  int err;
+
+  for (i = 0; i < a->nd; i++) sz *= a->dimensions[i];
+
+  memset(&tmp, 0, sizeof(tmp));
+  fortran = GpuArray_IS_F_CONTIGUOUS(a) && !GpuArray_IS_C_CONTIGUOUS(a);
+  if (!GpuArray_ISONESEGMENT(a)) {
+    GA_CHECK(GpuArray_copy(&tmp, a, GA_C_ORDER));
+    dev = &tmp;
+  }
+
+  err = npy_write_header(f, ctx->err, a, fortran);
+  if (err == GA_NO_ERROR) {
+    nf.f = f;
+    nf.e = ctx->err;
+    err = gpudata_stream(dev->data, dev->offset, sz, GpuArray_ITEMSIZE(a), 0,
+                         npy_fwrite, &nf);
+  }
+  GpuArray_clear(&tmp);
+  return err;
+}
@@ -80,10 +80,14 @@ typedef struct _blas_handle {
 
 static const char *code_sgemvBH_N_a1_b1_small =                         \
   "#include \"cluda.h\"\n"                                              \
-  "KERNEL void sgemv(const float *A[], size_t lda, "                    \
-  "                  const float *x[], size_t incx, "                   \
-  "                  float *y[], size_t incy, "                         \
-  "                  size_t b, size_t m, size_t n) {"                   \
+  "KERNEL void sgemv(const void *T, size_t toff, "                      \
+  "                  size_t lda, size_t incx, "                         \
+  "                  size_t incy, size_t b, "                           \
+  "                  size_t m, size_t n) {"                             \
+  "  const float * const *A ="                                          \
+  "    (const float * const *)((char *)T + toff);"                      \
+  "  const float * const *x = A + b;"                                   \
+  "  float * const *y = (float * const *)(A + 2 * b);"                  \
   "  for (size_t p = blockIdx.y * blockDim.y + threadIdx.y; p < b;"     \
   "       p += gridDim.y * blockDim.y) {"                               \
   "    for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < m;"   \
@@ -104,10 +108,14 @@ static const char *code_sgemvBH_N_a1_b1_small =                         \
 
 static const char *code_sgemvBH_T_a1_b1_small =         \
   "#include \"cluda.h\"\n"                              \
-  "KERNEL void sgemv(const float *A[], size_t lda, "    \
-  "                  const float *x[], size_t incx, "   \
-  "                  float *y[], size_t incy, "         \
-  "                  size_t b, size_t m, size_t n) {"   \
+  "KERNEL void sgemv(const void *T, size_t toff, "      \
+  "                  size_t lda, size_t incx, "         \
+  "                  size_t incy, size_t b, "           \
+  "                  size_t m, size_t n) {"             \
+  "  const float * const *A ="                          \
+  "    (const float * const *)((char *)T + toff);"      \
+  "  const float * const *x = A + b;"                   \
+  "  float * const *y = (float * const *)(A + 2 * b);"  \
   "  size_t i = blockIdx.x * blockDim.x + threadIdx.x;" \
   "  size_t p = blockIdx.y * blockDim.y + threadIdx.y;" \
   "  if (i >= m || p >= b) return;"                     \
@@ -124,10 +132,14 @@ static const char *code_sgemvBH_T_a1_b1_small =         \
 
 static const char *code_dgemvBH_N_a1_b1_small =                         \
   "#include \"cluda.h\"\n"                                              \
-  "KERNEL void dgemv(const double *A[], size_t lda, "                   \
-  "                  const double *x[], size_t incx, "                  \
-  "                  double *y[], size_t incy, "                        \
-  "                  size_t b, size_t m, size_t n) {"                   \
+  "KERNEL void dgemv(const void *T, size_t toff, "                      \
+  "                  size_t lda, size_t incx, "                         \
+  "                  size_t incy, size_t b, "                           \
+  "                  size_t m, size_t n) {"                             \
+  "  const double * const *A ="                                         \
+  "    (const double * const *)((char *)T + toff);"                     \
+  "  const double * const *x = A + b;"                                  \
+  "  double * const *y = (double * const *)(A + 2 * b);"                \
   "  for (size_t p = blockIdx.y * blockDim.y + threadIdx.y; p < b;"     \
   "       p += gridDim.y * blockDim.y) {"                               \
   "    for (size_t i = blockIdx.x * blockDim.x + threadIdx.x; i < m;"   \
@@ -148,10 +160,14 @@ static const char *code_dgemvBH_N_a1_b1_small =                         \
 
 static const char *code_dgemvBH_T_a1_b1_small =         \
   "#include \"cluda.h\"\n"                              \
-  "KERNEL void dgemv(const double *A[], size_t lda, "   \
-  "                  const double *x[], size_t incx, "  \
-  "                  double *y[], size_t incy, "        \
-  "                  size_t b, size_t m, size_t n) {"   \
+  "KERNEL void dgemv(const void *T, size_t toff, "      \
+  "                  size_t lda, size_t incx, "         \
+  "                  size_t incy, size_t b, "           \
+  "                  size_t m, size_t n) {"             \
+  "  const double * const *A ="                         \
+  "    (const double * const *)((char *)T + toff);"     \
+  "  const double * const *x = A + b;"                  \
+  "  double * const *y = (double * const *)(A + 2 * b);" \
   "  size_t i = blockIdx.x * blockDim.x + threadIdx.x;" \
   "  size_t p = blockIdx.y * blockDim.y + threadIdx.y;" \
   "  if (i >= m || p >= b) return;"                     \
@@ -169,10 +185,12 @@ static const char *code_dgemvBH_T_a1_b1_small =         \
 static const char *code_sgerBH_gen_small =                              \
   "#include \"cluda.h\"\n"                                              \
   "KERNEL void _sgerBH_gen_small("                                      \
-  "    const float *x[], size_t incx,"                                  \
-  "    const float *y[], size_t incy,"                                  \
-  "    float alpha, float *A[], size_t lda,"                            \
+  "    const void *T, size_t toff, size_t incx, size_t incy,"           \
+  "    float alpha, size_t lda,"                                        \
   "    size_t b, size_t m, size_t n) {"                                 \
+  "  float * const *A = (float * const *)((char *)T + toff);"           \
+  "  const float * const *x = (const float * const *)(A + b);"          \
+  "  const float * const *y = (const float * const *)(A + 2 * b);"      \
   "  size_t i = blockIdx.x * blockDim.x + threadIdx.x;"                 \
   "  size_t j = blockIdx.y * blockDim.y + threadIdx.y;"                 \
   "  if (i >= m || j >= n) return;"                                     \
@@ -185,10 +203,12 @@ static const char *code_sgerBH_gen_small =                              \
 static const char *code_dgerBH_gen_small =                              \
   "#include \"cluda.h\"\n"                                              \
   "KERNEL void _dgerBH_gen_small("                                      \
-  "      const double *x[], size_t incx, "                              \
-  "      const double *y[], size_t incy,"                               \
-  "      double alpha, double *A[], size_t lda,"                        \
-  "      size_t b, size_t m, size_t n) {"                               \
+  "    const void *T, size_t toff, size_t incx, size_t incy,"           \
+  "    double alpha, size_t lda,"                                       \
+  "    size_t b, size_t m, size_t n) {"                                 \
+  "  double * const *A = (double * const *)((char *)T + toff);"         \
+  "  const double * const *x = (const double * const *)(A + b);"        \
+  "  const double * const *y = (const double * const *)(A + 2 * b);"    \
   "  size_t i = blockIdx.x * blockDim.x + threadIdx.x;"                 \
   "  size_t j = blockIdx.y * blockDim.y + threadIdx.y;"                 \
   "  if (i >= m || j >= n) return;"                                     \
@@ -253,36 +273,34 @@ static int setup(gpucontext *c) {
 
   types[0] = GA_BUFFER;
   types[1] = GA_SIZE;
-  types[2] = GA_BUFFER;
+  types[2] = GA_SIZE;
   types[3] = GA_SIZE;
-  types[4] = GA_BUFFER;
+  types[4] = GA_SIZE;
   types[5] = GA_SIZE;
   types[6] = GA_SIZE;
   types[7] = GA_SIZE;
-  types[8] = GA_SIZE;
-  e = GpuKernel_init(&handle->sgemvBH_N_a1_b1_small, c, 1, &code_sgemvBH_N_a1_b1_small, NULL, "sgemv", 9, types, 0, NULL);
+  e = GpuKernel_init(&handle->sgemvBH_N_a1_b1_small, c, 1, &code_sgemvBH_N_a1_b1_small, NULL, "sgemv", 8, types, 0, NULL);
   if (e != GA_NO_ERROR) goto e1;
-  e = GpuKernel_init(&handle->sgemvBH_T_a1_b1_small, c, 1, &code_sgemvBH_T_a1_b1_small, NULL, "sgemv", 9, types, 0, NULL);
+  e = GpuKernel_init(&handle->sgemvBH_T_a1_b1_small, c, 1, &code_sgemvBH_T_a1_b1_small, NULL, "sgemv", 8, types, 0, NULL);
   if (e != GA_NO_ERROR) goto e2;
-  e = GpuKernel_init(&handle->dgemvBH_N_a1_b1_small, c, 1, &code_dgemvBH_N_a1_b1_small, NULL, "dgemv", 9, types, GA_USE_DOUBLE, NULL);
+  e = GpuKernel_init(&handle->dgemvBH_N_a1_b1_small, c, 1, &code_dgemvBH_N_a1_b1_small, NULL, "dgemv", 8, types, GA_USE_DOUBLE, NULL);
   if (e != GA_NO_ERROR) goto e3;
-  e = GpuKernel_init(&handle->dgemvBH_T_a1_b1_small, c, 1, &code_dgemvBH_T_a1_b1_small, NULL, "dgemv", 9, types, GA_USE_DOUBLE, NULL);
+  e = GpuKernel_init(&handle->dgemvBH_T_a1_b1_small, c, 1, &code_dgemvBH_T_a1_b1_small, NULL, "dgemv", 8, types, GA_USE_DOUBLE, NULL);
   if (e != GA_NO_ERROR) goto e4;
 
   types[0] = GA_BUFFER;
   types[1] = GA_SIZE;
-  types[2] = GA_BUFFER;
+  types[2] = GA_SIZE;
   types[3] = GA_SIZE;
   types[4] = GA_FLOAT;
-  types[5] = GA_BUFFER;
+  types[5] = GA_SIZE;
   types[6] = GA_SIZE;
   types[7] = GA_SIZE;
   types[8] = GA_SIZE;
-  types[9] = GA_SIZE;
-  e = GpuKernel_init(&handle->sgerBH_gen_small, c, 1, &code_sgerBH_gen_small, NULL, "_sgerBH_gen_small", 10, types, 0, NULL);
+  e = GpuKernel_init(&handle->sgerBH_gen_small, c, 1, &code_sgerBH_gen_small, NULL, "_sgerBH_gen_small", 9, types, 0, NULL);
   if (e != GA_NO_ERROR) goto e5;
   types[4] = GA_DOUBLE;
-  e = GpuKernel_init(&handle->dgerBH_gen_small, c, 1, &code_dgerBH_gen_small, NULL, "_dgerBH_gen_small", 10, types, GA_USE_DOUBLE, NULL);
+  e = GpuKernel_init(&handle->dgerBH_gen_small, c, 1, &code_dgerBH_gen_small, NULL, "_dgerBH_gen_small", 9, types, GA_USE_DOUBLE, NULL);
   if (e != GA_NO_ERROR) goto e6;
 
   ctx->blas_handle = handle;
@@ -839,6 +857,7 @@ static int sgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
     const float **B_l = (const float **)T_l + batchCount;
     float **C_l = T_l + (batchCount * 2);
     gpudata *Ta;
+    size_t offTa;
     CUdeviceptr Aa, Ba, Ca;
     cublasStatus_t err;
 
@@ -854,24 +873,18 @@ static int sgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
       C_l[i] = ((float *)C[i]->ptr) + offC[i];
     }
 
-    Ta = gpudata_alloc((gpucontext *)ctx, sizeof(float *) * batchCount * 3,
-                       NULL, 0, NULL);
-    if (Ta == NULL) {
+    if (gpudata_scratch_alloc((gpucontext *)ctx, NULL,
+                              sizeof(float *) * batchCount * 3, T_l,
+                              &Ta, &offTa) != GA_NO_ERROR) {
       cuda_exit(ctx);
       return ctx->err->code;
     }
-    Aa = *(CUdeviceptr *)Ta;
+    Aa = *(CUdeviceptr *)Ta + offTa;
     Ba = Aa + (batchCount * sizeof(float *));
     Ca = Aa + (batchCount * sizeof(float *) * 2);
 
-    if (gpudata_write(Ta, 0, T_l, sizeof(float *) * batchCount * 3) != GA_NO_ERROR) {
-      gpudata_release(Ta);
-      cuda_exit(ctx);
-      return ctx->err->code;
-    }
-
     if (cuda_wait(Ta, CUDA_WAIT_READ) != GA_NO_ERROR) {
-      gpudata_release(Ta);
+      gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
       cuda_exit(ctx);
       return ctx->err->code;
     }
@@ -883,11 +896,11 @@ static int sgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
                              (const float **)Ba, ldb, &beta,
                              (float **)Ca, ldc, batchCount);
     if (cuda_record(Ta, CUDA_WAIT_READ) != GA_NO_ERROR) {
-      gpudata_release(Ta);
+      gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
       cuda_exit(ctx);
       return ctx->err->code;
     }
-    gpudata_release(Ta);
+    gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
     if (err != CUBLAS_STATUS_SUCCESS) {
       cuda_exit(ctx);
       return error_cublas(ctx->err, "cublasSgemmBatched", err);
@@ -977,6 +990,7 @@ static int dgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
     const double **B_l = (const double **)T_l + batchCount;
     double **C_l = T_l + (batchCount * 2);
     gpudata *Ta;
+    size_t offTa;
     CUdeviceptr Aa, Ba, Ca;
     cublasStatus_t err;
 
@@ -992,24 +1006,18 @@ static int dgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
       C_l[i] = ((double *)C[i]->ptr) + offC[i];
     }
 
-    Ta = gpudata_alloc((gpucontext *)ctx, sizeof(double *) * batchCount * 3,
-                       NULL, 0, NULL);
-    if (Ta == NULL) {
+    if (gpudata_scratch_alloc((gpucontext *)ctx, NULL,
+                              sizeof(double *) * batchCount * 3, T_l,
+                              &Ta, &offTa) != GA_NO_ERROR) {
       cuda_exit(ctx);
       return ctx->err->code;
     }
-    Aa = *(CUdeviceptr *)Ta;
+    Aa = *(CUdeviceptr *)Ta + offTa;
     Ba = Aa + (batchCount * sizeof(double *));
     Ca = Aa + (batchCount * sizeof(double *) * 2);
 
-    if (gpudata_write(Ta, 0, T_l, sizeof(double *) * batchCount * 3) != GA_NO_ERROR) {
-      gpudata_release(Ta);
-      cuda_exit(ctx);
-      return ctx->err->code;
-    }
-
     if (cuda_wait(Ta, CUDA_WAIT_READ) != GA_NO_ERROR) {
-      gpudata_release(Ta);
+      gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
       cuda_exit(ctx);
       return ctx->err->code;
     }
@@ -1022,11 +1030,11 @@ static int dgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
                              (double **)Ca, ldc, batchCount);
 
     if (cuda_record(Ta, CUDA_WAIT_READ) != GA_NO_ERROR) {
-      gpudata_release(Ta);
+      gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
       cuda_exit(ctx);
       return ctx->err->code;
     }
-    gpudata_release(Ta);
+    gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
 
     if (err != CUBLAS_STATUS_SUCCESS) {
       cuda_exit(ctx);
@@ -1235,7 +1243,8 @@ static int sgemvBatch(cb_order order, cb_transpose transA,
   size_t t, i;
   size_t ls[2], gs[2];
   void *args[9];
-  gpudata *Aa, *xa, *ya;
+  gpudata *Ta;
+  size_t offTa;
   int err;
 
   ASSERT_BUF(A[0]);
@@ -1293,34 +1302,22 @@ static int sgemvBatch(cb_order order, cb_transpose transA,
       y_l[i] = (float *)(y[i]->ptr + offY[i]);
     }
 
-    Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, A_l,
-                               GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
-    xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, x_l,
-                               GA_BUFFER_INIT);
-    if (xa == NULL) {
-      cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
-    }
-    ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, y_l,
-                               GA_BUFFER_INIT);
-    if (ya == NULL) {
-      cuda_ops.buffer_release(Aa);
-      cuda_ops.buffer_release(xa);
+    if (gpudata_scratch_alloc((gpucontext *)ctx, NULL,
+                              sizeof(float *) * batchCount * 3, T_l,
+                              &Ta, &offTa) != GA_NO_ERROR) {
+      cuda_exit(ctx);
       return ctx->err->code;
     }
   }
 
-  args[0] = Aa;
-  args[1] = &lda;
-  args[2] = xa;
+  args[0] = Ta;
+  args[1] = &offTa;
+  args[2] = &lda;
   args[3] = &incX;
-  args[4] = ya;
-  args[5] = &incY;
-  args[6] = &batchCount;
-  args[7] = &M;
-  args[8] = &N;
+  args[4] = &incY;
+  args[5] = &batchCount;
+  args[6] = &M;
+  args[7] = &N;
 
   if (transA == cb_no_trans) {
     err = GpuKernel_call(&((blas_handle *)ctx->blas_handle)->sgemvBH_N_a1_b1_small, 2, gs, ls, 0, args);
@@ -1328,9 +1325,7 @@ static int sgemvBatch(cb_order order, cb_transpose transA,
     err = GpuKernel_call(&((blas_handle *)ctx->blas_handle)->sgemvBH_T_a1_b1_small, 2, gs, ls, 0, args);
   }
 
-  cuda_ops.buffer_release(Aa);
-  cuda_ops.buffer_release(xa);
-  cuda_ops.buffer_release(ya);
+  gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
 
   if (err != GA_NO_ERROR) {
     cuda_exit(ctx);
@@ -1358,7 +1353,8 @@ static int dgemvBatch(cb_order order, cb_transpose transA,
   size_t t, i;
   size_t ls[2], gs[2];
   void *args[9];
-  gpudata *Aa, *xa, *ya;
+  gpudata *Ta;
+  size_t offTa;
   int err;
 
   ASSERT_BUF(A[0]);
@@ -1416,34 +1412,22 @@ static int dgemvBatch(cb_order order, cb_transpose transA,
       y_l[i] = (double *)(y[i]->ptr + offY[i]);
     }
 
-    Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, A_l,
-                               GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
-    xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, x_l,
-                               GA_BUFFER_INIT);
-    if (xa == NULL) {
-      cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
-    }
-    ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, y_l,
-                               GA_BUFFER_INIT);
-    if (ya == NULL) {
-      cuda_ops.buffer_release(Aa);
-      cuda_ops.buffer_release(xa);
+    if (gpudata_scratch_alloc((gpucontext *)ctx, NULL,
+                              sizeof(double *) * batchCount * 3, T_l,
+                              &Ta, &offTa) != GA_NO_ERROR) {
+      cuda_exit(ctx);
       return ctx->err->code;
     }
   }
 
-  args[0] = Aa;
-  args[1] = &lda;
-  args[2] = xa;
+  args[0] = Ta;
+  args[1] = &offTa;
+  args[2] = &lda;
   args[3] = &incX;
-  args[4] = ya;
-  args[5] = &incY;
-  args[6] = &batchCount;
-  args[7] = &M;
-  args[8] = &N;
+  args[4] = &incY;
+  args[5] = &batchCount;
+  args[6] = &M;
+  args[7] = &N;
 
   if (transA == cb_no_trans) {
     err = GpuKernel_call(&((blas_handle *)ctx->blas_handle)->dgemvBH_N_a1_b1_small, 2, gs, ls, 0, args);
@@ -1451,9 +1435,7 @@ static int dgemvBatch(cb_order order, cb_transpose transA,
     err = GpuKernel_call(&((blas_handle *)ctx->blas_handle)->dgemvBH_T_a1_b1_small, 2, gs, ls, 0, args);
   }
 
-  cuda_ops.buffer_release(Aa);
-  cuda_ops.buffer_release(xa);
-  cuda_ops.buffer_release(ya);
+  gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
 
   if (err != GA_NO_ERROR) {
     cuda_exit(ctx);
@@ -1583,7 +1565,8 @@ static int sgerBatch(cb_order order, size_t M, size_t N, float alpha,
   size_t ls[3] = {M, N, 1}, gs[3] = {1, 1, batchCount};
   void *args[10];
   gpudata **T;
-  gpudata *Aa, *xa, *ya;
+  gpudata *Ta;
+  size_t offTa;
   int err;
 
   ASSERT_BUF(x[0]);
@@ -1652,41 +1635,27 @@ static int sgerBatch(cb_order order, size_t M, size_t N, float alpha,
       y_l[i] = (float *)(y[i]->ptr + offY[i]);
     }
 
-    Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, A_l,
-                               GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
-    xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, x_l,
-                               GA_BUFFER_INIT);
-    if (xa == NULL) {
-      cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
-    }
-    ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, y_l,
-                               GA_BUFFER_INIT);
-    if (ya == NULL) {
-      cuda_ops.buffer_release(Aa);
-      cuda_ops.buffer_release(xa);
+    if (gpudata_scratch_alloc((gpucontext *)ctx, NULL,
+                              sizeof(float *) * batchCount * 3, T_l,
+                              &Ta, &offTa) != GA_NO_ERROR) {
+      cuda_exit(ctx);
       return ctx->err->code;
     }
   }
 
-  args[0] = xa;
-  args[1] = &incX;
-  args[2] = ya;
+  args[0] = Ta;
+  args[1] = &offTa;
+  args[2] = &incX;
   args[3] = &incY;
   args[4] = &alpha;
-  args[5] = Aa;
-  args[6] = &lda;
-  args[7] = &batchCount;
-  args[8] = &M;
-  args[9] = &N;
+  args[5] = &lda;
+  args[6] = &batchCount;
+  args[7] = &M;
+  args[8] = &N;
 
   err = GpuKernel_call(&((blas_handle *)ctx->blas_handle)->sgerBH_gen_small, 3, gs, ls, 0, args);
 
-  cuda_ops.buffer_release(Aa);
-  cuda_ops.buffer_release(xa);
-  cuda_ops.buffer_release(ya);
+  gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
 
   if (err != GA_NO_ERROR) {
     cuda_exit(ctx);
@@ -1714,7 +1683,8 @@ static int dgerBatch(cb_order order, size_t M, size_t N, double alpha,
   size_t ls[3] = {M, N, 1}, gs[3] = {1, 1, batchCount};
   void *args[10];
   gpudata **T;
-  gpudata *Aa, *xa, *ya;
+  gpudata *Ta;
+  size_t offTa;
   int err;
 
   ASSERT_BUF(x[0]);
@@ -1783,41 +1753,27 @@ static int dgerBatch(cb_order order, size_t M, size_t N, double alpha,
       y_l[i] = (double *)(y[i]->ptr + offY[i]);
     }
 
-    Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, A_l,
-                               GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
-    xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, x_l,
-                               GA_BUFFER_INIT);
-    if (xa == NULL) {
-      cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
-    }
-    ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, y_l,
-                               GA_BUFFER_INIT);
-    if (ya == NULL) {
-      cuda_ops.buffer_release(Aa);
-      cuda_ops.buffer_release(xa);
+    if (gpudata_scratch_alloc((gpucontext *)ctx, NULL,
+                              sizeof(double *) * batchCount * 3, T_l,
+                              &Ta, &offTa) != GA_NO_ERROR) {
+      cuda_exit(ctx);
       return ctx->err->code;
     }
   }
 
-  args[0] = xa;
-  args[1] = &incX;
-  args[2] = ya;
+  args[0] = Ta;
+  args[1] = &offTa;
+  args[2] = &incX;
   args[3] = &incY;
   args[4] = &alpha;
-  args[5] = Aa;
-  args[6] = &lda;
-  args[7] = &batchCount;
-  args[8] = &M;
-  args[9] = &N;
+  args[5] = &lda;
+  args[6] = &batchCount;
+  args[7] = &M;
+  args[8] = &N;
 
   err = GpuKernel_call(&((blas_handle *)ctx->blas_handle)->sgerBH_gen_small, 3, gs, ls, 0, args);
 
-  cuda_ops.buffer_release(Aa);
-  cuda_ops.buffer_release(xa);
-  cuda_ops.buffer_release(ya);
+  gpudata_scratch_free((gpucontext *)ctx, NULL, Ta, offTa);
 
   if (err != GA_NO_ERROR) {
     cuda_exit(ctx);
@@ -46,6 +46,7 @@ int gpucontext_props_new(gpucontext_props **res) {
   r->kernel_cache_path = NULL;
   r->initial_cache_size = 0;
   r->max_cache_size = (size_t)-1;
+  r->transfer_chunk = DEFAULT_TRANSFER_CHUNK;
   *res = r;
   return GA_NO_ERROR;
 }
@@ -89,6 +90,13 @@ int gpucontext_props_kernel_cache(gpucontext_props *p, const char *path) {
   return GA_NO_ERROR;
 }
 
+int gpucontext_props_transfer_chunk(gpucontext_props *p, size_t sz) {
+  if (sz == 0)
+    return error_set(global_err, GA_VALUE_ERROR, "Transfer chunk size can't be 0");
+  p->transfer_chunk = sz;
+  return GA_NO_ERROR;
+}
+
 int gpucontext_props_alloc_cache(gpucontext_props *p, size_t initial, size_t max) {
   if (initial > max)
     return error_set(global_err, GA_VALUE_ERROR, "Initial size can't be bigger than max size");
@@ -104,6 +112,7 @@ void gpucontext_props_del(gpucontext_props *p) {
 int gpucontext_init(gpucontext **res, const char *name, gpucontext_props *p) {
   const gpuarray_buffer_ops *ops = gpuarray_get_ops(name);
   gpucontext *r;
+  trace_env();
   if (ops == NULL) {
     gpucontext_props_del(p);
     return global_err->code;
@@ -111,6 +120,8 @@ int gpucontext_init(gpucontext **res, const char *name, gpucontext_props *p) {
   if (p == NULL && gpucontext_props_new(&p) != GA_NO_ERROR)
     return global_err->code;
   r = ops->buffer_init(p);
+  if (r != NULL)
+    r->transfer_chunk = p->transfer_chunk;
   gpucontext_props_del(p);
   if (r == NULL) return global_err->code;
   r->ops = ops;
@@ -119,6 +130,116 @@ int gpucontext_init(gpucontext **res, const char *name, gpucontext_props *p) {
   return GA_NO_ERROR;
 }
 
+/*
+ * Scratch arenas, see gpudata_scratch_alloc().
+ *
+ * When a temporary doesn't fit in the block of its stream a bigger
+ * block replaces it.  Every temporary holds a reference to its block
+ * so the old one goes away when the last temporary in it is freed.
+ */
+struct _ga_scratch {
+  struct _ga_scratch *next;
+  gpustream *s;
+  gpudata *buf;
+  size_t size;
+  size_t used;
+};
+
+#define SCRATCH_ALIGN 256
+#define SCRATCH_MIN_SIZE (64 * 1024)
+
+static struct _ga_scratch *scratch_find(gpucontext *ctx, gpustream *s) {
+  struct _ga_scratch *a;
+  for (a = ctx->scratch; a != NULL; a = a->next)
+    if (a->s == s) return a;
+  return NULL;
+}
+
+/* Drop the arena of `s`, or all of them if `all` is set */
+static void scratch_clear(gpucontext *ctx, gpustream *s, int all) {
+  struct _ga_scratch **p = &ctx->scratch;
+  struct _ga_scratch *a;
+
+  while (*p != NULL) {
+    a = *p;
+    if (all || a->s == s) {
+      *p = a->next;
+      if (a->buf != NULL)
+        ctx->ops->buffer_release(a->buf);
+      free(a);
+    } else {
+      p = &a->next;
+    }
+  }
+}
+
+int gpudata_scratch_alloc(gpucontext *ctx, gpustream *s, size_t sz,
+                          const void *data, gpudata **b, size_t *off) {
+  struct _ga_scratch *a;
+  gpudata *buf;
+  size_t asz, size;
+
+  /* A graph replays its temporaries long after they were freed */
+  if (ctx->capture != NULL) {
+    *b = ctx->ops->buffer_alloc(ctx, sz, (void *)data,
+                                data ? GA_BUFFER_INIT : 0);
+    *off = 0;
+    return *b == NULL ? ctx->err->code : GA_NO_ERROR;
+  }
+  GA_CHECK(check_stream(ctx, s));
+
+  a = scratch_find(ctx, s);
+  if (a == NULL) {
+    a = calloc(1, sizeof(*a));
+    if (a == NULL)
+      return error_sys(ctx->err, "calloc");
+    a->s = s;
+    a->next = ctx->scratch;
+    ctx->scratch = a;
+  }
+
+  asz = (sz + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+  if (asz == 0)
+    asz = SCRATCH_ALIGN;
+  if (a->size - a->used < asz) {
+    size = a->size * 2;
+    if (size < SCRATCH_MIN_SIZE)
+      size = SCRATCH_MIN_SIZE;
+    if (size < asz)
+      size = asz;
+    buf = ctx->ops->buffer_alloc(ctx, size, NULL, 0);
+    if (buf == NULL)
+      return ctx->err->code;
+    if (a->buf != NULL)
+      ctx->ops->buffer_release(a->buf);
+    a->buf = buf;
+    a->size = size;
+    a->used = 0;
+  }
+
+  if (data != NULL && ctx->ops->buffer_upload != NULL)
+    GA_CHECK(ctx->ops->buffer_upload(a->buf, a->used, data, sz, s));
+  else if (data != NULL)
+    GA_CHECK(ctx->ops->buffer_write(a->buf, a->used, data, sz, s, NULL));
+  ctx->ops->buffer_retain(a->buf);
+  *b = a->buf;
+  *off = a->used;
+  a->used += asz;
+  return GA_NO_ERROR;
+}
+
+void gpudata_scratch_free(gpucontext *ctx, gpustream *s, gpudata *b,
+                          size_t off) {
+  struct _ga_scratch *a;
+
+  if (b == NULL)
+    return;
+  a = scratch_find(ctx, s);
+  if (a != NULL && a->buf == b && off < a->used)
+    a->used = off;
+  ctx->ops->buffer_release(b);
+}
+
 void gpucontext_deref(gpucontext *ctx) {
   if (ctx->blas_handle != NULL)
     ctx->blas_ops->teardown(ctx);
@@ -126,6 +247,7 @@ void gpucontext_deref(gpucontext *ctx) {
     cache_destroy(ctx->extcopy_cache);
     ctx->extcopy_cache = NULL;
   }
+  scratch_clear(ctx, NULL, 1);
   ctx->ops->buffer_deinit(ctx);
 }
 
@@ -142,8 +264,12 @@ const char *gpucontext_error(gpucontext *ctx, int err) {
 
 gpudata *gpudata_alloc(gpucontext *ctx, size_t sz, void *data, int flags,
                        int *ret) {
+  uint64_t t = ga_trace ? trace_now() : 0;
   gpudata *res = ctx->ops->buffer_alloc(ctx, sz, data, flags);
   if (res == NULL && ret) *ret = ctx->err->code;
+  if (ga_trace)
+    trace_complete("memory", "alloc", t, "\"size\":%llu,\"buf\":\"%p\"",
+                   (unsigned long long)sz, (void *)res);
   return res;
 }
 
@@ -152,8 +278,13 @@ void gpudata_retain(gpudata *b) {
 }
 
 void gpudata_release(gpudata *b) {
-  if (b)
+  uint64_t t;
+  if (b) {
+    t = ga_trace ? trace_now() : 0;
     ((partial_gpudata *)b)->ctx->ops->buffer_release(b);
+    if (ga_trace)
+      trace_complete("memory", "release", t, "\"buf\":\"%p\"", (void *)b);
+  }
 }
 
 int gpudata_share(gpudata *a, gpudata *b, int *ret) {
@@ -165,57 +296,390 @@ int gpudata_share(gpudata *a, gpudata *b, int *ret) {
 
 int gpudata_move(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
                  size_t sz) {
-  return ((partial_gpudata *)src)->ctx->ops->buffer_move(dst, dstoff,
-                                                         src, srcoff, sz);
+  return gpudata_move_s(dst, dstoff, src, srcoff, sz, NULL);
+}
+
+int gpudata_move_s(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
+                   size_t sz, gpustream *s) {
+  gpucontext *ctx = ((partial_gpudata *)src)->ctx;
+  uint64_t t;
+  int err = check_stream(ctx, s);
+  if (err != GA_NO_ERROR) return err;
+  if (ctx->capture != NULL)
+    return gpugraph_add_move(ctx->capture, dst, dstoff, src, srcoff, sz);
+  if (ga_trace) {
+    t = trace_now();
+    err = ctx->ops->buffer_move(dst, dstoff, src, srcoff, sz, s);
+    trace_complete("transfer", "move", t, "\"size\":%llu",
+                   (unsigned long long)sz);
+    return err;
+  }
+  return ctx->ops->buffer_move(dst, dstoff, src, srcoff, sz, s);
+}
+
+/*
+ * Get a page-locked staging buffer from `ctx` if it can provide one.
+ */
+void *gpudata_stage_alloc(gpucontext *ctx, size_t sz, gpudata **b) {
+  void *p;
+
+  *b = ctx->ops->buffer_alloc(ctx, sz, NULL, GA_BUFFER_HOST);
+  if (*b == NULL)
+    return NULL;
+  if (ctx->ops->property(ctx, *b, NULL, GA_BUFFER_PROP_HOSTPOINTER,
+                         &p) != GA_NO_ERROR) {
+    ctx->ops->buffer_release(*b);
+    *b = NULL;
+    return NULL;
+  }
+  return p;
+}
+
+/*
+ * Copy between buffers of different contexts through the host.
+ *
+ * The data moves in chunks through two staging buffers: while chunk k
+ * is written to `dst` from one of them, chunk k + 1 is read from `src`
+ * into the other.  The staging buffers are page-locked if either
+ * context can provide that, otherwise the transfers are synchronous
+ * but the host memory use is still bounded by the chunk size.
+ */
+int gpudata_transfer_host(gpudata *dst, size_t dstoff, gpudata *src,
+                          size_t srcoff, size_t sz, size_t *nchunks) {
+  gpucontext *src_ctx = ((partial_gpudata *)src)->ctx;
+  gpucontext *dst_ctx = ((partial_gpudata *)dst)->ctx;
+  gpudata *sb[2] = {NULL, NULL};
+  void *stage[2] = {NULL, NULL};
+  gpuevent *rev[2] = {NULL, NULL};
+  gpuevent *wev[2] = {NULL, NULL};
+  size_t chunk = src_ctx->transfer_chunk;
+  size_t n, k, off;
+  unsigned int b, nb;
+  int res = GA_NO_ERROR;
+
+  *nchunks = 0;
+  if (sz == 0)
+    return GA_NO_ERROR;
+  if (chunk == 0)
+    chunk = DEFAULT_TRANSFER_CHUNK;
+  if (chunk > sz)
+    chunk = sz;
+  n = (sz + chunk - 1) / chunk;
+  nb = n > 1 ? 2 : 1;
+
+  for (b = 0; b < nb; b++) {
+    stage[b] = gpudata_stage_alloc(src_ctx, chunk, &sb[b]);
+    if (stage[b] == NULL)
+      stage[b] = gpudata_stage_alloc(dst_ctx, chunk, &sb[b]);
+    if (stage[b] == NULL)
+      stage[b] = malloc(chunk);
+    if (stage[b] == NULL) {
+      error_sys(src_ctx->err, "malloc");
+      res = error_sys(dst_ctx->err, "malloc");
+      goto out;
+    }
+    res = src_ctx->ops->event_alloc(&rev[b], src_ctx);
+    if (res != GA_NO_ERROR) goto out;
+    res = dst_ctx->ops->event_alloc(&wev[b], dst_ctx);
+    if (res != GA_NO_ERROR) goto out;
+  }
+
+  res = src_ctx->ops->buffer_read(stage[0], src, srcoff, chunk, NULL, rev[0]);
+  if (res != GA_NO_ERROR) goto out;
+  for (k = 0; k < n; k++) {
+    b = k & 1;
+    off = k * chunk;
+    if (k + 1 < n) {
+      /* The other staging buffer is free once chunk k - 1 is written */
+      if (k > 0) {
+        res = dst_ctx->ops->event_sync(wev[!b]);
+        if (res != GA_NO_ERROR) goto out;
+      }
+      res = src_ctx->ops->buffer_read(stage[!b], src, srcoff + off + chunk,
+                                      sz - (off + chunk) < chunk ?
+                                      sz - (off + chunk) : chunk,
+                                      NULL, rev[!b]);
+      if (res != GA_NO_ERROR) goto out;
+    }
+    res = src_ctx->ops->event_sync(rev[b]);
+    if (res != GA_NO_ERROR) goto out;
+    res = dst_ctx->ops->buffer_write(dst, dstoff + off, stage[b],
+                                     sz - off < chunk ? sz - off : chunk,
+                                     NULL, wev[b]);
+    if (res != GA_NO_ERROR) goto out;
+  }
+  *nchunks = n;
+
+ out:
+  /* Nothing may be using the staging buffers when they are freed */
+  for (b = 0; b < nb; b++) {
+    if (rev[b] != NULL) {
+      src_ctx->ops->event_sync(rev[b]);
+      src_ctx->ops->event_free(rev[b]);
+    }
+    if (wev[b] != NULL) {
+      if (dst_ctx->ops->event_sync(wev[b]) != GA_NO_ERROR &&
+          res == GA_NO_ERROR)
+        res = dst_ctx->err->code;
+      dst_ctx->ops->event_free(wev[b]);
+    }
+    if (sb[b] != NULL)
+      ((partial_gpudata *)sb[b])->ctx->ops->buffer_release(sb[b]);
+    else
+      free(stage[b]);
+  }
+  return res;
+}
+
+int gpudata_stream(gpudata *buf, size_t off, size_t sz, size_t elsize,
+                   int write, gpudata_stage_fn fn, void *arg) {
+  gpucontext *ctx = ((partial_gpudata *)buf)->ctx;
+  gpudata *sb[2] = {NULL, NULL};
+  char *stage[2] = {NULL, NULL};
+  gpuevent *ev[2] = {NULL, NULL};
+  size_t chunk, n, k, len;
+  unsigned int b, nb;
+  int res = GA_NO_ERROR;
+
+  if (sz == 0)
+    return GA_NO_ERROR;
+  chunk = ctx->transfer_chunk - ctx->transfer_chunk % elsize;
+  if (chunk == 0) chunk = elsize;
+  if (chunk > sz) chunk = sz;
+  n = (sz + chunk - 1) / chunk;
+  nb = n > 1 ? 2 : 1;
+
+  for (b = 0; b < nb; b++) {
+    stage[b] = gpudata_stage_alloc(ctx, chunk, &sb[b]);
+    if (stage[b] == NULL)
+      stage[b] = malloc(chunk);
+    if (stage[b] == NULL) {
+      res = error_sys(ctx->err, "malloc");
+      goto out;
+    }
+    ev[b] = gpuevent_alloc(ctx, &res);
+    if (ev[b] == NULL) goto out;
+  }
+
+  if (write) {
+    for (k = 0; k < n; k++) {
+      b = k & 1;
+      len = sz - k * chunk < chunk ? sz - k * chunk : chunk;
+      /* Wait for the transfer that last used this staging buffer */
+      if (k >= 2) {
+        res = gpuevent_sync(ev[b]);
+        if (res != GA_NO_ERROR) goto out;
+      }
+      res = fn(stage[b], k * chunk, len, arg);
+      if (res != GA_NO_ERROR) goto out;
+      res = gpudata_write_async(buf, off + k * chunk, stage[b], len, NULL,
+                                ev[b]);
+      if (res != GA_NO_ERROR) goto out;
+    }
+  } else {
+    res = gpudata_read_async(stage[0], buf, off, chunk, NULL, ev[0]);
+    if (res != GA_NO_ERROR) goto out;
+    for (k = 0; k < n; k++) {
+      b = k & 1;
+      len = sz - k * chunk < chunk ? sz - k * chunk : chunk;
+      if (k + 1 < n) {
+        res = gpudata_read_async(stage[!b], buf, off + (k + 1) * chunk,
+                                 sz - (k + 1) * chunk < chunk ?
+                                 sz - (k + 1) * chunk : chunk,
+                                 NULL, ev[!b]);
+        if (res != GA_NO_ERROR) goto out;
+      }
+      res = gpuevent_sync(ev[b]);
+      if (res != GA_NO_ERROR) goto out;
+      res = fn(stage[b], k * chunk, len, arg);
+      if (res != GA_NO_ERROR) goto out;
+    }
+  }
+
+ out:
+  /* Nothing may be using the staging buffers when they are freed */
+  for (b = 0; b < nb; b++) {
+    if (ev[b] != NULL) {
+      if (gpuevent_sync(ev[b]) != GA_NO_ERROR && res == GA_NO_ERROR)
+        res = ctx->err->code;
+      gpuevent_free(ev[b]);
+    }
+    if (sb[b] != NULL)
+      ctx->ops->buffer_release(sb[b]);
+    else
+      free(stage[b]);
+  }
+  return res;
 }
 
 int gpudata_transfer(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
                      size_t sz) {
   gpucontext *src_ctx;
   gpucontext *dst_ctx;
-  void *tmp;
+  size_t nchunks;
+  uint64_t t;
   int res;
   src_ctx = ((partial_gpudata *)src)->ctx;
   dst_ctx = ((partial_gpudata *)dst)->ctx;
   if (src_ctx == dst_ctx)
-    return src_ctx->ops->buffer_move(dst, dstoff, src, srcoff, sz);
+    return gpudata_move_s(dst, dstoff, src, srcoff, sz, NULL);
+  GA_CHECK(check_capture(src_ctx, "Transfer"));
+  GA_CHECK(check_capture(dst_ctx, "Transfer"));
+  t = ga_trace ? trace_now() : 0;
   if (src_ctx->ops == dst_ctx->ops) {
     res = src_ctx->ops->buffer_transfer(dst, dstoff, src, srcoff, sz);
-    if (res == GA_NO_ERROR)
+    if (res == GA_NO_ERROR) {
+      if (ga_trace)
+        trace_complete("transfer", "transfer", t, "\"size\":%llu",
+                       (unsigned long long)sz);
       return res;
+    }
   }
 
   /* Fallback to host copy */
-  tmp = malloc(sz);
-  if (tmp == NULL) {
-    error_sys(src_ctx->err, "malloc");
-    return error_sys(dst_ctx->err, "malloc");
-  }
-  res = src_ctx->ops->buffer_read(tmp, src, srcoff, sz);
-  if (res != GA_NO_ERROR) {
-    free(tmp);
-    return res;
-  }
-  res = dst_ctx->ops->buffer_write(dst, dstoff, tmp, sz);
-  free(tmp);
+  res = gpudata_transfer_host(dst, dstoff, src, srcoff, sz, &nchunks);
+  if (ga_trace)
+    trace_complete("transfer", "transfer", t,
+                   "\"size\":%llu,\"host\":true,\"chunks\":%llu",
+                   (unsigned long long)sz, (unsigned long long)nchunks);
   return res;
 }
 
+int gpudata_copy_rect(const ga_rect *dst, const ga_rect *src,
+                      const size_t *region, gpustream *s) {
+  gpucontext *ctx = ((partial_gpudata *)(dst->buf ? dst->buf : src->buf))->ctx;
+  uint64_t t;
+  int err = check_stream(ctx, s);
+  if (err != GA_NO_ERROR) return err;
+  GA_CHECK(check_capture(ctx, "Rectangular copy"));
+  if (ctx->ops->buffer_copy_rect == NULL)
+    return error_set(ctx->err, GA_DEVSUP_ERROR,
+                     "Rectangular copies are not supported");
+  if (ga_trace) {
+    t = trace_now();
+    err = ctx->ops->buffer_copy_rect(dst, src, region, s);
+    trace_complete("transfer", dst->buf == NULL ? "read_rect" :
+                   (src->buf == NULL ? "write_rect" : "move_rect"), t,
+                   "\"width\":%llu,\"rows\":%llu,\"slices\":%llu",
+                   (unsigned long long)region[0],
+                   (unsigned long long)region[1],
+                   (unsigned long long)region[2]);
+    return err;
+  }
+  return ctx->ops->buffer_copy_rect(dst, src, region, s);
+}
+
 int gpudata_read(void *dst, gpudata *src, size_t srcoff, size_t sz) {
-  return ((partial_gpudata *)src)->ctx->ops->buffer_read(dst, src, srcoff, sz);
+  return gpudata_read_s(dst, src, srcoff, sz, NULL);
+}
+
+static int check_done(gpucontext *ctx, gpuevent *done) {
+  if (done == NULL)
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Asynchronous transfers need an event");
+  if (((partial_gpuevent *)done)->ctx != ctx)
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Event and buffer belong to different contexts");
+  return GA_NO_ERROR;
+}
+
+static int buffer_read(void *dst, gpudata *src, size_t srcoff, size_t sz,
+                       gpustream *s, gpuevent *done) {
+  gpucontext *ctx = ((partial_gpudata *)src)->ctx;
+  uint64_t t;
+  int err = check_stream(ctx, s);
+  if (err != GA_NO_ERROR) return err;
+  GA_CHECK(check_capture(ctx, "Read"));
+  if (ga_trace) {
+    t = trace_now();
+    err = ctx->ops->buffer_read(dst, src, srcoff, sz, s, done);
+    trace_complete("transfer", done ? "read_async" : "read", t,
+                   "\"size\":%llu", (unsigned long long)sz);
+    return err;
+  }
+  return ctx->ops->buffer_read(dst, src, srcoff, sz, s, done);
+}
+
+int gpudata_read_s(void *dst, gpudata *src, size_t srcoff, size_t sz,
+                   gpustream *s) {
+  return buffer_read(dst, src, srcoff, sz, s, NULL);
+}
+
+int gpudata_read_async(void *dst, gpudata *src, size_t srcoff, size_t sz,
+                       gpustream *s, gpuevent *done) {
+  GA_CHECK(check_done(((partial_gpudata *)src)->ctx, done));
+  return buffer_read(dst, src, srcoff, sz, s, done);
 }
 
 int gpudata_write(gpudata *dst, size_t dstoff, const void *src, size_t sz) {
-  return ((partial_gpudata *)dst)->ctx->ops->buffer_write(dst, dstoff,
-                                                          src, sz);
+  return gpudata_write_s(dst, dstoff, src, sz, NULL);
+}
+
+static int buffer_write(gpudata *dst, size_t dstoff, const void *src,
+                        size_t sz, gpustream *s, gpuevent *done) {
+  gpucontext *ctx = ((partial_gpudata *)dst)->ctx;
+  uint64_t t;
+  int err = check_stream(ctx, s);
+  if (err != GA_NO_ERROR) return err;
+  GA_CHECK(check_capture(ctx, "Write"));
+  if (ga_trace) {
+    t = trace_now();
+    err = ctx->ops->buffer_write(dst, dstoff, src, sz, s, done);
+    trace_complete("transfer", done ? "write_async" : "write", t,
+                   "\"size\":%llu", (unsigned long long)sz);
+    return err;
+  }
+  return ctx->ops->buffer_write(dst, dstoff, src, sz, s, done);
+}
+
+int gpudata_write_s(gpudata *dst, size_t dstoff, const void *src, size_t sz,
+                    gpustream *s) {
+  return buffer_write(dst, dstoff, src, sz, s, NULL);
+}
+
+int gpudata_write_async(gpudata *dst, size_t dstoff, const void *src,
+                        size_t sz, gpustream *s, gpuevent *done) {
+  GA_CHECK(check_done(((partial_gpudata *)dst)->ctx, done));
+  return buffer_write(dst, dstoff, src, sz, s, done);
 }
 
 int gpudata_memset(gpudata *dst, size_t dstoff, int data) {
-  return ((partial_gpudata *)dst)->ctx->ops->buffer_memset(dst, dstoff, data);
+  gpucontext *ctx = ((partial_gpudata *)dst)->ctx;
+  uint64_t t;
+  int err;
+  if (ctx->capture != NULL)
+    return gpugraph_add_memset(ctx->capture, dst, dstoff, data);
+  if (ga_trace) {
+    t = trace_now();
+    err = ctx->ops->buffer_memset(dst, dstoff, data);
+    trace_complete("transfer", "memset", t, "\"buf\":\"%p\"", (void *)dst);
+    return err;
+  }
+  return ctx->ops->buffer_memset(dst, dstoff, data);
+}
+
+int gpudata_fill(gpudata *dst, size_t dstoff, size_t sz, const void *pattern,
+                 size_t psz) {
+  gpucontext *ctx = ((partial_gpudata *)dst)->ctx;
+  uint64_t t;
+  int err;
+  /* Graphs only know about byte memsets */
+  if (ctx->capture != NULL || ctx->ops->buffer_fill == NULL)
+    return error_set(ctx->err, GA_UNSUPPORTED_ERROR,
+                     "No native fill available");
+  if (ga_trace) {
+    t = trace_now();
+    err = ctx->ops->buffer_fill(dst, dstoff, sz, pattern, psz);
+    trace_complete("transfer", "fill", t, "\"buf\":\"%p\"", (void *)dst);
+    return err;
+  }
+  return ctx->ops->buffer_fill(dst, dstoff, sz, pattern, psz);
 }
 
 int gpudata_sync(gpudata *b) {
-  return ((partial_gpudata *)b)->ctx->ops->buffer_sync(b);
+  gpucontext *ctx = ((partial_gpudata *)b)->ctx;
+  GA_CHECK(check_capture(ctx, "Sync"));
+  return ctx->ops->buffer_sync(b);
 }
 
 int gpudata_property(gpudata *b, int prop_id, void *res) {
@@ -249,10 +713,42 @@ int gpukernel_setarg(gpukernel *k, unsigned int i, void *a) {
   return ((partial_gpukernel *)k)->ctx->ops->kernel_setarg(k, i, a);
 }
 
+static int trace_kernel_call(gpucontext *ctx, gpukernel *k, unsigned int n,
+                             const size_t *gs, const size_t *ls,
+                             size_t shared, void **args, gpustream *s) {
+  unsigned long long g[3] = {1, 1, 1}, l[3] = {1, 1, 1};
+  unsigned int i;
+  uint64_t t = trace_now();
+  int err = ctx->ops->kernel_call(k, n, gs, ls, shared, args, s);
+
+  for (i = 0; i < n && i < 3; i++) {
+    if (gs != NULL) g[i] = gs[i];
+    if (ls != NULL) l[i] = ls[i];
+  }
+  trace_complete("kernel", "launch", t,
+                 "\"kernel\":\"%p\",\"gs\":[%llu,%llu,%llu],"
+                 "\"ls\":[%llu,%llu,%llu],\"shared\":%llu",
+                 (void *)k, g[0], g[1], g[2], l[0], l[1], l[2],
+                 (unsigned long long)shared);
+  return err;
+}
+
 int gpukernel_call(gpukernel *k, unsigned int n, const size_t *gs,
                    const size_t *ls, size_t shared, void **args) {
-  return ((partial_gpukernel *)k)->ctx->ops->kernel_call(k, n, gs, ls,
-                                                         shared, args);
+  return gpukernel_call_s(k, n, gs, ls, shared, args, NULL);
+}
+
+int gpukernel_call_s(gpukernel *k, unsigned int n, const size_t *gs,
+                     const size_t *ls, size_t shared, void **args,
+                     gpustream *s) {
+  gpucontext *ctx = ((partial_gpukernel *)k)->ctx;
+  int err = check_stream(ctx, s);
+  if (err != GA_NO_ERROR) return err;
+  if (ctx->capture != NULL)
+    return gpugraph_add_kernel(ctx->capture, k, n, gs, ls, shared, args);
+  if (ga_trace)
+    return trace_kernel_call(ctx, k, n, gs, ls, shared, args, s);
+  return ctx->ops->kernel_call(k, n, gs, ls, shared, args, s);
 }
 
 int gpukernel_property(gpukernel *k, int prop_id, void *res) {
@@ -260,6 +756,12 @@ int gpukernel_property(gpukernel *k, int prop_id, void *res) {
                                                       res);
 }
 
+int gpukernel_occupancy(gpukernel *k, size_t ls, size_t shared,
+                        unsigned int *blocks) {
+  return ((partial_gpukernel *)k)->ctx->ops->kernel_occupancy(k, ls, shared,
+                                                              blocks);
+}
+
 gpucontext *gpudata_context(gpudata *b) {
   return ((partial_gpudata *)b)->ctx;
 }
@@ -267,3 +769,86 @@ gpucontext *gpudata_context(gpudata *b) {
 gpucontext *gpukernel_context(gpukernel *k) {
   return ((partial_gpukernel *)k)->ctx;
 }
+
+gpustream *gpustream_alloc(gpucontext *ctx, int *ret) {
+  gpustream *res = NULL;
+  int err;
+  err = ctx->ops->stream_alloc(&res, ctx);
+  if (err != GA_NO_ERROR && ret != NULL)
+    *ret = ctx->err->code;
+  return res;
+}
+
+void gpustream_free(gpustream *s) {
+  gpucontext *ctx;
+  if (s) {
+    ctx = ((partial_gpustream *)s)->ctx;
+    scratch_clear(ctx, s, 0);
+    ctx->ops->stream_free(s);
+  }
+}
+
+int gpustream_sync(gpustream *s) {
+  return ((partial_gpustream *)s)->ctx->ops->stream_sync(s);
+}
+
+int gpustream_wait(gpustream *s, gpustream *other) {
+  gpucontext *ctx;
+  if (s == NULL && other == NULL)
+    return error_set(global_err, GA_VALUE_ERROR,
+                     "At least one stream must be given");
+  ctx = ((partial_gpustream *)(s ? s : other))->ctx;
+  if (s != NULL && other != NULL && ((partial_gpustream *)other)->ctx != ctx)
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Streams belong to different contexts");
+  if (s == other)
+    return GA_NO_ERROR;
+  return ctx->ops->stream_wait(s, other);
+}
+
+gpucontext *gpustream_context(gpustream *s) {
+  return ((partial_gpustream *)s)->ctx;
+}
+
+gpuevent *gpuevent_alloc(gpucontext *ctx, int *ret) {
+  gpuevent *res = NULL;
+  int err;
+  err = ctx->ops->event_alloc(&res, ctx);
+  if (err != GA_NO_ERROR && ret != NULL)
+    *ret = ctx->err->code;
+  return res;
+}
+
+void gpuevent_free(gpuevent *e) {
+  if (e)
+    ((partial_gpuevent *)e)->ctx->ops->event_free(e);
+}
+
+int gpuevent_record(gpuevent *e, gpustream *s) {
+  gpucontext *ctx = ((partial_gpuevent *)e)->ctx;
+  GA_CHECK(check_stream(ctx, s));
+  GA_CHECK(check_capture(ctx, "Event record"));
+  return ctx->ops->event_record(e, s);
+}
+
+int gpuevent_sync(gpuevent *e) {
+  gpucontext *ctx = ((partial_gpuevent *)e)->ctx;
+  GA_CHECK(check_capture(ctx, "Event sync"));
+  return ctx->ops->event_sync(e);
+}
+
+int gpuevent_query(gpuevent *e, int *done) {
+  return ((partial_gpuevent *)e)->ctx->ops->event_query(e, done);
+}
+
+int gpuevent_elapsed(gpuevent *start, gpuevent *end, double *ms) {
+  gpucontext *ctx = ((partial_gpuevent *)start)->ctx;
+  if (((partial_gpuevent *)end)->ctx != ctx)
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Events belong to different contexts");
+  return ctx->ops->event_elapsed(start, end, ms);
+}
+
+gpucontext *gpuevent_context(gpuevent *e) {
+  return ((partial_gpuevent *)e)->ctx;
+}
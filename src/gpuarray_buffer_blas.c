@@ -17,18 +17,32 @@ const char *gpublas_error(gpucontext *ctx) {
   return ctx->err->msg;
 }
 
+/* Trace the library call when tracing is on */
+#define BLAS_CALL(name, args)                                           \
+  do {                                                                  \
+    uint64_t t;                                                         \
+    int res;                                                            \
+    if (!ga_trace) return ctx->blas_ops->name args;                     \
+    t = trace_now();                                                    \
+    res = ctx->blas_ops->name args;                                     \
+    trace_complete("blas", #name, t, NULL);                             \
+    return res;                                                         \
+  } while (0)
+
 #define BLAS_OP(buf, name, args)                                        \
   gpucontext *ctx = gpudata_context(buf);                               \
+  GA_CHECK(check_capture(ctx, "Blas operation"));                       \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(name, args);                                              \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by device or missing library: %s", #name)
 
 #define BLAS_OPF(buf, name, args)                                       \
   gpucontext *ctx = gpudata_context(buf);                               \
   if (flags != 0) return error_set(ctx->err, GA_INVALID_ERROR, "flags is not 0"); \
+  GA_CHECK(check_capture(ctx, "Blas operation"));                       \
   if (ctx->blas_ops->name)						\
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(name, args);                                              \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by device or missing library: %s", #name)
 
@@ -142,8 +156,9 @@ int gpublas_dger(cb_order order, size_t M, size_t N, double alpha,
   gpucontext *ctx;                                                      \
   if (batchCount == 0) return GA_NO_ERROR;                              \
   ctx = gpudata_context(l[0]);                                          \
+  GA_CHECK(check_capture(ctx, "Blas operation"));                       \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(name, args);                                              \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by library in use: %s", #name)
 
@@ -152,8 +167,9 @@ int gpublas_dger(cb_order order, size_t M, size_t N, double alpha,
   if (batchCount == 0) return GA_NO_ERROR;                              \
   ctx = gpudata_context(l[0]);                                          \
   if (flags != 0) return error_set(ctx->err, GA_INVALID_ERROR, "flags is not 0"); \
+  GA_CHECK(check_capture(ctx, "Blas operation"));                       \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(name, args);                                              \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by library in use: %s", #name)
 
@@ -265,8 +281,9 @@ int gpublas_dgerBatch(cb_order order, size_t M, size_t N, double alpha,
   if (batchCount == 0) return GA_NO_ERROR;                              \
   ctx = gpudata_context(b);                                             \
   if (flags != 0) return error_set(ctx->err, GA_INVALID_ERROR, "flags is not 0"); \
+  GA_CHECK(check_capture(ctx, "Blas operation"));                       \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(name, args);                                              \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by library in use: %s", #name)
 
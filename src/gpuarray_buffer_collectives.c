@@ -51,47 +51,127 @@ int gpucomm_get_rank(gpucomm* comm, int* rank) {
 int gpucomm_reduce(gpudata* src, size_t offsrc, gpudata* dest, size_t offdest,
                    size_t count, int typecode, int opcode, int root,
                    gpucomm* comm) {
+  return gpucomm_reduce_s(src, offsrc, dest, offdest, count, typecode,
+                          opcode, root, comm, NULL);
+}
+
+int gpucomm_reduce_s(gpudata* src, size_t offsrc, gpudata* dest,
+                     size_t offdest, size_t count, int typecode, int opcode,
+                     int root, gpucomm* comm, gpustream* s) {
   gpucontext* ctx = gpucomm_context(comm);
+  uint64_t t;
+  int err;
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
-  return ctx->comm_ops->reduce(src, offsrc, dest, offdest, count, typecode,
-                               opcode, root, comm);
+  GA_CHECK(check_stream(ctx, s));
+  GA_CHECK(check_capture(ctx, "Collective operation"));
+  t = ga_trace ? trace_now() : 0;
+  err = ctx->comm_ops->reduce(src, offsrc, dest, offdest, count, typecode,
+                              opcode, root, comm, s);
+  if (ga_trace)
+    trace_complete("collective", "reduce", t, "\"count\":%llu",
+                   (unsigned long long)count);
+  return err;
 }
 
 int gpucomm_all_reduce(gpudata* src, size_t offsrc, gpudata* dest,
                        size_t offdest, size_t count, int typecode, int opcode,
                        gpucomm* comm) {
+  return gpucomm_all_reduce_s(src, offsrc, dest, offdest, count, typecode,
+                              opcode, comm, NULL);
+}
+
+int gpucomm_all_reduce_s(gpudata* src, size_t offsrc, gpudata* dest,
+                         size_t offdest, size_t count, int typecode,
+                         int opcode, gpucomm* comm, gpustream* s) {
   gpucontext* ctx = gpucomm_context(comm);
+  uint64_t t;
+  int err;
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
-  return ctx->comm_ops->all_reduce(src, offsrc, dest, offdest, count, typecode,
-                                   opcode, comm);
+  GA_CHECK(check_stream(ctx, s));
+  GA_CHECK(check_capture(ctx, "Collective operation"));
+  t = ga_trace ? trace_now() : 0;
+  err = ctx->comm_ops->all_reduce(src, offsrc, dest, offdest, count, typecode,
+                                  opcode, comm, s);
+  if (ga_trace)
+    trace_complete("collective", "all_reduce", t, "\"count\":%llu",
+                   (unsigned long long)count);
+  return err;
 }
 
 int gpucomm_reduce_scatter(gpudata* src, size_t offsrc, gpudata* dest,
                            size_t offdest, size_t count, int typecode,
                            int opcode, gpucomm* comm) {
+  return gpucomm_reduce_scatter_s(src, offsrc, dest, offdest, count,
+                                  typecode, opcode, comm, NULL);
+}
+
+int gpucomm_reduce_scatter_s(gpudata* src, size_t offsrc, gpudata* dest,
+                             size_t offdest, size_t count, int typecode,
+                             int opcode, gpucomm* comm, gpustream* s) {
   gpucontext* ctx = gpucomm_context(comm);
+  uint64_t t;
+  int err;
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
-  return ctx->comm_ops->reduce_scatter(src, offsrc, dest, offdest, count,
-                                       typecode, opcode, comm);
+  GA_CHECK(check_stream(ctx, s));
+  GA_CHECK(check_capture(ctx, "Collective operation"));
+  t = ga_trace ? trace_now() : 0;
+  err = ctx->comm_ops->reduce_scatter(src, offsrc, dest, offdest, count,
+                                      typecode, opcode, comm, s);
+  if (ga_trace)
+    trace_complete("collective", "reduce_scatter", t, "\"count\":%llu",
+                   (unsigned long long)count);
+  return err;
 }
 
 int gpucomm_broadcast(gpudata* array, size_t offset, size_t count, int typecode,
                       int root, gpucomm* comm) {
+  return gpucomm_broadcast_s(array, offset, count, typecode, root, comm,
+                             NULL);
+}
+
+int gpucomm_broadcast_s(gpudata* array, size_t offset, size_t count,
+                        int typecode, int root, gpucomm* comm, gpustream* s) {
   gpucontext* ctx = gpucomm_context(comm);
+  uint64_t t;
+  int err;
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
-  return ctx->comm_ops->broadcast(array, offset, count, typecode, root, comm);
+  GA_CHECK(check_stream(ctx, s));
+  GA_CHECK(check_capture(ctx, "Collective operation"));
+  t = ga_trace ? trace_now() : 0;
+  err = ctx->comm_ops->broadcast(array, offset, count, typecode, root, comm,
+                                 s);
+  if (ga_trace)
+    trace_complete("collective", "broadcast", t, "\"count\":%llu",
+                   (unsigned long long)count);
+  return err;
 }
 
 int gpucomm_all_gather(gpudata* src, size_t offsrc, gpudata* dest,
                        size_t offdest, size_t count, int typecode,
                        gpucomm* comm) {
+  return gpucomm_all_gather_s(src, offsrc, dest, offdest, count, typecode,
+                              comm, NULL);
+}
+
+int gpucomm_all_gather_s(gpudata* src, size_t offsrc, gpudata* dest,
+                         size_t offdest, size_t count, int typecode,
+                         gpucomm* comm, gpustream* s) {
   gpucontext* ctx = gpucomm_context(comm);
+  uint64_t t;
+  int err;
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
-  return ctx->comm_ops->all_gather(src, offsrc, dest, offdest, count, typecode,
-                                   comm);
+  GA_CHECK(check_stream(ctx, s));
+  GA_CHECK(check_capture(ctx, "Collective operation"));
+  t = ga_trace ? trace_now() : 0;
+  err = ctx->comm_ops->all_gather(src, offsrc, dest, offdest, count, typecode,
+                                  comm, s);
+  if (ga_trace)
+    trace_complete("collective", "all_gather", t, "\"count\":%llu",
+                   (unsigned long long)count);
+  return err;
 }
@@ -9,6 +9,7 @@
 #include <sys/types.h>
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #include <cache.h>
@@ -47,8 +48,6 @@ const gpuarray_buffer_ops cuda_ops;
 
 static void cuda_freekernel(gpukernel *);
 static int cuda_property(gpucontext *, gpudata *, gpukernel *, int, void *);
-static int cuda_waits(gpudata *, int, CUstream);
-static int cuda_records(gpudata *, int, CUstream);
 static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags);
 static void cuda_free(gpudata *);
 
@@ -257,7 +256,13 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
   res->enter = 0;
   res->major = major;
   res->minor = minor;
-  res->freeblocks = NULL;
+  res->pools = NULL;
+  res->seq = 0;
+  res->capture = NULL;
+  res->scratch = NULL;
+  res->transfer_chunk = DEFAULT_TRANSFER_CHUNK;
+  res->trace = NULL;
+  res->host = NULL;
   if (error_alloc(&res->err)) {
     error_set(global_err, GA_SYS_ERROR, "Could not create error context");
     goto fail_errmsg;
@@ -283,6 +288,12 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
       goto fail_mem_stream;
     }
   }
+  res->pools = calloc(1, sizeof(*res->pools));
+  if (res->pools == NULL) {
+    error_sys(global_err, "calloc");
+    goto fail_pool;
+  }
+  res->pools->s = res->s;
 
   res->kernel_cache = cache_twoq(64, 128, 64, 8,
                                  (cache_eq_fn)kernel_eq,
@@ -355,6 +366,8 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
     cache_destroy(res->disk_cache);
   cache_destroy(res->kernel_cache);
  fail_cache:
+  free(res->pools);
+ fail_pool:
   if (ISCLR(res->flags, GA_CTX_SINGLE_STREAM))
     cuStreamDestroy(res->mem_s);
  fail_mem_stream:
@@ -366,11 +379,110 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
   return NULL;
 }
 
+/*
+ * Emit the device time of the traced launches that are done, or of
+ * all of them if wait is set.  Must be called inside the context.
+ */
+static void cuda_trace_flush(cuda_context *ctx, int wait) {
+  cuda_trace *t = ctx->trace;
+  unsigned int i;
+  float off, ms;
+
+  while (t->n > 0) {
+    i = t->first;
+    if (wait)
+      cuEventSynchronize(t->end[i]);
+    else if (cuEventQuery(t->end[i]) != CUDA_SUCCESS)
+      break;
+    if (cuEventElapsedTime(&off, t->base, t->start[i]) == CUDA_SUCCESS &&
+        cuEventElapsedTime(&ms, t->start[i], t->end[i]) == CUDA_SUCCESS)
+      trace_device("kernel", t->base_ts + (uint64_t)(off * 1e6),
+                   (uint64_t)(ms * 1e6), "\"kernel\":\"%p\"", t->k[i]);
+    t->first = (t->first + 1) % CUDA_TRACE_MAX;
+    t->n--;
+  }
+}
+
+static void cuda_trace_destroy(cuda_trace *t) {
+  unsigned int i;
+
+  for (i = 0; i < CUDA_TRACE_MAX; i++) {
+    if (t->start[i] != NULL) cuEventDestroy(t->start[i]);
+    if (t->end[i] != NULL) cuEventDestroy(t->end[i]);
+  }
+  if (t->base != NULL) cuEventDestroy(t->base);
+  free(t);
+}
+
+/*
+ * Called by gputrace_stop() to emit the launches still in flight.
+ * The next session starts over with a new base event.
+ */
+static void cuda_trace_stop(void *c) {
+  cuda_context *ctx = (cuda_context *)c;
+
+  cuda_enter(ctx);
+  cuda_trace_flush(ctx, 1);
+  cuda_trace_destroy(ctx->trace);
+  ctx->trace = NULL;
+  cuda_exit(ctx);
+}
+
+/*
+ * Reserve a slot for a traced launch and record its start event.
+ * Returns the slot or -1 if the device time can't be measured.
+ */
+static int cuda_trace_begin(cuda_context *ctx, gpukernel *k, CUstream s) {
+  cuda_trace *t = ctx->trace;
+  unsigned int i;
+
+  if (t == NULL) {
+    t = calloc(1, sizeof(*t));
+    if (t == NULL) return -1;
+    for (i = 0; i < CUDA_TRACE_MAX; i++) {
+      if (cuEventCreate(&t->start[i], CU_EVENT_DEFAULT) != CUDA_SUCCESS ||
+          cuEventCreate(&t->end[i], CU_EVENT_DEFAULT) != CUDA_SUCCESS)
+        break;
+    }
+    /* The base is taken once the stream is idle so that its device
+       time matches the host time we read after it */
+    if (i != CUDA_TRACE_MAX ||
+        cuEventCreate(&t->base, CU_EVENT_DEFAULT) != CUDA_SUCCESS ||
+        cuEventRecord(t->base, s) != CUDA_SUCCESS ||
+        cuEventSynchronize(t->base) != CUDA_SUCCESS ||
+        trace_add_flush(cuda_trace_stop, ctx) != GA_NO_ERROR) {
+      cuda_trace_destroy(t);
+      return -1;
+    }
+    t->base_ts = trace_now();
+    ctx->trace = t;
+  }
+  cuda_trace_flush(ctx, 0);
+  if (t->n == CUDA_TRACE_MAX) {
+    /* Only wait for the oldest launch to free its slot, the others
+       stay in flight */
+    cuEventSynchronize(t->end[t->first]);
+    cuda_trace_flush(ctx, 0);
+  }
+  i = (t->first + t->n) % CUDA_TRACE_MAX;
+  if (cuEventRecord(t->start[i], s) != CUDA_SUCCESS)
+    return -1;
+  t->k[i] = k;
+  return i;
+}
+
+static void cuda_trace_end(cuda_context *ctx, int slot, CUstream s) {
+  if (cuEventRecord(ctx->trace->end[slot], s) == CUDA_SUCCESS)
+    ctx->trace->n++;
+}
+
 static void deallocate(gpudata *);
 
 static void cuda_free_ctx(cuda_context *ctx) {
+  cuda_pool *pool;
   gpudata *next, *curr;
   CUdevice dev;
+  unsigned int i;
 
   ASSERT_CTX(ctx);
   ctx->refcnt--;
@@ -382,15 +494,42 @@ static void cuda_free_ctx(cuda_context *ctx) {
     cuMemFreeHost((void *)ctx->errbuf->ptr);
     deallocate(ctx->errbuf);
 
+    if (ctx->trace != NULL) {
+      trace_del_flush(cuda_trace_stop, ctx);
+      cuda_enter(ctx);
+      /* Only a running session can take the events */
+      if (ga_trace)
+        cuda_trace_flush(ctx, 1);
+      cuda_trace_destroy(ctx->trace);
+      cuda_exit(ctx);
+    }
+
     if (ISCLR(ctx->flags, GA_CTX_SINGLE_STREAM))
       cuStreamDestroy(ctx->mem_s);
     cuStreamDestroy(ctx->s);
 
-    /* Clear out the freelist */
-    for (curr = ctx->freeblocks; curr != NULL; curr = next) {
-      next = curr->next;
-      cuMemFree(curr->ptr);
-      deallocate(curr);
+    /* Clear out the freelists.  Pieces of an allocation can be in
+       different pools so only the head frees the memory. */
+    while (ctx->pools != NULL) {
+      pool = ctx->pools;
+      for (curr = pool->freeblocks; curr != NULL; curr = next) {
+        next = curr->next;
+        if (curr->flags & CUDA_HEAD_ALLOC)
+          cuMemFree(curr->ptr);
+        deallocate(curr);
+      }
+      ctx->pools = pool->next;
+      free(pool);
+    }
+    if (ctx->host != NULL) {
+      for (i = 0; i < CUDA_HOST_CLASSES; i++) {
+        while (ctx->host->free[i] != NULL) {
+          void *p = ctx->host->free[i];
+          ctx->host->free[i] = *(void **)p;
+          cuMemFreeHost(p);
+        }
+      }
+      free(ctx->host);
     }
     cache_destroy(ctx->kernel_cache);
     if (ctx->disk_cache)
@@ -413,6 +552,20 @@ CUstream cuda_get_stream(cuda_context *ctx) {
   return ctx->s;
 }
 
+int cuda_get_device(cuda_context *ctx) {
+  CUdevice dev;
+  CUresult err;
+  ASSERT_CTX(ctx);
+  cuda_enter(ctx);
+  err = cuCtxGetDevice(&dev);
+  cuda_exit(ctx);
+  if (err != CUDA_SUCCESS) {
+    error_cuda(ctx->err, "cuCtxGetDevice", err);
+    return -1;
+  }
+  return (int)dev;
+}
+
 void cuda_enter(cuda_context *ctx) {
   ASSERT_CTX(ctx);
   if (!ctx->enter)
@@ -444,6 +597,10 @@ static gpudata *new_gpudata(cuda_context *ctx, CUdeviceptr ptr, size_t size) {
 
   res->flags = 0;
   res->ls = NULL;
+  res->rs = NULL;
+  res->xrev = NULL;
+  res->rseq = 0;
+  res->wseq = 0;
 
   cuda_enter(ctx);
 
@@ -597,24 +754,153 @@ static void cuda_deinit(gpucontext *c) {
 }
 
 /*
- * Find the block in the free list that is the best fit for the size
- * we want, which means the smallest that can still fit the size.
+ * Get the pool for blocks last used on `s`, creating it if needed.
+ * Returns NULL if it couldn't be created.
+ */
+static cuda_pool *pool_get(cuda_context *ctx, CUstream s) {
+  cuda_pool *p;
+
+  for (p = ctx->pools; p != NULL; p = p->next)
+    if (p->s == s) return p;
+  p = malloc(sizeof(*p));
+  if (p == NULL) return NULL;
+  p->s = s;
+  p->freeblocks = NULL;
+  /* Keep the pool of the context stream first */
+  p->next = ctx->pools->next;
+  ctx->pools->next = p;
+  return p;
+}
+
+/*
+ * Check if all the work recorded on a block is done, without
+ * waiting.
  */
-static void find_best(cuda_context *ctx, gpudata **best, gpudata **prev,
-                     size_t size) {
-  gpudata *temp, *tempPrev = NULL;
+static int block_idle(gpudata *d) {
+  int res;
+
+  cuda_enter(d->ctx);
+  res = (cuEventQuery(d->rev) == CUDA_SUCCESS &&
+         cuEventQuery(d->wev) == CUDA_SUCCESS);
+  cuda_exit(d->ctx);
+  return res;
+}
+
+/*
+ * Have `d`, which is absorbing `o`, keep the latest of their events.
+ * Both must be from the same pool.
+ */
+static void merge_events(gpudata *d, gpudata *o) {
+  CUevent tmp;
+
+  if (o->rseq > d->rseq) {
+    tmp = d->rev;
+    d->rev = o->rev;
+    o->rev = tmp;
+    d->rseq = o->rseq;
+    d->rs = o->rs;
+  }
+  if (o->wseq > d->wseq) {
+    tmp = d->wev;
+    d->wev = o->wev;
+    o->wev = tmp;
+    d->wseq = o->wseq;
+  }
+}
+
+/*
+ * Put a block in the freelist of a pool, merging it with its
+ * neighbours if possible.
+ */
+static void pool_insert(cuda_pool *p, gpudata *d) {
+  gpudata *next = p->freeblocks, *prev = NULL;
+
+  d->ls = p->s;
+  /* Freelist is kept in order of allocation address */
+  for (; next && next->ptr < d->ptr; next = next->next) {
+    prev = next;
+  }
+
+  /* See if we can merge the block with the previous one */
+  if (!(d->flags & CUDA_HEAD_ALLOC) &&
+      prev != NULL && prev->ptr + prev->sz == d->ptr) {
+    prev->sz = prev->sz + d->sz;
+    merge_events(prev, d);
+    deallocate(d);
+    d = prev;
+  } else if (prev != NULL) {
+    prev->next = d;
+  } else {
+    p->freeblocks = d;
+  }
+
+  /* See if we can merge with next */
+  if (next && !(next->flags & CUDA_HEAD_ALLOC) &&
+      d->ptr + d->sz == next->ptr) {
+    d->sz = d->sz + next->sz;
+    d->next = next->next;
+    merge_events(d, next);
+    deallocate(next);
+  } else {
+    d->next = next;
+  }
+}
+
+/*
+ * Fold the pool of a stream in the main one.  All the work on the
+ * stream must be done.
+ */
+static void pool_release(cuda_context *ctx, CUstream s) {
+  cuda_pool *p, **pp;
+  gpudata *curr, *next;
+
+  for (pp = &ctx->pools->next; *pp != NULL; pp = &(*pp)->next) {
+    p = *pp;
+    if (p->s == s) {
+      *pp = p->next;
+      for (curr = p->freeblocks; curr != NULL; curr = next) {
+        next = curr->next;
+        pool_insert(ctx->pools, curr);
+      }
+      free(p);
+      return;
+    }
+  }
+}
+
+/*
+ * Find the block that is the best fit for the size we want, which
+ * means the smallest that can still fit the size.  The pool of the
+ * context stream is looked at first.  The others only give their
+ * best block if it is idle, unless `busy` is set.
+ */
+static void find_best(cuda_context *ctx, cuda_pool **pool, gpudata **best,
+                      gpudata **prev, size_t size, int busy) {
+  cuda_pool *p;
+  gpudata *temp, *tempPrev, *b, *bPrev = NULL;
   *best = NULL;
 
-  for (temp = ctx->freeblocks; temp; temp = temp->next) {
-    if (temp->sz >= size && (!*best || temp->sz < (*best)->sz)) {
-      *best = temp;
-      *prev = tempPrev;
+  for (p = ctx->pools; p != NULL; p = p->next) {
+    b = NULL;
+    tempPrev = NULL;
+    for (temp = p->freeblocks; temp; temp = temp->next) {
+      if (temp->sz >= size && (!b || temp->sz < b->sz)) {
+        b = temp;
+        bPrev = tempPrev;
+      }
+      tempPrev = temp;
+    }
+    if (b != NULL && (p == ctx->pools || busy || block_idle(b))) {
+      *pool = p;
+      *best = b;
+      *prev = bPrev;
+      return;
     }
-    tempPrev = temp;
   }
 }
 
 static size_t largest_size(cuda_context *ctx) {
+  cuda_pool *p;
   gpudata *temp;
   size_t sz, dummy;
   cuda_enter(ctx);
@@ -623,16 +909,18 @@ static size_t largest_size(cuda_context *ctx) {
    /* We guess that we can allocate at least a quarter of the free size
      in a single block. This might be wrong though. */
   sz /= 4;
-  for (temp = ctx->freeblocks; temp; temp = temp->next) {
-    if (temp->sz > sz) sz = temp->sz;
+  for (p = ctx->pools; p != NULL; p = p->next) {
+    for (temp = p->freeblocks; temp; temp = temp->next) {
+      if (temp->sz > sz) sz = temp->sz;
+    }
   }
   return sz;
 }
 
 /*
- * Allocate a new block and place in on the freelist. Will allocate
- * the bigger of the requested size and BLOCK_SIZE to avoid allocating
- * multiple small blocks.
+ * Allocate a new block and place in on the freelist of the context
+ * stream. Will allocate the bigger of the requested size and
+ * BLOCK_SIZE to avoid allocating multiple small blocks.
  */
 static int allocate(cuda_context *ctx, gpudata **res, gpudata **prev,
                     size_t size) {
@@ -668,9 +956,10 @@ static int allocate(cuda_context *ctx, gpudata **res, gpudata **prev,
   ctx->cache_size += size;
 
   (*res)->flags |= CUDA_HEAD_ALLOC;
+  (*res)->ls = ctx->s;
 
   /* Now that the block is allocated, enter it in the freelist */
-  next = ctx->freeblocks;
+  next = ctx->pools->freeblocks;
   for (; next && next->ptr < (*res)->ptr; next = next->next) {
     *prev = next;
   }
@@ -678,19 +967,21 @@ static int allocate(cuda_context *ctx, gpudata **res, gpudata **prev,
   if (*prev)
     (*prev)->next = *res;
   else
-    ctx->freeblocks = *res;
+    ctx->pools->freeblocks = *res;
 
   return GA_NO_ERROR;
 }
 
 /*
- * Extract the `curr` block from the freelist, possibly splitting it
- * if it's too big for the requested size.  The remaining block will
- * stay on the freelist if there is a split.  `prev` is only to
- * facilitate the extraction so we don't have to go through the list
- * again.
+ * Extract the `curr` block from the freelist of `p`, possibly
+ * splitting it if it's too big for the requested size.  The remaining
+ * block will stay on the freelist if there is a split.  `prev` is
+ * only to facilitate the extraction so we don't have to go through
+ * the list again.  If `idle` is set there is no pending work on the
+ * block to order the remaining one after.
  */
-static int extract(gpudata *curr, gpudata *prev, size_t size) {
+static int extract(cuda_pool *p, gpudata *curr, gpudata *prev, size_t size,
+                   int idle) {
   gpudata *next, *split;
   size_t remaining = curr->sz - size;
 
@@ -705,7 +996,9 @@ static int extract(gpudata *curr, gpudata *prev, size_t size) {
     split->next = curr->next;
     curr->next = NULL;
     /* Make sure we don't start using the split buffer too soon */
-    cuda_records(split, CUDA_WAIT_ALL, curr->ls);
+    if (!idle)
+      cuda_records(split, CUDA_WAIT_ALL, curr->ls);
+    split->ls = curr->ls;
     next = split;
     curr->sz = size;
   }
@@ -713,13 +1006,95 @@ static int extract(gpudata *curr, gpudata *prev, size_t size) {
   if (prev != NULL)
     prev->next = next;
   else
-    curr->ctx->freeblocks = next;
+    p->freeblocks = next;
 
   return GA_NO_ERROR;
 }
 
+static unsigned int host_class(size_t sz) {
+  unsigned int c = 0;
+  while (c < CUDA_HOST_CLASSES &&
+         ((size_t)1 << (c + CUDA_HOST_MIN_CLASS)) < sz)
+    c++;
+  return c;
+}
+
+/*
+ * Get a page-locked block of at least `sz` bytes from the host pool,
+ * allocating one if there is none of the right size class.
+ */
+void *cuda_host_alloc(cuda_context *ctx, size_t sz) {
+  unsigned int c = host_class(sz);
+  void *p;
+  CUresult err;
+
+  if (ctx->host == NULL) {
+    ctx->host = calloc(1, sizeof(*ctx->host));
+    if (ctx->host == NULL) {
+      error_sys(ctx->err, "calloc");
+      return NULL;
+    }
+  }
+
+  if (c < CUDA_HOST_CLASSES) {
+    p = ctx->host->free[c];
+    if (p != NULL) {
+      ctx->host->free[c] = *(void **)p;
+      ctx->host->cache_size -= (size_t)1 << (c + CUDA_HOST_MIN_CLASS);
+      return p;
+    }
+    sz = (size_t)1 << (c + CUDA_HOST_MIN_CLASS);
+  }
+
+  cuda_enter(ctx);
+  err = cuMemHostAlloc(&p, sz, CU_MEMHOSTALLOC_PORTABLE |
+                       CU_MEMHOSTALLOC_DEVICEMAP);
+  cuda_exit(ctx);
+  if (err != CUDA_SUCCESS) {
+    error_cuda(ctx->err, "cuMemHostAlloc", err);
+    return NULL;
+  }
+  return p;
+}
+
+/*
+ * Give back a block from cuda_host_alloc().  `sz` must be the size
+ * that was requested.  The device must be done with the block.
+ */
+void cuda_host_free(cuda_context *ctx, void *p, size_t sz) {
+  unsigned int c = host_class(sz);
+  size_t csz = (size_t)1 << (c + CUDA_HOST_MIN_CLASS);
+
+  if (c < CUDA_HOST_CLASSES && ctx->max_cache_size != 0 &&
+      ctx->host->cache_size + csz <= CUDA_HOST_CACHE_MAX) {
+    *(void **)p = ctx->host->free[c];
+    ctx->host->free[c] = p;
+    ctx->host->cache_size += csz;
+  } else {
+    cuda_enter(ctx);
+    cuMemFreeHost(p);
+    cuda_exit(ctx);
+  }
+}
+
+static gpudata *cuda_alloc_host(cuda_context *ctx, size_t size) {
+  gpudata *res;
+  void *p;
+
+  p = cuda_host_alloc(ctx, size);
+  if (p == NULL)
+    return NULL;
+  res = new_gpudata(ctx, (CUdeviceptr)p, size);
+  if (res == NULL) {
+    cuda_host_free(ctx, p, size);
+    return NULL;
+  }
+  res->flags |= CUDA_MAPPED_PTR|CUDA_HOST_ALLOC;
+  return res;
+}
+
 static int cuda_write(gpudata *dst, size_t dstoff, const void *src,
-                      size_t sz);
+                      size_t sz, gpustream *st, gpuevent *done);
 
 static inline size_t roundup(size_t s, size_t m) {
   return ((s + (m - 1)) / m) * m;
@@ -728,7 +1103,9 @@ static inline size_t roundup(size_t s, size_t m) {
 static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags) {
   gpudata *res = NULL, *prev = NULL;
   cuda_context *ctx = (cuda_context *)c;
+  cuda_pool *pool = NULL;
   size_t asize;
+  int idle = 0;
 
   if (size == 0) size = 1;
 
@@ -742,10 +1119,11 @@ static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags) {
     return NULL;
   }
 
-  /* TODO: figure out how to make this work */
   if (flags & GA_BUFFER_HOST) {
-    error_set(ctx->err, GA_DEVSUP_ERROR, "Host mapped allocations are not supported yet");
-    return NULL;
+    res = cuda_alloc_host(ctx, size);
+    if (res == NULL)
+      return NULL;
+    goto ready;
   }
 
   /* We don't want to manage really small allocations so we round up
@@ -754,24 +1132,40 @@ static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags) {
    */
   if (ctx->max_cache_size != 0) {
     asize = roundup(size, FRAG_SIZE);
-    find_best(ctx, &res, &prev, asize);
+    find_best(ctx, &pool, &res, &prev, asize, 0);
+    /* A block from another pool is idle so it can join our stream */
+    idle = (res != NULL && pool != ctx->pools);
   } else {
     asize = size;
   }
 
-  if (res == NULL && allocate(ctx, &res, &prev, asize) != GA_NO_ERROR)
-    return NULL;
+  if (res == NULL) {
+    pool = ctx->pools;
+    idle = 1;
+    if (allocate(ctx, &res, &prev, asize) != GA_NO_ERROR) {
+      /* Last resort, take a block that is still in use on another
+         stream and have the users wait on its events */
+      if (ctx->max_cache_size != 0)
+        find_best(ctx, &pool, &res, &prev, asize, 1);
+      if (res == NULL)
+        return NULL;
+      idle = 0;
+    }
+  }
 
-  if (extract(res, prev, asize) != GA_NO_ERROR)
+  if (extract(pool, res, prev, asize, idle) != GA_NO_ERROR)
     return NULL;
+  if (idle)
+    res->ls = ctx->s;
 
+ ready:
   /* It's out of the freelist, so add a ref */
   res->ctx->refcnt++;
   /* We consider this buffer allocated and ready to go */
   res->refcnt = 1;
 
   if (flags & GA_BUFFER_INIT) {
-    if (cuda_write(res, 0, data, size) != GA_NO_ERROR) {
+    if (cuda_write(res, 0, data, size, NULL, NULL) != GA_NO_ERROR) {
       cuda_free(res);
       return NULL;
     }
@@ -814,10 +1208,79 @@ static void cuda_retain(gpudata *d) {
   d->refcnt++;
 }
 
+/*
+ * Is `d` read on a stream other than `s` in a way that is not
+ * ordered by its last write?
+ */
+static int reads_elsewhere(gpudata *d, CUstream s) {
+  cuda_rev *r;
+
+  if (d->rs != NULL && d->rs != s)
+    return 1;
+  for (r = d->xrev; r != NULL; r = r->next)
+    if (r->pending && r->s != s)
+      return 1;
+  return 0;
+}
+
+/*
+ * Get the read event of `d` for stream `s`, creating it if needed.
+ */
+static cuda_rev *get_xrev(gpudata *d, CUstream s) {
+  cuda_rev *r;
+  CUresult err;
+  int fl = CU_EVENT_DISABLE_TIMING;
+
+  for (r = d->xrev; r != NULL; r = r->next)
+    if (r->s == s)
+      return r;
+
+  r = malloc(sizeof(*r));
+  if (r == NULL) {
+    error_sys(d->ctx->err, "malloc");
+    return NULL;
+  }
+  if (d->ctx->flags & GA_CTX_MULTI_THREAD)
+    fl |= CU_EVENT_BLOCKING_SYNC;
+  cuda_enter(d->ctx);
+  err = cuEventCreate(&r->ev, fl);
+  cuda_exit(d->ctx);
+  if (err != CUDA_SUCCESS) {
+    error_cuda(d->ctx->err, "cuEventCreate", err);
+    free(r);
+    return NULL;
+  }
+  r->s = s;
+  r->pending = 0;
+  r->next = d->xrev;
+  d->xrev = r;
+  return r;
+}
+
+/*
+ * Wait on the host for all the reads of `d`.
+ */
+static CUresult sync_reads(gpudata *d) {
+  cuda_rev *r;
+  CUresult err;
+
+  err = cuEventSynchronize(d->rev);
+  for (r = d->xrev; r != NULL && err == CUDA_SUCCESS; r = r->next)
+    if (r->pending)
+      err = cuEventSynchronize(r->ev);
+  return err;
+}
+
 static void deallocate(gpudata *d) {
+  cuda_rev *r, *next;
   cuda_enter(d->ctx);
   cuEventDestroy(d->rev);
   cuEventDestroy(d->wev);
+  for (r = d->xrev; r != NULL; r = next) {
+    next = r->next;
+    cuEventDestroy(r->ev);
+    free(r);
+  }
   cuda_exit(d->ctx);
   CLEAR(d);
   free(d);
@@ -837,44 +1300,40 @@ static void cuda_free(gpudata *d) {
     } else if (d->flags & CUDA_IPC_MEMORY) {
       cuIpcCloseMemHandle(d->ptr);
       deallocate(d);
+    } else if (d->flags & CUDA_HOST_ALLOC) {
+      /* The host can reuse the block as soon as it is back in the
+         pool so wait for the device to be done with it */
+      cuda_enter(ctx);
+      if (ISSET(ctx->flags, GA_CTX_SINGLE_STREAM)) {
+        cuStreamSynchronize(ctx->s);
+      } else {
+        sync_reads(d);
+        cuEventSynchronize(d->wev);
+      }
+      cuda_exit(ctx);
+      cuda_host_free(ctx, (void *)d->ptr, d->sz);
+      deallocate(d);
     } else if (ctx->max_cache_size == 0) {
       /* Just free the pointer */
       cuMemFree(d->ptr);
       deallocate(d);
     } else {
-      /* Find the position in the freelist.  Freelist is kept in order
-         of allocation address */
-      gpudata *next = d->ctx->freeblocks, *prev = NULL;
-      for (; next && next->ptr < d->ptr; next = next->next) {
-        prev = next;
-      }
-      next = prev != NULL ? prev->next : d->ctx->freeblocks;
-
-      /* See if we can merge the block with the previous one */
-      if (!(d->flags & CUDA_HEAD_ALLOC) &&
-            prev != NULL && prev->ptr + prev->sz == d->ptr) {
-        prev->sz = prev->sz + d->sz;
-        cuda_waits(d, CUDA_WAIT_ALL, prev->ls);
-        cuda_records(prev, CUDA_WAIT_ALL, prev->ls);
-        deallocate(d);
-        d = prev;
-      } else if (prev != NULL) {
-        prev->next = d;
-      } else {
-        d->ctx->freeblocks = d;
-      }
-
-      /* See if we can merge with next */
-      if (next && !(next->flags & CUDA_HEAD_ALLOC) &&
-          d->ptr + d->sz == next->ptr) {
-        d->sz = d->sz + next->sz;
-        d->next = next->next;
-        cuda_waits(next, CUDA_WAIT_ALL, d->ls);
-        cuda_records(d, CUDA_WAIT_ALL, d->ls);
-        deallocate(next);
-      } else {
-        d->next = next;
+      /* The block goes in the pool of the last stream that used it.
+         Blocks that were never used go with the context stream. */
+      cuda_pool *p = ctx->pools;
+      if (ISCLR(ctx->flags, GA_CTX_SINGLE_STREAM) && d->ls != NULL) {
+        p = pool_get(ctx, d->ls);
+        if (p == NULL)
+          p = ctx->pools;
+        /* The pool only looks at rev and wev, so fold reads from
+           other streams in them, on the stream of the pool.  This
+           is also how the block moves to our stream the slow way. */
+        if (d->ls != p->s || reads_elsewhere(d, p->s)) {
+          cuda_waits(d, CUDA_WAIT_ALL, p->s);
+          cuda_records(d, CUDA_WAIT_ALL, p->s);
+        }
       }
+      pool_insert(p, d);
     }
     /* We keep this at the end since the freed buffer could be the
      * last reference to the context and therefore clearing the
@@ -892,7 +1351,8 @@ static int cuda_share(gpudata *a, gpudata *b) {
            (b->ptr <= a->ptr && b->ptr + b->sz > a->ptr)));
 }
 
-static int cuda_waits(gpudata *a, int flags, CUstream s) {
+int cuda_waits(gpudata *a, int flags, CUstream s) {
+  cuda_rev *r;
   ASSERT_BUF(a);
 
   /* Never skip the wait if CUDA_WAIT_FORCE */
@@ -901,8 +1361,10 @@ static int cuda_waits(gpudata *a, int flags, CUstream s) {
       return GA_NO_ERROR;
 
     /* If the last stream to touch this buffer is the same, we don't
-     * need to wait for anything. */
-    if (a->ls == s)
+     * need to wait for anything, unless we write and there are reads
+     * on other streams that are not ordered before us. */
+    if (a->ls == s &&
+        (ISCLR(flags, CUDA_WAIT_WRITE) || !reads_elsewhere(a, s)))
       return GA_NO_ERROR;
   }
 
@@ -912,8 +1374,12 @@ static int cuda_waits(gpudata *a, int flags, CUstream s) {
   if (ISSET(flags, CUDA_WAIT_READ) || ISSET(flags, CUDA_WAIT_WRITE))
     CUDA_EXIT_ON_ERROR(a->ctx, cuStreamWaitEvent(s, a->wev, 0));
   /* Make sure to not disturb previous reads */
-  if (ISSET(flags, CUDA_WAIT_WRITE))
+  if (ISSET(flags, CUDA_WAIT_WRITE)) {
     CUDA_EXIT_ON_ERROR(a->ctx, cuStreamWaitEvent(s, a->rev, 0));
+    for (r = a->xrev; r != NULL; r = r->next)
+      if (r->pending && r->s != s)
+        CUDA_EXIT_ON_ERROR(a->ctx, cuStreamWaitEvent(s, r->ev, 0));
+  }
   cuda_exit(a->ctx);
   return GA_NO_ERROR;
 }
@@ -922,16 +1388,38 @@ int cuda_wait(gpudata *a, int flags) {
   return cuda_waits(a, flags, a->ctx->s);
 }
 
-static int cuda_records(gpudata *a, int flags, CUstream s) {
+int cuda_records(gpudata *a, int flags, CUstream s) {
+  cuda_rev *r;
   ASSERT_BUF(a);
   if (ISCLR(flags, CUDA_WAIT_FORCE) &&
       ISSET(a->ctx->flags, GA_CTX_SINGLE_STREAM))
     return GA_NO_ERROR;
   cuda_enter(a->ctx);
-  if (ISSET(flags, CUDA_WAIT_READ))
-    CUDA_EXIT_ON_ERROR(a->ctx, cuEventRecord(a->rev, s));
-  if (ISSET(flags, CUDA_WAIT_WRITE))
+  if (ISSET(flags, CUDA_WAIT_WRITE)) {
     CUDA_EXIT_ON_ERROR(a->ctx, cuEventRecord(a->wev, s));
+    a->wseq = ++a->ctx->seq;
+    /* The write waited for all the reads, later accesses will wait
+       for it instead */
+    a->rs = NULL;
+    for (r = a->xrev; r != NULL; r = r->next)
+      r->pending = 0;
+  }
+  if (ISSET(flags, CUDA_WAIT_READ)) {
+    if (a->rs == NULL || a->rs == s) {
+      CUDA_EXIT_ON_ERROR(a->ctx, cuEventRecord(a->rev, s));
+      a->rseq = ++a->ctx->seq;
+      a->rs = s;
+    } else {
+      /* Don't overwrite the reads of the other stream */
+      r = get_xrev(a, s);
+      if (r == NULL) {
+        cuda_exit(a->ctx);
+        return a->ctx->err->code;
+      }
+      CUDA_EXIT_ON_ERROR(a->ctx, cuEventRecord(r->ev, s));
+      r->pending = 1;
+    }
+  }
   cuda_exit(a->ctx);
   a->ls = s;
   return GA_NO_ERROR;
@@ -941,9 +1429,34 @@ int cuda_record(gpudata *a, int flags) {
   return cuda_records(a, flags, a->ctx->s);
 }
 
+/*
+ * Make stream `s`, which may come from another library, wait for all
+ * the work queued on `a`.
+ */
+int cuda_handoff(gpudata *a, CUstream s) {
+  ASSERT_BUF(a);
+  GA_CHECK(cuda_waits(a, CUDA_WAIT_ALL, a->ctx->s));
+  GA_CHECK(cuda_records(a, CUDA_WAIT_ALL|CUDA_WAIT_FORCE, a->ctx->s));
+  return cuda_waits(a, CUDA_WAIT_ALL|CUDA_WAIT_FORCE, s);
+}
+
+/*
+ * Make the work queued on `a` from now on wait for what is queued on
+ * stream `s`.
+ */
+int cuda_takeover(gpudata *a, CUstream s) {
+  ASSERT_BUF(a);
+  GA_CHECK(cuda_records(a, CUDA_WAIT_ALL|CUDA_WAIT_FORCE, s));
+  /* Single stream contexts don't look at the events */
+  if (ISSET(a->ctx->flags, GA_CTX_SINGLE_STREAM))
+    return cuda_waits(a, CUDA_WAIT_ALL|CUDA_WAIT_FORCE, a->ctx->s);
+  return GA_NO_ERROR;
+}
+
 static int cuda_move(gpudata *dst, size_t dstoff, gpudata *src,
-                     size_t srcoff, size_t sz) {
+                     size_t srcoff, size_t sz, gpustream *st) {
     cuda_context *ctx = dst->ctx;
+    CUstream s = CUDA_STREAM(ctx, st);
     int res = GA_NO_ERROR;
     ASSERT_BUF(dst);
     ASSERT_BUF(src);
@@ -960,28 +1473,30 @@ static int cuda_move(gpudata *dst, size_t dstoff, gpudata *src,
     cuda_enter(ctx);
 
     GA_CUDA_EXIT_ON_ERROR(ctx,
-        cuda_wait(src, CUDA_WAIT_READ));
+        cuda_waits(src, CUDA_WAIT_READ, s));
     GA_CUDA_EXIT_ON_ERROR(ctx,
-        cuda_wait(dst, CUDA_WAIT_WRITE));
+        cuda_waits(dst, CUDA_WAIT_WRITE, s));
 
     CUDA_EXIT_ON_ERROR(ctx,
-        cuMemcpyDtoDAsync(dst->ptr + dstoff, src->ptr + srcoff, sz, ctx->s));
+        cuMemcpyDtoDAsync(dst->ptr + dstoff, src->ptr + srcoff, sz, s));
 
     GA_CUDA_EXIT_ON_ERROR(ctx,
-        cuda_record(src, CUDA_WAIT_READ));
+        cuda_records(src, CUDA_WAIT_READ, s));
     GA_CUDA_EXIT_ON_ERROR(ctx,
-        cuda_record(dst, CUDA_WAIT_WRITE));
+        cuda_records(dst, CUDA_WAIT_WRITE, s));
 
     cuda_exit(ctx);
     return res;
 }
 
-static int cuda_read(void *dst, gpudata *src, size_t srcoff, size_t sz) {
+static int cuda_read(void *dst, gpudata *src, size_t srcoff, size_t sz,
+                     gpustream *st, gpuevent *done) {
     cuda_context *ctx = src->ctx;
+    CUstream s = st ? st->s : ctx->mem_s;
 
     ASSERT_BUF(src);
 
-    if (sz == 0) return GA_NO_ERROR;
+    if (sz == 0) goto record;
 
     if ((src->sz - srcoff) < sz)
       return error_set(ctx->err, GA_VALUE_ERROR, "source is smaller than the read size");
@@ -998,25 +1513,48 @@ static int cuda_read(void *dst, gpudata *src, size_t srcoff, size_t sz) {
       memcpy(dst, (void *)(src->ptr + srcoff), sz);
     } else {
       GA_CUDA_EXIT_ON_ERROR(ctx,
-          cuda_waits(src, CUDA_WAIT_READ, ctx->mem_s));
+          cuda_waits(src, CUDA_WAIT_READ, s));
 
       CUDA_EXIT_ON_ERROR(ctx,
-          cuMemcpyDtoHAsync(dst, src->ptr + srcoff, sz, ctx->mem_s));
+          cuMemcpyDtoHAsync(dst, src->ptr + srcoff, sz, s));
 
       GA_CUDA_EXIT_ON_ERROR(ctx,
-          cuda_records(src, CUDA_WAIT_READ, ctx->mem_s));
+          cuda_records(src, CUDA_WAIT_READ, s));
+
+      /* Page-locked destinations don't block in the copy above */
+      if (done == NULL)
+        CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(s));
     }
     cuda_exit(ctx);
+ record:
+    if (done != NULL) {
+      ASSERT_EVENT(done);
+      cuda_enter(ctx);
+      CUDA_EXIT_ON_ERROR(ctx, cuEventRecord(done->ev, s));
+      cuda_exit(ctx);
+    }
     return GA_NO_ERROR;
 }
 
+/*
+ * Is `p` page-locked host memory that the driver knows about?
+ */
+static int host_locked(const void *p) {
+  CUmemorytype t;
+  if (cuPointerGetAttribute(&t, CU_POINTER_ATTRIBUTE_MEMORY_TYPE,
+                            (CUdeviceptr)p) != CUDA_SUCCESS)
+    return 0;
+  return t == CU_MEMORYTYPE_HOST;
+}
+
 static int cuda_write(gpudata *dst, size_t dstoff, const void *src,
-                      size_t sz) {
+                      size_t sz, gpustream *st, gpuevent *done) {
     cuda_context *ctx = dst->ctx;
+    CUstream s = st ? st->s : ctx->mem_s;
 
     ASSERT_BUF(dst);
 
-    if (sz == 0) return GA_NO_ERROR;
+    if (sz == 0) goto record;
 
     if ((dst->sz - dstoff) < sz)
       return error_set(ctx->err, GA_VALUE_ERROR, "Destination is smaller than the write size");
@@ -1028,19 +1566,114 @@ static int cuda_write(gpudata *dst, size_t dstoff, const void *src,
       if (ISSET(ctx->flags, GA_CTX_SINGLE_STREAM))
         CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(ctx->s));
       else
-        CUDA_EXIT_ON_ERROR(ctx, cuEventSynchronize(dst->rev));
+        CUDA_EXIT_ON_ERROR(ctx, sync_reads(dst));
 
       memcpy((void *)(dst->ptr + dstoff), src, sz);
     } else {
       GA_CUDA_EXIT_ON_ERROR(ctx,
-          cuda_waits(dst, CUDA_WAIT_WRITE, ctx->mem_s));
+          cuda_waits(dst, CUDA_WAIT_WRITE, s));
 
       CUDA_EXIT_ON_ERROR(ctx,
-          cuMemcpyHtoDAsync(dst->ptr + dstoff, src, sz, ctx->mem_s));
+          cuMemcpyHtoDAsync(dst->ptr + dstoff, src, sz, s));
 
       GA_CUDA_EXIT_ON_ERROR(ctx,
-          cuda_records(dst, CUDA_WAIT_WRITE, ctx->mem_s));
+          cuda_records(dst, CUDA_WAIT_WRITE, s));
+
+      /* Page-locked sources are still being read by the copy above
+         when it returns, and the caller is free to reuse them after
+         a plain write.  Pageable ones were staged by the driver. */
+      if (done == NULL && host_locked(src))
+        CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(s));
+    }
+    cuda_exit(ctx);
+ record:
+    if (done != NULL) {
+      ASSERT_EVENT(done);
+      cuda_enter(ctx);
+      CUDA_EXIT_ON_ERROR(ctx, cuEventRecord(done->ev, s));
+      cuda_exit(ctx);
     }
+    return GA_NO_ERROR;
+}
+
+static int rect_fits(const ga_rect *r, const size_t *region) {
+  if (r->buf == NULL) return 1;
+  return (r->buf->sz >= r->off &&
+          (r->buf->sz - r->off) >= ((region[2] - 1) * r->slice +
+                                    (region[1] - 1) * r->pitch + region[0]));
+}
+
+static void rect_side(const ga_rect *r, CUmemorytype *type,
+                      const void **host, CUdeviceptr *dev, size_t *pitch,
+                      size_t *height) {
+  /* Buffers from the host pool are mapped, so let the driver look at
+     the address instead of assuming device memory. */
+  if (r->buf != NULL) {
+    *type = CU_MEMORYTYPE_UNIFIED;
+    *dev = r->buf->ptr + r->off;
+  } else {
+    *type = CU_MEMORYTYPE_HOST;
+    *host = (const char *)r->host + r->off;
+  }
+  *pitch = r->pitch;
+  *height = r->slice / r->pitch;
+}
+
+static int cuda_copy_rect(const ga_rect *dst, const ga_rect *src,
+                          const size_t *region, gpustream *st) {
+    cuda_context *ctx = (dst->buf ? dst->buf : src->buf)->ctx;
+    CUDA_MEMCPY3D p;
+    const void *dhost = NULL;
+    CUstream s;
+
+    if (dst->buf && src->buf && dst->buf->ctx != src->buf->ctx)
+      return error_set(ctx->err, GA_VALUE_ERROR,
+                       "Cannot copy between contexts");
+
+    if (region[0] == 0 || region[1] == 0 || region[2] == 0)
+      return GA_NO_ERROR;
+
+    if (!rect_fits(dst, region))
+      return error_set(ctx->err, GA_VALUE_ERROR,
+                       "Destination is smaller than the copied region");
+    if (!rect_fits(src, region))
+      return error_set(ctx->err, GA_VALUE_ERROR,
+                       "Source is smaller than the copied region");
+
+    /* Same streams as move, read and write */
+    if (dst->buf && src->buf)
+      s = CUDA_STREAM(ctx, st);
+    else
+      s = st ? st->s : ctx->mem_s;
+
+    memset(&p, 0, sizeof(p));
+    rect_side(src, &p.srcMemoryType, &p.srcHost, &p.srcDevice,
+              &p.srcPitch, &p.srcHeight);
+    rect_side(dst, &p.dstMemoryType, &dhost, &p.dstDevice,
+              &p.dstPitch, &p.dstHeight);
+    p.dstHost = (void *)dhost;
+    p.WidthInBytes = region[0];
+    p.Height = region[1];
+    p.Depth = region[2];
+
+    cuda_enter(ctx);
+
+    if (src->buf)
+      GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(src->buf, CUDA_WAIT_READ, s));
+    if (dst->buf)
+      GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(dst->buf, CUDA_WAIT_WRITE, s));
+
+    CUDA_EXIT_ON_ERROR(ctx, cuMemcpy3DAsync(&p, s));
+
+    if (src->buf)
+      GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(src->buf, CUDA_WAIT_READ, s));
+    if (dst->buf)
+      GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(dst->buf, CUDA_WAIT_WRITE, s));
+
+    /* Host memory must be usable (or reusable) when we return */
+    if (dst->buf == NULL || src->buf == NULL)
+      CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(s));
+
     cuda_exit(ctx);
     return GA_NO_ERROR;
 }
@@ -1066,6 +1699,79 @@ static int cuda_memset(gpudata *dst, size_t dstoff, int data) {
     return GA_NO_ERROR;
 }
 
+static int cuda_fill(gpudata *dst, size_t dstoff, size_t sz,
+                     const void *pattern, size_t psz) {
+    cuda_context *ctx = dst->ctx;
+    CUdeviceptr p = dst->ptr + dstoff;
+    unsigned short us;
+    unsigned int ui;
+
+    ASSERT_BUF(dst);
+
+    if (sz == 0) return GA_NO_ERROR;
+
+    if ((psz != 1 && psz != 2 && psz != 4) || p % psz != 0 || sz % psz != 0)
+      return error_set(ctx->err, GA_UNSUPPORTED_ERROR,
+                       "Fill pattern not supported");
+
+    cuda_enter(ctx);
+
+    GA_CUDA_EXIT_ON_ERROR(ctx,
+        cuda_wait(dst, CUDA_WAIT_WRITE));
+
+    switch (psz) {
+    case 1:
+      CUDA_EXIT_ON_ERROR(ctx,
+          cuMemsetD8Async(p, *(const unsigned char *)pattern, sz, ctx->s));
+      break;
+    case 2:
+      memcpy(&us, pattern, 2);
+      CUDA_EXIT_ON_ERROR(ctx, cuMemsetD16Async(p, us, sz / 2, ctx->s));
+      break;
+    case 4:
+      memcpy(&ui, pattern, 4);
+      CUDA_EXIT_ON_ERROR(ctx, cuMemsetD32Async(p, ui, sz / 4, ctx->s));
+      break;
+    }
+
+    GA_CUDA_EXIT_ON_ERROR(ctx,
+        cuda_record(dst, CUDA_WAIT_WRITE));
+    cuda_exit(ctx);
+    return GA_NO_ERROR;
+}
+
+static int cuda_upload(gpudata *dst, size_t dstoff, const void *src,
+                       size_t sz, gpustream *st) {
+    cuda_context *ctx = dst->ctx;
+    CUstream s = CUDA_STREAM(ctx, st);
+
+    ASSERT_BUF(dst);
+
+    if (sz == 0) return GA_NO_ERROR;
+
+    if ((dst->sz - dstoff) < sz)
+      return error_set(ctx->err, GA_VALUE_ERROR, "Destination is smaller than the write size");
+
+    cuda_enter(ctx);
+
+    /* When the buffer is only used on s this doesn't wait for
+       anything, the stream orders the upload after the earlier users
+       of the other ranges. */
+    GA_CUDA_EXIT_ON_ERROR(ctx,
+        cuda_waits(dst, CUDA_WAIT_WRITE, s));
+
+    CUDA_EXIT_ON_ERROR(ctx,
+        cuMemcpyHtoDAsync(dst->ptr + dstoff, src, sz, s));
+
+    GA_CUDA_EXIT_ON_ERROR(ctx,
+        cuda_records(dst, CUDA_WAIT_WRITE, s));
+
+    if (host_locked(src))
+      CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(s));
+    cuda_exit(ctx);
+    return GA_NO_ERROR;
+}
+
 int get_cc(CUdevice dev, int *maj, int *min, error *e) {
   CUresult err;
   err = cuDeviceGetAttribute(maj,
@@ -1212,7 +1918,8 @@ out:
   return res;
 }
 
-static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
+static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log,
+                   const char **origin) {
   strb ptx = STRB_STATIC_INIT;
   strb *cbin;
   disk_key k;
@@ -1233,10 +1940,12 @@ static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
     cbin = cache_get(ctx->disk_cache, &k);
     if (cbin != NULL) {
       strb_appendb(bin, cbin);
+      *origin = "disk";
       return GA_NO_ERROR;
     }
   }
 
+  *origin = "nvrtc";
   GA_CHECK(call_compiler(ctx, src, &ptx, log));
 
   GA_CHECK(make_bin(ctx, &ptx, bin, log));
@@ -1299,10 +2008,25 @@ static void _cuda_freekernel(gpukernel *k) {
     free(k->args);
     free(k->bin);
     free(k->types);
+    free(k->access);
     free(k);
   }
 }
 
+/* Synchronization needed for an argument of type t */
+static int arg_access(int t) {
+  switch (t) {
+  case GA_BUFFER:
+    return CUDA_WAIT_ALL;
+  case GA_BUFFER_RO:
+    return CUDA_WAIT_READ;
+  case GA_BUFFER_WO:
+    return CUDA_WAIT_WRITE;
+  default:
+    return 0;
+  }
+}
+
 static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
                           const char **strings, const size_t *lengths,
                           const char *fname, unsigned int argcount,
@@ -1316,6 +2040,8 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     kernel_key *p_key;
     CUdevice dev;
     CUresult err;
+    const char *origin = "cache";
+    uint64_t t = 0;
     unsigned int i;
     int major, minor;
 
@@ -1338,6 +2064,7 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
 
     // GA_USE_SMALL will always work
     // GA_USE_HALF should always work
+    // GA_USE_ATOM64 will always work
     if (flags & GA_USE_DOUBLE) {
       if (major < 1 || (major == 1 && minor < 3)) {
         cuda_exit(ctx);
@@ -1373,15 +2100,26 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     k_key.fname = fname;
     k_key.src = src;
 
+    if (ga_trace)
+      t = trace_now();
+
     res = (gpukernel *)cache_get(ctx->kernel_cache, &k_key);
     if (res != NULL) {
+      /* The same code might be declared with different access, keep
+         the widest. */
+      for (i = 0; i < argcount && i < res->argcount; i++)
+        res->access[i] |= arg_access(types[i]);
       res->refcnt++;
       strb_clear(&src);
+      cuda_exit(ctx);
+      if (ga_trace)
+        trace_complete("kernel", "compile", t,
+                       "\"name\":\"%s\",\"origin\":\"%s\"", fname, origin);
       *k = res;
       return GA_NO_ERROR;
     }
 
-    if (compile(ctx, &src, &bin, &log) != GA_NO_ERROR) {
+    if (compile(ctx, &src, &bin, &log, &origin) != GA_NO_ERROR) {
       if (err_str != NULL) {
         strb debug_msg = STRB_STATIC_INIT;
         strb_appends(&debug_msg, "CUDA kernel compile failure ::\n");
@@ -1427,7 +2165,17 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
       cuda_exit(ctx);
       return error_sys(ctx->err, "calloc");
     }
-    memcpy(res->types, types, argcount*sizeof(int));
+    res->access = calloc(argcount, sizeof(int));
+    if (res->access == NULL) {
+      _cuda_freekernel(res);
+      strb_clear(&src);
+      cuda_exit(ctx);
+      return error_sys(ctx->err, "calloc");
+    }
+    for (i = 0; i < argcount; i++) {
+      res->access[i] = arg_access(types[i]);
+      res->types[i] = res->access[i] != 0 ? GA_BUFFER : types[i];
+    }
     res->args = calloc(argcount, sizeof(void *));
     if (res->args == NULL) {
       _cuda_freekernel(res);
@@ -1473,6 +2221,9 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     } else {
       strb_clear(&src);
     }
+    if (ga_trace)
+      trace_complete("kernel", "compile", t,
+                     "\"name\":\"%s\",\"origin\":\"%s\"", fname, origin);
     *k = res;
     return GA_NO_ERROR;
 }
@@ -1497,9 +2248,11 @@ static int cuda_kernelsetarg(gpukernel *k, unsigned int i, void *arg) {
 
 static int cuda_callkernel(gpukernel *k, unsigned int n,
                            const size_t *gs, const size_t *ls,
-                           size_t shared, void **args) {
+                           size_t shared, void **args, gpustream *st) {
     cuda_context *ctx = k->ctx;
+    CUstream s = CUDA_STREAM(ctx, st);
     unsigned int i;
+    int slot = -1;
 
     ASSERT_KER(k);
     cuda_enter(ctx);
@@ -1507,39 +2260,46 @@ static int cuda_callkernel(gpukernel *k, unsigned int n,
     if (args == NULL)
       args = k->args;
 
+    /* Readers only wait for previous writes and only update the read
+       event of their stream so that they don't serialize each other.
+       Writers wait for everything, but only update the write event. */
     for (i = 0; i < k->argcount; i++) {
-      if (k->types[i] == GA_BUFFER) {
-        /* We don't have any better info for now */
+      if (k->access[i] != 0) {
         GA_CUDA_EXIT_ON_ERROR(ctx,
-            cuda_wait((gpudata *)args[i], CUDA_WAIT_ALL));
+            cuda_waits((gpudata *)args[i], k->access[i], s));
       }
     }
 
+    if (ga_trace)
+      slot = cuda_trace_begin(ctx, k, s);
+
     switch (n) {
     case 1:
       CUDA_EXIT_ON_ERROR(ctx, cuLaunchKernel(k->k, gs[0], 1, 1, ls[0], 1, 1,
-                                             shared, ctx->s, args, NULL));
+                                             shared, s, args, NULL));
       break;
     case 2:
       CUDA_EXIT_ON_ERROR(ctx, cuLaunchKernel(k->k, gs[0], gs[1], 1,
                                              ls[0], ls[1], 1, shared,
-                                             ctx->s, args, NULL));
+                                             s, args, NULL));
       break;
     case 3:
       CUDA_EXIT_ON_ERROR(ctx, cuLaunchKernel(k->k, gs[0], gs[1], gs[2],
                                              ls[0], ls[1], ls[2], shared,
-                                             ctx->s, args, NULL));
+                                             s, args, NULL));
       break;
     default:
       cuda_exit(ctx);
       return error_set(ctx->err, GA_VALUE_ERROR, "Call with more than 3 dimensions");
     }
 
+    if (slot != -1)
+      cuda_trace_end(ctx, slot, s);
+
     for (i = 0; i < k->argcount; i++) {
-      if (k->types[i] == GA_BUFFER) {
-        /* We don't have any better info for now */
+      if (k->access[i] != 0) {
         GA_CUDA_EXIT_ON_ERROR(ctx,
-            cuda_record((gpudata *)args[i], CUDA_WAIT_ALL));
+            cuda_records((gpudata *)args[i], k->access[i], s));
       }
     }
 
@@ -1547,6 +2307,22 @@ static int cuda_callkernel(gpukernel *k, unsigned int n,
     return GA_NO_ERROR;
 }
 
+static int cuda_kerneloccupancy(gpukernel *k, size_t ls, size_t shared,
+                                unsigned int *blocks) {
+    cuda_context *ctx = k->ctx;
+    int res;
+
+    ASSERT_KER(k);
+    if (ls > INT_MAX)
+      return error_set(ctx->err, GA_VALUE_ERROR, "Block size too large");
+    cuda_enter(ctx);
+    CUDA_EXIT_ON_ERROR(ctx, cuOccupancyMaxActiveBlocksPerMultiprocessor(
+                           &res, k->k, (int)ls, shared));
+    cuda_exit(ctx);
+    *blocks = res;
+    return GA_NO_ERROR;
+}
+
 static int cuda_sync(gpudata *b) {
   cuda_context *ctx = (cuda_context *)b->ctx;
   int err = GA_NO_ERROR;
@@ -1557,7 +2333,7 @@ static int cuda_sync(gpudata *b) {
     CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(ctx->s));
   } else {
     CUDA_EXIT_ON_ERROR(ctx, cuEventSynchronize(b->wev));
-    CUDA_EXIT_ON_ERROR(ctx, cuEventSynchronize(b->rev));
+    CUDA_EXIT_ON_ERROR(ctx, sync_reads(b));
   }
   cuda_exit(ctx);
   return err;
@@ -1727,6 +2503,13 @@ static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((size_t *)res) = buf->sz;
     return GA_NO_ERROR;
 
+  case GA_BUFFER_PROP_HOSTPOINTER:
+    if (!(buf->flags & CUDA_MAPPED_PTR))
+      return error_set(ctx->err, GA_VALUE_ERROR,
+                       "Buffer was not allocated with GA_BUFFER_HOST");
+    *((void **)res) = (void *)buf->ptr;
+    return GA_NO_ERROR;
+
   case GA_BUFFER_PROP_CTX:
   case GA_KERNEL_PROP_CTX:
     *((gpucontext **)res) = (gpucontext *)ctx;
@@ -1755,11 +2538,274 @@ static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((const int **)res) = k->types;
     return GA_NO_ERROR;
 
+  case GA_KERNEL_PROP_NUMREGS:
+    cuda_enter(ctx);
+    CUDA_EXIT_ON_ERROR(ctx, cuFuncGetAttribute(&i, CU_FUNC_ATTRIBUTE_NUM_REGS, k->k));
+    cuda_exit(ctx);
+    *((unsigned int *)res) = i;
+    return GA_NO_ERROR;
+
+  case GA_KERNEL_PROP_SHAREDSIZE:
+    cuda_enter(ctx);
+    CUDA_EXIT_ON_ERROR(ctx, cuFuncGetAttribute(&i, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, k->k));
+    cuda_exit(ctx);
+    *((size_t *)res) = i;
+    return GA_NO_ERROR;
+
   default:
     return error_fmt(ctx->err, GA_INVALID_ERROR, "Invalid property: %d", prop_id);
   }
 }
 
+static int cuda_stream_alloc(gpustream **res, gpucontext *c) {
+  cuda_context *ctx = (cuda_context *)c;
+  gpustream *s;
+  CUresult err;
+
+  ASSERT_CTX(ctx);
+  *res = NULL;
+  if (ISSET(ctx->flags, GA_CTX_SINGLE_STREAM))
+    return error_set(ctx->err, GA_UNSUPPORTED_ERROR,
+                     "Single stream contexts can't have extra streams");
+
+  s = malloc(sizeof(*s));
+  if (s == NULL)
+    return error_sys(ctx->err, "malloc");
+  s->ctx = ctx;
+
+  cuda_enter(ctx);
+  err = cuStreamCreate(&s->s, 0);
+  cuda_exit(ctx);
+  if (err != CUDA_SUCCESS) {
+    free(s);
+    return error_cuda(ctx->err, "cuStreamCreate", err);
+  }
+  TAG_STREAM(s);
+  *res = s;
+  return GA_NO_ERROR;
+}
+
+static void cuda_stream_free(gpustream *s) {
+  cuda_context *ctx = s->ctx;
+
+  ASSERT_STREAM(s);
+  cuda_enter(ctx);
+  /* Buffers may still refer to this stream as their last one, so make
+     sure the handle is idle before it can get reused. */
+  cuStreamSynchronize(s->s);
+  pool_release(ctx, s->s);
+  cuStreamDestroy(s->s);
+  cuda_exit(ctx);
+  CLEAR(s);
+  free(s);
+}
+
+static int cuda_stream_sync(gpustream *s) {
+  cuda_context *ctx = s->ctx;
+
+  ASSERT_STREAM(s);
+  cuda_enter(ctx);
+  CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(s->s));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+static int cuda_stream_wait(gpustream *s, gpustream *other) {
+  cuda_context *ctx = s ? s->ctx : other->ctx;
+  CUevent ev;
+  CUresult err;
+
+  cuda_enter(ctx);
+  CUDA_EXIT_ON_ERROR(ctx, cuEventCreate(&ev, CU_EVENT_DISABLE_TIMING));
+  err = cuEventRecord(ev, CUDA_STREAM(ctx, other));
+  if (err == CUDA_SUCCESS)
+    err = cuStreamWaitEvent(CUDA_STREAM(ctx, s), ev, 0);
+  /* The wait is kept by the driver even after the event is gone */
+  cuEventDestroy(ev);
+  cuda_exit(ctx);
+  if (err != CUDA_SUCCESS)
+    return error_cuda(ctx->err, "cuStreamWaitEvent", err);
+  return GA_NO_ERROR;
+}
+
+/*
+ * Turn the recorded list into a CUDA graph by capturing it on a
+ * private stream.  Buffer arguments are passed the same way as in
+ * cuda_callkernel(), the graph nodes keep the device pointers.
+ */
+static int cuda_graph_build(gpugraph *g) {
+  cuda_context *ctx = (cuda_context *)g->ctx;
+  graph_node *node;
+  CUstream cs;
+  CUgraph graph = NULL;
+  CUgraphExec exec;
+  CUresult err, err2;
+  size_t i;
+
+  cuda_enter(ctx);
+  CUDA_EXIT_ON_ERROR(ctx, cuStreamCreate(&cs, CU_STREAM_NON_BLOCKING));
+  err = cuStreamBeginCapture(cs, CU_STREAM_CAPTURE_MODE_RELAXED);
+  if (err == CUDA_SUCCESS) {
+    for (i = 0; i < g->nnodes && err == CUDA_SUCCESS; i++) {
+      node = &g->nodes[i];
+      switch (node->kind) {
+      case GRAPH_KERNEL:
+        err = cuLaunchKernel(node->k->k, node->gs[0], node->gs[1],
+                             node->gs[2], node->ls[0], node->ls[1],
+                             node->ls[2], node->shared, cs, node->args,
+                             NULL);
+        break;
+      case GRAPH_MOVE:
+        err = cuMemcpyDtoDAsync(node->dst->ptr + node->dstoff,
+                                node->src->ptr + node->srcoff,
+                                node->sz, cs);
+        break;
+      case GRAPH_MEMSET:
+        if (node->dst->sz > node->dstoff)
+          err = cuMemsetD8Async(node->dst->ptr + node->dstoff, node->data,
+                                node->dst->sz - node->dstoff, cs);
+        break;
+      }
+    }
+    /* Always end the capture to leave the stream usable */
+    err2 = cuStreamEndCapture(cs, &graph);
+    if (err == CUDA_SUCCESS)
+      err = err2;
+  }
+  if (err == CUDA_SUCCESS)
+    err = cuGraphInstantiateWithFlags(&exec, graph, 0);
+  if (graph != NULL)
+    cuGraphDestroy(graph);
+  cuStreamDestroy(cs);
+  cuda_exit(ctx);
+  if (err != CUDA_SUCCESS)
+    return error_cuda(ctx->err, "cuda_graph_build", err);
+  g->impl = exec;
+  return GA_NO_ERROR;
+}
+
+static int cuda_graph_launch(gpugraph *g, gpustream *st) {
+  cuda_context *ctx = (cuda_context *)g->ctx;
+  CUstream s = CUDA_STREAM(ctx, st);
+  size_t i;
+
+  /* Drivers before 11.4 don't have everything we need */
+  if (cuGraphLaunch == NULL || cuStreamBeginCapture == NULL ||
+      cuStreamEndCapture == NULL || cuGraphInstantiateWithFlags == NULL ||
+      cuGraphExecDestroy == NULL || cuGraphDestroy == NULL)
+    return gpugraph_replay(g, st);
+
+  if (g->impl == NULL)
+    GA_CHECK(cuda_graph_build(g));
+
+  /* One wait and one record per buffer for the whole graph */
+  cuda_enter(ctx);
+  for (i = 0; i < g->nbufs; i++)
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(g->bufs[i], CUDA_WAIT_ALL, s));
+  CUDA_EXIT_ON_ERROR(ctx, cuGraphLaunch((CUgraphExec)g->impl, s));
+  for (i = 0; i < g->nbufs; i++)
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(g->bufs[i], CUDA_WAIT_ALL, s));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+static void cuda_graph_reset(gpugraph *g) {
+  cuda_context *ctx = (cuda_context *)g->ctx;
+
+  cuda_enter(ctx);
+  cuGraphExecDestroy((CUgraphExec)g->impl);
+  cuda_exit(ctx);
+  g->impl = NULL;
+}
+
+static int cuda_event_alloc(gpuevent **res, gpucontext *c) {
+  cuda_context *ctx = (cuda_context *)c;
+  gpuevent *e;
+  CUresult err;
+
+  ASSERT_CTX(ctx);
+  *res = NULL;
+  e = malloc(sizeof(*e));
+  if (e == NULL)
+    return error_sys(ctx->err, "malloc");
+  e->ctx = ctx;
+
+  cuda_enter(ctx);
+  err = cuEventCreate(&e->ev, CU_EVENT_DEFAULT);
+  cuda_exit(ctx);
+  if (err != CUDA_SUCCESS) {
+    free(e);
+    return error_cuda(ctx->err, "cuEventCreate", err);
+  }
+  TAG_EVENT(e);
+  *res = e;
+  return GA_NO_ERROR;
+}
+
+static void cuda_event_free(gpuevent *e) {
+  cuda_context *ctx = e->ctx;
+
+  ASSERT_EVENT(e);
+  cuda_enter(ctx);
+  cuEventDestroy(e->ev);
+  cuda_exit(ctx);
+  CLEAR(e);
+  free(e);
+}
+
+static int cuda_event_record(gpuevent *e, gpustream *s) {
+  cuda_context *ctx = e->ctx;
+
+  ASSERT_EVENT(e);
+  cuda_enter(ctx);
+  if (s == NULL && ctx->mem_s != ctx->s) {
+    /* Transfers without a stream run on mem_s, so join it in the
+       default stream to have the event come after them too */
+    CUDA_EXIT_ON_ERROR(ctx, cuEventRecord(e->ev, ctx->mem_s));
+    CUDA_EXIT_ON_ERROR(ctx, cuStreamWaitEvent(ctx->s, e->ev, 0));
+  }
+  CUDA_EXIT_ON_ERROR(ctx, cuEventRecord(e->ev, CUDA_STREAM(ctx, s)));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+static int cuda_event_sync(gpuevent *e) {
+  cuda_context *ctx = e->ctx;
+
+  ASSERT_EVENT(e);
+  cuda_enter(ctx);
+  CUDA_EXIT_ON_ERROR(ctx, cuEventSynchronize(e->ev));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+static int cuda_event_query(gpuevent *e, int *done) {
+  cuda_context *ctx = e->ctx;
+  CUresult err;
+
+  ASSERT_EVENT(e);
+  cuda_enter(ctx);
+  err = cuEventQuery(e->ev);
+  cuda_exit(ctx);
+  if (err != CUDA_SUCCESS && err != CUDA_ERROR_NOT_READY)
+    return error_cuda(ctx->err, "cuEventQuery", err);
+  *done = (err == CUDA_SUCCESS);
+  return GA_NO_ERROR;
+}
+
+static int cuda_event_elapsed(gpuevent *start, gpuevent *end, double *ms) {
+  cuda_context *ctx = start->ctx;
+  float res;
+
+  ASSERT_EVENT(start);
+  ASSERT_EVENT(end);
+  cuda_enter(ctx);
+  CUDA_EXIT_ON_ERROR(ctx, cuEventElapsedTime(&res, start->ev, end->ev));
+  cuda_exit(ctx);
+  *ms = res;
+  return GA_NO_ERROR;
+}
+
 static const char *cuda_error(gpucontext *c) {
   cuda_context *ctx = (cuda_context *)c;
   const char *errstr = NULL;
@@ -1787,7 +2833,23 @@ const gpuarray_buffer_ops cuda_ops = {cuda_get_platform_count,
                                       cuda_freekernel,
                                       cuda_kernelsetarg,
                                       cuda_callkernel,
+                                      cuda_kerneloccupancy,
                                       cuda_sync,
                                       cuda_transfer,
                                       cuda_property,
-                                      cuda_error};
+                                      cuda_error,
+                                      cuda_stream_alloc,
+                                      cuda_stream_free,
+                                      cuda_stream_sync,
+                                      cuda_stream_wait,
+                                      cuda_graph_launch,
+                                      cuda_graph_reset,
+                                      cuda_event_alloc,
+                                      cuda_event_free,
+                                      cuda_event_record,
+                                      cuda_event_sync,
+                                      cuda_event_query,
+                                      cuda_event_elapsed,
+                                      cuda_copy_rect,
+                                      cuda_fill,
+                                      cuda_upload};
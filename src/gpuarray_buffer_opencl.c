@@ -169,6 +169,7 @@ cl_ctx *cl_make_ctx(cl_context ctx, gpucontext_props *p) {
   }
 
   res->ctx = ctx;
+  res->dev = id;
   res->ops = &opencl_ops;
   if (error_alloc(&res->err)) {
     error_set(global_err, GA_SYS_ERROR, "Could not create error context");
@@ -177,13 +178,18 @@ cl_ctx *cl_make_ctx(cl_context ctx, gpucontext_props *p) {
   }
 
   res->refcnt = 1;
+  res->flags = p->flags;
+  res->capture = NULL;
+  res->scratch = NULL;
+  res->transfer_chunk = DEFAULT_TRANSFER_CHUNK;
   res->exts = NULL;
   res->blas_handle = NULL;
   res->options = NULL;
-  res->q = clCreateCommandQueue(
-    ctx, id,
-    ISSET(p->flags, GA_CTX_SINGLE_STREAM) ? 0 : qprop&CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,
-    &err);
+  /* Profiling is needed for gpuevent_elapsed() */
+  res->qprop = qprop&CL_QUEUE_PROFILING_ENABLE;
+  if (ISCLR(p->flags, GA_CTX_SINGLE_STREAM))
+    res->qprop |= qprop&CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+  res->q = clCreateCommandQueue(ctx, id, res->qprop, &err);
   if (res->q == NULL) {
     error_cl(global_err, "clCreateCommandQueue", err);
     error_free(res->err);
@@ -308,11 +314,13 @@ cl_mem cl_get_buf(gpudata *g) { ASSERT_BUF(g); return g->buf; }
 #define CL_SMALL "cl_khr_byte_addressable_store"
 #define CL_DOUBLE "cl_khr_fp64"
 #define CL_HALF "cl_khr_fp16"
+#define CL_ATOM64 "cl_khr_int64_base_atomics"
 
 static void cl_releasekernel(gpukernel *k);
 static int cl_callkernel(gpukernel *k, unsigned int n,
                          const size_t *gs, const size_t *ls,
-                         size_t shared, void **args);
+                         size_t shared, void **args, gpustream *s);
+static int cl_event_record(gpuevent *e, gpustream *s);
 
 const char *cl_error_string(cl_int err) {
   switch (err) {
@@ -371,13 +379,9 @@ const char *cl_error_string(cl_int err) {
 }
 
 static int check_ext(cl_ctx *ctx, const char *name) {
-  cl_device_id dev;
-
   if (ctx->exts == NULL) {
-    dev = get_dev(ctx->ctx, ctx->err);
-    if (dev == NULL) return ctx->err->code;
-
-    CL_GET_PROP(ctx->err, clGetDeviceInfo, dev, CL_DEVICE_EXTENSIONS, ctx->exts);
+    CL_GET_PROP(ctx->err, clGetDeviceInfo, ctx->dev, CL_DEVICE_EXTENSIONS,
+                ctx->exts);
   }
   if (strstr(ctx->exts, name) == NULL)
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Unsupported extension %s", name);
@@ -587,7 +591,7 @@ static int cl_share(gpudata *a, gpudata *b) {
 }
 
 static int cl_move(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
-                   size_t sz) {
+                   size_t sz, gpustream *s) {
   cl_ctx *ctx;
   cl_event ev;
   cl_event evw[2];
@@ -615,7 +619,7 @@ static int cl_move(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
   if (num_ev > 0)
     evl = evw;
 
-  CL_CHECK(ctx->err, clEnqueueCopyBuffer(ctx->q, src->buf, dst->buf, srcoff,
+  CL_CHECK(ctx->err, clEnqueueCopyBuffer(CL_QUEUE(ctx, s), src->buf, dst->buf, srcoff,
                                          dstoff, sz, num_ev, evl, &ev));
   if (src->ev != NULL)
     clReleaseEvent(src->ev);
@@ -629,16 +633,35 @@ static int cl_move(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
   return GA_NO_ERROR;
 }
 
-static int cl_read(void *dst, gpudata *src, size_t srcoff, size_t sz) {
+/*
+ * Keep the event of an asynchronous transfer in `done` and as the
+ * last event of the buffer so that later work waits for it.
+ */
+static void cl_transfer_done(gpudata *b, gpuevent *done, cl_event ev) {
+  ASSERT_EVENT(done);
+  if (done->ev != NULL) clReleaseEvent(done->ev);
+  done->ev = ev;
+  if (b->ev != NULL) clReleaseEvent(b->ev);
+  b->ev = ev;
+  clRetainEvent(ev);
+}
+
+static int cl_read(void *dst, gpudata *src, size_t srcoff, size_t sz,
+                   gpustream *s, gpuevent *done) {
   cl_ctx *ctx = src->ctx;
   cl_event ev[1];
   cl_event *evl = NULL;
+  cl_event rev;
   cl_uint num_ev = 0;
 
   ASSERT_BUF(src);
   ASSERT_CTX(ctx);
 
-  if (sz == 0) return GA_NO_ERROR;
+  if (sz == 0) {
+    if (done != NULL)
+      return cl_event_record(done, s);
+    return GA_NO_ERROR;
+  }
 
   if (src->ev != NULL) {
     ev[0] = src->ev;
@@ -646,8 +669,15 @@ static int cl_read(void *dst, gpudata *src, size_t srcoff, size_t sz) {
     num_ev = 1;
   }
 
-  CL_CHECK(ctx->err, clEnqueueReadBuffer(ctx->q, src->buf, CL_TRUE, srcoff, sz,
-                                         dst, num_ev, evl, NULL));
+  CL_CHECK(ctx->err, clEnqueueReadBuffer(CL_QUEUE(ctx, s), src->buf,
+                                         done ? CL_FALSE : CL_TRUE,
+                                         srcoff, sz, dst, num_ev, evl,
+                                         done ? &rev : NULL));
+
+  if (done != NULL) {
+    cl_transfer_done(src, done, rev);
+    return GA_NO_ERROR;
+  }
 
   if (src->ev != NULL) clReleaseEvent(src->ev);
   src->ev = NULL;
@@ -655,16 +685,22 @@ static int cl_read(void *dst, gpudata *src, size_t srcoff, size_t sz) {
   return GA_NO_ERROR;
 }
 
-static int cl_write(gpudata *dst, size_t dstoff, const void *src, size_t sz) {
+static int cl_write(gpudata *dst, size_t dstoff, const void *src, size_t sz,
+                    gpustream *s, gpuevent *done) {
   cl_ctx *ctx = dst->ctx;
   cl_event ev[1];
   cl_event *evl = NULL;
+  cl_event wev;
   cl_uint num_ev = 0;
 
   ASSERT_BUF(dst);
   ASSERT_CTX(ctx);
 
-  if (sz == 0) return GA_NO_ERROR;
+  if (sz == 0) {
+    if (done != NULL)
+      return cl_event_record(done, s);
+    return GA_NO_ERROR;
+  }
 
   if (dst->ev != NULL) {
     ev[0] = dst->ev;
@@ -672,8 +708,15 @@ static int cl_write(gpudata *dst, size_t dstoff, const void *src, size_t sz) {
     num_ev = 1;
   }
 
-  CL_CHECK(ctx->err, clEnqueueWriteBuffer(ctx->q, dst->buf, CL_TRUE, dstoff,
-                                          sz, src, num_ev, evl, NULL));
+  CL_CHECK(ctx->err, clEnqueueWriteBuffer(CL_QUEUE(ctx, s), dst->buf,
+                                          done ? CL_FALSE : CL_TRUE,
+                                          dstoff, sz, src, num_ev, evl,
+                                          done ? &wev : NULL));
+
+  if (done != NULL) {
+    cl_transfer_done(dst, done, wev);
+    return GA_NO_ERROR;
+  }
 
   if (dst->ev != NULL) clReleaseEvent(dst->ev);
   dst->ev = NULL;
@@ -681,6 +724,80 @@ static int cl_write(gpudata *dst, size_t dstoff, const void *src, size_t sz) {
   return GA_NO_ERROR;
 }
 
+static int cl_copy_rect(const ga_rect *dst, const ga_rect *src,
+                        const size_t *region, gpustream *s) {
+  cl_ctx *ctx = (dst->buf ? dst->buf : src->buf)->ctx;
+  size_t dorig[3], sorig[3];
+  cl_event ev;
+  cl_event evw[2];
+  cl_event *evl = NULL;
+  cl_uint num_ev = 0;
+
+  if (dst->buf && src->buf && dst->buf->ctx != src->buf->ctx)
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Differing contexts for source and destination");
+
+  ASSERT_CTX(ctx);
+
+  if (region[0] == 0 || region[1] == 0 || region[2] == 0)
+    return GA_NO_ERROR;
+
+  /* The offset goes in the byte origin, the driver does the bounds
+     checks. */
+  dorig[0] = dst->off; dorig[1] = 0; dorig[2] = 0;
+  sorig[0] = src->off; sorig[1] = 0; sorig[2] = 0;
+
+  if (src->buf && src->buf->ev != NULL)
+    evw[num_ev++] = src->buf->ev;
+  if (dst->buf && dst->buf->ev != NULL && dst->buf != src->buf)
+    evw[num_ev++] = dst->buf->ev;
+  if (num_ev > 0)
+    evl = evw;
+
+  if (src->buf == NULL) {
+    CL_CHECK(ctx->err, clEnqueueWriteBufferRect(CL_QUEUE(ctx, s),
+                                                dst->buf->buf, CL_TRUE,
+                                                dorig, sorig, region,
+                                                dst->pitch, dst->slice,
+                                                src->pitch, src->slice,
+                                                src->host, num_ev, evl,
+                                                NULL));
+    if (dst->buf->ev != NULL) clReleaseEvent(dst->buf->ev);
+    dst->buf->ev = NULL;
+    return GA_NO_ERROR;
+  }
+
+  if (dst->buf == NULL) {
+    CL_CHECK(ctx->err, clEnqueueReadBufferRect(CL_QUEUE(ctx, s),
+                                               src->buf->buf, CL_TRUE,
+                                               sorig, dorig, region,
+                                               src->pitch, src->slice,
+                                               dst->pitch, dst->slice,
+                                               dst->host, num_ev, evl,
+                                               NULL));
+    if (src->buf->ev != NULL) clReleaseEvent(src->buf->ev);
+    src->buf->ev = NULL;
+    return GA_NO_ERROR;
+  }
+
+  CL_CHECK(ctx->err, clEnqueueCopyBufferRect(CL_QUEUE(ctx, s),
+                                             src->buf->buf, dst->buf->buf,
+                                             sorig, dorig, region,
+                                             src->pitch, src->slice,
+                                             dst->pitch, dst->slice,
+                                             num_ev, evl, &ev));
+  if (src->buf->ev != NULL)
+    clReleaseEvent(src->buf->ev);
+  if (dst->buf->ev != NULL && dst->buf != src->buf)
+    clReleaseEvent(dst->buf->ev);
+
+  src->buf->ev = ev;
+  dst->buf->ev = ev;
+  clRetainEvent(ev);
+
+  return GA_NO_ERROR;
+}
+
 static int cl_memset(gpudata *dst, size_t offset, int data) {
   char local_kern[256];
   cl_ctx *ctx = dst->ctx;
@@ -766,13 +883,46 @@ static int cl_memset(gpudata *dst, size_t offset, int data) {
   if (res != GA_NO_ERROR) goto fail;
   gs = ((n-1) / ls) + 1;
   args[0] = dst;
-  res = cl_callkernel(m, 1, &gs, &ls, 0, args);
+  res = cl_callkernel(m, 1, &gs, &ls, 0, args, NULL);
 
  fail:
   cl_releasekernel(m);
   return res;
 }
 
+static int cl_fill(gpudata *dst, size_t dstoff, size_t sz,
+                   const void *pattern, size_t psz) {
+  cl_ctx *ctx = dst->ctx;
+  cl_event ev;
+  cl_event *evl = NULL;
+  cl_uint num_ev = 0;
+
+  ASSERT_BUF(dst);
+  ASSERT_CTX(ctx);
+
+  if (sz == 0) return GA_NO_ERROR;
+
+  /* The pattern size must be a power of two up to 128 and the
+     region a multiple of it */
+  if (psz > 128 || (psz & (psz - 1)) != 0 || dstoff % psz != 0 ||
+      sz % psz != 0)
+    return error_set(ctx->err, GA_UNSUPPORTED_ERROR,
+                     "Fill pattern not supported");
+
+  if (dst->ev != NULL) {
+    evl = &dst->ev;
+    num_ev = 1;
+  }
+
+  CL_CHECK(ctx->err, clEnqueueFillBuffer(ctx->q, dst->buf, pattern, psz,
+                                         dstoff, sz, num_ev, evl, &ev));
+  if (dst->ev != NULL)
+    clReleaseEvent(dst->ev);
+  dst->ev = ev;
+
+  return GA_NO_ERROR;
+}
+
 static int cl_check_extensions(const char **preamble, unsigned int *count,
                                int flags, cl_ctx *ctx) {
   if (flags & GA_USE_SMALL) {
@@ -785,6 +935,9 @@ static int cl_check_extensions(const char **preamble, unsigned int *count,
     preamble[*count] = PRAGMA CL_DOUBLE ENABLE;
     (*count)++;
   }
+  /* cluda.h enables the extension itself when it is there */
+  if (flags & GA_USE_ATOM64)
+    GA_CHECK(check_ext(ctx, CL_ATOM64));
   if (flags & GA_USE_COMPLEX) {
     return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Complex are not supported yet");
   }
@@ -813,16 +966,17 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
   const char **news = NULL;
   cl_int err;
   unsigned int n = 0;
+  unsigned int i;
   strb debug_msg = STRB_STATIC_INIT;
   size_t log_size;
+  uint64_t t = 0;
 
   ASSERT_CTX(ctx);
 
   if (count == 0)
     return error_set(ctx->err, GA_VALUE_ERROR, "Empty kernel source list");
 
-  dev = get_dev(ctx->ctx, ctx->err);
-  if (dev == NULL) return ctx->err->code;
+  dev = ctx->dev;
 
   if (cl_check_extensions(preamble, &n, flags, ctx))
     return ctx->err->code;
@@ -868,6 +1022,8 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     return error_cl(ctx->err, "clCreateProgramWithSource (kernel)", err);
   }
 
+  if (ga_trace)
+    t = trace_now();
   err = clCompileProgram(p, 0, NULL, ctx->options, 1, &cluda, headers, NULL, NULL);
   if (err != CL_SUCCESS)
     goto compile_error;
@@ -916,6 +1072,10 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     return error_cl(ctx->err, "clBuildProgram", err);
   }
 
+  if (ga_trace)
+    trace_complete("kernel", "compile", t,
+                   "\"name\":\"%s\",\"origin\":\"opencl\"", fname);
+
   if (n != 0) {
     free(news);
     free(newl);
@@ -930,6 +1090,7 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
   res->argcount = argcount;
   res->k = clCreateKernel(p, fname, &err);
   res->types = NULL;  /* This avoids a crash in cl_releasekernel */
+  res->ro = NULL;
   res->evr = NULL;   /* This avoids a crash in cl_releasekernel */
   res->ctx = ctx;
   ctx->refcnt++;
@@ -944,7 +1105,19 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     cl_releasekernel(res);
     return error_sys(ctx->err, "calloc");
   }
-  memcpy(res->types, types, argcount * sizeof(int));
+  res->ro = calloc(argcount, 1);
+  if (res->ro == NULL) {
+    cl_releasekernel(res);
+    return error_sys(ctx->err, "calloc");
+  }
+  /* Buffers only have one event so only reads can be told apart */
+  for (i = 0; i < argcount; i++) {
+    res->ro[i] = (types[i] == GA_BUFFER_RO);
+    if (types[i] == GA_BUFFER_RO || types[i] == GA_BUFFER_WO)
+      res->types[i] = GA_BUFFER;
+    else
+      res->types[i] = types[i];
+  }
 
   res->evr = calloc(argcount, sizeof(cl_event *));
   if (res->evr == NULL) {
@@ -971,6 +1144,7 @@ static void cl_releasekernel(gpukernel *k) {
     if (k->k) clReleaseKernel(k->k);
     cl_free_ctx(k->ctx);
     free(k->types);
+    free(k->ro);
     free(k->evr);
     free(k);
   }
@@ -1004,17 +1178,21 @@ static int cl_setkernelarg(gpukernel *k, unsigned int i, void *a) {
   return GA_NO_ERROR;
 }
 
+/* Kernels with up to this many arguments don't allocate on launch */
+#define CL_INLINE_EVENTS 16
+
 static int cl_callkernel(gpukernel *k, unsigned int n,
                          const size_t *gs, const size_t *ls,
-                         size_t shared, void **args) {
+                         size_t shared, void **args, gpustream *s) {
   cl_ctx *ctx = k->ctx;
   size_t _gs[3];
   cl_event ev;
-  cl_event *evw;
-  cl_device_id dev;
+  cl_event evw_inline[CL_INLINE_EVENTS];
+  cl_event *evw = evw_inline;
   cl_uint num_ev;
-  cl_uint i;
+  cl_uint i, j;
   cl_int err;
+  int written_only;
 
   ASSERT_KER(k);
   ASSERT_CTX(ctx);
@@ -1022,9 +1200,6 @@ static int cl_callkernel(gpukernel *k, unsigned int n,
   if (n > 3)
     return error_set(ctx->err, GA_VALUE_ERROR, "Call with more than 3 dimensions");
 
-  dev = get_dev(ctx->ctx, ctx->err);
-  if (dev == NULL) return ctx->err->code;
-
   if (args != NULL) {
     for (i = 0; i < k->argcount; i++) {
       GA_CHECK(cl_setkernelarg(k, i, args[i]));
@@ -1036,23 +1211,24 @@ static int cl_callkernel(gpukernel *k, unsigned int n,
     CL_CHECK(ctx->err, clSetKernelArg(k->k, k->argcount, shared, NULL));
   }
 
-  evw = calloc(sizeof(cl_event), k->argcount);
-  if (evw == NULL) {
-    return error_sys(ctx->err, "calloc");
+  if (k->argcount > CL_INLINE_EVENTS) {
+    evw = malloc(sizeof(cl_event) * k->argcount);
+    if (evw == NULL)
+      return error_sys(ctx->err, "malloc");
   }
 
   num_ev = 0;
   for (i = 0; i < k->argcount; i++) {
     if (k->evr[i] != NULL && *k->evr[i] != NULL) {
-      evw[num_ev++] = *k->evr[i];
+      /* Buffers often share their last event, only wait once */
+      for (j = 0; j < num_ev; j++)
+        if (evw[j] == *k->evr[i])
+          break;
+      if (j == num_ev)
+        evw[num_ev++] = *k->evr[i];
     }
   }
 
-  if (num_ev == 0) {
-    free(evw);
-    evw = NULL;
-  }
-
   switch (n) {
   case 3:
     _gs[2] = gs[2] * ls[2];
@@ -1061,14 +1237,18 @@ static int cl_callkernel(gpukernel *k, unsigned int n,
   case 1:
     _gs[0] = gs[0] * ls[0];
   }
-  err = clEnqueueNDRangeKernel(ctx->q, k->k, n, NULL, _gs, ls,
-                                    num_ev, evw, &ev);
-  free(evw);
+  err = clEnqueueNDRangeKernel(CL_QUEUE(ctx, s), k->k, n, NULL, _gs, ls,
+                               num_ev, num_ev ? evw : NULL, &ev);
+  if (evw != evw_inline)
+    free(evw);
   if (err != CL_SUCCESS)
     return error_cl(ctx->err, "clEnqueueNDRangeKernel", err);
 
+  /* With a single in-order queue, later writes can't overtake this
+     call so buffers that are only read keep their previous event. */
+  written_only = ISSET(ctx->flags, GA_CTX_SINGLE_STREAM);
   for (i = 0; i < k->argcount; i++) {
-    if (k->types[i] == GA_BUFFER) {
+    if (k->types[i] == GA_BUFFER && !(written_only && k->ro[i])) {
       if (*k->evr[i] != NULL)
         clReleaseEvent(*k->evr[i]);
       *k->evr[i] = ev;
@@ -1134,10 +1314,10 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     size_t *psz;
     cl_device_id id;
     cl_uint ui;
+    cl_ulong ul;
 
   case GA_CTX_PROP_DEVNAME:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_CHECK(ctx->err, clGetDeviceInfo(id, CL_DEVICE_NAME, 256, (char *)res,
                                        NULL));
     return GA_NO_ERROR;
@@ -1146,16 +1326,14 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Can't get unique ID on OpenCL");
 
   case GA_CTX_PROP_LMEMSIZE:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_CHECK(ctx->err, clGetDeviceInfo(id, CL_DEVICE_LOCAL_MEM_SIZE,
                                        sizeof(sz), &sz, NULL));
     *((size_t *)res) = sz;
     return GA_NO_ERROR;
 
   case GA_CTX_PROP_NUMPROCS:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_CHECK(ctx->err, clGetDeviceInfo(id, CL_DEVICE_MAX_COMPUTE_UNITS,
                                        sizeof(ui), &ui, NULL));
     *((unsigned int *)res) = ui;
@@ -1170,8 +1348,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     return GA_NO_ERROR;
 
   case GA_CTX_PROP_TOTAL_GMEM:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_CHECK(ctx->err, clGetDeviceInfo(id, CL_DEVICE_GLOBAL_MEM_SIZE,
                                        sizeof(sz), &sz, NULL));
     *((size_t *)res) = sz;
@@ -1181,8 +1358,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     /* There is no way to query free memory so we just return the
         largest block size */
   case GA_CTX_PROP_LARGEST_MEMBLOCK:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_CHECK(ctx->err, clGetDeviceInfo(id, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
                                        sizeof(sz), &sz, NULL));
     *((size_t *)res) = sz;
@@ -1211,8 +1387,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     return GA_NO_ERROR;
 
   case GA_CTX_PROP_MAXLSIZE0:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_GET_PROP(ctx->err, clGetDeviceInfo, id, CL_DEVICE_MAX_WORK_ITEM_SIZES,
                 psz);
     *((size_t *)res) = psz[0];
@@ -1220,8 +1395,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     return GA_NO_ERROR;
 
   case GA_CTX_PROP_MAXLSIZE1:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_GET_PROP(ctx->err, clGetDeviceInfo, id, CL_DEVICE_MAX_WORK_ITEM_SIZES,
                 psz);
     *((size_t *)res) = psz[1];
@@ -1229,8 +1403,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     return GA_NO_ERROR;
 
   case GA_CTX_PROP_MAXLSIZE2:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_GET_PROP(ctx->err, clGetDeviceInfo, id, CL_DEVICE_MAX_WORK_ITEM_SIZES,
                 psz);
     *((size_t *)res) = psz[2];
@@ -1247,6 +1420,10 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((size_t *)res) = sz;
     return GA_NO_ERROR;
 
+  case GA_BUFFER_PROP_HOSTPOINTER:
+    return error_set(ctx->err, GA_DEVSUP_ERROR,
+                     "Host pointers need mapping on OpenCL");
+
   /* GA_BUFFER_PROP_CTX is not ordered to simplify code */
   case GA_BUFFER_PROP_CTX:
   case GA_KERNEL_PROP_CTX:
@@ -1254,8 +1431,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     return GA_NO_ERROR;
 
   case GA_KERNEL_PROP_MAXLSIZE:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_CHECK(ctx->err, clGetKernelWorkGroupInfo(k->k, id,
                                                 CL_KERNEL_WORK_GROUP_SIZE,
                                                 sizeof(sz), &sz, NULL));
@@ -1263,8 +1439,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     return GA_NO_ERROR;
 
   case GA_KERNEL_PROP_PREFLSIZE:
-    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
-                                        sizeof(id), &id, NULL));
+    id = ctx->dev;
     CL_CHECK(ctx->err, clGetKernelWorkGroupInfo(k->k, id,
                                                 CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
                                                 sizeof(sz), &sz, NULL));
@@ -1279,11 +1454,196 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((const int **)res) = k->types;
     return GA_NO_ERROR;
 
+  case GA_KERNEL_PROP_NUMREGS:
+    return error_set(ctx->err, GA_DEVSUP_ERROR,
+                     "Register count is not available with OpenCL");
+
+  case GA_KERNEL_PROP_SHAREDSIZE:
+    id = ctx->dev;
+    CL_CHECK(ctx->err, clGetKernelWorkGroupInfo(k->k, id,
+                                                CL_KERNEL_LOCAL_MEM_SIZE,
+                                                sizeof(ul), &ul, NULL));
+    *((size_t *)res) = ul;
+    return GA_NO_ERROR;
+
   default:
     return error_fmt(ctx->err, GA_INVALID_ERROR, "Invalid property: %d", prop_id);
   }
 }
 
+/*
+ * OpenCL has no occupancy query so this only accounts for the local
+ * memory and assumes a compute unit can hold as many threads as the
+ * largest work group.
+ */
+static int cl_kerneloccupancy(gpukernel *k, size_t ls, size_t shared,
+                              unsigned int *blocks) {
+  cl_ctx *ctx = k->ctx;
+  cl_device_id id;
+  cl_ulong lmem, used;
+  size_t max_l;
+  size_t res;
+
+  ASSERT_KER(k);
+  id = ctx->dev;
+  CL_CHECK(ctx->err, clGetKernelWorkGroupInfo(k->k, id,
+                                              CL_KERNEL_WORK_GROUP_SIZE,
+                                              sizeof(max_l), &max_l, NULL));
+  CL_CHECK(ctx->err, clGetKernelWorkGroupInfo(k->k, id,
+                                              CL_KERNEL_LOCAL_MEM_SIZE,
+                                              sizeof(used), &used, NULL));
+  CL_CHECK(ctx->err, clGetDeviceInfo(id, CL_DEVICE_LOCAL_MEM_SIZE,
+                                     sizeof(lmem), &lmem, NULL));
+  used += shared;
+  if (ls == 0 || ls > max_l || used > lmem) {
+    *blocks = 0;
+    return GA_NO_ERROR;
+  }
+  res = max_l / ls;
+  if (used != 0 && lmem / used < res)
+    res = lmem / used;
+  *blocks = res;
+  return GA_NO_ERROR;
+}
+
+static int cl_stream_alloc(gpustream **res, gpucontext *c) {
+  cl_ctx *ctx = (cl_ctx *)c;
+  gpustream *s;
+  cl_int err;
+
+  ASSERT_CTX(ctx);
+  *res = NULL;
+  if (ISSET(ctx->flags, GA_CTX_SINGLE_STREAM))
+    return error_set(ctx->err, GA_UNSUPPORTED_ERROR,
+                     "Single stream contexts can't have extra streams");
+
+  s = malloc(sizeof(*s));
+  if (s == NULL)
+    return error_sys(ctx->err, "malloc");
+  s->ctx = ctx;
+  s->q = clCreateCommandQueue(ctx->ctx, ctx->dev, ctx->qprop, &err);
+  if (s->q == NULL) {
+    free(s);
+    return error_cl(ctx->err, "clCreateCommandQueue", err);
+  }
+  TAG_STREAM(s);
+  *res = s;
+  return GA_NO_ERROR;
+}
+
+static void cl_stream_free(gpustream *s) {
+  ASSERT_STREAM(s);
+  clFinish(s->q);
+  clReleaseCommandQueue(s->q);
+  CLEAR(s);
+  free(s);
+}
+
+static int cl_stream_sync(gpustream *s) {
+  ASSERT_STREAM(s);
+  CL_CHECK(s->ctx->err, clFinish(s->q));
+  return GA_NO_ERROR;
+}
+
+static int cl_stream_wait(gpustream *s, gpustream *other) {
+  cl_ctx *ctx = s ? s->ctx : other->ctx;
+  cl_event ev;
+  cl_int err;
+
+  ASSERT_CTX(ctx);
+  CL_CHECK(ctx->err, clEnqueueMarkerWithWaitList(CL_QUEUE(ctx, other), 0,
+                                                 NULL, &ev));
+  err = clEnqueueBarrierWithWaitList(CL_QUEUE(ctx, s), 1, &ev, NULL);
+  clReleaseEvent(ev);
+  if (err != CL_SUCCESS)
+    return error_cl(ctx->err, "clEnqueueBarrierWithWaitList", err);
+  return GA_NO_ERROR;
+}
+
+static int cl_event_alloc(gpuevent **res, gpucontext *c) {
+  cl_ctx *ctx = (cl_ctx *)c;
+  gpuevent *e;
+
+  ASSERT_CTX(ctx);
+  e = malloc(sizeof(*e));
+  if (e == NULL) {
+    *res = NULL;
+    return error_sys(ctx->err, "malloc");
+  }
+  e->ctx = ctx;
+  e->ev = NULL;
+  TAG_EVENT(e);
+  *res = e;
+  return GA_NO_ERROR;
+}
+
+static void cl_event_free(gpuevent *e) {
+  ASSERT_EVENT(e);
+  if (e->ev != NULL)
+    clReleaseEvent(e->ev);
+  CLEAR(e);
+  free(e);
+}
+
+static int cl_event_record(gpuevent *e, gpustream *s) {
+  cl_ctx *ctx = e->ctx;
+  cl_event ev;
+
+  ASSERT_EVENT(e);
+  CL_CHECK(ctx->err, clEnqueueMarkerWithWaitList(CL_QUEUE(ctx, s), 0, NULL,
+                                                 &ev));
+  if (e->ev != NULL)
+    clReleaseEvent(e->ev);
+  e->ev = ev;
+  return GA_NO_ERROR;
+}
+
+static int cl_event_sync(gpuevent *e) {
+  ASSERT_EVENT(e);
+  if (e->ev != NULL)
+    CL_CHECK(e->ctx->err, clWaitForEvents(1, &e->ev));
+  return GA_NO_ERROR;
+}
+
+static int cl_event_query(gpuevent *e, int *done) {
+  cl_int status;
+
+  ASSERT_EVENT(e);
+  if (e->ev == NULL) {
+    *done = 1;
+    return GA_NO_ERROR;
+  }
+  CL_CHECK(e->ctx->err, clGetEventInfo(e->ev,
+                                       CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                       sizeof(status), &status, NULL));
+  /* Negative values are the error of the failed command */
+  if (status < 0)
+    return error_cl(e->ctx->err, "Event command", status);
+  *done = (status == CL_COMPLETE);
+  return GA_NO_ERROR;
+}
+
+static int cl_event_elapsed(gpuevent *start, gpuevent *end, double *ms) {
+  cl_ctx *ctx = start->ctx;
+  cl_ulong t0, t1;
+
+  ASSERT_EVENT(start);
+  ASSERT_EVENT(end);
+  if (start->ev == NULL || end->ev == NULL)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Event was not recorded");
+  if (ISCLR(ctx->qprop, CL_QUEUE_PROFILING_ENABLE))
+    return error_set(ctx->err, GA_DEVSUP_ERROR,
+                     "Device does not support queue profiling");
+  CL_CHECK(ctx->err, clGetEventProfilingInfo(start->ev,
+                                             CL_PROFILING_COMMAND_END,
+                                             sizeof(t0), &t0, NULL));
+  CL_CHECK(ctx->err, clGetEventProfilingInfo(end->ev,
+                                             CL_PROFILING_COMMAND_END,
+                                             sizeof(t1), &t1, NULL));
+  *ms = ((double)t1 - (double)t0) / 1e6;
+  return GA_NO_ERROR;
+}
+
 static const char *cl_error(gpucontext *c) {
   cl_ctx *ctx = (cl_ctx *)c;
   if (ctx == NULL){
@@ -1311,7 +1671,23 @@ const gpuarray_buffer_ops opencl_ops = {cl_get_platform_count,
                                         cl_releasekernel,
                                         cl_setkernelarg,
                                         cl_callkernel,
+                                        cl_kerneloccupancy,
                                         cl_sync,
                                         cl_transfer,
                                         cl_property,
-                                        cl_error};
+                                        cl_error,
+                                        cl_stream_alloc,
+                                        cl_stream_free,
+                                        cl_stream_sync,
+                                        cl_stream_wait,
+                                        NULL,
+                                        NULL,
+                                        cl_event_alloc,
+                                        cl_event_free,
+                                        cl_event_record,
+                                        cl_event_sync,
+                                        cl_event_query,
+                                        cl_event_elapsed,
+                                        cl_copy_rect,
+                                        cl_fill,
+                                        NULL};
@@ -235,13 +235,14 @@ static inline int check_restrictions(gpudata *src, size_t offsrc,
  */
 static int reduce(gpudata *src, size_t offsrc, gpudata *dest, size_t offdest,
                   size_t count, int typecode, int opcode, int root,
-                  gpucomm *comm) {
+                  gpucomm *comm, gpustream *st) {
   // need dummy init so that compiler shuts up
   ncclRedOp_t op = ncclNumOps;
   ncclDataType_t datatype = ncclNumTypes;
   gpudata *dst = NULL;
   int rank = 0;
   cuda_context *ctx;
+  CUstream s;
 
   ASSERT_BUF(src);
   ASSERT_COMM(comm);
@@ -254,26 +255,27 @@ static int reduce(gpudata *src, size_t offsrc, gpudata *dest, size_t offdest,
                               opcode, comm, &datatype, &op));
 
   ctx = comm->ctx;
+  s = CUDA_STREAM(ctx, st);
   cuda_enter(ctx);
 
   // sync: wait till a write has finished (out of concurrent kernels)
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(src, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(src, CUDA_WAIT_READ, s));
   // sync: wait till a read/write has finished (out of concurrent kernels)
   if (rank == root)
-    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(dest, CUDA_WAIT_WRITE));
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(dest, CUDA_WAIT_WRITE, s));
 
   // change stream of nccl ops to enable concurrency
   if (rank == root)
     NCCL_EXIT_ON_ERROR(ctx, ncclReduce((void *)(src->ptr + offsrc),
                                        (void *)(dest->ptr + offdest), count,
-                                       datatype, op, root, comm->c, ctx->s));
+                                       datatype, op, root, comm->c, s));
   else
     NCCL_EXIT_ON_ERROR(ctx, ncclReduce((void *)(src->ptr + offsrc), NULL, count,
-                                       datatype, op, root, comm->c, ctx->s));
+                                       datatype, op, root, comm->c, s));
 
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(src, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(src, CUDA_WAIT_READ, s));
   if (rank == root)
-    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(dest, CUDA_WAIT_WRITE));
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(dest, CUDA_WAIT_WRITE, s));
 
   cuda_exit(ctx);
 
@@ -285,11 +287,12 @@ static int reduce(gpudata *src, size_t offsrc, gpudata *dest, size_t offdest,
  */
 static int all_reduce(gpudata *src, size_t offsrc, gpudata *dest,
                       size_t offdest, size_t count, int typecode, int opcode,
-                      gpucomm *comm) {
+                      gpucomm *comm, gpustream *st) {
   // need dummy init so that compiler shuts up
   ncclRedOp_t op = ncclNumOps;
   ncclDataType_t datatype = ncclNumTypes;
   cuda_context *ctx;
+  CUstream s;
 
   ASSERT_BUF(src);
   ASSERT_COMM(comm);
@@ -298,20 +301,21 @@ static int all_reduce(gpudata *src, size_t offsrc, gpudata *dest,
                               opcode, comm, &datatype, &op));
 
   ctx = comm->ctx;
+  s = CUDA_STREAM(ctx, st);
   cuda_enter(ctx);
 
   // sync: wait till a write has finished (out of concurrent kernels)
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(src, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(src, CUDA_WAIT_READ, s));
   // sync: wait till a read/write has finished (out of concurrent kernels)
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(dest, CUDA_WAIT_WRITE));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(dest, CUDA_WAIT_WRITE, s));
 
   // change stream of nccl ops to enable concurrency
   NCCL_EXIT_ON_ERROR(ctx, ncclAllReduce((void *)(src->ptr + offsrc),
                                         (void *)(dest->ptr + offdest), count,
-                                        datatype, op, comm->c, ctx->s));
+                                        datatype, op, comm->c, s));
 
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(src, CUDA_WAIT_READ));
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(dest, CUDA_WAIT_WRITE));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(src, CUDA_WAIT_READ, s));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(dest, CUDA_WAIT_WRITE, s));
 
   cuda_exit(ctx);
 
@@ -323,13 +327,14 @@ static int all_reduce(gpudata *src, size_t offsrc, gpudata *dest,
  */
 static int reduce_scatter(gpudata *src, size_t offsrc, gpudata *dest,
                           size_t offdest, size_t count, int typecode,
-                          int opcode, gpucomm *comm) {
+                          int opcode, gpucomm *comm, gpustream *st) {
   // need dummy init so that compiler shuts up
   ncclRedOp_t op = ncclNumOps;
   ncclDataType_t datatype = ncclNumTypes;
   int ndev = 0;
   size_t resc_size;
   cuda_context *ctx;
+  CUstream s;
 
   ASSERT_BUF(src);
   ASSERT_COMM(comm);
@@ -345,20 +350,21 @@ static int reduce_scatter(gpudata *src, size_t offsrc, gpudata *dest,
   assert(!(offdest > dest->sz));
 
   ctx = comm->ctx;
+  s = CUDA_STREAM(ctx, st);
   cuda_enter(ctx);
 
   // sync: wait till a write has finished (out of concurrent kernels)
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(src, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(src, CUDA_WAIT_READ, s));
   // sync: wait till a read/write has finished (out of concurrent kernels)
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(dest, CUDA_WAIT_WRITE));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(dest, CUDA_WAIT_WRITE, s));
 
   // change stream of nccl ops to enable concurrency
   NCCL_EXIT_ON_ERROR(ctx, ncclReduceScatter((void *)(src->ptr + offsrc),
                                             (void *)(dest->ptr + offdest), count,
-                                            datatype, op, comm->c, ctx->s));
+                                            datatype, op, comm->c, s));
 
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(src, CUDA_WAIT_READ));
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(dest, CUDA_WAIT_WRITE));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(src, CUDA_WAIT_READ, s));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(dest, CUDA_WAIT_WRITE, s));
 
   cuda_exit(ctx);
 
@@ -369,11 +375,12 @@ static int reduce_scatter(gpudata *src, size_t offsrc, gpudata *dest,
  * \brief NCCL implementation of \ref gpucomm_broadcast.
  */
 static int broadcast(gpudata *array, size_t offset, size_t count, int typecode,
-                     int root, gpucomm *comm) {
+                     int root, gpucomm *comm, gpustream *st) {
   // need dummy init so that compiler shuts up
   ncclDataType_t datatype = ncclNumTypes;
   int rank = 0;
   cuda_context *ctx;
+  CUstream s;
 
   ASSERT_BUF(array);
   ASSERT_COMM(comm);
@@ -382,22 +389,23 @@ static int broadcast(gpudata *array, size_t offset, size_t count, int typecode,
   GA_CHECK(get_rank(comm, &rank));
 
   ctx = comm->ctx;
+  s = CUDA_STREAM(ctx, st);
   cuda_enter(ctx);
 
   // sync: wait till a write has finished (out of concurrent kernels)
   if (rank == root)
-    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(array, CUDA_WAIT_READ));
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(array, CUDA_WAIT_READ, s));
   else
-    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(array, CUDA_WAIT_WRITE));
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(array, CUDA_WAIT_WRITE, s));
 
   // change stream of nccl ops to enable concurrency
   NCCL_EXIT_ON_ERROR(ctx, ncclBcast((void *)(array->ptr + offset), count,
-                                    datatype, root, comm->c, ctx->s));
+                                    datatype, root, comm->c, s));
 
   if (rank == root)
-    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(array, CUDA_WAIT_READ));
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(array, CUDA_WAIT_READ, s));
   else
-    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(array, CUDA_WAIT_WRITE));
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(array, CUDA_WAIT_WRITE, s));
 
   cuda_exit(ctx);
 
@@ -409,12 +417,13 @@ static int broadcast(gpudata *array, size_t offset, size_t count, int typecode,
  */
 static int all_gather(gpudata *src, size_t offsrc, gpudata *dest,
                       size_t offdest, size_t count, int typecode,
-                      gpucomm *comm) {
+                      gpucomm *comm, gpustream *st) {
   // need dummy init so that compiler shuts up
   ncclDataType_t datatype = ncclNumTypes;
   int ndev = 0;
   size_t resc_size;
   cuda_context *ctx;
+  CUstream s;
 
   ASSERT_BUF(src);
   ASSERT_COMM(comm);
@@ -430,20 +439,21 @@ static int all_gather(gpudata *src, size_t offsrc, gpudata *dest,
   assert(!(offdest > dest->sz));
 
   ctx = comm->ctx;
+  s = CUDA_STREAM(ctx, st);
   cuda_enter(ctx);
 
   // sync: wait till a write has finished (out of concurrent kernels)
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(src, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(src, CUDA_WAIT_READ, s));
   // sync: wait till a read/write has finished (out of concurrent kernels)
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(dest, CUDA_WAIT_WRITE));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(dest, CUDA_WAIT_WRITE, s));
 
   // change stream of nccl ops to enable concurrency
   NCCL_EXIT_ON_ERROR(
       ctx, ncclAllGather((void *)(src->ptr + offsrc),
-			 (void *)(dest->ptr + offdest), count, datatype, comm->c, ctx->s));
+			 (void *)(dest->ptr + offdest), count, datatype, comm->c, s));
 
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(src, CUDA_WAIT_READ));
-  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(dest, CUDA_WAIT_WRITE));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(src, CUDA_WAIT_READ, s));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_records(dest, CUDA_WAIT_WRITE, s));
 
   cuda_exit(ctx);
 
@@ -10,12 +10,23 @@
 #include "util/strb.h"
 
 struct _GpuElemwise {
+  gpucontext *ctx; /* Context the operation runs in */
   const char *expr; /* Expression code (to be able to build kernels on-demand) */
   const char *preamble; /* Preamble code */
   gpuelemwise_arg *args; /* Argument descriptors */
   GpuKernel k_contig; /* Contiguous kernel */
   GpuKernel *k_basic; /* Normal basic kernels */
   GpuKernel *k_basic_32; /* 32-bit address basic kernels */
+  GpuKernel *k_grid; /* 32-bit address grid kernels (by nd and unroll) */
+  GpuKernel k_tiled; /* Tiled kernel for transposing operations */
+  unsigned int tiled_mask; /* Arrays staged through local memory by k_tiled */
+  GpuKernel k_multi; /* Multi-tensor apply kernel */
+  size_t *multi_vals; /* nblocks, chunk and (n, start) for each slot */
+  unsigned int multi_slots; /* Argument sets per launch of k_multi */
+  gpuelemwise_reduce *red; /* Reduction clause (NULL if none) */
+  GpuKernel *k_reduce; /* Map-reduce and finishing kernels by kept and reduced nd */
+  unsigned int red_nd; /* Maximum nd of k_reduce */
+  ssize_t **red_strs; /* Scratch strides pointers for collapsing */
   size_t *dims; /* Preallocated shape buffer for dimension collapsing */
   ssize_t **strides; /* Preallocated strides buffer for dimension collapsing */
   unsigned int nd; /* Current maximum number of dimensions allocated */
@@ -26,9 +37,41 @@ struct _GpuElemwise {
 
 #define GEN_ADDR32      0x1
 #define GEN_CONVERT_F16 0x2
+#define GEN_INDEX       0x4
+
+/* Geometry of the tiles used by the transposing kernel. The block is
+   TILE_DIM x TILE_ROWS threads and each thread handles TILE_DIM /
+   TILE_ROWS elements of the tile. */
+#define TILE_DIM  32
+#define TILE_ROWS 8
+
+/* Grid kernels are generated with 1, 2 and 4 elements per thread
+   (GRID_NUNROLL variants) for blocks of up to GRID_BLOCK threads. */
+#define GRID_NUNROLL 3
+#define GRID_BLOCK   256
+/* Resident threads needed to keep a processor busy */
+#define GRID_THREADS_PER_PROC 2048
+
+/* Multi-tensor apply kernels take at most MULTI_PARAM_SIZE bytes of
+   arguments for up to MULTI_MAX_SLOTS argument sets.  Each block
+   handles MULTI_CHUNK elements per thread of one set. */
+#define MULTI_PARAM_SIZE 1024
+#define MULTI_MAX_SLOTS  32
+#define MULTI_BLOCK      256
+#define MULTI_CHUNK      4
+
+/* Reductions run with blocks of up to RED_BLOCK threads, at most
+   RED_WIDTH of them along the outputs.  The reduction is split to
+   get RED_BLOCKS_PER_PROC blocks per processor as long as each thread
+   gets at least RED_MIN_ITEMS values. */
+#define RED_BLOCK           256
+#define RED_WIDTH           32
+#define RED_BLOCKS_PER_PROC 4
+#define RED_MIN_ITEMS       8
 
 /* This makes sure we have the same value for those flags since we use some shortcuts */
 STATIC_ASSERT(GEN_CONVERT_F16 == GE_CONVERT_F16, same_flags_value_elem1);
+STATIC_ASSERT(GEN_INDEX == GE_INDEX, same_flags_value_elem2);
 
 #define is_array(a) (ISCLR((a).flags, GE_SCALAR))
 #define is_output(a) (ISSET((a).flags, GE_WRITE))
@@ -37,6 +80,15 @@ static inline int k_initialized(GpuKernel *k) {
   return k->k != NULL;
 }
 
+/* Kernel argument type for the data of an array argument */
+static inline int buftype(gpuelemwise_arg *a) {
+  if (ISCLR(a->flags, GE_WRITE))
+    return GA_BUFFER_RO;
+  if (ISCLR(a->flags, GE_READ))
+    return GA_BUFFER_WO;
+  return GA_BUFFER;
+}
+
 static inline const char *ctype(int typecode) {
   return gpuarray_get_type(typecode)->cluda_name;
 }
@@ -110,6 +162,8 @@ static int ge_grow(GpuElemwise *ge, unsigned int nd) {
 
   if (reallocaz((void **)&ge->k_basic, sizeof(GpuKernel), ge->nd, nd) ||
       reallocaz((void **)&ge->k_basic_32, sizeof(GpuKernel), ge->nd, nd) ||
+      reallocaz((void **)&ge->k_grid, sizeof(GpuKernel),
+                ge->nd * GRID_NUNROLL, nd * GRID_NUNROLL) ||
       reallocaz((void **)&ge->dims, sizeof(size_t), ge->nd, nd))
     return 1;
   for (i = 0; i < ge->narray; i++) {
@@ -168,7 +222,7 @@ static int gen_elemwise_basic_kernel(GpuKernel *k, gpucontext *ctx,
       strb_appendf(&sb, "GLOBAL_MEM %s *%s_data, const ga_size %s_offset%s",
                    ctype(args[j].typecode), args[j].name, args[j].name,
                    nd == 0 ? "" : ", ");
-      ktypes[p++] = GA_BUFFER;
+      ktypes[p++] = buftype(&args[j]);
       ktypes[p++] = GA_SIZE;
 
       for (i = 0; i < nd; i++) {
@@ -190,6 +244,8 @@ static int gen_elemwise_basic_kernel(GpuKernel *k, gpucontext *ctx,
   strb_appends(&sb, "for(i = idx; i < n; i += numThreads) {\n");
   if (nd > 0)
     strb_appendf(&sb, "%s ii = i;\n%s pos;\n", size, size);
+  if (ISSET(gen_flags, GEN_INDEX))
+    strb_appendf(&sb, "const %s ga_i = i;\n", size);
   for (j = 0; j < n; j++) {
     if (is_array(args[j]))
       strb_appendf(&sb, "%s %s_p = %s_offset;\n",
@@ -201,6 +257,8 @@ static int gen_elemwise_basic_kernel(GpuKernel *k, gpucontext *ctx,
       strb_appendf(&sb, "pos = ii %% (%s)dim%u;\nii = ii / (%s)dim%u;\n", size, i, size, i);
     else
       strb_appends(&sb, "pos = ii;\n");
+    if (ISSET(gen_flags, GEN_INDEX))
+      strb_appendf(&sb, "const %s ga_idx%u = pos;\n", size, i);
     for (j = 0; j < n; j++) {
       if (is_array(args[j]))
         strb_appendf(&sb, "%s_p += pos * (%s)%s_str_%u;\n", args[j].name,
@@ -273,7 +331,7 @@ static int check_basic(GpuElemwise *ge, void **args, int flags,
                        size_t *_n, unsigned int *_nd, size_t **_dims,
                        ssize_t ***_strides, int *_call32) {
   size_t n;
-  gpucontext *ctx = GpuKernel_context(&ge->k_contig);
+  gpucontext *ctx = ge->ctx;
   GpuArray *a = NULL, *v;
   unsigned int i, j, p, num_arrays = 0, nd = 0, nnd;
   int call32 = 1;
@@ -382,35 +440,22 @@ static int check_basic(GpuElemwise *ge, void **args, int flags,
   return GA_NO_ERROR;
 }
 
-static int call_basic(GpuElemwise *ge, void **args, size_t n, unsigned int nd,
-                      size_t *dims, ssize_t **strs, int call32) {
-  GpuKernel *k;
-  size_t ls = 0, gs = 0;
+/*
+ * The backends may only keep the pointers passed to setarg, so
+ * everything here must outlive the kernel call (hence `n` by pointer).
+ */
+static int set_basic_args(GpuElemwise *ge, GpuKernel *k, void **args,
+                          size_t *n, unsigned int nd, size_t *dims,
+                          ssize_t **strs) {
   unsigned int p = 0, i, j, l;
   int err;
 
-  if (nd == 0) return error_set(GpuKernel_context(&ge->k_contig)->err, GA_VALUE_ERROR, "nd == 0");
-
-  if (call32)
-    k = &ge->k_basic_32[nd-1];
-  else
-    k = &ge->k_basic[nd-1];
-
-  if (!k_initialized(k)) {
-    err = gen_elemwise_basic_kernel(k, GpuKernel_context(&ge->k_contig), NULL,
-                                    ge->preamble, ge->expr, nd, ge->n,
-                                    ge->args, ((call32 ? GEN_ADDR32 : 0) |
-                                               (ge->flags & GE_CONVERT_F16)));
-    if (err != GA_NO_ERROR)
-      return err;
-  }
-
-  err = GpuKernel_setarg(k, p++, &n);
-  if (err != GA_NO_ERROR) goto error_call_basic;
+  err = GpuKernel_setarg(k, p++, n);
+  if (err != GA_NO_ERROR) return err;
 
   for (i = 0; i < nd; i++) {
     err = GpuKernel_setarg(k, p++, &dims[i]);
-    if (err != GA_NO_ERROR) goto error_call_basic;
+    if (err != GA_NO_ERROR) return err;
   }
 
   /* l is the number of arrays to date */
@@ -419,221 +464,1832 @@ static int call_basic(GpuElemwise *ge, void **args, size_t n, unsigned int nd,
     if (is_array(ge->args[j])) {
       GpuArray *v = (GpuArray *)args[j];
       err = GpuKernel_setarg(k, p++, v->data);
-      if (err != GA_NO_ERROR) goto error_call_basic;
+      if (err != GA_NO_ERROR) return err;
       err = GpuKernel_setarg(k, p++, &v->offset);
-      if (err != GA_NO_ERROR) goto error_call_basic;
+      if (err != GA_NO_ERROR) return err;
       for (i = 0; i < nd; i++) {
         err = GpuKernel_setarg(k, p++, &strs[l][i]);
-        if (err != GA_NO_ERROR) goto error_call_basic;
+        if (err != GA_NO_ERROR) return err;
       }
       l++;
     } else {
       err = GpuKernel_setarg(k, p++, args[j]);
-      if (err != GA_NO_ERROR) goto error_call_basic;
+      if (err != GA_NO_ERROR) return err;
     }
   }
+  return GA_NO_ERROR;
+}
+
+static int call_basic(GpuElemwise *ge, void **args, size_t n, unsigned int nd,
+                      size_t *dims, ssize_t **strs, int call32) {
+  GpuKernel *k;
+  size_t ls = 0, gs = 0;
+  int err;
+
+  if (nd == 0) return error_set(ge->ctx->err, GA_VALUE_ERROR, "nd == 0");
+
+  if (call32)
+    k = &ge->k_basic_32[nd-1];
+  else
+    k = &ge->k_basic[nd-1];
+
+  if (!k_initialized(k)) {
+    err = gen_elemwise_basic_kernel(k, ge->ctx, NULL,
+                                    ge->preamble, ge->expr, nd, ge->n,
+                                    ge->args, ((call32 ? GEN_ADDR32 : 0) |
+                                               (ge->flags & (GE_CONVERT_F16 |
+                                                             GE_INDEX))));
+    if (err != GA_NO_ERROR)
+      return err;
+  }
+
+  err = set_basic_args(ge, k, args, &n, nd, dims, strs);
+  if (err != GA_NO_ERROR) return err;
 
   err = GpuKernel_sched(k, n, &gs, &ls);
-  if (err != GA_NO_ERROR) goto error_call_basic;
+  if (err != GA_NO_ERROR) return err;
 
-  err = GpuKernel_call(k, 1, &gs, &ls, 0, NULL);
- error_call_basic:
-  return err;
+  return GpuKernel_call(k, 1, &gs, &ls, 0, NULL);
 }
 
-static int gen_elemwise_contig_kernel(GpuKernel *k,
-                                      gpucontext *ctx, char **err_str,
-                                      const char *preamble,
-                                      const char *expr,
-                                      unsigned int n,
-                                      gpuelemwise_arg *args,
-                                      int gen_flags) {
+/*
+ * With GE_INDEX the expression sees the coordinates of the element
+ * in the output, so the dimensions can't be collapsed and only the
+ * basic kernels are usable.  A 0-d output is run as shape (1,).
+ */
+static int call_index(GpuElemwise *ge, void **args, int flags) {
+  size_t n;
+  size_t *dims;
+  ssize_t **strs;
+  unsigned int nd, l;
+  int call32;
+  int err;
+
+  err = check_basic(ge, args, flags | GE_NOCOLLAPSE, &n, &nd, &dims, &strs,
+                    &call32);
+  if (err != GA_NO_ERROR) return err;
+  if (n == 0) return GA_NO_ERROR;
+
+  if (nd == 0) {
+    nd = 1;
+    dims[0] = 1;
+    for (l = 0; l < ge->narray; l++)
+      strs[l][0] = 0;
+  }
+
+  return call_basic(ge, args, n, nd, dims, strs, call32);
+}
+
+/*
+ * Same arguments as the basic kernel, but the two innermost
+ * dimensions are mapped onto the x and y axes of the launch grid and
+ * the remaining ones onto z.  Only the z index needs to be split
+ * with division and each thread handles `unroll` elements of a row
+ * spaced by the block width.
+ */
+static int gen_elemwise_grid_kernel(GpuKernel *k, gpucontext *ctx,
+                                    char **err_str,
+                                    const char *preamble,
+                                    const char *expr,
+                                    unsigned int nd, /* Number of dims */
+                                    unsigned int n, /* Length of args */
+                                    gpuelemwise_arg *args,
+                                    unsigned int unroll,
+                                    int gen_flags) {
   strb sb = STRB_STATIC_INIT;
-  int *ktypes = NULL;
+  unsigned int i, _i, j, u;
+  int *ktypes;
+  char *size = "ga_size", *ssize = "ga_ssize";
   unsigned int p;
-  unsigned int j;
   int flags = 0;
   int res;
 
+  if (ISSET(gen_flags, GEN_ADDR32)) {
+    size = "ga_uint";
+    ssize = "ga_int";
+  }
+
   flags |= gpuarray_type_flagsa(n, args);
 
-  p = 1;
-  for (j = 0; j < n; j++)
-    p += ISSET(args[j].flags, GE_SCALAR) ? 1 : 2;
+  p = 1 + nd;
+  for (j = 0; j < n; j++) {
+    p += ISSET(args[j].flags, GE_SCALAR) ? 1 : (2 + nd);
+  }
 
   ktypes = calloc(p, sizeof(int));
-  if (ktypes == NULL) {
-    res = error_sys(ctx->err, "calloc");
-    goto bail;
-  }
+  if (ktypes == NULL)
+    return error_sys(ctx->err, "calloc");
 
   p = 0;
 
   strb_appends(&sb, "#include \"cluda.h\"\n");
   if (preamble)
     strb_appends(&sb, preamble);
-  strb_appends(&sb, "\nKERNEL void elem(const ga_size n, ");
+  strb_appends(&sb, "\nKERNEL void elem_grid(const ga_size n, ");
   ktypes[p++] = GA_SIZE;
+  for (i = 0; i < nd; i++) {
+    strb_appendf(&sb, "const ga_size dim%u, ", i);
+    ktypes[p++] = GA_SIZE;
+  }
   for (j = 0; j < n; j++) {
     if (is_array(args[j])) {
-      strb_appendf(&sb, "GLOBAL_MEM %s *%s_p,  const ga_size %s_offset",
-                   ctype(args[j].typecode), args[j].name, args[j].name);
-      ktypes[p++] = GA_BUFFER;
+      strb_appendf(&sb, "GLOBAL_MEM %s *%s_data, const ga_size %s_offset%s",
+                   ctype(args[j].typecode), args[j].name, args[j].name,
+                   nd == 0 ? "" : ", ");
+      ktypes[p++] = buftype(&args[j]);
       ktypes[p++] = GA_SIZE;
+
+      for (i = 0; i < nd; i++) {
+        strb_appendf(&sb, "const ga_ssize %s_str_%u%s", args[j].name, i,
+                     (i == (nd - 1)) ? "": ", ");
+        ktypes[p++] = GA_SSIZE;
+      }
     } else {
       strb_appendf(&sb, "%s %s", ctype(args[j].typecode), args[j].name);
       ktypes[p++] = args[j].typecode;
     }
-    if (j != (n - 1))
-      strb_appends(&sb, ", ");
+    if (j != (n - 1)) strb_appends(&sb, ", ");
   }
-  strb_appends(&sb, ") {\n"
-               "const ga_size idx = LDIM_0 * GID_0 + LID_0;\n"
-               "const ga_size numThreads = LDIM_0 * GDIM_0;\n"
-               "ga_size i;\n"
-               "GLOBAL_MEM char *tmp;\n\n");
+  strb_appendf(&sb, ") {\n%s gi_z, gi_y, gi_x;\n", size);
+
+  /* Outer dimensions (if any) on the z axis */
+  strb_appends(&sb, "const ga_size outer = 1");
+  for (i = 0; i + 2 < nd; i++)
+    strb_appendf(&sb, " * dim%u", i);
+  strb_appends(&sb, ";\n");
+  strb_appends(&sb, "for (gi_z = GID_2; gi_z < outer; gi_z += GDIM_2) {\n");
+  if (nd > 2)
+    strb_appendf(&sb, "%s ii = gi_z;\n%s pos;\n", size, size);
   for (j = 0; j < n; j++) {
-    if (is_array(args[j])) {
-      strb_appendf(&sb, "tmp = (GLOBAL_MEM char *)%s_p;"
-                   "tmp += %s_offset; %s_p = (GLOBAL_MEM %s *)tmp;",
-                   args[j].name, args[j].name, args[j].name,
-                   ctype(args[j].typecode));
+    if (is_array(args[j]))
+      strb_appendf(&sb, "%s %s_z = %s_offset;\n",
+                   size, args[j].name, args[j].name);
+  }
+  for (_i = nd > 2 ? nd - 2 : 0; _i > 0; _i--) {
+    i = _i - 1;
+    if (i > 0)
+      strb_appendf(&sb, "pos = ii %% (%s)dim%u;\nii = ii / (%s)dim%u;\n", size, i, size, i);
+    else
+      strb_appends(&sb, "pos = ii;\n");
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]))
+        strb_appendf(&sb, "%s_z += pos * (%s)%s_str_%u;\n", args[j].name,
+                     ssize, args[j].name, i);
     }
   }
 
-  strb_appends(&sb, "for (i = idx; i < n; i += numThreads) {\n");
-  for (j = 0; j < n; j++) {
-    if (is_array(args[j])) {
-      strb_appendf(&sb, "%s %s;\n", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+  /* Second innermost dimension on the y axis */
+  if (nd > 1) {
+    strb_appendf(&sb, "for (gi_y = GID_1 * LDIM_1 + LID_1; gi_y < dim%u; "
+                 "gi_y += GDIM_1 * LDIM_1) {\n", nd - 2);
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]))
+        strb_appendf(&sb, "%s %s_y = %s_z + gi_y * (%s)%s_str_%u;\n",
+                     size, args[j].name, args[j].name, ssize, args[j].name,
+                     nd - 2);
+    }
+  } else {
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]))
+        strb_appendf(&sb, "%s %s_y = %s_z;\n", size, args[j].name,
+                     args[j].name);
+    }
+  }
+
+  /* Innermost dimension on the x axis, unroll elements per thread */
+  strb_appendf(&sb, "for (gi_x = GID_0 * LDIM_0 * %u + LID_0; gi_x < dim%u; "
+               "gi_x += GDIM_0 * LDIM_0 * %u) {\n", unroll, nd - 1, unroll);
+  for (u = 0; u < unroll; u++) {
+    strb_appendf(&sb, "if (gi_x + %u * LDIM_0 < dim%u) {\n", u, nd - 1);
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]))
+        strb_appendf(&sb, "%s %s_p = %s_y + (gi_x + %u * LDIM_0) * (%s)%s_str_%u;\n",
+                     size, args[j].name, args[j].name, u, ssize,
+                     args[j].name, nd - 1);
+    }
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j])) {
+        strb_appendf(&sb, "%s %s;", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
                                           GA_FLOAT : args[j].typecode), args[j].name);
-      if (ISSET(args[j].flags, GE_READ)) {
-        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
-          strb_appendf(&sb, "%s = ga_half2float(%s_p[i]);\n", args[j].name, args[j].name);
-        } else {
-          strb_appendf(&sb, "%s = %s_p[i];\n", args[j].name, args[j].name);
+        if (ISSET(args[j].flags, GE_READ)) {
+          if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+            strb_appendf(&sb, "%s = ga_half2float(*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p));\n",
+                         args[j].name, args[j].name, args[j].name);
+          } else {
+            strb_appendf(&sb, "%s = *(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p);\n",
+                         args[j].name, ctype(args[j].typecode), args[j].name, args[j].name);
+          }
         }
       }
     }
-  }
-  strb_appends(&sb, expr);
-  strb_appends(&sb, ";\n");
-
-  for (j = 0; j < n; j++) {
-    if (is_array(args[j])) {
-      if (ISSET(args[j].flags, GE_WRITE)) {
+    strb_appends(&sb, expr);
+    strb_appends(&sb, ";\n");
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]) && ISSET(args[j].flags, GE_WRITE)) {
         if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
-          strb_appendf(&sb, "%s_p[i] = ga_float2half(%s);\n", args[j].name, args[j].name);
+          strb_appendf(&sb, "*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p) = ga_float2half(%s);\n",
+                       args[j].name, args[j].name, args[j].name);
         } else {
-          strb_appendf(&sb, "%s_p[i] = %s;\n", args[j].name, args[j].name);
+          strb_appendf(&sb, "*(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p) = %s;\n",
+                       ctype(args[j].typecode), args[j].name, args[j].name, args[j].name);
         }
       }
     }
+    strb_appends(&sb, "}\n");
   }
+  strb_appends(&sb, "}\n");
+  if (nd > 1)
+    strb_appends(&sb, "}\n");
   strb_appends(&sb, "}\n}\n");
-
   if (strb_error(&sb)) {
-    res = error_set(ctx->err, GA_MISC_ERROR, "Formatting error creating kernel source");
+    res = GA_MEMORY_ERROR;
     goto bail;
   }
 
-  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem",
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem_grid",
                        p, ktypes, flags, err_str);
  bail:
-  strb_clear(&sb);
   free(ktypes);
+  strb_clear(&sb);
   return res;
 }
 
-static int check_contig(GpuElemwise *ge, void **args,
-                        size_t *_n, int *contig) {
-  GpuArray *a = NULL, *v;
-  size_t n = 1;
-  unsigned int i, j;
-  int c_contig = 1, f_contig = 1;
+/*
+ * Small cost model to choose between the basic and grid kernels.
+ *
+ * The grid kernel avoids the division for the two innermost
+ * dimensions, but the threads of a block that fall past the end of a
+ * row are wasted, so it is only used when rows are at least `warp`
+ * long and there is more than one dimension (the basic kernel
+ * doesn't divide in 1d).  Elements per thread are added as long as
+ * the rows are long enough for the unrolled blocks and there are
+ * still enough threads left to fill every processor.
+ *
+ * Returns the index of the unroll variant to use or -1 for the basic
+ * kernel.
+ */
+static int grid_unroll(size_t n, unsigned int nd, size_t *dims,
+                       size_t warp, unsigned int numprocs) {
+  size_t fill = (size_t)numprocs * GRID_THREADS_PER_PROC;
+  int u = 0;
+
+  if (nd < 2 || dims[nd - 1] < warp)
+    return -1;
 
-  for (i = 0; i < ge->n; i++) {
-    if (is_array(ge->args[i])) {
-      v = (GpuArray *)args[i];
-      if (a == NULL) {
-        a = v;
-        for (j = 0; j < a->nd; j++) n *= a->dimensions[j];
-      }
-      c_contig &= GpuArray_IS_C_CONTIGUOUS(v);
-      f_contig &= GpuArray_IS_F_CONTIGUOUS(v);
-      if (a != v) {
-        if (a->nd != v->nd)
-          return -1; /* We don't check the value of the error code */
-        for (j = 0; j < a->nd; j++) {
-          if (v->dimensions[j] != a->dimensions[j])
-            return -1; /* We don't check the value of the error code */
-        }
-      }
-    }
-  }
-  *contig = f_contig || c_contig;
-  *_n = n;
-  return GA_NO_ERROR;
+  while (u + 1 < GRID_NUNROLL &&
+         dims[nd - 1] >= ((size_t)2 << u) * warp &&
+         n / ((size_t)2 << u) >= fill)
+    u++;
+  return u;
 }
 
-static int call_contig(GpuElemwise *ge, void **args, size_t n) {
-  GpuArray *a;
-  size_t ls = 0, gs = 0;
-  unsigned int i, p;
+static int call_grid(GpuElemwise *ge, void **args, size_t n, unsigned int nd,
+                     size_t *dims, ssize_t **strs, int *done) {
+  gpucontext *ctx = ge->ctx;
+  GpuKernel *k;
+  size_t ls[3], gs[3];
+  size_t warp, max_l, max_g, outer;
+  unsigned int numprocs, i;
+  int u;
   int err;
 
-  p = 0;
-  err = GpuKernel_setarg(&ge->k_contig, p++, &n);
+  *done = 0;
+
+  err = gpukernel_property(ge->k_contig.k, GA_KERNEL_PROP_PREFLSIZE, &warp);
   if (err != GA_NO_ERROR) return err;
-  for (i = 0; i < ge->n; i++) {
-    if (is_array(ge->args[i])) {
-      a = (GpuArray *)args[i];
-      err = GpuKernel_setarg(&ge->k_contig, p++, a->data);
-      if (err != GA_NO_ERROR) return err;
-      err = GpuKernel_setarg(&ge->k_contig, p++, &a->offset);
-      if (err != GA_NO_ERROR) return err;
-    } else {
-      err = GpuKernel_setarg(&ge->k_contig, p++, args[i]);
-      if (err != GA_NO_ERROR) return err;
-    }
-  }
-  err = GpuKernel_sched(&ge->k_contig, n, &gs, &ls);
+  err = gpucontext_property(ctx, GA_CTX_PROP_NUMPROCS, &numprocs);
   if (err != GA_NO_ERROR) return err;
-  return GpuKernel_call(&ge->k_contig, 1, &gs, &ls, 0, NULL);
-}
 
-GpuElemwise *GpuElemwise_new(gpucontext *ctx,
-                             const char *preamble, const char *expr,
-                             unsigned int n, gpuelemwise_arg *args,
-                             unsigned int nd, int flags) {
-  GpuElemwise *res;
-#ifdef DEBUG
-  char *errstr = NULL;
-#endif
-  unsigned int i;
-  int ret;
+  u = grid_unroll(n, nd, dims, warp, numprocs);
+  if (u < 0)
+    return GA_NO_ERROR;
 
-  res = calloc(1, sizeof(*res));
-  if (res == NULL) {
-    error_sys(ctx->err, "calloc");
-    return NULL;
+  k = &ge->k_grid[(nd - 1) * GRID_NUNROLL + u];
+  if (!k_initialized(k)) {
+    err = gen_elemwise_grid_kernel(k, ctx, NULL, ge->preamble, ge->expr,
+                                   nd, ge->n, ge->args, 1U << u,
+                                   GEN_ADDR32 | (ge->flags & GE_CONVERT_F16));
+    if (err != GA_NO_ERROR)
+      return err;
   }
 
-  res->flags = flags;
-  res->nd = 8;
-  res->n = n;
+  err = gpukernel_property(k->k, GA_KERNEL_PROP_MAXLSIZE, &max_l);
+  if (err != GA_NO_ERROR) return err;
+  if (max_l > GRID_BLOCK)
+    max_l = GRID_BLOCK;
+
+  /* Widen the block along rows first, then stack rows in y */
+  ls[0] = warp;
+  while (ls[0] * 2 <= max_l && (ls[0] << (u + 1)) <= dims[nd - 1])
+    ls[0] *= 2;
+  ls[1] = max_l / ls[0];
+  while (ls[1] > 1 && ls[1] / 2 >= dims[nd - 2])
+    ls[1] /= 2;
+  if (ls[1] == 0)
+    ls[1] = 1;
+  ls[2] = 1;
+
+  outer = 1;
+  for (i = 0; i + 2 < nd; i++)
+    outer *= dims[i];
+
+  gs[0] = (dims[nd - 1] + (ls[0] << u) - 1) / (ls[0] << u);
+  gs[1] = (dims[nd - 2] + ls[1] - 1) / ls[1];
+  gs[2] = outer;
+
+  /* The kernel loops over what doesn't fit in the grid */
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE0, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  if (gs[0] > max_g) gs[0] = max_g;
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE1, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  if (gs[1] > max_g) gs[1] = max_g;
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE2, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  if (gs[2] > max_g) gs[2] = max_g;
 
-  res->expr = strdup(expr);
-  if (res->expr == NULL) {
-    error_sys(ctx->err, "strdup");
-    goto fail;
-  }
-  if (preamble != NULL) {
-    res->preamble = strdup(preamble);
-    if (res->preamble == NULL) {
-      error_sys(ctx->err, "strdup");
-      goto fail;
-    }
-  }
+  err = set_basic_args(ge, k, args, &n, nd, dims, strs);
+  if (err != GA_NO_ERROR) return err;
+
+  *done = 1;
+  return GpuKernel_call(k, 3, gs, ls, 0, NULL);
+}
+
+static void tiled_load(strb *sb, gpuelemwise_arg *a, int gen_flags) {
+  if (a->typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+    strb_appendf(sb, "ga_half2float(*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p))",
+                 a->name, a->name);
+  } else {
+    strb_appendf(sb, "*(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p)",
+                 ctype(a->typecode), a->name, a->name);
+  }
+}
+
+/*
+ * The tiled kernel works over a (possibly batched) 2d space with axes
+ * a and b.  The outputs are contiguous along a and the arrays in
+ * `mask` are contiguous along b.  Those are first loaded into local
+ * memory with consecutive threads walking b, then the expression is
+ * evaluated with consecutive threads walking a, so that both the
+ * global loads and stores are coalesced.
+ *
+ * Arguments are dim_a, dim_b, dim_c (the batch) and then for each
+ * array: data, offset, str_a, str_b, str_c.  Scalars are passed as
+ * in the basic kernel.
+ */
+static int gen_elemwise_tiled_kernel(GpuKernel *k, gpucontext *ctx,
+                                     char **err_str,
+                                     const char *preamble,
+                                     const char *expr,
+                                     unsigned int n,
+                                     gpuelemwise_arg *args,
+                                     unsigned int mask,
+                                     int gen_flags) {
+  strb sb = STRB_STATIC_INIT;
+  unsigned int j, l;
+  int *ktypes;
+  unsigned int p;
+  int flags = 0;
+  int res;
+
+  flags |= gpuarray_type_flagsa(n, args);
+
+  p = 3;
+  for (j = 0; j < n; j++)
+    p += ISSET(args[j].flags, GE_SCALAR) ? 1 : 5;
+
+  ktypes = calloc(p, sizeof(int));
+  if (ktypes == NULL)
+    return error_sys(ctx->err, "calloc");
+
+  p = 0;
+
+  strb_appends(&sb, "#include \"cluda.h\"\n");
+  if (preamble)
+    strb_appends(&sb, preamble);
+  strb_appends(&sb, "\nKERNEL void elem_tiled(const ga_size dim_a, "
+               "const ga_size dim_b, const ga_size dim_c");
+  ktypes[p++] = GA_SIZE;
+  ktypes[p++] = GA_SIZE;
+  ktypes[p++] = GA_SIZE;
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      strb_appendf(&sb, ", GLOBAL_MEM %s *%s_data, const ga_size %s_offset, "
+                   "const ga_ssize %s_str_a, const ga_ssize %s_str_b, "
+                   "const ga_ssize %s_str_c", ctype(args[j].typecode),
+                   args[j].name, args[j].name, args[j].name, args[j].name,
+                   args[j].name);
+      ktypes[p++] = buftype(&args[j]);
+      ktypes[p++] = GA_SIZE;
+      ktypes[p++] = GA_SSIZE;
+      ktypes[p++] = GA_SSIZE;
+      ktypes[p++] = GA_SSIZE;
+    } else {
+      strb_appendf(&sb, ", %s %s", ctype(args[j].typecode), args[j].name);
+      ktypes[p++] = args[j].typecode;
+    }
+  }
+  strb_appends(&sb, ") {\n");
+  l = 0;
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      if (mask & (1U << l))
+        strb_appendf(&sb, "LOCAL_MEM %s %s_tile[%u][%u];\n",
+                     ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+                           GA_FLOAT : args[j].typecode), args[j].name,
+                     TILE_DIM, TILE_DIM + 1);
+      l++;
+    }
+  }
+  strb_appendf(&sb, "ga_size ti_a, ti_b, ti_c, ti_r;\n"
+               "for (ti_c = GID_2; ti_c < dim_c; ti_c += GDIM_2) {\n"
+               "for (ti_b = GID_1 * %u; ti_b < dim_b; ti_b += GDIM_1 * %u) {\n"
+               "for (ti_a = GID_0 * %u; ti_a < dim_a; ti_a += GDIM_0 * %u) {\n",
+               TILE_DIM, TILE_DIM, TILE_DIM, TILE_DIM);
+
+  /* Stage the arrays that are contiguous along b */
+  strb_appendf(&sb, "for (ti_r = LID_1; ti_r < %u; ti_r += %u) {\n"
+               "if (ti_a + ti_r < dim_a && ti_b + LID_0 < dim_b) {\n",
+               TILE_DIM, TILE_ROWS);
+  l = 0;
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      if (mask & (1U << l)) {
+        strb_appendf(&sb, "ga_size %s_p = %s_offset + (ga_ssize)ti_c * %s_str_c + "
+                     "(ga_ssize)(ti_a + ti_r) * %s_str_a + "
+                     "(ga_ssize)(ti_b + LID_0) * %s_str_b;\n",
+                     args[j].name, args[j].name, args[j].name, args[j].name,
+                     args[j].name);
+        strb_appendf(&sb, "%s_tile[ti_r][LID_0] = ", args[j].name);
+        tiled_load(&sb, &args[j], gen_flags);
+        strb_appends(&sb, ";\n");
+      }
+      l++;
+    }
+  }
+  strb_appends(&sb, "}\n}\nlocal_barrier();\n");
+
+  /* Evaluate the expression with consecutive threads walking a */
+  strb_appendf(&sb, "for (ti_r = LID_1; ti_r < %u; ti_r += %u) {\n"
+               "if (ti_a + LID_0 < dim_a && ti_b + ti_r < dim_b) {\n",
+               TILE_DIM, TILE_ROWS);
+  l = 0;
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      strb_appendf(&sb, "%s %s;\n", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+                                          GA_FLOAT : args[j].typecode), args[j].name);
+      if (mask & (1U << l)) {
+        strb_appendf(&sb, "%s = %s_tile[LID_0][ti_r];\n", args[j].name,
+                     args[j].name);
+      } else {
+        strb_appendf(&sb, "ga_size %s_p = %s_offset + (ga_ssize)ti_c * %s_str_c + "
+                     "(ga_ssize)(ti_a + LID_0) * %s_str_a + "
+                     "(ga_ssize)(ti_b + ti_r) * %s_str_b;\n",
+                     args[j].name, args[j].name, args[j].name, args[j].name,
+                     args[j].name);
+        if (ISSET(args[j].flags, GE_READ)) {
+          strb_appendf(&sb, "%s = ", args[j].name);
+          tiled_load(&sb, &args[j], gen_flags);
+          strb_appends(&sb, ";\n");
+        }
+      }
+      l++;
+    }
+  }
+  strb_appends(&sb, expr);
+  strb_appends(&sb, ";\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]) && ISSET(args[j].flags, GE_WRITE)) {
+      if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+        strb_appendf(&sb, "*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p) = ga_float2half(%s);\n",
+                     args[j].name, args[j].name, args[j].name);
+      } else {
+        strb_appendf(&sb, "*(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p) = %s;\n",
+                     ctype(args[j].typecode), args[j].name, args[j].name, args[j].name);
+      }
+    }
+  }
+  /* The barrier protects the tiles before the next iteration */
+  strb_appends(&sb, "}\n}\nlocal_barrier();\n}\n}\n}\n}\n");
+  if (strb_error(&sb)) {
+    res = GA_MEMORY_ERROR;
+    goto bail;
+  }
+
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem_tiled",
+                       p, ktypes, flags, err_str);
+ bail:
+  free(ktypes);
+  strb_clear(&sb);
+  return res;
+}
+
+/*
+ * Check if the collapsed shape describes a transposition, that is the
+ * outputs and some of the inputs are contiguous along different
+ * axes.  If so the tiled kernel is prepared for the operation and
+ * the axis along which the outputs are contiguous is returned in
+ * `_axis`.
+ *
+ * Returns 1 if the tiled kernel should be used and 0 otherwise.
+ */
+static int check_tiled(GpuElemwise *ge, void **args, unsigned int nd,
+                       size_t *dims, ssize_t **strs, unsigned int *_axis) {
+  gpucontext *ctx = ge->ctx;
+  GpuArray *v;
+  size_t elsize, lmem_used = 0, lmem = 0, max_l = 0;
+  unsigned int i, l, axis, other, mask = 0;
+  int err;
+
+  /* Batched 2d only, with one bit per array for the staging mask */
+  if (nd < 2 || nd > 3 || ge->narray > sizeof(mask) * 8)
+    return 0;
+
+  /* nd marks the axis as not yet known */
+  axis = nd;
+
+  /* All outputs must be contiguous along the same axis */
+  l = 0;
+  for (i = 0; i < ge->n; i++) {
+    if (is_array(ge->args[i])) {
+      if (is_output(ge->args[i])) {
+        v = (GpuArray *)args[i];
+        elsize = gpuarray_get_elsize(v->typecode);
+        if (strs[l][nd - 1] == (ssize_t)elsize)
+          other = nd - 1;
+        else if (strs[l][nd - 2] == (ssize_t)elsize)
+          other = nd - 2;
+        else
+          return 0;
+        if (axis != nd && axis != other)
+          return 0;
+        axis = other;
+      }
+      l++;
+    }
+  }
+  other = (axis == nd - 1) ? nd - 2 : nd - 1;
+
+  /* Tiles smaller than that would mostly be wasted threads */
+  if (dims[axis] < TILE_DIM || dims[other] < TILE_DIM)
+    return 0;
+
+  /* Inputs contiguous along the other axis need staging */
+  l = 0;
+  for (i = 0; i < ge->n; i++) {
+    if (is_array(ge->args[i])) {
+      if (!is_output(ge->args[i])) {
+        v = (GpuArray *)args[i];
+        elsize = gpuarray_get_elsize(v->typecode);
+        if (strs[l][other] == (ssize_t)elsize &&
+            strs[l][axis] != (ssize_t)elsize) {
+          mask |= 1U << l;
+          if (v->typecode == GA_HALF && ISSET(ge->flags, GE_CONVERT_F16))
+            elsize = gpuarray_get_elsize(GA_FLOAT);
+          lmem_used += elsize * TILE_DIM * (TILE_DIM + 1);
+        }
+      }
+      l++;
+    }
+  }
+  if (mask == 0)
+    return 0;
+
+  if (gpucontext_property(ctx, GA_CTX_PROP_LMEMSIZE, &lmem) != GA_NO_ERROR ||
+      lmem_used > lmem)
+    return 0;
+
+  if (!k_initialized(&ge->k_tiled) || ge->tiled_mask != mask) {
+    if (k_initialized(&ge->k_tiled))
+      GpuKernel_clear(&ge->k_tiled);
+    err = gen_elemwise_tiled_kernel(&ge->k_tiled, ctx, NULL, ge->preamble,
+                                    ge->expr, ge->n, ge->args, mask,
+                                    ge->flags & GE_CONVERT_F16);
+    /* The basic kernel can still do the work */
+    if (err != GA_NO_ERROR) {
+      ge->k_tiled.k = NULL;
+      return 0;
+    }
+    ge->tiled_mask = mask;
+  }
+
+  if (gpukernel_property(ge->k_tiled.k, GA_KERNEL_PROP_MAXLSIZE,
+                         &max_l) != GA_NO_ERROR ||
+      max_l < TILE_DIM * TILE_ROWS)
+    return 0;
+
+  *_axis = axis;
+  return 1;
+}
+
+static int call_tiled(GpuElemwise *ge, void **args, unsigned int nd,
+                      size_t *dims, ssize_t **strs, unsigned int axis) {
+  GpuKernel *k = &ge->k_tiled;
+  size_t ls[3] = {TILE_DIM, TILE_ROWS, 1};
+  size_t gs[3];
+  size_t max_g;
+  size_t one = 1;
+  ssize_t zero = 0;
+  unsigned int p = 0, j, l, other;
+  int err;
+
+  other = (axis == nd - 1) ? nd - 2 : nd - 1;
+
+  err = GpuKernel_setarg(k, p++, &dims[axis]);
+  if (err != GA_NO_ERROR) return err;
+  err = GpuKernel_setarg(k, p++, &dims[other]);
+  if (err != GA_NO_ERROR) return err;
+  err = GpuKernel_setarg(k, p++, nd == 3 ? &dims[0] : &one);
+  if (err != GA_NO_ERROR) return err;
+
+  l = 0;
+  for (j = 0; j < ge->n; j++) {
+    if (is_array(ge->args[j])) {
+      GpuArray *v = (GpuArray *)args[j];
+      err = GpuKernel_setarg(k, p++, v->data);
+      if (err != GA_NO_ERROR) return err;
+      err = GpuKernel_setarg(k, p++, &v->offset);
+      if (err != GA_NO_ERROR) return err;
+      err = GpuKernel_setarg(k, p++, &strs[l][axis]);
+      if (err != GA_NO_ERROR) return err;
+      err = GpuKernel_setarg(k, p++, &strs[l][other]);
+      if (err != GA_NO_ERROR) return err;
+      err = GpuKernel_setarg(k, p++, nd == 3 ? &strs[l][0] : &zero);
+      if (err != GA_NO_ERROR) return err;
+      l++;
+    } else {
+      err = GpuKernel_setarg(k, p++, args[j]);
+      if (err != GA_NO_ERROR) return err;
+    }
+  }
+
+  gs[0] = (dims[axis] + TILE_DIM - 1) / TILE_DIM;
+  gs[1] = (dims[other] + TILE_DIM - 1) / TILE_DIM;
+  gs[2] = nd == 3 ? dims[0] : 1;
+
+  /* The kernel loops over what doesn't fit in the grid */
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE0, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  if (gs[0] > max_g) gs[0] = max_g;
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE1, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  if (gs[1] > max_g) gs[1] = max_g;
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE2, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  if (gs[2] > max_g) gs[2] = max_g;
+
+  return GpuKernel_call(k, 3, gs, ls, 0, NULL);
+}
+
+static int gen_elemwise_contig_kernel(GpuKernel *k,
+                                      gpucontext *ctx, char **err_str,
+                                      const char *preamble,
+                                      const char *expr,
+                                      unsigned int n,
+                                      gpuelemwise_arg *args,
+                                      int gen_flags) {
+  strb sb = STRB_STATIC_INIT;
+  int *ktypes = NULL;
+  unsigned int p;
+  unsigned int j;
+  int flags = 0;
+  int res;
+
+  flags |= gpuarray_type_flagsa(n, args);
+
+  p = 1;
+  for (j = 0; j < n; j++)
+    p += ISSET(args[j].flags, GE_SCALAR) ? 1 : 2;
+
+  ktypes = calloc(p, sizeof(int));
+  if (ktypes == NULL) {
+    res = error_sys(ctx->err, "calloc");
+    goto bail;
+  }
+
+  p = 0;
+
+  strb_appends(&sb, "#include \"cluda.h\"\n");
+  if (preamble)
+    strb_appends(&sb, preamble);
+  strb_appends(&sb, "\nKERNEL void elem(const ga_size n, ");
+  ktypes[p++] = GA_SIZE;
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      strb_appendf(&sb, "GLOBAL_MEM %s *%s_p,  const ga_size %s_offset",
+                   ctype(args[j].typecode), args[j].name, args[j].name);
+      ktypes[p++] = buftype(&args[j]);
+      ktypes[p++] = GA_SIZE;
+    } else {
+      strb_appendf(&sb, "%s %s", ctype(args[j].typecode), args[j].name);
+      ktypes[p++] = args[j].typecode;
+    }
+    if (j != (n - 1))
+      strb_appends(&sb, ", ");
+  }
+  strb_appends(&sb, ") {\n"
+               "const ga_size idx = LDIM_0 * GID_0 + LID_0;\n"
+               "const ga_size numThreads = LDIM_0 * GDIM_0;\n"
+               "ga_size i;\n"
+               "GLOBAL_MEM char *tmp;\n\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      strb_appendf(&sb, "tmp = (GLOBAL_MEM char *)%s_p;"
+                   "tmp += %s_offset; %s_p = (GLOBAL_MEM %s *)tmp;",
+                   args[j].name, args[j].name, args[j].name,
+                   ctype(args[j].typecode));
+    }
+  }
+
+  strb_appends(&sb, "for (i = idx; i < n; i += numThreads) {\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      strb_appendf(&sb, "%s %s;\n", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+                                          GA_FLOAT : args[j].typecode), args[j].name);
+      if (ISSET(args[j].flags, GE_READ)) {
+        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+          strb_appendf(&sb, "%s = ga_half2float(%s_p[i]);\n", args[j].name, args[j].name);
+        } else {
+          strb_appendf(&sb, "%s = %s_p[i];\n", args[j].name, args[j].name);
+        }
+      }
+    }
+  }
+  strb_appends(&sb, expr);
+  strb_appends(&sb, ";\n");
+
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      if (ISSET(args[j].flags, GE_WRITE)) {
+        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+          strb_appendf(&sb, "%s_p[i] = ga_float2half(%s);\n", args[j].name, args[j].name);
+        } else {
+          strb_appendf(&sb, "%s_p[i] = %s;\n", args[j].name, args[j].name);
+        }
+      }
+    }
+  }
+  strb_appends(&sb, "}\n}\n");
+
+  if (strb_error(&sb)) {
+    res = error_set(ctx->err, GA_MISC_ERROR, "Formatting error creating kernel source");
+    goto bail;
+  }
+
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem",
+                       p, ktypes, flags, err_str);
+ bail:
+  strb_clear(&sb);
+  free(ktypes);
+  return res;
+}
+
+static int check_contig(GpuElemwise *ge, void **args,
+                        size_t *_n, int *contig) {
+  GpuArray *a = NULL, *v;
+  size_t n = 1;
+  unsigned int i, j;
+  int c_contig = 1, f_contig = 1;
+
+  for (i = 0; i < ge->n; i++) {
+    if (is_array(ge->args[i])) {
+      v = (GpuArray *)args[i];
+      if (a == NULL) {
+        a = v;
+        for (j = 0; j < a->nd; j++) n *= a->dimensions[j];
+      }
+      c_contig &= GpuArray_IS_C_CONTIGUOUS(v);
+      f_contig &= GpuArray_IS_F_CONTIGUOUS(v);
+      if (a != v) {
+        if (a->nd != v->nd)
+          return -1; /* We don't check the value of the error code */
+        for (j = 0; j < a->nd; j++) {
+          if (v->dimensions[j] != a->dimensions[j])
+            return -1; /* We don't check the value of the error code */
+        }
+      }
+    }
+  }
+  *contig = f_contig || c_contig;
+  *_n = n;
+  return GA_NO_ERROR;
+}
+
+static int call_contig(GpuElemwise *ge, void **args, size_t n) {
+  GpuArray *a;
+  size_t ls = 0, gs = 0;
+  unsigned int i, p;
+  int err;
+
+  p = 0;
+  err = GpuKernel_setarg(&ge->k_contig, p++, &n);
+  if (err != GA_NO_ERROR) return err;
+  for (i = 0; i < ge->n; i++) {
+    if (is_array(ge->args[i])) {
+      a = (GpuArray *)args[i];
+      err = GpuKernel_setarg(&ge->k_contig, p++, a->data);
+      if (err != GA_NO_ERROR) return err;
+      err = GpuKernel_setarg(&ge->k_contig, p++, &a->offset);
+      if (err != GA_NO_ERROR) return err;
+    } else {
+      err = GpuKernel_setarg(&ge->k_contig, p++, args[i]);
+      if (err != GA_NO_ERROR) return err;
+    }
+  }
+  err = GpuKernel_sched(&ge->k_contig, n, &gs, &ls);
+  if (err != GA_NO_ERROR) return err;
+  return GpuKernel_call(&ge->k_contig, 1, &gs, &ls, 0, NULL);
+}
+
+/*
+ * Open the branch of slot `s` (out of `slots`) in a kernel that
+ * handles several pieces in one launch.  Branches are generated from
+ * the last slot down and block `blk` takes the first one whose
+ * `<prefix><s>_start` it reaches.  `i` is then the first element of
+ * its chunk in the piece.  The code for the slot follows and the
+ * branch of slot 0 must be closed with "}".
+ */
+void gen_slot_select(strb *sb, const char *prefix, unsigned int s,
+                     unsigned int slots) {
+  if (s > 0)
+    strb_appendf(sb, "%sif (blk >= %s%u_start) {\n",
+                 s == slots - 1 ? "" : "} else ", prefix, s);
+  else
+    strb_appends(sb, slots == 1 ? "{\n" : "} else {\n");
+  strb_appendf(sb, "i = (blk - %s%u_start) * chunk;\n", prefix, s);
+}
+
+/*
+ * Kernel for GpuElemwise_call_multi().  The arguments of `slots`
+ * contiguous argument sets are passed to a single launch, each set
+ * with its size and the index of its first block.  Every block
+ * processes one chunk of one set, looking up which one from its
+ * index.
+ *
+ * Arguments are nblocks, chunk and then for each slot: n, start and
+ * the arguments of the set (data and offset for arrays, the value
+ * for scalars).
+ */
+static int gen_elemwise_multi_kernel(GpuKernel *k, gpucontext *ctx,
+                                     char **err_str,
+                                     const char *preamble,
+                                     const char *expr,
+                                     unsigned int n,
+                                     gpuelemwise_arg *args,
+                                     unsigned int slots,
+                                     int gen_flags) {
+  strb sb = STRB_STATIC_INIT;
+  int *ktypes = NULL;
+  unsigned int p;
+  unsigned int j, s, _s;
+  int flags = 0;
+  int res;
+
+  flags |= gpuarray_type_flagsa(n, args);
+
+  p = 0;
+  for (j = 0; j < n; j++)
+    p += ISSET(args[j].flags, GE_SCALAR) ? 1 : 2;
+  p = 2 + slots * (2 + p);
+
+  ktypes = calloc(p, sizeof(int));
+  if (ktypes == NULL) {
+    res = error_sys(ctx->err, "calloc");
+    goto bail;
+  }
+
+  p = 0;
+
+  strb_appends(&sb, "#include \"cluda.h\"\n");
+  if (preamble)
+    strb_appends(&sb, preamble);
+  strb_appends(&sb, "\nKERNEL void elem_multi(const ga_size nblocks, "
+               "const ga_size chunk");
+  ktypes[p++] = GA_SIZE;
+  ktypes[p++] = GA_SIZE;
+  for (s = 0; s < slots; s++) {
+    strb_appendf(&sb, ", const ga_size ms%u_n, const ga_size ms%u_start",
+                 s, s);
+    ktypes[p++] = GA_SIZE;
+    ktypes[p++] = GA_SIZE;
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j])) {
+        strb_appendf(&sb, ", GLOBAL_MEM %s *%s_%u_data, const ga_size %s_%u_offset",
+                     ctype(args[j].typecode), args[j].name, s, args[j].name, s);
+        ktypes[p++] = buftype(&args[j]);
+        ktypes[p++] = GA_SIZE;
+      } else {
+        strb_appendf(&sb, ", %s %s_%u", ctype(args[j].typecode),
+                     args[j].name, s);
+        ktypes[p++] = args[j].typecode;
+      }
+    }
+  }
+  strb_appends(&sb, ") {\n"
+               "ga_size blk, i, end, n;\n"
+               "GLOBAL_MEM char *tmp;\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]))
+      strb_appendf(&sb, "GLOBAL_MEM %s *%s_p;\n", ctype(args[j].typecode),
+                   args[j].name);
+    else
+      strb_appendf(&sb, "%s %s;\n", ctype(args[j].typecode), args[j].name);
+  }
+
+  strb_appends(&sb, "for (blk = GID_0; blk < nblocks; blk += GDIM_0) {\n");
+  /* Unused slots start at nblocks so they are never picked */
+  for (_s = slots; _s > 0; _s--) {
+    s = _s - 1;
+    gen_slot_select(&sb, "ms", s, slots);
+    strb_appendf(&sb, "n = ms%u_n;\n", s);
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j])) {
+        strb_appendf(&sb, "tmp = (GLOBAL_MEM char *)%s_%u_data;"
+                     "tmp += %s_%u_offset; %s_p = (GLOBAL_MEM %s *)tmp;\n",
+                     args[j].name, s, args[j].name, s, args[j].name,
+                     ctype(args[j].typecode));
+      } else {
+        strb_appendf(&sb, "%s = %s_%u;\n", args[j].name, args[j].name, s);
+      }
+    }
+  }
+  strb_appends(&sb, "}\n"
+               "end = i + chunk;\n"
+               "if (end > n) end = n;\n"
+               "for (i += LID_0; i < end; i += LDIM_0) {\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      strb_appendf(&sb, "%s %s;\n", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+                                          GA_FLOAT : args[j].typecode), args[j].name);
+      if (ISSET(args[j].flags, GE_READ)) {
+        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+          strb_appendf(&sb, "%s = ga_half2float(%s_p[i]);\n", args[j].name, args[j].name);
+        } else {
+          strb_appendf(&sb, "%s = %s_p[i];\n", args[j].name, args[j].name);
+        }
+      }
+    }
+  }
+  strb_appends(&sb, expr);
+  strb_appends(&sb, ";\n");
+
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      if (ISSET(args[j].flags, GE_WRITE)) {
+        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+          strb_appendf(&sb, "%s_p[i] = ga_float2half(%s);\n", args[j].name, args[j].name);
+        } else {
+          strb_appendf(&sb, "%s_p[i] = %s;\n", args[j].name, args[j].name);
+        }
+      }
+    }
+  }
+  strb_appends(&sb, "}\n}\n}\n");
+
+  if (strb_error(&sb)) {
+    res = error_set(ctx->err, GA_MISC_ERROR, "Formatting error creating kernel source");
+    goto bail;
+  }
+
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem_multi",
+                       p, ktypes, flags, err_str);
+ bail:
+  strb_clear(&sb);
+  free(ktypes);
+  return res;
+}
+
+/*
+ * Number of argument sets that fit in one multi launch.  This keeps
+ * the kernel arguments under MULTI_PARAM_SIZE bytes, which is the
+ * smallest limit that OpenCL devices are allowed to have.
+ */
+static unsigned int multi_slots(GpuElemwise *ge) {
+  size_t slot = 2 * sizeof(size_t);
+  size_t sz;
+  unsigned int j, res;
+
+  for (j = 0; j < ge->n; j++) {
+    if (is_array(ge->args[j])) {
+      slot += sizeof(void *) + sizeof(size_t);
+    } else {
+      sz = gpuarray_get_elsize(ge->args[j].typecode);
+      slot += (sz + 7) & ~(size_t)7;
+    }
+  }
+  res = (MULTI_PARAM_SIZE - 2 * sizeof(size_t)) / slot;
+  if (res > MULTI_MAX_SLOTS)
+    res = MULTI_MAX_SLOTS;
+  return res;
+}
+
+static int multi_setup(GpuElemwise *ge) {
+  gpucontext *ctx = ge->ctx;
+  unsigned int slots;
+  int err;
+
+  slots = multi_slots(ge);
+  /* Not worth it if we can't batch anything and the multi kernel
+     has no coordinates for GE_INDEX */
+  if (slots < 2 || ISSET(ge->flags, GE_INDEX)) {
+    ge->multi_slots = 1;
+    return GA_NO_ERROR;
+  }
+  ge->multi_vals = calloc(2 + 2 * slots, sizeof(size_t));
+  if (ge->multi_vals == NULL)
+    return error_sys(ctx->err, "calloc");
+  err = gen_elemwise_multi_kernel(&ge->k_multi, ctx, NULL, ge->preamble,
+                                  ge->expr, ge->n, ge->args, slots,
+                                  ge->flags & GE_CONVERT_F16);
+  if (err != GA_NO_ERROR) {
+    free(ge->multi_vals);
+    ge->multi_vals = NULL;
+    return err;
+  }
+  ge->multi_slots = slots;
+  return GA_NO_ERROR;
+}
+
+/* Set the arguments for slot s from the argument set args */
+static int multi_setargs(GpuElemwise *ge, unsigned int s, void **args) {
+  GpuKernel *k = &ge->k_multi;
+  unsigned int j, p;
+  int err;
+
+  p = 0;
+  for (j = 0; j < ge->n; j++)
+    p += is_array(ge->args[j]) ? 2 : 1;
+  p = 2 + s * (2 + p);
+
+  err = GpuKernel_setarg(k, p++, &ge->multi_vals[2 + 2 * s]);
+  if (err != GA_NO_ERROR) return err;
+  err = GpuKernel_setarg(k, p++, &ge->multi_vals[2 + 2 * s + 1]);
+  if (err != GA_NO_ERROR) return err;
+  for (j = 0; j < ge->n; j++) {
+    if (is_array(ge->args[j])) {
+      GpuArray *v = (GpuArray *)args[j];
+      err = GpuKernel_setarg(k, p++, v->data);
+      if (err != GA_NO_ERROR) return err;
+      err = GpuKernel_setarg(k, p++, &v->offset);
+      if (err != GA_NO_ERROR) return err;
+    } else {
+      err = GpuKernel_setarg(k, p++, args[j]);
+      if (err != GA_NO_ERROR) return err;
+    }
+  }
+  return GA_NO_ERROR;
+}
+
+static int call_multi(GpuElemwise *ge, unsigned int used, void **first,
+                      size_t ls) {
+  GpuKernel *k = &ge->k_multi;
+  size_t gs, max_g;
+  unsigned int s;
+  int err;
+
+  /* Fill the unused slots with empty sets */
+  for (s = used; s < ge->multi_slots; s++) {
+    ge->multi_vals[2 + 2 * s] = 0;
+    ge->multi_vals[2 + 2 * s + 1] = ge->multi_vals[0];
+    err = multi_setargs(ge, s, first);
+    if (err != GA_NO_ERROR) return err;
+  }
+
+  err = GpuKernel_setarg(k, 0, &ge->multi_vals[0]);
+  if (err != GA_NO_ERROR) return err;
+  err = GpuKernel_setarg(k, 1, &ge->multi_vals[1]);
+  if (err != GA_NO_ERROR) return err;
+
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE0, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  gs = ge->multi_vals[0];
+  if (gs > max_g) gs = max_g;
+
+  return GpuKernel_call(k, 1, &gs, &ls, 0, NULL);
+}
+
+static const char *red_neutral(gpuelemwise_reduce *red) {
+  if (red->neutral != NULL)
+    return red->neutral;
+  return red->op == GE_REDUCE_PROD ? "1" : "0";
+}
+
+static void red_combine(strb *sb, int op, const char *a, const char *b) {
+  switch (op) {
+  case GE_REDUCE_SUM:
+    strb_appendf(sb, "%s = %s + %s;\n", a, a, b);
+    break;
+  case GE_REDUCE_PROD:
+    strb_appendf(sb, "%s = %s * %s;\n", a, a, b);
+    break;
+  case GE_REDUCE_MAX:
+    strb_appendf(sb, "%s = (%s > %s) ? %s : %s;\n", a, a, b, a, b);
+    break;
+  case GE_REDUCE_MIN:
+    strb_appendf(sb, "%s = (%s < %s) ? %s : %s;\n", a, a, b, a, b);
+    break;
+  }
+}
+
+/* Type in which the reduction is accumulated */
+static int red_acctype(int typecode) {
+  return typecode == GA_HALF ? GA_FLOAT : typecode;
+}
+
+/* Emit the part of the kernel that sums up the block and stores the
+   results for output ga_o (the reduction was accumulated in ga_acc). */
+static void red_block_epilogue(strb *sb, int op) {
+  strb_appends(sb, "ga_red_buf[LID_1 * LDIM_0 + LID_0] = ga_acc;\n"
+               "local_barrier();\n"
+               "for (ga_s = LDIM_1 / 2; ga_s > 0; ga_s >>= 1) {\n"
+               "if (LID_1 < ga_s) {\n");
+  red_combine(sb, op, "ga_red_buf[LID_1 * LDIM_0 + LID_0]",
+              "ga_red_buf[(LID_1 + ga_s) * LDIM_0 + LID_0]");
+  strb_appends(sb, "}\nlocal_barrier();\n}\n");
+}
+
+static void red_store(strb *sb, gpuelemwise_arg *a, const char *val) {
+  if (a->typecode == GA_HALF)
+    strb_appendf(sb, "*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_k) = ga_float2half(%s);\n",
+                 a->name, a->name, val);
+  else
+    strb_appendf(sb, "*(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_k) = %s;\n",
+                 ctype(a->typecode), a->name, a->name, val);
+}
+
+/* Emit the computation of the offsets of output `var` along the kept
+   dimensions for the arrays in `args` */
+static void red_kept_offsets(strb *sb, const char *var, unsigned int nk,
+                             unsigned int n, gpuelemwise_arg *args) {
+  unsigned int i, _i, j;
+
+  strb_appendf(sb, "ga_ii = %s;\n", var);
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]))
+      strb_appendf(sb, "%s_k = %s_offset;\n", args[j].name, args[j].name);
+  }
+  for (_i = nk; _i > 0; _i--) {
+    i = _i - 1;
+    if (i > 0)
+      strb_appendf(sb, "ga_pos = ga_ii %% kdim%u;\nga_ii = ga_ii / kdim%u;\n",
+                   i, i);
+    else
+      strb_appends(sb, "ga_pos = ga_ii;\n");
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]))
+        strb_appendf(sb, "%s_k += ga_pos * (ga_ssize)%s_kstr_%u;\n",
+                     args[j].name, args[j].name, i);
+    }
+  }
+}
+
+/*
+ * Map-reduce kernel.  The kept dimensions are flattened into m
+ * outputs and the reduced ones into r values per output.  Blocks
+ * handle LDIM_0 consecutive outputs with LDIM_1 threads along the
+ * reduction, and the reduction may be split in nparts blocks along
+ * the y axis of the grid that each write a partial result.
+ *
+ * Arguments are m, r, rchunk (reduction length per part), nparts,
+ * kdim0.., rdim0.., then for each array: data, offset, kstr_0..,
+ * rstr_0.. (no rstr for the reduction output) and finally the buffer
+ * and offset for partial results.  Scalars are passed by value.
+ */
+static int gen_elemwise_reduce_kernel(GpuKernel *k, gpucontext *ctx,
+                                      char **err_str,
+                                      const char *preamble,
+                                      const char *expr,
+                                      unsigned int n,
+                                      gpuelemwise_arg *args,
+                                      gpuelemwise_reduce *red,
+                                      unsigned int nk, unsigned int nr,
+                                      int gen_flags) {
+  strb sb = STRB_STATIC_INIT;
+  gpuelemwise_arg *ra = &args[red->arg];
+  const char *acc = ctype(red_acctype(ra->typecode));
+  unsigned int i, _i, j;
+  int *ktypes;
+  unsigned int p;
+  int flags = 0;
+  int res;
+
+  flags |= gpuarray_type_flagsa(n, args);
+
+  p = 4 + nk + nr + 2;
+  for (j = 0; j < n; j++) {
+    if (j == red->arg)
+      p += 2 + nk;
+    else
+      p += ISSET(args[j].flags, GE_SCALAR) ? 1 : (2 + nk + nr);
+  }
+
+  ktypes = calloc(p, sizeof(int));
+  if (ktypes == NULL)
+    return error_sys(ctx->err, "calloc");
+
+  p = 0;
+
+  strb_appends(&sb, "#include \"cluda.h\"\n");
+  if (preamble)
+    strb_appends(&sb, preamble);
+  strb_appends(&sb, "\nKERNEL void elem_reduce(const ga_size ga_m, "
+               "const ga_size ga_r, const ga_size ga_rchunk, "
+               "const ga_size ga_nparts");
+  for (i = 0; i < 4; i++)
+    ktypes[p++] = GA_SIZE;
+  for (i = 0; i < nk; i++) {
+    strb_appendf(&sb, ", const ga_size kdim%u", i);
+    ktypes[p++] = GA_SIZE;
+  }
+  for (i = 0; i < nr; i++) {
+    strb_appendf(&sb, ", const ga_size rdim%u", i);
+    ktypes[p++] = GA_SIZE;
+  }
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      strb_appendf(&sb, ", GLOBAL_MEM %s *%s_data, const ga_size %s_offset",
+                   ctype(args[j].typecode), args[j].name, args[j].name);
+      ktypes[p++] = buftype(&args[j]);
+      ktypes[p++] = GA_SIZE;
+      for (i = 0; i < nk; i++) {
+        strb_appendf(&sb, ", const ga_ssize %s_kstr_%u", args[j].name, i);
+        ktypes[p++] = GA_SSIZE;
+      }
+      if (j != red->arg) {
+        for (i = 0; i < nr; i++) {
+          strb_appendf(&sb, ", const ga_ssize %s_rstr_%u", args[j].name, i);
+          ktypes[p++] = GA_SSIZE;
+        }
+      }
+    } else {
+      strb_appendf(&sb, ", %s %s", ctype(args[j].typecode), args[j].name);
+      ktypes[p++] = args[j].typecode;
+    }
+  }
+  strb_appendf(&sb, ", GLOBAL_MEM %s *ga_partial, "
+               "const ga_size ga_partial_offset) {\n", acc);
+  ktypes[p++] = GA_BUFFER_WO;
+  ktypes[p++] = GA_SIZE;
+
+  strb_appendf(&sb, "LOCAL_MEM %s ga_red_buf[%u];\n"
+               "ga_size ga_ob, ga_o, ga_t, ga_tend, ga_ii, ga_pos;\n"
+               "ga_uint ga_s;\n"
+               "%s ga_acc;\n", acc, RED_BLOCK, acc);
+  strb_appendf(&sb, "ga_partial = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)"
+               "ga_partial) + ga_partial_offset);\n", acc);
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]))
+      strb_appendf(&sb, "ga_size %s_k = 0;\n", args[j].name);
+  }
+  strb_appends(&sb, "for (ga_ob = GID_0 * LDIM_0; ga_ob < ga_m; "
+               "ga_ob += GDIM_0 * LDIM_0) {\n"
+               "ga_o = ga_ob + LID_0;\n");
+  strb_appendf(&sb, "ga_acc = %s;\n", red_neutral(red));
+  strb_appends(&sb, "if (ga_o < ga_m) {\n");
+  red_kept_offsets(&sb, "ga_o", nk, n, args);
+  strb_appends(&sb, "ga_tend = (GID_1 + 1) * ga_rchunk;\n"
+               "if (ga_tend > ga_r) ga_tend = ga_r;\n"
+               "for (ga_t = GID_1 * ga_rchunk + LID_1; ga_t < ga_tend; "
+               "ga_t += LDIM_1) {\n"
+               "ga_ii = ga_t;\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]) && j != red->arg)
+      strb_appendf(&sb, "ga_size %s_p = %s_k;\n", args[j].name, args[j].name);
+  }
+  for (_i = nr; _i > 0; _i--) {
+    i = _i - 1;
+    if (i > 0)
+      strb_appendf(&sb, "ga_pos = ga_ii %% rdim%u;\nga_ii = ga_ii / rdim%u;\n",
+                   i, i);
+    else
+      strb_appends(&sb, "ga_pos = ga_ii;\n");
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]) && j != red->arg)
+        strb_appendf(&sb, "%s_p += ga_pos * (ga_ssize)%s_rstr_%u;\n",
+                     args[j].name, args[j].name, i);
+    }
+  }
+  for (j = 0; j < n; j++) {
+    if (j == red->arg) {
+      strb_appendf(&sb, "%s %s;\n", acc, args[j].name);
+    } else if (is_array(args[j])) {
+      strb_appendf(&sb, "%s %s;", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+                                        GA_FLOAT : args[j].typecode), args[j].name);
+      if (ISSET(args[j].flags, GE_READ)) {
+        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+          strb_appendf(&sb, "%s = ga_half2float(*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p));\n",
+                       args[j].name, args[j].name, args[j].name);
+        } else {
+          strb_appendf(&sb, "%s = *(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p);\n",
+                       args[j].name, ctype(args[j].typecode), args[j].name, args[j].name);
+        }
+      }
+    }
+  }
+  strb_appends(&sb, expr);
+  strb_appends(&sb, ";\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]) && ISSET(args[j].flags, GE_WRITE) &&
+        j != red->arg) {
+      if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
+        strb_appendf(&sb, "*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p) = ga_float2half(%s);\n",
+                     args[j].name, args[j].name, args[j].name);
+      } else {
+        strb_appendf(&sb, "*(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p) = %s;\n",
+                     ctype(args[j].typecode), args[j].name, args[j].name, args[j].name);
+      }
+    }
+  }
+  red_combine(&sb, red->op, "ga_acc", ra->name);
+  strb_appends(&sb, "}\n}\n");
+  red_block_epilogue(&sb, red->op);
+  strb_appends(&sb, "if (LID_1 == 0 && ga_o < ga_m) {\n"
+               "if (ga_nparts == 1) {\n");
+  red_store(&sb, ra, "ga_red_buf[LID_0]");
+  strb_appends(&sb, "} else {\n"
+               "ga_partial[ga_o * ga_nparts + GID_1] = ga_red_buf[LID_0];\n"
+               "}\n}\n"
+               "local_barrier();\n"
+               "}\n}\n");
+  if (strb_error(&sb)) {
+    res = GA_MEMORY_ERROR;
+    goto bail;
+  }
+
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem_reduce",
+                       p, ktypes, flags, err_str);
+ bail:
+  free(ktypes);
+  strb_clear(&sb);
+  return res;
+}
+
+/*
+ * Combines the partial results of the map-reduce kernel.
+ *
+ * Arguments are m, nparts, the partial results and their offset,
+ * kdim0.. and the data, offset and kstr_0.. of the reduction output.
+ */
+static int gen_elemwise_reduce_fin_kernel(GpuKernel *k, gpucontext *ctx,
+                                          char **err_str,
+                                          gpuelemwise_arg *args,
+                                          gpuelemwise_reduce *red,
+                                          unsigned int nk) {
+  strb sb = STRB_STATIC_INIT;
+  gpuelemwise_arg *ra = &args[red->arg];
+  const char *acc = ctype(red_acctype(ra->typecode));
+  unsigned int i;
+  int *ktypes;
+  unsigned int p;
+  int flags = 0;
+  int res;
+
+  flags |= gpuarray_type_flagsa(1, ra);
+
+  ktypes = calloc(6 + 2 * nk, sizeof(int));
+  if (ktypes == NULL)
+    return error_sys(ctx->err, "calloc");
+
+  p = 0;
+
+  strb_appendf(&sb, "#include \"cluda.h\"\n"
+               "\nKERNEL void elem_reduce_fin(const ga_size ga_m, "
+               "const ga_size ga_nparts, GLOBAL_MEM %s *ga_partial, "
+               "const ga_size ga_partial_offset", acc);
+  ktypes[p++] = GA_SIZE;
+  ktypes[p++] = GA_SIZE;
+  ktypes[p++] = GA_BUFFER_RO;
+  ktypes[p++] = GA_SIZE;
+  for (i = 0; i < nk; i++) {
+    strb_appendf(&sb, ", const ga_size kdim%u", i);
+    ktypes[p++] = GA_SIZE;
+  }
+  strb_appendf(&sb, ", GLOBAL_MEM %s *%s_data, const ga_size %s_offset",
+               ctype(ra->typecode), ra->name, ra->name);
+  ktypes[p++] = GA_BUFFER_WO;
+  ktypes[p++] = GA_SIZE;
+  for (i = 0; i < nk; i++) {
+    strb_appendf(&sb, ", const ga_ssize %s_kstr_%u", ra->name, i);
+    ktypes[p++] = GA_SSIZE;
+  }
+  strb_appendf(&sb, ") {\n"
+               "LOCAL_MEM %s ga_red_buf[%u];\n"
+               "ga_size ga_ob, ga_o, ga_t, ga_ii, ga_pos;\n"
+               "ga_uint ga_s;\n"
+               "%s ga_acc;\n"
+               "ga_size %s_k = 0;\n", acc, RED_BLOCK, acc, ra->name);
+  strb_appendf(&sb, "ga_partial = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)"
+               "ga_partial) + ga_partial_offset);\n", acc);
+  strb_appends(&sb, "for (ga_ob = GID_0 * LDIM_0; ga_ob < ga_m; "
+               "ga_ob += GDIM_0 * LDIM_0) {\n"
+               "ga_o = ga_ob + LID_0;\n");
+  strb_appendf(&sb, "ga_acc = %s;\n", red_neutral(red));
+  strb_appends(&sb, "if (ga_o < ga_m) {\n"
+               "for (ga_t = LID_1; ga_t < ga_nparts; ga_t += LDIM_1) {\n");
+  red_combine(&sb, red->op, "ga_acc", "ga_partial[ga_o * ga_nparts + ga_t]");
+  strb_appends(&sb, "}\n");
+  red_kept_offsets(&sb, "ga_o", nk, 1, ra);
+  strb_appends(&sb, "}\n");
+  red_block_epilogue(&sb, red->op);
+  strb_appends(&sb, "if (LID_1 == 0 && ga_o < ga_m) {\n");
+  red_store(&sb, ra, "ga_red_buf[LID_0]");
+  strb_appends(&sb, "}\n"
+               "local_barrier();\n"
+               "}\n}\n");
+  if (strb_error(&sb)) {
+    res = GA_MEMORY_ERROR;
+    goto bail;
+  }
+
+  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l,
+                       "elem_reduce_fin", p, ktypes, flags, err_str);
+ bail:
+  free(ktypes);
+  strb_clear(&sb);
+  return res;
+}
+
+static void red_clear(GpuElemwise *ge) {
+  unsigned int i;
+
+  if (ge->k_reduce != NULL)
+    for (i = 0; i < 2 * (ge->red_nd + 1) * (ge->red_nd + 1); i++) {
+      if (k_initialized(&ge->k_reduce[i]))
+        GpuKernel_clear(&ge->k_reduce[i]);
+    }
+  free(ge->k_reduce);
+  ge->k_reduce = NULL;
+  ge->red_nd = 0;
+}
+
+/* Get (and build if needed) the kernels for nk kept and nr reduced
+   dimensions */
+static int red_kernels(GpuElemwise *ge, unsigned int nk, unsigned int nr,
+                       GpuKernel **k, GpuKernel **kf) {
+  unsigned int idx;
+  int err;
+
+  if (ge->k_reduce == NULL || nk + nr > ge->red_nd) {
+    red_clear(ge);
+    ge->k_reduce = calloc(2 * (ge->nd + 1) * (ge->nd + 1), sizeof(GpuKernel));
+    if (ge->k_reduce == NULL)
+      return error_sys(ge->ctx->err, "calloc");
+    ge->red_nd = ge->nd;
+  }
+
+  idx = 2 * (nk * (ge->red_nd + 1) + nr);
+  *k = &ge->k_reduce[idx];
+  *kf = &ge->k_reduce[idx + 1];
+  if (!k_initialized(*k)) {
+    err = gen_elemwise_reduce_kernel(*k, ge->ctx, NULL, ge->preamble,
+                                     ge->expr, ge->n, ge->args, ge->red,
+                                     nk, nr, ge->flags & GE_CONVERT_F16);
+    if (err != GA_NO_ERROR)
+      return err;
+  }
+  if (!k_initialized(*kf)) {
+    err = gen_elemwise_reduce_fin_kernel(*kf, ge->ctx, NULL, ge->args,
+                                         ge->red, nk);
+    if (err != GA_NO_ERROR)
+      return err;
+  }
+  return GA_NO_ERROR;
+}
+
+/*
+ * Check the arguments of a reduction and sort the dimensions with
+ * the kept ones first and then the reduced ones, each group
+ * collapsed separately.
+ */
+static int check_reduce(GpuElemwise *ge, void **args, int flags,
+                        size_t *_m, size_t *_r,
+                        unsigned int *_nk, unsigned int *_nr) {
+  gpucontext *ctx = ge->ctx;
+  GpuArray *out = (GpuArray *)args[ge->red->arg];
+  GpuArray *v;
+  size_t full, m = 1, r = 1;
+  unsigned int i, j, p, k, pass, nnd, nk0;
+  unsigned int nd = out->nd, nk = 0, nr = 0;
+
+  for (i = 0; i < ge->n; i++) {
+    if (is_array(ge->args[i]) && ((GpuArray *)args[i])->nd != nd)
+      return error_fmt(ctx->err, GA_VALUE_ERROR, "Arg %u has differing nd = %u", i, ((GpuArray *)args[i])->nd);
+  }
+
+  if (nd > ge->nd) {
+    nnd = ge->nd * 2;
+    while (nd > nnd) nnd *= 2;
+    if (ge_grow(ge, nnd))
+      return error_sys(ctx->err, "ge_grow");
+  }
+
+  for (pass = 0; pass < 2; pass++) {
+    for (j = 0; j < nd; j++) {
+      full = 1;
+      for (i = 0; i < ge->n; i++) {
+        if (is_array(ge->args[i]) && i != ge->red->arg) {
+          v = (GpuArray *)args[i];
+          if (full == 1)
+            full = v->dimensions[j];
+        }
+      }
+      if (pass == 0) {
+        for (i = 0; i < ge->n; i++) {
+          if (is_array(ge->args[i]) && i != ge->red->arg) {
+            v = (GpuArray *)args[i];
+            if (v->dimensions[j] != full &&
+                (ISCLR(flags, GE_BROADCAST) || is_output(ge->args[i]) ||
+                 v->dimensions[j] != 1))
+              return error_fmt(ctx->err, GA_VALUE_ERROR, "Mismatched dimension %u for input %u (expected %" SPREFIX "u got %" SPREFIX "u)", j, i, full, v->dimensions[j]);
+          }
+        }
+        if (out->dimensions[j] != full && out->dimensions[j] != 1)
+          return error_fmt(ctx->err, GA_VALUE_ERROR, "Mismatched dimension %u for the reduction output (expected 1 or %" SPREFIX "u got %" SPREFIX "u)", j, full, out->dimensions[j]);
+      }
+      if (full == 1)
+        continue;
+      /* Kept dimensions on the first pass, reduced ones on the second */
+      if ((out->dimensions[j] == 1) != (pass == 1))
+        continue;
+
+      k = nk + nr;
+      ge->dims[k] = full;
+      p = 0;
+      for (i = 0; i < ge->n; i++) {
+        if (is_array(ge->args[i])) {
+          v = (GpuArray *)args[i];
+          ge->strides[p][k] = v->dimensions[j] == 1 ? 0 : v->strides[j];
+          p++;
+        }
+      }
+      if (pass == 0) {
+        m *= full;
+        nk++;
+      } else {
+        r *= full;
+        nr++;
+      }
+    }
+  }
+
+  if (ISCLR(flags, GE_NOCOLLAPSE)) {
+    if (nr > 1) {
+      p = 0;
+      for (i = 0; i < ge->n; i++) {
+        if (is_array(ge->args[i])) {
+          ge->red_strs[p] = (i == ge->red->arg) ? NULL : ge->strides[p] + nk;
+          p++;
+        }
+      }
+      gpuarray_elemwise_collapse(ge->narray, &nr, ge->dims + nk,
+                                 ge->red_strs);
+    }
+    if (nk > 1) {
+      nk0 = nk;
+      gpuarray_elemwise_collapse(ge->narray, &nk, ge->dims, ge->strides);
+      memmove(ge->dims + nk, ge->dims + nk0, nr * sizeof(size_t));
+      for (p = 0; p < ge->narray; p++)
+        memmove(ge->strides[p] + nk, ge->strides[p] + nk0,
+                nr * sizeof(ssize_t));
+    }
+  }
+
+  *_m = m;
+  *_r = r;
+  *_nk = nk;
+  *_nr = nr;
+  return GA_NO_ERROR;
+}
+
+static int call_reduce(GpuElemwise *ge, void **args, int flags) {
+  gpucontext *ctx = ge->ctx;
+  GpuArray *out = (GpuArray *)args[ge->red->arg];
+  GpuKernel *k = NULL, *kf = NULL;
+  gpudata *partial = NULL;
+  size_t poff = 0;
+  size_t m = 0, r = 0, rchunk, nparts, max_l, max_g, target, pmax;
+  size_t ls[2], gs[2];
+  ssize_t sk, sr;
+  unsigned int nk = 0, nr = 0, numprocs, i, j, l, p;
+  int err;
+
+  err = check_reduce(ge, args, flags, &m, &r, &nk, &nr);
+  if (err != GA_NO_ERROR) return err;
+  if (m == 0) return GA_NO_ERROR;
+
+  err = red_kernels(ge, nk, nr, &k, &kf);
+  if (err != GA_NO_ERROR) return err;
+
+  err = gpukernel_property(k->k, GA_KERNEL_PROP_MAXLSIZE, &max_l);
+  if (err != GA_NO_ERROR) return err;
+  if (max_l > RED_BLOCK) max_l = RED_BLOCK;
+  ls[0] = 1;
+  while (ls[0] * 2 <= max_l) ls[0] *= 2;
+  max_l = ls[0];
+
+  /* Put consecutive threads along the outputs if the innermost kept
+     dimension of the first input is denser than its innermost
+     reduced dimension and along the reduction otherwise. */
+  if (nk == 0) {
+    ls[0] = 1;
+  } else if (nr != 0) {
+    for (i = 0, l = 0; i < ge->n && (!is_array(ge->args[i]) || i == ge->red->arg); i++)
+      if (is_array(ge->args[i])) l++;
+    sk = 0;
+    sr = 0;
+    if (i != ge->n) {
+      sk = ge->strides[l][nk - 1];
+      sr = ge->strides[l][nk + nr - 1];
+      if (sk < 0) sk = -sk;
+      if (sr < 0) sr = -sr;
+    }
+    if (sr < sk)
+      ls[0] = 1;
+    else if (ls[0] > RED_WIDTH)
+      ls[0] = RED_WIDTH;
+  }
+  while (ls[0] > 1 && ls[0] / 2 >= m) ls[0] /= 2;
+  ls[1] = max_l / ls[0];
+  while (ls[1] > 1 && ls[1] / 2 >= r) ls[1] /= 2;
+
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE0, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  gs[0] = (m + ls[0] - 1) / ls[0];
+  if (gs[0] > max_g) gs[0] = max_g;
+
+  /* Split the reduction if there aren't enough outputs to keep the
+     device busy */
+  err = gpucontext_property(ctx, GA_CTX_PROP_NUMPROCS, &numprocs);
+  if (err != GA_NO_ERROR) return err;
+  target = (size_t)numprocs * RED_BLOCKS_PER_PROC;
+  nparts = 1;
+  if (gs[0] < target) {
+    nparts = target / gs[0];
+    pmax = r / (ls[1] * RED_MIN_ITEMS);
+    if (nparts > pmax) nparts = pmax;
+    if (nparts == 0) nparts = 1;
+  }
+  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE1, &max_g);
+  if (err != GA_NO_ERROR) return err;
+  if (nparts > max_g) nparts = max_g;
+  gs[1] = nparts;
+  rchunk = (r + nparts - 1) / nparts;
+
+  /* The partial results are a temporary from the scratch arena */
+  if (nparts > 1) {
+    err = gpudata_scratch_alloc(ctx, NULL, m * nparts *
+                                gpuarray_get_elsize(red_acctype(out->typecode)),
+                                NULL, &partial, &poff);
+    if (err != GA_NO_ERROR) return err;
+  }
+
+  p = 0;
+  err = GpuKernel_setarg(k, p++, &m);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(k, p++, &r);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(k, p++, &rchunk);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(k, p++, &nparts);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  for (i = 0; i < nk + nr; i++) {
+    err = GpuKernel_setarg(k, p++, &ge->dims[i]);
+    if (err != GA_NO_ERROR) goto error_call_reduce;
+  }
+  l = 0;
+  for (j = 0; j < ge->n; j++) {
+    if (is_array(ge->args[j])) {
+      GpuArray *v = (GpuArray *)args[j];
+      err = GpuKernel_setarg(k, p++, v->data);
+      if (err != GA_NO_ERROR) goto error_call_reduce;
+      err = GpuKernel_setarg(k, p++, &v->offset);
+      if (err != GA_NO_ERROR) goto error_call_reduce;
+      for (i = 0; i < (j == ge->red->arg ? nk : nk + nr); i++) {
+        err = GpuKernel_setarg(k, p++, &ge->strides[l][i]);
+        if (err != GA_NO_ERROR) goto error_call_reduce;
+      }
+      l++;
+    } else {
+      err = GpuKernel_setarg(k, p++, args[j]);
+      if (err != GA_NO_ERROR) goto error_call_reduce;
+    }
+  }
+  err = GpuKernel_setarg(k, p++, partial != NULL ? partial : out->data);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(k, p++, &poff);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+
+  err = GpuKernel_call(k, 2, gs, ls, 0, NULL);
+  if (err != GA_NO_ERROR || partial == NULL) goto error_call_reduce;
+
+  /* Combine the partial results, one output per block */
+  err = gpukernel_property(kf->k, GA_KERNEL_PROP_MAXLSIZE, &max_l);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  if (max_l > RED_BLOCK) max_l = RED_BLOCK;
+  ls[0] = 1;
+  ls[1] = 1;
+  while (ls[1] * 2 <= max_l && ls[1] < nparts) ls[1] *= 2;
+  gs[0] = m;
+  err = gpukernel_property(kf->k, GA_CTX_PROP_MAXGSIZE0, &max_g);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  if (gs[0] > max_g) gs[0] = max_g;
+  gs[1] = 1;
+
+  p = 0;
+  err = GpuKernel_setarg(kf, p++, &m);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(kf, p++, &nparts);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(kf, p++, partial);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(kf, p++, &poff);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  for (i = 0; i < nk; i++) {
+    err = GpuKernel_setarg(kf, p++, &ge->dims[i]);
+    if (err != GA_NO_ERROR) goto error_call_reduce;
+  }
+  err = GpuKernel_setarg(kf, p++, out->data);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  err = GpuKernel_setarg(kf, p++, &out->offset);
+  if (err != GA_NO_ERROR) goto error_call_reduce;
+  /* Index of the reduction output among the arrays */
+  for (j = 0, l = 0; j < ge->red->arg; j++)
+    if (is_array(ge->args[j])) l++;
+  for (i = 0; i < nk; i++) {
+    err = GpuKernel_setarg(kf, p++, &ge->strides[l][i]);
+    if (err != GA_NO_ERROR) goto error_call_reduce;
+  }
+
+  err = GpuKernel_call(kf, 2, gs, ls, 0, NULL);
+ error_call_reduce:
+  gpudata_scratch_free(ctx, NULL, partial, poff);
+  return err;
+}
+
+GpuElemwise *GpuElemwise_new(gpucontext *ctx,
+                             const char *preamble, const char *expr,
+                             unsigned int n, gpuelemwise_arg *args,
+                             unsigned int nd, int flags) {
+  return GpuElemwise_new_reduce(ctx, preamble, expr, n, args, nd, flags,
+                                NULL);
+}
+
+GpuElemwise *GpuElemwise_new_reduce(gpucontext *ctx,
+                                    const char *preamble, const char *expr,
+                                    unsigned int n, gpuelemwise_arg *args,
+                                    unsigned int nd, int flags,
+                                    gpuelemwise_reduce *red) {
+  GpuElemwise *res;
+#ifdef DEBUG
+  char *errstr = NULL;
+#endif
+  unsigned int i;
+  int ret;
+
+  if (red != NULL) {
+    if (red->arg >= n || !is_array(args[red->arg]) ||
+        !is_output(args[red->arg]) || ISSET(args[red->arg].flags, GE_READ)) {
+      error_set(ctx->err, GA_VALUE_ERROR, "Reduction argument must be a write-only array");
+      return NULL;
+    }
+    if (red->op < GE_REDUCE_SUM || red->op > GE_REDUCE_MIN) {
+      error_fmt(ctx->err, GA_VALUE_ERROR, "Unknown reduction operator %d", red->op);
+      return NULL;
+    }
+    if (red->neutral == NULL &&
+        red->op != GE_REDUCE_SUM && red->op != GE_REDUCE_PROD) {
+      error_set(ctx->err, GA_VALUE_ERROR, "Reduction operator requires a neutral element");
+      return NULL;
+    }
+    if (ISSET(flags, GE_INDEX)) {
+      error_set(ctx->err, GA_UNSUPPORTED_ERROR, "GE_INDEX is not supported with reductions");
+      return NULL;
+    }
+  }
+
+  res = calloc(1, sizeof(*res));
+  if (res == NULL) {
+    error_sys(ctx->err, "calloc");
+    return NULL;
+  }
+
+  res->ctx = ctx;
+  res->flags = flags;
+  res->nd = 8;
+  res->n = n;
+
+  res->expr = strdup(expr);
+  if (res->expr == NULL) {
+    error_sys(ctx->err, "strdup");
+    goto fail;
+  }
+  if (preamble != NULL) {
+    res->preamble = strdup(preamble);
+    if (res->preamble == NULL) {
+      error_sys(ctx->err, "strdup");
+      goto fail;
+    }
+  }
 
   res->args = copy_args(n, args);
   if (res->args == NULL) {
@@ -669,26 +2325,61 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
     goto fail;
   }
 
-  ret = gen_elemwise_contig_kernel(&res->k_contig, ctx,
+  res->k_grid = calloc(res->nd * GRID_NUNROLL, sizeof(GpuKernel));
+  if (res->k_grid == NULL) {
+    error_sys(ctx->err, "calloc");
+    goto fail;
+  }
+
+  if (red != NULL) {
+    res->red = malloc(sizeof(*red));
+    if (res->red == NULL) {
+      error_sys(ctx->err, "malloc");
+      goto fail;
+    }
+    *res->red = *red;
+    if (red->neutral != NULL) {
+      res->red->neutral = strdup(red->neutral);
+      if (res->red->neutral == NULL) {
+        error_sys(ctx->err, "strdup");
+        goto fail;
+      }
+    }
+    res->red_strs = calloc(res->narray, sizeof(ssize_t *));
+    if (res->red_strs == NULL) {
+      error_sys(ctx->err, "calloc");
+      goto fail;
+    }
+    /* The other kernels would store the reduction elementwise */
+    return res;
+  }
+
+  /* Coordinates are only available in the basic kernels, and
+     only for the exact number of dimensions of the call. */
+  if (ISCLR(flags, GE_INDEX)) {
+    ret = gen_elemwise_contig_kernel(&res->k_contig, ctx,
 #ifdef DEBUG
-                                   &errstr,
+                                     &errstr,
 #else
-                                   NULL,
+                                     NULL,
 #endif
-                                   res->preamble, res->expr,
-                                   res->n, res->args,
-                                   (res->flags & GE_CONVERT_F16));
-  if (ret != GA_NO_ERROR) {
+                                     res->preamble, res->expr,
+                                     res->n, res->args,
+                                     (res->flags & GE_CONVERT_F16));
+    if (ret != GA_NO_ERROR) {
 #ifdef DEBUG
-    if (errstr != NULL)
-      fprintf(stderr, "%s\n", errstr);
-    free(errstr);
+      if (errstr != NULL)
+        fprintf(stderr, "%s\n", errstr);
+      free(errstr);
 #endif
-    goto fail;
+      goto fail;
+    }
   }
 
   if (ISCLR(flags, GE_NOADDR64)) {
     for (i = 0; i < nd; i++) {
+      if (ISSET(flags, GE_INDEX) && i + 1 != nd)
+        continue;
       ret = gen_elemwise_basic_kernel(&res->k_basic[i], ctx,
 #ifdef DEBUG
                                       &errstr,
@@ -697,7 +2388,8 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
 #endif
                                       res->preamble, res->expr,
                                       i+1, res->n, res->args,
-                                      (res->flags & GE_CONVERT_F16));
+                                      (res->flags & (GE_CONVERT_F16 |
+                                                     GE_INDEX)));
       if (ret != GA_NO_ERROR) {
 #ifdef DEBUG
         if (errstr != NULL)
@@ -710,6 +2402,8 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
   }
 
   for (i = 0; i < nd; i++) {
+    if (ISSET(flags, GE_INDEX) && i + 1 != nd)
+      continue;
     ret = gen_elemwise_basic_kernel(&res->k_basic_32[i], ctx,
 #ifdef DEBUG
                                     &errstr,
@@ -718,7 +2412,8 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
 #endif
                                     res->preamble, res->expr,
                                     i+1, res->n, res->args,
-                                    GEN_ADDR32 | (res->flags & GE_CONVERT_F16));
+                                    GEN_ADDR32 | (res->flags & (GE_CONVERT_F16 |
+                                                                GE_INDEX)));
     if (ret != GA_NO_ERROR) {
 #ifdef DEBUG
       if (errstr != NULL)
@@ -738,6 +2433,11 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
 
 void GpuElemwise_free(GpuElemwise *ge) {
   unsigned int i;
+  if (ge->k_grid != NULL)
+    for (i = 0; i < ge->nd * GRID_NUNROLL; i++) {
+      if (k_initialized(&ge->k_grid[i]))
+        GpuKernel_clear(&ge->k_grid[i]);
+    }
   if (ge->k_basic_32 != NULL)
     for (i = 0; i < ge->nd; i++) {
       if (k_initialized(&ge->k_basic_32[i]))
@@ -754,6 +2454,17 @@ void GpuElemwise_free(GpuElemwise *ge) {
     }
   if (k_initialized(&ge->k_contig))
     GpuKernel_clear(&ge->k_contig);
+  if (k_initialized(&ge->k_tiled))
+    GpuKernel_clear(&ge->k_tiled);
+  if (k_initialized(&ge->k_multi))
+    GpuKernel_clear(&ge->k_multi);
+  free(ge->multi_vals);
+  red_clear(ge);
+  if (ge->red != NULL)
+    free((void *)ge->red->neutral);
+  free(ge->red);
+  free(ge->red_strs);
+  free(ge->k_grid);
   free(ge->k_basic_32);
   free(ge->k_basic);
   free_args(ge->n, ge->args);
@@ -769,10 +2480,17 @@ int GpuElemwise_call(GpuElemwise *ge, void **args, int flags) {
   size_t *dims = NULL;
   ssize_t **strides = NULL;
   unsigned int nd = 0;
+  unsigned int axis = 0;
   int contig = 0;
   int call32 = 0;
+  int done = 0;
   int err;
 
+  if (ge->red != NULL)
+    return call_reduce(ge, args, flags);
+  if (ISSET(ge->flags, GE_INDEX))
+    return call_index(ge, args, flags);
+
   err = check_contig(ge, args, &n, &contig);
   if (err == GA_NO_ERROR && contig) {
     if (n == 0) return GA_NO_ERROR;
@@ -781,7 +2499,96 @@ int GpuElemwise_call(GpuElemwise *ge, void **args, int flags) {
   err = check_basic(ge, args, flags, &n, &nd, &dims, &strides, &call32);
   if (err == GA_NO_ERROR) {
     if (n == 0) return GA_NO_ERROR;
+    if (ISCLR(flags, GE_NOTILE) &&
+        check_tiled(ge, args, nd, dims, strides, &axis))
+      return call_tiled(ge, args, nd, dims, strides, axis);
+    /* The basic kernel still works if the grid one can't be built or
+       launched */
+    if (call32 &&
+        call_grid(ge, args, n, nd, dims, strides, &done) == GA_NO_ERROR &&
+        done)
+      return GA_NO_ERROR;
     return call_basic(ge, args, n, nd, dims, strides, call32);
   }
   return err;
 }
+
+/*
+ * Launch the `used` argument sets batched in the multi kernel.  If
+ * that fails they go through GpuElemwise_call() one by one.
+ */
+static int multi_flush(GpuElemwise *ge, void ***args, const unsigned int *sets,
+                       unsigned int used, size_t ls, int flags) {
+  unsigned int s;
+  int err;
+
+  if (call_multi(ge, used, args[sets[0]], ls) == GA_NO_ERROR)
+    return GA_NO_ERROR;
+  for (s = 0; s < used; s++) {
+    err = GpuElemwise_call(ge, args[sets[s]], flags);
+    if (err != GA_NO_ERROR) return err;
+  }
+  return GA_NO_ERROR;
+}
+
+int GpuElemwise_call_multi(GpuElemwise *ge, unsigned int nsets, void ***args,
+                           int flags) {
+  unsigned int sets[MULTI_MAX_SLOTS];
+  size_t n = 0;
+  size_t ls, chunk;
+  unsigned int i, used = 0;
+  int contig = 0;
+  int err;
+
+  if (ge->red != NULL)
+    return error_set(ge->ctx->err, GA_UNSUPPORTED_ERROR, "Reductions are not supported by GpuElemwise_call_multi");
+
+  /* If the multi kernel doesn't build, every set goes through
+     GpuElemwise_call() */
+  if (ge->multi_slots == 0 && multi_setup(ge) != GA_NO_ERROR)
+    ge->multi_slots = 1;
+
+  if (ge->multi_slots < 2 ||
+      gpukernel_property(ge->k_multi.k, GA_KERNEL_PROP_MAXLSIZE,
+                         &ls) != GA_NO_ERROR) {
+    for (i = 0; i < nsets; i++) {
+      err = GpuElemwise_call(ge, args[i], flags);
+      if (err != GA_NO_ERROR) return err;
+    }
+    return GA_NO_ERROR;
+  }
+
+  if (ls > MULTI_BLOCK) ls = MULTI_BLOCK;
+  chunk = ls * MULTI_CHUNK;
+
+  ge->multi_vals[0] = 0;
+  ge->multi_vals[1] = chunk;
+
+  for (i = 0; i < nsets; i++) {
+    err = check_contig(ge, args[i], &n, &contig);
+    if (err == GA_NO_ERROR && contig) {
+      if (n == 0) continue;
+      ge->multi_vals[2 + 2 * used] = n;
+      ge->multi_vals[2 + 2 * used + 1] = ge->multi_vals[0];
+      err = multi_setargs(ge, used, args[i]);
+    }
+    if (err != GA_NO_ERROR || !contig) {
+      err = GpuElemwise_call(ge, args[i], flags);
+      if (err != GA_NO_ERROR) return err;
+      continue;
+    }
+    sets[used] = i;
+    ge->multi_vals[0] += (n + chunk - 1) / chunk;
+    used++;
+
+    if (used == ge->multi_slots) {
+      err = multi_flush(ge, args, sets, used, ls, flags);
+      if (err != GA_NO_ERROR) return err;
+      ge->multi_vals[0] = 0;
+      used = 0;
+    }
+  }
+  if (used > 0)
+    return multi_flush(ge, args, sets, used, ls, flags);
+  return GA_NO_ERROR;
+}
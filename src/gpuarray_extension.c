@@ -11,10 +11,13 @@ extern void cuda_enter(void);
 extern void cuda_exit(void);
 extern void *cuda_make_ctx(void);
 extern void *cuda_get_stream(void);
+extern void *cuda_get_device(void);
 extern void *cuda_make_buf(void);
 extern void *cuda_get_sz(void);
 extern void *cuda_wait(void);
 extern void *cuda_record(void);
+extern void *cuda_handoff(void);
+extern void *cuda_takeover(void);
 extern void *cuda_get_ipc_handle(void);
 extern void *cuda_open_ipc_handle(void);
 
@@ -28,10 +31,13 @@ static ext ext_list[] = {
   {"cuda_exit", cuda_exit},
   {"cuda_make_ctx", cuda_make_ctx},
   {"cuda_get_stream", cuda_get_stream},
+  {"cuda_get_device", cuda_get_device},
   {"cuda_make_buf", cuda_make_buf},
   {"cuda_get_sz", cuda_get_sz},
   {"cuda_wait", cuda_wait},
   {"cuda_record", cuda_record},
+  {"cuda_handoff", cuda_handoff},
+  {"cuda_takeover", cuda_takeover},
   {"cuda_get_ipc_handle", cuda_get_ipc_handle},
   {"cuda_open_ipc_handle", cuda_open_ipc_handle},
 
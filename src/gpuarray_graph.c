@@ -0,0 +1,304 @@
+#include "gpuarray/buffer.h"
+#include "gpuarray/error.h"
+#include "gpuarray/types.h"
+
+#include "util/error.h"
+#include "private.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int graph_fail(gpugraph *g, int err) {
+  if (g->err == GA_NO_ERROR)
+    g->err = err;
+  return err;
+}
+
+static int graph_add_buf(gpugraph *g, gpudata *b) {
+  gpudata **tmp;
+  size_t i;
+
+  for (i = 0; i < g->nbufs; i++)
+    if (g->bufs[i] == b)
+      return GA_NO_ERROR;
+
+  if (g->nbufs == g->abufs) {
+    tmp = realloc(g->bufs, (g->abufs ? g->abufs * 2 : 8) * sizeof(gpudata *));
+    if (tmp == NULL)
+      return graph_fail(g, error_sys(g->ctx->err, "realloc"));
+    g->bufs = tmp;
+    g->abufs = g->abufs ? g->abufs * 2 : 8;
+  }
+  gpudata_retain(b);
+  g->bufs[g->nbufs++] = b;
+  return GA_NO_ERROR;
+}
+
+static graph_node *graph_new_node(gpugraph *g, int kind) {
+  graph_node *tmp;
+
+  if (g->nnodes == g->anodes) {
+    tmp = realloc(g->nodes,
+                  (g->anodes ? g->anodes * 2 : 16) * sizeof(graph_node));
+    if (tmp == NULL) {
+      graph_fail(g, error_sys(g->ctx->err, "realloc"));
+      return NULL;
+    }
+    g->nodes = tmp;
+    g->anodes = g->anodes ? g->anodes * 2 : 16;
+  }
+  tmp = &g->nodes[g->nnodes];
+  memset(tmp, 0, sizeof(*tmp));
+  tmp->kind = kind;
+  return tmp;
+}
+
+int gpugraph_add_kernel(gpugraph *g, gpukernel *k, unsigned int n,
+                        const size_t *gs, const size_t *ls, size_t shared,
+                        void **args) {
+  graph_node *node;
+  const int *types;
+  char *data;
+  size_t sz;
+  unsigned int numargs, i;
+  int err;
+
+  if (args == NULL)
+    return graph_fail(g, error_set(g->ctx->err, GA_VALUE_ERROR,
+                                   "Captured kernel calls need arguments"));
+  if (n == 0 || n > 3)
+    return graph_fail(g, error_set(g->ctx->err, GA_VALUE_ERROR,
+                                   "Call with more than 3 dimensions"));
+
+  err = gpukernel_property(k, GA_KERNEL_PROP_NUMARGS, &numargs);
+  if (err != GA_NO_ERROR) return graph_fail(g, err);
+  err = gpukernel_property(k, GA_KERNEL_PROP_TYPES, &types);
+  if (err != GA_NO_ERROR) return graph_fail(g, err);
+
+  /* The argument table and the scalar copies share one allocation,
+     each value padded to 8 bytes for alignment */
+  sz = numargs * sizeof(void *);
+  for (i = 0; i < numargs; i++) {
+    if (args[i] == NULL)
+      return graph_fail(g, error_fmt(g->ctx->err, GA_VALUE_ERROR,
+                                     "Argument %u is not set", i));
+    if (types[i] != GA_BUFFER)
+      sz += (gpuarray_get_elsize(types[i]) + 7) & ~(size_t)7;
+  }
+
+  node = graph_new_node(g, GRAPH_KERNEL);
+  if (node == NULL) return g->err;
+  node->args = malloc(sz ? sz : 1);
+  if (node->args == NULL)
+    return graph_fail(g, error_sys(g->ctx->err, "malloc"));
+
+  data = (char *)(node->args + numargs);
+  for (i = 0; i < numargs; i++) {
+    if (types[i] == GA_BUFFER) {
+      err = graph_add_buf(g, (gpudata *)args[i]);
+      if (err != GA_NO_ERROR) {
+        free(node->args);
+        return err;
+      }
+      node->args[i] = args[i];
+    } else {
+      memcpy(data, args[i], gpuarray_get_elsize(types[i]));
+      node->args[i] = data;
+      data += (gpuarray_get_elsize(types[i]) + 7) & ~(size_t)7;
+    }
+  }
+
+  node->n = n;
+  for (i = 0; i < 3; i++) {
+    node->gs[i] = i < n ? gs[i] : 1;
+    node->ls[i] = i < n ? ls[i] : 1;
+  }
+  node->shared = shared;
+  gpukernel_retain(k);
+  node->k = k;
+  g->nnodes++;
+  return GA_NO_ERROR;
+}
+
+int gpugraph_add_move(gpugraph *g, gpudata *dst, size_t dstoff,
+                      gpudata *src, size_t srcoff, size_t sz) {
+  graph_node *node;
+  int err;
+
+  if (sz == 0) return GA_NO_ERROR;
+  if (gpudata_context(dst) != g->ctx)
+    return graph_fail(g, error_set(g->ctx->err, GA_VALUE_ERROR,
+                                   "Cannot move between contexts"));
+
+  node = graph_new_node(g, GRAPH_MOVE);
+  if (node == NULL) return g->err;
+  err = graph_add_buf(g, dst);
+  if (err != GA_NO_ERROR) return err;
+  err = graph_add_buf(g, src);
+  if (err != GA_NO_ERROR) return err;
+  node->dst = dst;
+  node->dstoff = dstoff;
+  node->src = src;
+  node->srcoff = srcoff;
+  node->sz = sz;
+  g->nnodes++;
+  return GA_NO_ERROR;
+}
+
+int gpugraph_add_memset(gpugraph *g, gpudata *dst, size_t dstoff, int data) {
+  graph_node *node;
+  int err;
+
+  node = graph_new_node(g, GRAPH_MEMSET);
+  if (node == NULL) return g->err;
+  err = graph_add_buf(g, dst);
+  if (err != GA_NO_ERROR) return err;
+  node->dst = dst;
+  node->dstoff = dstoff;
+  node->data = data;
+  g->nnodes++;
+  return GA_NO_ERROR;
+}
+
+int gpugraph_replay(gpugraph *g, gpustream *s) {
+  const gpuarray_buffer_ops *ops = g->ctx->ops;
+  graph_node *node;
+  size_t i;
+  int err = GA_NO_ERROR;
+
+  for (i = 0; i < g->nnodes && err == GA_NO_ERROR; i++) {
+    node = &g->nodes[i];
+    switch (node->kind) {
+    case GRAPH_KERNEL:
+      err = ops->kernel_call(node->k, node->n, node->gs, node->ls,
+                             node->shared, node->args, s);
+      break;
+    case GRAPH_MOVE:
+      err = ops->buffer_move(node->dst, node->dstoff, node->src, node->srcoff,
+                             node->sz, s);
+      break;
+    case GRAPH_MEMSET:
+      err = ops->buffer_memset(node->dst, node->dstoff, node->data);
+      break;
+    }
+  }
+  return err;
+}
+
+int gpucontext_capture_begin(gpucontext *ctx) {
+  gpugraph *g;
+
+  if (ctx->capture != NULL)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Context is already capturing");
+  g = calloc(1, sizeof(*g));
+  if (g == NULL)
+    return error_sys(ctx->err, "calloc");
+  g->ctx = ctx;
+  ctx->capture = g;
+  return GA_NO_ERROR;
+}
+
+gpugraph *gpucontext_capture_end(gpucontext *ctx, int *ret) {
+  gpugraph *g = ctx->capture;
+
+  if (g == NULL) {
+    error_set(ctx->err, GA_VALUE_ERROR, "Context is not capturing");
+    if (ret) *ret = GA_VALUE_ERROR;
+    return NULL;
+  }
+  ctx->capture = NULL;
+  if (g->err != GA_NO_ERROR) {
+    if (ret) *ret = g->err;
+    error_set(ctx->err, g->err, "An operation failed during capture");
+    gpugraph_free(g);
+    return NULL;
+  }
+  return g;
+}
+
+int gpugraph_launch(gpugraph *g, gpustream *s) {
+  gpucontext *ctx = g->ctx;
+
+  GA_CHECK(check_stream(ctx, s));
+  if (ctx->capture != NULL)
+    return error_set(ctx->err, GA_UNSUPPORTED_ERROR,
+                     "Can't launch a graph while capturing");
+  if (g->nnodes == 0)
+    return GA_NO_ERROR;
+  if (ctx->ops->graph_launch != NULL)
+    return ctx->ops->graph_launch(g, s);
+  return gpugraph_replay(g, s);
+}
+
+int gpugraph_update(gpugraph *g, gpudata *old, gpudata *buf) {
+  graph_node *node;
+  const int *types;
+  unsigned int numargs, j;
+  size_t i, pos;
+  int present = 0;
+  int err;
+
+  if (old == buf) return GA_NO_ERROR;
+  if (gpudata_context(buf) != g->ctx)
+    return error_set(g->ctx->err, GA_VALUE_ERROR,
+                     "Buffer belongs to a different context");
+
+  pos = g->nbufs;
+  for (i = 0; i < g->nbufs; i++) {
+    if (g->bufs[i] == old) pos = i;
+    if (g->bufs[i] == buf) present = 1;
+  }
+  if (pos == g->nbufs)
+    return error_set(g->ctx->err, GA_VALUE_ERROR,
+                     "Buffer is not used by the graph");
+
+  for (i = 0; i < g->nnodes; i++) {
+    node = &g->nodes[i];
+    if (node->dst == old) node->dst = buf;
+    if (node->src == old) node->src = buf;
+    if (node->kind == GRAPH_KERNEL) {
+      err = gpukernel_property(node->k, GA_KERNEL_PROP_NUMARGS, &numargs);
+      if (err != GA_NO_ERROR) return err;
+      err = gpukernel_property(node->k, GA_KERNEL_PROP_TYPES, &types);
+      if (err != GA_NO_ERROR) return err;
+      for (j = 0; j < numargs; j++)
+        if (types[j] == GA_BUFFER && node->args[j] == (void *)old)
+          node->args[j] = buf;
+    }
+  }
+
+  if (present) {
+    g->bufs[pos] = g->bufs[--g->nbufs];
+  } else {
+    gpudata_retain(buf);
+    g->bufs[pos] = buf;
+  }
+  gpudata_release(old);
+
+  if (g->impl != NULL && g->ctx->ops->graph_reset != NULL)
+    g->ctx->ops->graph_reset(g);
+  return GA_NO_ERROR;
+}
+
+void gpugraph_free(gpugraph *g) {
+  size_t i;
+
+  if (g == NULL) return;
+  if (g->impl != NULL && g->ctx->ops->graph_reset != NULL)
+    g->ctx->ops->graph_reset(g);
+  for (i = 0; i < g->nnodes; i++) {
+    if (g->nodes[i].kind == GRAPH_KERNEL) {
+      gpukernel_release(g->nodes[i].k);
+      free(g->nodes[i].args);
+    }
+  }
+  for (i = 0; i < g->nbufs; i++)
+    gpudata_release(g->bufs[i]);
+  free(g->nodes);
+  free(g->bufs);
+  free(g);
+}
+
+gpucontext *gpugraph_context(gpugraph *g) {
+  return g->ctx;
+}
@@ -16,6 +16,9 @@ int GpuKernel_init(GpuKernel *k, gpucontext *ctx, unsigned int count,
   k->args = calloc(argcount, sizeof(void *));
   if (k->args == NULL)
     return error_sys(ctx->err, "calloc");
+  k->sched_ls = 0;
+  k->sched_shared = 0;
+  k->sched_blocks = 0;
   k->k = gpukernel_init(ctx, count, strs, lens, name, argcount, types,
                         flags, &res, err_str);
   if (res != GA_NO_ERROR)
@@ -35,15 +38,42 @@ gpucontext *GpuKernel_context(GpuKernel *k) {
   return gpukernel_context(k->k);
 }
 
+/* Find the block size that keeps the most threads active */
+static int sched_search(GpuKernel *k, size_t shared, size_t min_l,
+                        size_t max_l) {
+  size_t l, best_l = 0;
+  unsigned int blocks, best_b = 0;
+  int err;
+
+  for (l = min_l; l <= max_l; l += min_l) {
+    err = gpukernel_occupancy(k->k, l, shared, &blocks);
+    if (err != GA_NO_ERROR)
+      return err;
+    /* Ties go to the larger block */
+    if (blocks != 0 && blocks * l >= best_b * best_l) {
+      best_l = l;
+      best_b = blocks;
+    }
+  }
+  k->sched_ls = best_l;
+  k->sched_blocks = best_b;
+  k->sched_shared = shared;
+  return GA_NO_ERROR;
+}
+
 int GpuKernel_sched(GpuKernel *k, size_t n, size_t *gs, size_t *ls) {
+  return GpuKernel_sched_shared(k, n, 0, gs, ls);
+}
+
+int GpuKernel_sched_shared(GpuKernel *k, size_t n, size_t shared,
+                           size_t *gs, size_t *ls) {
   size_t min_l;
   size_t max_l;
-  size_t target_l;
   size_t max_g;
   size_t target_g;
   unsigned int numprocs;
+  unsigned int blocks;
   int err;
-  int want_ls = 0;
 
   err = gpukernel_property(k->k, GA_KERNEL_PROP_MAXLSIZE, &max_l);
   if (err != GA_NO_ERROR)
@@ -58,44 +88,60 @@ int GpuKernel_sched(GpuKernel *k, size_t n, size_t *gs, size_t *ls) {
   if (err != GA_NO_ERROR)
     return err;
 
-  /* Do something about these hardcoded values */
-  target_g = numprocs * 32;
-  if (target_g > max_g)
-    target_g = max_g;
-  target_l = 512;
-  if (target_l > max_l)
-    target_l = max_l;
+  if (min_l == 0 || min_l > max_l)
+    min_l = max_l;
 
   if (*ls == 0) {
-    want_ls = 1;
-    *ls = min_l;
+    if (k->sched_ls == 0 || k->sched_shared != shared) {
+      err = sched_search(k, shared, min_l, max_l);
+      if (err != GA_NO_ERROR)
+        return err;
+    }
+    blocks = k->sched_blocks;
+    /* Nothing fits, let the call report the error */
+    *ls = k->sched_ls != 0 ? k->sched_ls : min_l;
+    /* Don't launch mostly idle blocks for small sizes */
+    if (n < *ls)
+      *ls = n > min_l ? ((n + min_l - 1) / min_l) * min_l : min_l;
+  } else if (*gs != 0 ||
+             gpukernel_occupancy(k->k, *ls, shared, &blocks) != GA_NO_ERROR) {
+    /* Only the grid size needs the occupancy */
+    blocks = 0;
   }
 
   if (*gs == 0) {
-    *gs = ((n-1) / *ls) + 1;
+    /* One wave of resident blocks, the kernels loop over the rest */
+    target_g = blocks != 0 ? (size_t)blocks * numprocs : numprocs * 32;
+    if (target_g > max_g)
+      target_g = max_g;
+    *gs = n == 0 ? 1 : ((n-1) / *ls) + 1;
     if (*gs > target_g)
       *gs = target_g;
   }
 
-  if (want_ls && n > (*ls * *gs)) {
-    /* The division and multiplication by min_l is to ensure we end up
-     * with a multiple of min_l */
-    *ls = ((n / min_l) / *gs) * min_l;
-    if (*ls > target_l)
-      *ls = target_l;
-  }
-
   return GA_NO_ERROR;
 }
 
 int GpuKernel_setarg(GpuKernel *k, unsigned int i, void *a) {
-  return gpukernel_setarg(k->k, i, a);
+  int err = gpukernel_setarg(k->k, i, a);
+  /* Keep them around for captures */
+  if (err == GA_NO_ERROR)
+    k->args[i] = a;
+  return err;
 }
 
 int GpuKernel_call(GpuKernel *k, unsigned int n,
                    const size_t *gs, const size_t *ls,
                    size_t shared, void **args) {
-  return gpukernel_call(k->k, n, gs, ls, shared, args);
+  return GpuKernel_call_s(k, n, gs, ls, shared, args, NULL);
+}
+
+int GpuKernel_call_s(GpuKernel *k, unsigned int n,
+                     const size_t *gs, const size_t *ls,
+                     size_t shared, void **args, gpustream *s) {
+  if (args == NULL && gpukernel_context(k->k)->capture != NULL)
+    args = k->args;
+  return gpukernel_call_s(k->k, n, gs, ls, shared, args, s);
 }
 
 const char *GpuKernel_error(const GpuKernel *k, int err) {
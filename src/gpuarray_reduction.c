@@ -53,11 +53,8 @@ struct maxandargmax_ctx{
 	size_t          chunkSize [3];
 
 	/* Invoker */
-	gpudata*        srcStepsGD;
-	gpudata*        srcSizeGD;
-	gpudata*        chunkSizeGD;
-	gpudata*        dstMaxStepsGD;
-	gpudata*        dstArgmaxStepsGD;
+	gpudata*        metaGD;
+	size_t          metaOff;
 };
 typedef struct maxandargmax_ctx maxandargmax_ctx;
 
@@ -215,8 +212,8 @@ static int   maxandargmaxCheckargs              (maxandargmax_ctx*  ctx){
 	ctx->gridSize  [0] = ctx->gridSize  [1] = ctx->gridSize  [2] = 1;
 	ctx->chunkSize [0] = ctx->chunkSize [1] = ctx->chunkSize [2] = 1;
 
-	ctx->srcStepsGD    = ctx->srcSizeGD     = ctx->chunkSizeGD   =
-	ctx->dstMaxStepsGD = ctx->dstArgmaxStepsGD = NULL;
+	ctx->metaGD        = NULL;
+	ctx->metaOff       = 0;
 
 
 	/* Insane src or reduxLen? */
@@ -343,15 +340,12 @@ static void  maxandargmaxAppendTypedefs         (maxandargmax_ctx*  ctx){
 static void  maxandargmaxAppendPrototype        (maxandargmax_ctx*  ctx){
 	strb_appends(&ctx->s, "KERNEL void maxandargmax(const GLOBAL_MEM T*        src,\n");
 	strb_appends(&ctx->s, "                         const X         srcOff,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        srcSteps,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        srcSize,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        chunkSize,\n");
+	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        meta,\n");
+	strb_appends(&ctx->s, "                         const X         metaOff,\n");
 	strb_appends(&ctx->s, "                         GLOBAL_MEM T*              dstMax,\n");
 	strb_appends(&ctx->s, "                         const X         dstMaxOff,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        dstMaxSteps,\n");
 	strb_appends(&ctx->s, "                         GLOBAL_MEM X*              dstArgmax,\n");
-	strb_appends(&ctx->s, "                         const X         dstArgmaxOff,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        dstArgmaxSteps)");
+	strb_appends(&ctx->s, "                         const X         dstArgmaxOff)");
 }
 static void  maxandargmaxAppendOffsets          (maxandargmax_ctx*  ctx){
 	strb_appends(&ctx->s, "\t/* Add offsets */\n");
@@ -359,6 +353,14 @@ static void  maxandargmaxAppendOffsets          (maxandargmax_ctx*  ctx){
 	strb_appends(&ctx->s, "\tdstMax    = (GLOBAL_MEM T*)      ((GLOBAL_MEM char*)      dstMax    + dstMaxOff);\n");
 	strb_appends(&ctx->s, "\tdstArgmax = (GLOBAL_MEM X*)      ((GLOBAL_MEM char*)      dstArgmax + dstArgmaxOff);\n");
 	strb_appends(&ctx->s, "\t\n");
+	strb_appends(&ctx->s, "\t/* Unpack the metadata */\n");
+	strb_appends(&ctx->s, "\tmeta      = (const GLOBAL_MEM X*)((const GLOBAL_MEM char*)meta      + metaOff);\n");
+	strb_appends(&ctx->s, "\tconst GLOBAL_MEM X* srcSteps       = meta;\n");
+	strb_appendf(&ctx->s, "\tconst GLOBAL_MEM X* srcSize        = srcSteps    + %d;\n", ctx->nds);
+	strb_appendf(&ctx->s, "\tconst GLOBAL_MEM X* chunkSize      = srcSize     + %d;\n", ctx->nds);
+	strb_appendf(&ctx->s, "\tconst GLOBAL_MEM X* dstMaxSteps    = chunkSize   + %d;\n", ctx->ndh);
+	strb_appendf(&ctx->s, "\tconst GLOBAL_MEM X* dstArgmaxSteps = dstMaxSteps + %d;\n", ctx->ndd);
+	strb_appends(&ctx->s, "\t\n");
 	strb_appends(&ctx->s, "\t\n");
 }
 static void  maxandargmaxAppendIndexDeclarations(maxandargmax_ctx*  ctx){
@@ -635,15 +637,12 @@ static int   maxandargmaxCompile                (maxandargmax_ctx*  ctx){
 	const int    ARG_TYPECODES[]   = {
 		GA_BUFFER, /* src */
 		GA_SIZE,   /* srcOff */
-		GA_BUFFER, /* srcSteps */
-		GA_BUFFER, /* srcSize */
-		GA_BUFFER, /* chnkSize */
+		GA_BUFFER, /* meta */
+		GA_SIZE,   /* metaOff */
 		GA_BUFFER, /* dstMax */
 		GA_SIZE,   /* dstMaxOff */
-		GA_BUFFER, /* dstMaxSteps */
 		GA_BUFFER, /* dstArgmax */
-		GA_SIZE,   /* dstArgmaxOff */
-		GA_BUFFER  /* dstArgmaxSteps */
+		GA_SIZE    /* dstArgmaxOff */
 	};
 	const unsigned int ARG_TYPECODES_LEN = sizeof(ARG_TYPECODES)/sizeof(*ARG_TYPECODES);
 	const char*  SRCS[1];
@@ -780,55 +779,52 @@ static int   maxandargmaxSchedule               (maxandargmax_ctx*  ctx){
  */
 
 static int   maxandargmaxInvoke                 (maxandargmax_ctx*  ctx){
-	void* args[11];
+	void*   args[8];
+	size_t* meta;
+	size_t  metaLen;
 
 	/**
 	 * Argument Marshalling. This the grossest gross thing in here.
+	 *
+	 * The steps and sizes are packed in a single temporary from the
+	 * scratch arena of the context.
 	 */
 
-	const int flags       = GA_BUFFER_READ_ONLY|GA_BUFFER_INIT;
-	ctx->srcStepsGD       = gpudata_alloc(ctx->gpuCtx, ctx->nds    * sizeof(size_t),
-	                                      ctx->src->strides,       flags, 0);
-	ctx->srcSizeGD        = gpudata_alloc(ctx->gpuCtx, ctx->nds    * sizeof(size_t),
-	                                      ctx->src->dimensions,    flags, 0);
-	ctx->chunkSizeGD      = gpudata_alloc(ctx->gpuCtx, ctx->ndh * sizeof(size_t),
-	                                      ctx->chunkSize,          flags, 0);
-	ctx->dstMaxStepsGD    = gpudata_alloc(ctx->gpuCtx, ctx->ndd * sizeof(size_t),
-	                                      ctx->dstMax->strides,    flags, 0);
-	ctx->dstArgmaxStepsGD = gpudata_alloc(ctx->gpuCtx, ctx->ndd * sizeof(size_t),
-	                                      ctx->dstArgmax->strides, flags, 0);
+	metaLen = 2*ctx->nds + ctx->ndh + 2*ctx->ndd;
+	meta    = malloc(metaLen * sizeof(size_t));
+	if(!meta){
+		return ctx->ret=GA_MEMORY_ERROR;
+	}
+	memcpy(meta,                                  ctx->src->strides,       ctx->nds * sizeof(size_t));
+	memcpy(meta +   ctx->nds,                     ctx->src->dimensions,    ctx->nds * sizeof(size_t));
+	memcpy(meta + 2*ctx->nds,                     ctx->chunkSize,          ctx->ndh * sizeof(size_t));
+	memcpy(meta + 2*ctx->nds + ctx->ndh,          ctx->dstMax->strides,    ctx->ndd * sizeof(size_t));
+	memcpy(meta + 2*ctx->nds + ctx->ndh+ctx->ndd, ctx->dstArgmax->strides, ctx->ndd * sizeof(size_t));
+	ctx->ret = gpudata_scratch_alloc(ctx->gpuCtx, NULL, metaLen * sizeof(size_t),
+	                                 meta, &ctx->metaGD, &ctx->metaOff);
+	free(meta);
+	if(ctx->ret != GA_NO_ERROR){
+		return ctx->ret;
+	}
+
 	args[ 0] = (void*) ctx->src->data;
 	args[ 1] = (void*)&ctx->src->offset;
-	args[ 2] = (void*) ctx->srcStepsGD;
-	args[ 3] = (void*) ctx->srcSizeGD;
-	args[ 4] = (void*) ctx->chunkSizeGD;
-	args[ 5] = (void*) ctx->dstMax->data;
-	args[ 6] = (void*)&ctx->dstMax->offset;
-	args[ 7] = (void*) ctx->dstMaxStepsGD;
-	args[ 8] = (void*) ctx->dstArgmax->data;
-	args[ 9] = (void*)&ctx->dstArgmax->offset;
-	args[10] = (void*) ctx->dstArgmaxStepsGD;
-
-	if(ctx->srcStepsGD      &&
-	   ctx->srcSizeGD       &&
-	   ctx->chunkSizeGD     &&
-	   ctx->dstMaxStepsGD   &&
-	   ctx->dstArgmaxStepsGD){
-		ctx->ret = GpuKernel_call(&ctx->kernel,
-		                          ctx->ndh>0 ? ctx->ndh : 1,
-		                          ctx->gridSize,
-		                          ctx->blockSize,
-		                          0,
-		                          args);
-	}else{
-		ctx->ret = GA_MEMORY_ERROR;
-	}
+	args[ 2] = (void*) ctx->metaGD;
+	args[ 3] = (void*)&ctx->metaOff;
+	args[ 4] = (void*) ctx->dstMax->data;
+	args[ 5] = (void*)&ctx->dstMax->offset;
+	args[ 6] = (void*) ctx->dstArgmax->data;
+	args[ 7] = (void*)&ctx->dstArgmax->offset;
+
+	ctx->ret = GpuKernel_call(&ctx->kernel,
+	                          ctx->ndh>0 ? ctx->ndh : 1,
+	                          ctx->gridSize,
+	                          ctx->blockSize,
+	                          0,
+	                          args);
 
-	gpudata_release(ctx->srcStepsGD);
-	gpudata_release(ctx->srcSizeGD);
-	gpudata_release(ctx->chunkSizeGD);
-	gpudata_release(ctx->dstMaxStepsGD);
-	gpudata_release(ctx->dstArgmaxStepsGD);
+	gpudata_scratch_free(ctx->gpuCtx, NULL, ctx->metaGD, ctx->metaOff);
+	ctx->metaGD = NULL;
 
 	return ctx->ret;
 }
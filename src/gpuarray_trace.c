@@ -0,0 +1,256 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpuarray/error.h"
+#include "gpuarray/trace.h"
+
+#include "util/error.h"
+#include "private.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Events kept per thread, older ones get overwritten */
+#define TRACE_RING 8192
+#define TRACE_ARGS 128
+
+#define TRACE_PID_HOST 1
+#define TRACE_PID_DEVICE 2
+
+typedef struct _trace_ev {
+  const char *cat;
+  const char *name;
+  uint64_t ts;
+  uint64_t dur;
+  int pid;
+  char args[TRACE_ARGS];
+} trace_ev;
+
+typedef struct _trace_buf {
+  struct _trace_buf *next;
+  unsigned int tid;
+  size_t n; /* number of events recorded since the start */
+  trace_ev ev[TRACE_RING];
+} trace_buf;
+
+/*
+ * Every thread only writes to its own buffer so recording needs no
+ * locks.  Buffers are pushed on a global list the first time a thread
+ * records something and are never freed since the thread may still
+ * point to them.
+ */
+#if defined(_MSC_VER)
+#define TRACE_TLS __declspec(thread)
+static unsigned int atomic_inc(volatile unsigned int *p) {
+  return InterlockedIncrement((volatile LONG *)p);
+}
+static int atomic_cas_ptr(void *volatile *p, void *o, void *n) {
+  return InterlockedCompareExchangePointer(p, n, o) == o;
+}
+#else
+#define TRACE_TLS __thread
+#define atomic_inc(p) __sync_add_and_fetch((p), 1)
+#define atomic_cas_ptr(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#endif
+
+int ga_trace = 0;
+
+static char *trace_path = NULL;
+static uint64_t trace_epoch;
+static trace_buf *volatile trace_bufs = NULL;
+static volatile unsigned int trace_ntid = 0;
+static TRACE_TLS trace_buf *trace_mine = NULL;
+
+typedef struct _trace_flush {
+  struct _trace_flush *next;
+  void (*fn)(void *);
+  void *arg;
+} trace_flush;
+
+static trace_flush *trace_flushes = NULL;
+
+uint64_t trace_now(void) {
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER c;
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&c);
+  return (uint64_t)((double)c.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+#endif
+}
+
+static trace_buf *trace_get_buf(void) {
+  trace_buf *b = trace_mine;
+
+  if (b != NULL)
+    return b;
+  b = calloc(1, sizeof(*b));
+  if (b == NULL)
+    return NULL;
+  b->tid = atomic_inc(&trace_ntid);
+  do {
+    b->next = trace_bufs;
+  } while (!atomic_cas_ptr((void *volatile *)&trace_bufs, b->next, b));
+  trace_mine = b;
+  return b;
+}
+
+static void trace_record(int pid, const char *cat, const char *name,
+                         uint64_t ts, uint64_t dur, const char *fmt,
+                         va_list ap) {
+  trace_buf *b = trace_get_buf();
+  trace_ev *ev;
+
+  if (b == NULL) return;
+  ev = &b->ev[b->n % TRACE_RING];
+  ev->pid = pid;
+  ev->cat = cat;
+  ev->name = name;
+  ev->ts = ts;
+  ev->dur = dur;
+  if (fmt != NULL)
+    vsnprintf(ev->args, TRACE_ARGS, fmt, ap);
+  else
+    ev->args[0] = '\0';
+  b->n++;
+}
+
+void trace_complete(const char *cat, const char *name, uint64_t start,
+                    const char *fmt, ...) {
+  uint64_t end = trace_now();
+  va_list ap;
+
+  va_start(ap, fmt);
+  trace_record(TRACE_PID_HOST, cat, name, start, end - start, fmt, ap);
+  va_end(ap);
+}
+
+void trace_device(const char *name, uint64_t start, uint64_t dur,
+                  const char *fmt, ...) {
+  va_list ap;
+
+  va_start(ap, fmt);
+  trace_record(TRACE_PID_DEVICE, "device", name, start, dur, fmt, ap);
+  va_end(ap);
+}
+
+int trace_add_flush(void (*fn)(void *), void *arg) {
+  trace_flush *f = malloc(sizeof(*f));
+
+  if (f == NULL)
+    return error_sys(global_err, "malloc");
+  f->fn = fn;
+  f->arg = arg;
+  f->next = trace_flushes;
+  trace_flushes = f;
+  return GA_NO_ERROR;
+}
+
+void trace_del_flush(void (*fn)(void *), void *arg) {
+  trace_flush **pf, *f;
+
+  for (pf = &trace_flushes; *pf != NULL; pf = &(*pf)->next) {
+    f = *pf;
+    if (f->fn == fn && f->arg == arg) {
+      *pf = f->next;
+      free(f);
+      return;
+    }
+  }
+}
+
+static void trace_atexit(void) {
+  if (ga_trace)
+    gputrace_stop();
+}
+
+void trace_env(void) {
+  static int checked = 0;
+  const char *path;
+
+  if (checked) return;
+  checked = 1;
+  path = getenv("GPUARRAY_TRACE");
+  if (path != NULL && path[0] != '\0' && !ga_trace &&
+      gputrace_start(path) == GA_NO_ERROR)
+    atexit(trace_atexit);
+}
+
+int gputrace_start(const char *path) {
+  trace_buf *b;
+
+  if (ga_trace)
+    return error_set(global_err, GA_VALUE_ERROR, "Tracing is already on");
+  trace_path = strdup(path);
+  if (trace_path == NULL)
+    return error_sys(global_err, "strdup");
+  for (b = trace_bufs; b != NULL; b = b->next)
+    b->n = 0;
+  trace_epoch = trace_now();
+  ga_trace = 1;
+  return GA_NO_ERROR;
+}
+
+static void trace_write_ev(FILE *f, trace_buf *b, trace_ev *ev) {
+  /* Events recorded before the start are from a previous session */
+  if (ev->ts < trace_epoch) return;
+  fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+          "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{%s}}",
+          ev->name, ev->cat, (ev->ts - trace_epoch) / 1000.0,
+          ev->dur / 1000.0, ev->pid, b->tid, ev->args);
+}
+
+int gputrace_stop(void) {
+  trace_flush *fl;
+  trace_buf *b;
+  FILE *f;
+  size_t i, first;
+  int err = GA_NO_ERROR;
+
+  if (!ga_trace)
+    return error_set(global_err, GA_VALUE_ERROR, "Tracing is not on");
+  /* Get the device events that are still in flight */
+  while (trace_flushes != NULL) {
+    fl = trace_flushes;
+    trace_flushes = fl->next;
+    fl->fn(fl->arg);
+    free(fl);
+  }
+  ga_trace = 0;
+
+  f = fopen(trace_path, "w");
+  if (f == NULL) {
+    err = error_sys(global_err, "fopen");
+    goto out;
+  }
+  fprintf(f, "{\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"args\":{\"name\":\"host\"}},\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"args\":{\"name\":\"device\"}}",
+          TRACE_PID_HOST, TRACE_PID_DEVICE);
+  for (b = trace_bufs; b != NULL; b = b->next) {
+    first = b->n > TRACE_RING ? b->n - TRACE_RING : 0;
+    for (i = first; i < b->n; i++)
+      trace_write_ev(f, b, &b->ev[i % TRACE_RING]);
+    b->n = 0;
+  }
+  fprintf(f, "\n]}\n");
+  if (fclose(f) != 0)
+    err = error_sys(global_err, "fclose");
+
+ out:
+  free(trace_path);
+  trace_path = NULL;
+  return err;
+}
@@ -18,7 +18,7 @@ void *ga_load_library(const char *name, error *e) {
 
 void *ga_func_ptr(void *h, const char *name, error *e) {
   void *res = dlsym(h, name);
-  if (res == NULL)
+  if (res == NULL && e != NULL)
     error_fmt(e, GA_LOAD_ERROR, "Could not find symbol \"%s\": %s", name, dlerror());
   return res;
 }
@@ -49,7 +49,7 @@ void *ga_load_library(const char *name, error *e) {
 
 void *ga_func_ptr(void *h, const char *name, error *e) {
   void *res = (void *)GetProcAddress(h, name);
-  if (res == NULL)
+  if (res == NULL && e != NULL)
     error_win(name, e);
   return res;
 }
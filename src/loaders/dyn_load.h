@@ -4,6 +4,7 @@
 #include "util/error.h"
 
 void *ga_load_library(const char *name, error *e);
+/* `e` can be NULL for optional symbols */
 void *ga_func_ptr(void *h, const char *name, error *e);
 
 #endif
@@ -19,9 +19,13 @@ static char libname[] = "libcuda.so";
 
 #define DEF_PROC(name, args) t##name *name
 #define DEF_PROC_V2(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT_V2(name, args) DEF_PROC(name, args)
 
 #include "libcuda.fn"
 
+#undef DEF_PROC_OPT_V2
+#undef DEF_PROC_OPT
 #undef DEF_PROC_V2
 #undef DEF_PROC
 
@@ -39,6 +43,13 @@ static char libname[] = "libcuda.so";
     return e->code;                                            \
   }
 
+/* Optional entry points are left NULL when the driver is too old */
+#define DEF_PROC_OPT(name, args)                        \
+  name = (t##name *)ga_func_ptr(lib, #name, NULL)
+
+#define DEF_PROC_OPT_V2(name, args)                                   \
+  name = (t##name *)ga_func_ptr(lib, STRINGIFY(name##_v2), NULL)
+
 static int loaded = 0;
 
 int load_libcuda(error *e) {
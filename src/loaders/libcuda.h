@@ -12,7 +12,8 @@
 #endif
 
 typedef enum {
-  CUDA_SUCCESS = 0
+  CUDA_SUCCESS = 0,
+  CUDA_ERROR_NOT_READY = 600
 } CUresult;
 
 #if defined(_WIN64) || defined(__LP64__)
@@ -28,21 +29,73 @@ typedef struct CUfunc_st *CUfunction;
 typedef struct CUevent_st *CUevent;
 typedef struct CUstream_st *CUstream;
 typedef struct CUlinkState_st *CUlinkState;
+typedef struct CUgraph_st *CUgraph;
+typedef struct CUgraphExec_st *CUgraphExec;
+typedef struct CUarray_st *CUarray;
 
 typedef enum CUdevice_attribute_enum CUdevice_attribute;
 typedef enum CUfunction_attribute_enum CUfunction_attribute;
 typedef enum CUevent_flags_enum CUevent_flags;
+typedef enum CUstream_flags_enum CUstream_flags;
+typedef enum CUstreamCaptureMode_enum CUstreamCaptureMode;
 typedef enum CUctx_flags_enum CUctx_flags;
 typedef enum CUipcMem_flags_enum CUipcMem_flags;
 typedef enum CUjit_option_enum CUjit_option;
 typedef enum CUjitInputType_enum CUjitInputType;
+typedef enum CUmemorytype_enum CUmemorytype;
+typedef enum CUpointer_attribute_enum CUpointer_attribute;
 
 #define CU_IPC_HANDLE_SIZE 64
 
+#define CU_MEMHOSTALLOC_PORTABLE 0x01
+#define CU_MEMHOSTALLOC_DEVICEMAP 0x02
+
 typedef struct CUipcMemHandle_st {
   char reserved[CU_IPC_HANDLE_SIZE];
 } CUipcMemHandle;
 
+enum CUmemorytype_enum {
+  CU_MEMORYTYPE_HOST    = 0x01,
+  CU_MEMORYTYPE_DEVICE  = 0x02,
+  CU_MEMORYTYPE_ARRAY   = 0x03,
+  CU_MEMORYTYPE_UNIFIED = 0x04
+};
+
+enum CUpointer_attribute_enum {
+  CU_POINTER_ATTRIBUTE_CONTEXT = 1,
+  CU_POINTER_ATTRIBUTE_MEMORY_TYPE = 2
+};
+
+typedef struct CUDA_MEMCPY3D_st {
+  size_t srcXInBytes;
+  size_t srcY;
+  size_t srcZ;
+  size_t srcLOD;
+  CUmemorytype srcMemoryType;
+  const void *srcHost;
+  CUdeviceptr srcDevice;
+  CUarray srcArray;
+  void *reserved0;
+  size_t srcPitch;
+  size_t srcHeight;
+
+  size_t dstXInBytes;
+  size_t dstY;
+  size_t dstZ;
+  size_t dstLOD;
+  CUmemorytype dstMemoryType;
+  void *dstHost;
+  CUdeviceptr dstDevice;
+  CUarray dstArray;
+  void *reserved1;
+  size_t dstPitch;
+  size_t dstHeight;
+
+  size_t WidthInBytes;
+  size_t Height;
+  size_t Depth;
+} CUDA_MEMCPY3D;
+
 /** @endcond */
 
 int load_libcuda(error *);
@@ -51,17 +104,25 @@ int load_libcuda(error *);
 
 #define DEF_PROC(name, args) typedef CUresult CUDAAPI t##name args
 #define DEF_PROC_V2(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT_V2(name, args) DEF_PROC(name, args)
 
 #include "libcuda.fn"
 
+#undef DEF_PROC_OPT_V2
+#undef DEF_PROC_OPT
 #undef DEF_PROC_V2
 #undef DEF_PROC
 
 #define DEF_PROC(name, args) extern t##name *name
 #define DEF_PROC_V2(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT_V2(name, args) DEF_PROC(name, args)
 
 #include "libcuda.fn"
 
+#undef DEF_PROC_OPT_V2
+#undef DEF_PROC_OPT
 #undef DEF_PROC_V2
 #undef DEF_PROC
 
@@ -182,6 +243,17 @@ enum CUevent_flags_enum {
   CU_EVENT_INTERPROCESS   = 0x4
 };
 
+enum CUstream_flags_enum {
+  CU_STREAM_DEFAULT      = 0x0,
+  CU_STREAM_NON_BLOCKING = 0x1
+};
+
+enum CUstreamCaptureMode_enum {
+  CU_STREAM_CAPTURE_MODE_GLOBAL       = 0,
+  CU_STREAM_CAPTURE_MODE_THREAD_LOCAL = 1,
+  CU_STREAM_CAPTURE_MODE_RELAXED      = 2
+};
+
 enum CUctx_flags_enum {
   CU_CTX_SCHED_AUTO          = 0x00,
   CU_CTX_SCHED_SPIN          = 0x01,
@@ -57,6 +57,8 @@ typedef cl_uint cl_program_info;
 typedef cl_uint cl_program_build_info;
 typedef cl_uint cl_kernel_info;
 typedef cl_uint cl_kernel_work_group_info;
+typedef cl_uint cl_event_info;
+typedef cl_uint cl_profiling_info;
 
 /** @endcond */
 
@@ -332,6 +334,18 @@ int load_libopencl(error *);
 #define CL_KERNEL_PRIVATE_MEM_SIZE                  0x11B4
 #define CL_KERNEL_GLOBAL_WORK_SIZE                  0x11B5
 
+/* cl_event_info */
+#define CL_EVENT_COMMAND_EXECUTION_STATUS           0x11D3
+
+/* command execution status */
+#define CL_COMPLETE                                 0x0
+
+/* cl_profiling_info */
+#define CL_PROFILING_COMMAND_QUEUED                 0x1280
+#define CL_PROFILING_COMMAND_SUBMIT                 0x1281
+#define CL_PROFILING_COMMAND_START                  0x1282
+#define CL_PROFILING_COMMAND_END                    0x1283
+
 /** @endcond */
 
 #endif
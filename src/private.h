@@ -50,9 +50,16 @@ typedef struct _gpuarray_comm_ops gpuarray_comm_ops;
   int flags;                                    \
   struct _gpudata *errbuf;                      \
   cache *extcopy_cache;                         \
+  struct _gpugraph *capture;                    \
+  struct _ga_scratch *scratch;                  \
+  size_t transfer_chunk;                        \
   char bin_id[64];                              \
   char tag[8]
 
+/* Staging chunk size for transfers between contexts that go
+   through the host */
+#define DEFAULT_TRANSFER_CHUNK (8 * 1024 * 1024)
+
 /* These will go away eventually but are kept to ease the transition for now */
 #define GA_CTX_SINGLE_STREAM 0x01
 #define GA_CTX_MULTI_THREAD  0x02
@@ -64,6 +71,7 @@ struct _gpucontext_props {
   const char *kernel_cache_path;
   size_t max_cache_size;
   size_t initial_cache_size;
+  size_t transfer_chunk;
 };
 
 struct _gpucontext {
@@ -87,6 +95,99 @@ typedef struct _partial_gpucomm {
   gpucontext* ctx;
 } partial_gpucomm;
 
+typedef struct _partial_gpustream {
+  gpucontext *ctx;
+} partial_gpustream;
+
+typedef struct _partial_gpuevent {
+  gpucontext *ctx;
+} partial_gpuevent;
+
+/*
+ * One side of a rectangular copy, which is either a buffer or host
+ * memory.  Rows are `pitch` bytes apart and slices are `slice` bytes
+ * apart, which must be a multiple of `pitch`.
+ */
+typedef struct _ga_rect {
+  gpudata *buf; /* NULL for host memory */
+  void *host;
+  size_t off; /* in bytes from the start of buf or host */
+  size_t pitch;
+  size_t slice;
+} ga_rect;
+
+int gpudata_copy_rect(const ga_rect *dst, const ga_rect *src,
+                      const size_t *region, gpustream *s);
+
+/* Page-locked host memory of `ctx` backed by *b, or NULL if it has none */
+void *gpudata_stage_alloc(gpucontext *ctx, size_t sz, gpudata **b);
+
+/*
+ * Copy between buffers of any two contexts through host staging
+ * buffers, in chunks of the transfer size of the source context.
+ * This is the fallback of gpudata_transfer().  The number of chunks
+ * is returned in *nchunks.
+ */
+int gpudata_transfer_host(gpudata *dst, size_t dstoff, gpudata *src,
+                          size_t srcoff, size_t sz, size_t *nchunks);
+
+/*
+ * Bump allocator for short-lived library temporaries.
+ *
+ * Each stream of a context (NULL for the default one) has a block of
+ * device memory that gpudata_scratch_alloc() carves `sz` bytes out of
+ * by advancing an offset and fills with `data` if it isn't NULL.  The
+ * temporary is at `*off` in `*b` and must
+ * be given back with gpudata_scratch_free() in reverse order of
+ * allocation, which rewinds the offset to `off`.  The memory can be
+ * handed out again immediately because the backends order the accesses
+ * to a buffer.  `data` is uploaded on the stream itself, without
+ * waiting for the users of the other ranges.
+ */
+int gpudata_scratch_alloc(gpucontext *ctx, gpustream *s, size_t sz,
+                          const void *data, gpudata **b, size_t *off);
+void gpudata_scratch_free(gpucontext *ctx, gpustream *s, gpudata *b,
+                          size_t off);
+
+/*
+ * Like GpuArray_copy() but the copy is a temporary from the scratch
+ * arena that must be cleared with GpuArray_scratch_clear().
+ */
+int GpuArray_scratch_copy(GpuArray *res, const GpuArray *a, ga_order order);
+void GpuArray_scratch_clear(GpuArray *a);
+
+/*
+ * Produces (for a write) or consumes (for a read) the `len` bytes at
+ * position `pos` of a streamed transfer in `stage`.
+ */
+typedef int (*gpudata_stage_fn)(char *stage, size_t pos, size_t len,
+                                void *arg);
+
+/*
+ * Stream `sz` bytes between host code and `buf` from `off`, in chunks
+ * of the context transfer chunk size (rounded down to a multiple of
+ * `elsize`).  Two staging buffers, page-locked if the context has
+ * them, let `fn` work on one chunk while the other is in flight.
+ */
+int gpudata_stream(gpudata *buf, size_t off, size_t sz, size_t elsize,
+                   int write, gpudata_stage_fn fn, void *arg);
+
+/*
+ * Repeat the `psz` bytes at `pattern` over `sz` bytes of `dst` from
+ * `dstoff` with the native fill of the backend.  Returns
+ * GA_UNSUPPORTED_ERROR if there is none for this pattern, in which
+ * case the caller should use a kernel.
+ */
+int gpudata_fill(gpudata *dst, size_t dstoff, size_t sz, const void *pattern,
+                 size_t psz);
+
+/*
+ * Generates the piece selection of kernels that handle several
+ * pieces in one launch (see gpuarray_elemwise.c).
+ */
+void gen_slot_select(strb *sb, const char *prefix, unsigned int s,
+                     unsigned int slots);
+
 struct _gpuarray_buffer_ops {
   int (*get_platform_count)(unsigned int* platcount);
   int (*get_device_count)(unsigned int platform, unsigned int* devcount);
@@ -97,9 +198,12 @@ struct _gpuarray_buffer_ops {
   void (*buffer_release)(gpudata *b);
   int (*buffer_share)(gpudata *a, gpudata *b);
   int (*buffer_move)(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
-                     size_t sz);
-  int (*buffer_read)(void *dst, gpudata *src, size_t srcoff, size_t sz);
-  int (*buffer_write)(gpudata *dst, size_t dstoff, const void *src, size_t sz);
+                     size_t sz, gpustream *s);
+  /* A non-NULL done makes the transfer asynchronous */
+  int (*buffer_read)(void *dst, gpudata *src, size_t srcoff, size_t sz,
+                     gpustream *s, gpuevent *done);
+  int (*buffer_write)(gpudata *dst, size_t dstoff, const void *src, size_t sz,
+                      gpustream *s, gpuevent *done);
   int (*buffer_memset)(gpudata *dst, size_t dstoff, int data);
   int (*kernel_alloc)(gpukernel **k, gpucontext *ctx, unsigned int count,
                       const char **strings, const size_t *lengths,
@@ -110,7 +214,9 @@ struct _gpuarray_buffer_ops {
   int (*kernel_setarg)(gpukernel *k, unsigned int i, void *a);
   int (*kernel_call)(gpukernel *k, unsigned int n,
                      const size_t *gs, const size_t *ls,
-                     size_t shared, void **args);
+                     size_t shared, void **args, gpustream *s);
+  int (*kernel_occupancy)(gpukernel *k, size_t ls, size_t shared,
+                          unsigned int *blocks);
 
   int (*buffer_sync)(gpudata *b);
   int (*buffer_transfer)(gpudata *dst, size_t dstoff,
@@ -118,6 +224,31 @@ struct _gpuarray_buffer_ops {
   int (*property)(gpucontext *ctx, gpudata *buf, gpukernel *k, int prop_id,
                   void *res);
   const char *(*ctx_error)(gpucontext *ctx);
+  int (*stream_alloc)(gpustream **s, gpucontext *ctx);
+  void (*stream_free)(gpustream *s);
+  int (*stream_sync)(gpustream *s);
+  int (*stream_wait)(gpustream *s, gpustream *other);
+  int (*graph_launch)(gpugraph *g, gpustream *s);
+  void (*graph_reset)(gpugraph *g);
+  int (*event_alloc)(gpuevent **e, gpucontext *ctx);
+  void (*event_free)(gpuevent *e);
+  int (*event_record)(gpuevent *e, gpustream *s);
+  int (*event_sync)(gpuevent *e);
+  int (*event_query)(gpuevent *e, int *done);
+  int (*event_elapsed)(gpuevent *start, gpuevent *end, double *ms);
+  /* region is the width in bytes, the number of rows and of slices.
+     At least one of dst and src is a buffer. */
+  int (*buffer_copy_rect)(const ga_rect *dst, const ga_rect *src,
+                          const size_t *region, gpustream *s);
+  /* Repeat the psz bytes of pattern over sz bytes.  Returns
+     GA_UNSUPPORTED_ERROR for the patterns it can't do natively. */
+  int (*buffer_fill)(gpudata *dst, size_t dstoff, size_t sz,
+                     const void *pattern, size_t psz);
+  /* Write to a range of dst that only work queued later on the
+     compute stream s (NULL for the default one) uses.  src can be
+     reused on return.  Optional, buffer_write is used without it. */
+  int (*buffer_upload)(gpudata *dst, size_t dstoff, const void *src,
+                       size_t sz, gpustream *s);
 };
 
 struct _gpuarray_blas_ops {
@@ -257,22 +388,22 @@ struct _gpuarray_comm_ops {
   int (*reduce)(gpudata* src, size_t offsrc,
                 gpudata* dest, size_t offdest,
                 size_t count, int typecode, int opcode,
-                int root, gpucomm* comm);
+                int root, gpucomm* comm, gpustream *s);
   int (*all_reduce)(gpudata* src, size_t offsrc,
                     gpudata* dest, size_t offdest,
                     size_t count, int typecode, int opcode,
-                    gpucomm* comm);
+                    gpucomm* comm, gpustream *s);
   int (*reduce_scatter)(gpudata* src, size_t offsrc,
                         gpudata* dest, size_t offdest,
                         size_t count, int typecode, int opcode,
-                        gpucomm* comm);
+                        gpucomm* comm, gpustream *s);
   int (*broadcast)(gpudata* array, size_t offset,
                    size_t count, int typecode,
-                   int root, gpucomm* comm);
+                   int root, gpucomm* comm, gpustream *s);
   int (*all_gather)(gpudata* src, size_t offsrc,
                     gpudata* dest, size_t offdest,
                     size_t count, int typecode,
-                    gpucomm* comm);
+                    gpucomm* comm, gpustream *s);
 };
 
 #define STATIC_ASSERT(COND, MSG) typedef char static_assertion_##MSG[2*(!!(COND))-1]
@@ -284,6 +415,78 @@ static inline void *memdup(const void *p, size_t s) {
   return res;
 }
 
+static inline int check_stream(gpucontext *ctx, gpustream *s) {
+  if (s != NULL && ((partial_gpustream *)s)->ctx != ctx)
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "Stream belongs to a different context");
+  return GA_NO_ERROR;
+}
+
+#define GRAPH_KERNEL 0
+#define GRAPH_MOVE   1
+#define GRAPH_MEMSET 2
+
+typedef struct _graph_node {
+  int kind;
+  unsigned int n; /* grid dimensions */
+  gpukernel *k;
+  void **args; /* scalar arguments point to copies after the table */
+  gpudata *dst;
+  gpudata *src;
+  size_t dstoff;
+  size_t srcoff;
+  size_t sz;
+  size_t gs[3];
+  size_t ls[3];
+  size_t shared;
+  int data;
+} graph_node;
+
+struct _gpugraph {
+  gpucontext *ctx; /* Keep the context first */
+  graph_node *nodes;
+  size_t nnodes;
+  size_t anodes;
+  gpudata **bufs; /* every buffer the graph touches, referenced once */
+  size_t nbufs;
+  size_t abufs;
+  void *impl; /* backend replay data */
+  int err; /* first error while capturing */
+};
+
+int gpugraph_replay(gpugraph *g, gpustream *s);
+int gpugraph_add_kernel(gpugraph *g, gpukernel *k, unsigned int n,
+                        const size_t *gs, const size_t *ls, size_t shared,
+                        void **args);
+int gpugraph_add_move(gpugraph *g, gpudata *dst, size_t dstoff,
+                      gpudata *src, size_t srcoff, size_t sz);
+int gpugraph_add_memset(gpugraph *g, gpudata *dst, size_t dstoff, int data);
+
+/* For operations that run on the host or in vendor libraries */
+static inline int check_capture(gpucontext *ctx, const char *what) {
+  if (ctx->capture == NULL)
+    return GA_NO_ERROR;
+  ctx->capture->err = GA_UNSUPPORTED_ERROR;
+  return error_fmt(ctx->err, GA_UNSUPPORTED_ERROR,
+                   "%s can't be captured", what);
+}
+
+/* Tracing, only call these when ga_trace is set */
+extern int ga_trace;
+uint64_t trace_now(void);
+void trace_complete(const char *cat, const char *name, uint64_t start,
+                    const char *fmt, ...);
+void trace_device(const char *name, uint64_t start, uint64_t dur,
+                  const char *fmt, ...);
+void trace_env(void);
+/*
+ * Have gputrace_stop() call fn(arg) before it writes the trace, to
+ * emit device events that are still pending.  The registration is
+ * dropped after the call.
+ */
+int trace_add_flush(void (*fn)(void *), void *arg);
+void trace_del_flush(void (*fn)(void *), void *arg);
+
 int GpuArray_is_c_contiguous(const GpuArray *a);
 int GpuArray_is_f_contiguous(const GpuArray *a);
 int GpuArray_is_aligned(const GpuArray *a);
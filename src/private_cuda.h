@@ -16,15 +16,21 @@
 #define BUF_TAG "cudabuf "
 #define KER_TAG "cudakern"
 #define COMM_TAG "cudacomm"
+#define STREAM_TAG "cudastrm"
+#define EVENT_TAG "cudaevnt"
 
 #define TAG_CTX(c) memcpy((c)->tag, CTX_TAG, 8)
 #define TAG_BUF(b) memcpy((b)->tag, BUF_TAG, 8)
 #define TAG_KER(k) memcpy((k)->tag, KER_TAG, 8)
 #define TAG_COMM(co) memcpy((co)->tag, COMM_TAG, 8)
+#define TAG_STREAM(s) memcpy((s)->tag, STREAM_TAG, 8)
+#define TAG_EVENT(e) memcpy((e)->tag, EVENT_TAG, 8)
 #define ASSERT_CTX(c) assert(memcmp((c)->tag, CTX_TAG, 8) == 0)
 #define ASSERT_BUF(b) assert(memcmp((b)->tag, BUF_TAG, 8) == 0)
 #define ASSERT_KER(k) assert(memcmp((k)->tag, KER_TAG, 8) == 0)
 #define ASSERT_COMM(co) assert(memcmp((co)->tag, COMM_TAG, 8) == 0)
+#define ASSERT_STREAM(s) assert(memcmp((s)->tag, STREAM_TAG, 8) == 0)
+#define ASSERT_EVENT(e) assert(memcmp((e)->tag, EVENT_TAG, 8) == 0)
 #define CLEAR(o) memset((o)->tag, 0, 8);
 
 #else
@@ -32,10 +38,14 @@
 #define TAG_BUF(b)
 #define TAG_KER(k)
 #define TAG_COMM(k)
+#define TAG_STREAM(s)
+#define TAG_EVENT(e)
 #define ASSERT_CTX(c)
 #define ASSERT_BUF(b)
 #define ASSERT_KER(k)
 #define ASSERT_COMM(k)
+#define ASSERT_STREAM(s)
+#define ASSERT_EVENT(e)
 #define CLEAR(o)
 #endif
 
@@ -67,16 +77,50 @@ static inline int error_cuda(error *e, const char *msg, CUresult err) {
     }                                           \
   } while (0)
 
+/* Launches waiting for their device time while tracing */
+#define CUDA_TRACE_MAX 32
+
+typedef struct _cuda_trace {
+  CUevent start[CUDA_TRACE_MAX];
+  CUevent end[CUDA_TRACE_MAX];
+  void *k[CUDA_TRACE_MAX];
+  CUevent base; /* device times are measured from this event */
+  uint64_t base_ts; /* host time of base */
+  unsigned int first;
+  unsigned int n;
+} cuda_trace;
+
+/* Page-locked host blocks are cached by power of two size class,
+   from 4k up to 2G.  Bigger blocks are not cached. */
+#define CUDA_HOST_MIN_CLASS 12
+#define CUDA_HOST_CLASSES 20
+/* Maximum amount of page-locked memory kept around for reuse */
+#define CUDA_HOST_CACHE_MAX (256 * 1024 * 1024)
+
+typedef struct _cuda_hostpool {
+  void *free[CUDA_HOST_CLASSES]; /* linked through their first word */
+  size_t cache_size;
+} cuda_hostpool;
+
+typedef struct _cuda_pool {
+  struct _cuda_pool *next;
+  CUstream s; /* stream the blocks were last used on */
+  gpudata *freeblocks;
+} cuda_pool;
+
 typedef struct _cuda_context {
   GPUCONTEXT_HEAD;
   CUcontext ctx;
   CUstream s;
   CUstream mem_s;
-  gpudata *freeblocks;
+  cuda_pool *pools; /* the first one is for s */
+  size_t seq; /* counts event records */
   size_t cache_size;
   size_t max_cache_size;
   cache *kernel_cache;
   cache *disk_cache; // This is per-context to avoid lock contention
+  cuda_trace *trace;
+  cuda_hostpool *host;
   unsigned int enter;
   unsigned char major;
   unsigned char minor;
@@ -100,15 +144,54 @@ STATIC_ASSERT(sizeof(cuda_context) <= sizeof(gpucontext),
  * will be merged with their neighbours, but not across original
  * allocation lines (which are kept track of with the CUDA_HEAD_ALLOC
  * flag.
+ *
+ * There is one list per stream, in a cuda_pool, and a freed block
+ * goes in the pool of the last stream that used it.  All the pending
+ * work on the blocks of a pool is ordered before the tail of its
+ * stream, so merging them doesn't need any event waits (the merged
+ * block keeps the most recent of each event) and the pool of the
+ * context stream can be reused right away.  Blocks of other pools
+ * are only taken once a query of their events shows them idle, or as
+ * a last resort when a new allocation fails.  The pool of a stream
+ * is folded back in the main one when the stream is freed.
+ */
+
+/*
+ * About the host pool.
+ *
+ * Page-locked host memory is needed for transfers that don't block
+ * and for GA_BUFFER_HOST buffers, which the device accesses directly.
+ * Since cuMemHostAlloc() and cuMemFreeHost() are even slower than
+ * their device counterparts, freed blocks are kept in a free list per
+ * size class (rounded up to a power of two) instead of the
+ * address-ordered list used for device memory.  Blocks are never
+ * split or merged.
+ *
+ * Blocks handed out are usable from the device at the same address
+ * (this requires unified addressing, like the rest of the
+ * CUDA_MAPPED_PTR code).
  */
 
 #define ARCH_PREFIX "compute_"
 
 cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p);
 CUstream cuda_get_stream(cuda_context *ctx);
+int cuda_get_device(cuda_context *ctx);
 void cuda_enter(cuda_context *ctx);
 void cuda_exit(cuda_context *ctx);
 
+/*
+ * Read event of a buffer on a stream other than the one of its main
+ * read event.  Readers on different streams don't order each other,
+ * so the next writer has to wait for all of them.
+ */
+typedef struct _cuda_rev {
+  struct _cuda_rev *next;
+  CUstream s;
+  CUevent ev;
+  int pending; /* recorded since the last write */
+} cuda_rev;
+
 struct _gpudata {
   CUdeviceptr ptr;
   cuda_context *ctx;
@@ -117,9 +200,13 @@ struct _gpudata {
   CUevent rev;
   CUevent wev;
   CUstream ls; /* last stream used */
+  CUstream rs; /* stream of rev, NULL if the reads are covered by wev */
+  cuda_rev *xrev; /* reads on the other streams */
   unsigned int refcnt;
   int flags;
   size_t sz;
+  size_t rseq; /* value of ctx->seq when rev was recorded */
+  size_t wseq;
   gpudata *next;
 #ifdef DEBUG
   char tag[8];
@@ -127,9 +214,15 @@ struct _gpudata {
 };
 
 gpudata *cuda_make_buf(cuda_context *c, CUdeviceptr p, size_t sz);
+void *cuda_host_alloc(cuda_context *ctx, size_t sz);
+void cuda_host_free(cuda_context *ctx, void *p, size_t sz);
 size_t cuda_get_sz(gpudata *g);
 int cuda_wait(gpudata *, int);
 int cuda_record(gpudata *, int);
+int cuda_waits(gpudata *, int, CUstream);
+int cuda_records(gpudata *, int, CUstream);
+int cuda_handoff(gpudata *, CUstream);
+int cuda_takeover(gpudata *, CUstream);
 
 /* private flags are in the upper 16 bits */
 #define CUDA_WAIT_READ  0x10000
@@ -141,6 +234,7 @@ int cuda_record(gpudata *, int);
 #define CUDA_IPC_MEMORY 0x100000
 #define CUDA_HEAD_ALLOC 0x200000
 #define CUDA_MAPPED_PTR 0x400000
+#define CUDA_HOST_ALLOC 0x800000
 
 struct _gpukernel {
   cuda_context *ctx; /* Keep the context first */
@@ -150,6 +244,7 @@ struct _gpukernel {
   size_t bin_sz;
   void *bin;
   int *types;
+  int *access; /* CUDA_WAIT_* flags for each argument */
   unsigned int argcount;
   unsigned int refcnt;
 #ifdef DEBUG
@@ -157,6 +252,25 @@ struct _gpukernel {
 #endif
 };
 
+struct _gpustream {
+  cuda_context *ctx; /* Keep the context first */
+  CUstream s;
+#ifdef DEBUG
+  char tag[8];
+#endif
+};
+
+struct _gpuevent {
+  cuda_context *ctx; /* Keep the context first */
+  CUevent ev;
+#ifdef DEBUG
+  char tag[8];
+#endif
+};
+
+/* Stream to use for an operation (NULL means the default one) */
+#define CUDA_STREAM(ctx, st) ((st) ? (st)->s : (ctx)->s)
+
 int get_cc(CUdevice dev, int *maj, int *min, error *e);
 
 #endif
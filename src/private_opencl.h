@@ -12,22 +12,32 @@
 #define CTX_TAG "ocl ctx "
 #define BUF_TAG "ocl buf "
 #define KER_TAG "ocl kern"
+#define STREAM_TAG "ocl strm"
+#define EVENT_TAG "ocl evnt"
 
 #define TAG_CTX(c) memcpy((c)->tag, CTX_TAG, 8)
 #define TAG_BUF(b) memcpy((b)->tag, BUF_TAG, 8)
 #define TAG_KER(k) memcpy((k)->tag, KER_TAG, 8)
+#define TAG_STREAM(s) memcpy((s)->tag, STREAM_TAG, 8)
+#define TAG_EVENT(e) memcpy((e)->tag, EVENT_TAG, 8)
 #define ASSERT_CTX(c) assert(memcmp((c)->tag, CTX_TAG, 8) == 0)
 #define ASSERT_BUF(b) assert(memcmp((b)->tag, BUF_TAG, 8) == 0)
 #define ASSERT_KER(k) assert(memcmp((k)->tag, KER_TAG, 8) == 0)
+#define ASSERT_STREAM(s) assert(memcmp((s)->tag, STREAM_TAG, 8) == 0)
+#define ASSERT_EVENT(e) assert(memcmp((e)->tag, EVENT_TAG, 8) == 0)
 #define CLEAR(o) memset((o)->tag, 0, 8);
 
 #else
 #define TAG_CTX(c)
 #define TAG_BUF(b)
 #define TAG_KER(k)
+#define TAG_STREAM(s)
+#define TAG_EVENT(e)
 #define ASSERT_CTX(c)
 #define ASSERT_BUF(b)
 #define ASSERT_KER(k)
+#define ASSERT_STREAM(s)
+#define ASSERT_EVENT(e)
 #define CLEAR(o)
 #endif
 /** @endcond */
@@ -69,7 +79,9 @@ static inline int error_cl(error *e, const char *msg, cl_int err) {
 typedef struct _cl_ctx {
   GPUCONTEXT_HEAD;
   cl_context ctx;
+  cl_device_id dev; /* first device of ctx */
   cl_command_queue q;
+  cl_command_queue_properties qprop; /* properties of q */
   char *exts;
   char *options;
 } cl_ctx;
@@ -96,6 +108,7 @@ struct _gpukernel {
   cl_event ev;
   cl_event **evr;
   int *types;
+  char *ro; /* buffer arguments that are only read */
   unsigned int argcount;
   unsigned int refcnt;
   cl_uint num_ev;
@@ -104,6 +117,25 @@ struct _gpukernel {
 #endif
 };
 
+struct _gpustream {
+  cl_ctx *ctx; /* Keep the context first */
+  cl_command_queue q;
+#ifdef DEBUG
+  char tag[8];
+#endif
+};
+
+struct _gpuevent {
+  cl_ctx *ctx; /* Keep the context first */
+  cl_event ev; /* NULL until recorded */
+#ifdef DEBUG
+  char tag[8];
+#endif
+};
+
+/* Queue to use for an operation (NULL means the default one) */
+#define CL_QUEUE(ctx, st) ((st) ? (st)->q : (ctx)->q)
+
 cl_ctx *cl_make_ctx(cl_context ctx, gpucontext_props *p);
 cl_command_queue cl_get_stream(gpucontext *ctx);
 gpudata *cl_make_buf(gpucontext *c, cl_mem buf);
@@ -0,0 +1,370 @@
+/*
+ * Compare launch sizes picked by GpuKernel_sched() with the fixed
+ * 512 threads / 32 blocks per compute unit it used before, and
+ * measure the launch rate of tiny kernels, which is bound by the
+ * host work of each launch.  Also compare GpuElemwise_call_multi()
+ * with one GpuElemwise_call() per array on many small arrays, and the
+ * bandwidth of transposing copies with and without the tiled kernel.
+ *
+ * Usage: bench_kernel [reps]
+ * The device comes from GPUARRAY_TEST_DEVICE or DEVICE like the tests.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gpuarray/array.h"
+#include "gpuarray/elemwise.h"
+#include "gpuarray/error.h"
+#include "gpuarray/kernel.h"
+
+int get_env_dev(const char **name, gpucontext_props *p);
+
+static const char *src =
+  "KERNEL void axpb(GLOBAL_MEM float *c, GLOBAL_MEM const float *a,\n"
+  "                 GLOBAL_MEM const float *b, ga_size n) {\n"
+  "  ga_size i;\n"
+  "  for (i = LDIM_0 * GID_0 + LID_0; i < n; i += LDIM_0 * GDIM_0)\n"
+  "    c[i] = a[i] * 2.0f + b[i];\n"
+  "}\n"
+  "KERNEL void gather(GLOBAL_MEM float *r, GLOBAL_MEM const float *v,\n"
+  "                   GLOBAL_MEM const ga_long *ind, ga_size n) {\n"
+  "  ga_size i;\n"
+  "  for (i = LDIM_0 * GID_0 + LID_0; i < n; i += LDIM_0 * GDIM_0)\n"
+  "    r[i] = v[ind[i]];\n"
+  "}\n"
+  "KERNEL void tiny(GLOBAL_MEM float *r, GLOBAL_MEM const float *a,\n"
+  "                 GLOBAL_MEM const float *b, ga_size n) {\n"
+  "  if (LID_0 == 0 && n != 0) r[0] = a[0] + b[0];\n"
+  "}\n";
+
+#define CHECK(cmd) do {                                              \
+    int err_ = (cmd);                                                \
+    if (err_ != GA_NO_ERROR) {                                       \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__,             \
+              gpucontext_error(ctx, err_));                          \
+      exit(1);                                                       \
+    }                                                                \
+  } while (0)
+
+static gpucontext *ctx;
+
+/* Average time of a launch in microseconds */
+static double time_kernel(GpuKernel *k, size_t gs, size_t ls, void **args,
+                          unsigned int reps) {
+  gpuevent *start, *end;
+  unsigned int r;
+  double ms;
+
+  start = gpuevent_alloc(ctx, NULL);
+  end = gpuevent_alloc(ctx, NULL);
+  if (start == NULL || end == NULL) exit(1);
+  CHECK(GpuKernel_call(k, 1, &gs, &ls, 0, args));
+  CHECK(gpuevent_record(start, NULL));
+  for (r = 0; r < reps; r++)
+    CHECK(GpuKernel_call(k, 1, &gs, &ls, 0, args));
+  CHECK(gpuevent_record(end, NULL));
+  CHECK(gpuevent_sync(end));
+  CHECK(gpuevent_elapsed(start, end, &ms));
+  gpuevent_free(start);
+  gpuevent_free(end);
+  return ms * 1000.0 / reps;
+}
+
+static void compare(const char *name, GpuKernel *k, size_t n, void **args,
+                    unsigned int reps) {
+  size_t max_l, gs, ls, old_gs, old_ls;
+  unsigned int numprocs;
+
+  CHECK(gpukernel_property(k->k, GA_KERNEL_PROP_MAXLSIZE, &max_l));
+  CHECK(gpukernel_property(k->k, GA_CTX_PROP_NUMPROCS, &numprocs));
+  old_ls = max_l < 512 ? max_l : 512;
+  old_gs = (n + old_ls - 1) / old_ls;
+  if (old_gs > (size_t)numprocs * 32) old_gs = (size_t)numprocs * 32;
+  gs = ls = 0;
+  CHECK(GpuKernel_sched(k, n, &gs, &ls));
+  printf("%-8s %10llu %6llux%-5llu %10.2f %6llux%-5llu %10.2f\n", name,
+         (unsigned long long)n,
+         (unsigned long long)old_gs, (unsigned long long)old_ls,
+         time_kernel(k, old_gs, old_ls, args, reps),
+         (unsigned long long)gs, (unsigned long long)ls,
+         time_kernel(k, gs, ls, args, reps));
+}
+
+/* Launches per second of a one-thread kernel with two read-only inputs */
+static void launch_rate(GpuKernel *k, void **args, unsigned int reps) {
+  size_t one = 1;
+  double us;
+
+  reps *= 100;
+  us = time_kernel(k, one, one, args, reps);
+  printf("launches of a tiny kernel: %.0f/s (%u launches)\n",
+         1e6 / us, reps);
+}
+
+/* Average time of the library calls built on the scheduler */
+static void library(GpuArray *a, GpuArray *b, GpuArray *c, GpuArray *ind,
+                    size_t n, unsigned int reps) {
+  gpuelemwise_arg gargs[3];
+  GpuElemwise *ge;
+  gpuevent *start, *end;
+  void *args[3];
+  unsigned int r;
+  double ems, tms;
+
+  gargs[0].name = "c";
+  gargs[0].typecode = GA_FLOAT;
+  gargs[0].flags = GE_WRITE;
+  gargs[1].name = "a";
+  gargs[1].typecode = GA_FLOAT;
+  gargs[1].flags = GE_READ;
+  gargs[2].name = "b";
+  gargs[2].typecode = GA_FLOAT;
+  gargs[2].flags = GE_READ;
+  ge = GpuElemwise_new(ctx, "", "c = a * 2.0f + b", 3, gargs, 1, 0);
+  if (ge == NULL) exit(1);
+  args[0] = c;
+  args[1] = a;
+  args[2] = b;
+
+  start = gpuevent_alloc(ctx, NULL);
+  end = gpuevent_alloc(ctx, NULL);
+  if (start == NULL || end == NULL) exit(1);
+  CHECK(GpuElemwise_call(ge, args, 0));
+  CHECK(gpuevent_record(start, NULL));
+  for (r = 0; r < reps; r++)
+    CHECK(GpuElemwise_call(ge, args, 0));
+  CHECK(gpuevent_record(end, NULL));
+  CHECK(gpuevent_sync(end));
+  CHECK(gpuevent_elapsed(start, end, &ems));
+
+  CHECK(GpuArray_take1(c, a, ind, 0));
+  CHECK(gpuevent_record(start, NULL));
+  for (r = 0; r < reps; r++)
+    CHECK(GpuArray_take1(c, a, ind, 0));
+  CHECK(gpuevent_record(end, NULL));
+  CHECK(gpuevent_sync(end));
+  CHECK(gpuevent_elapsed(start, end, &tms));
+
+  printf("library  %10llu elemwise %10.2f take1 %10.2f\n",
+         (unsigned long long)n, ems * 1000.0 / reps, tms * 1000.0 / reps);
+  gpuevent_free(start);
+  gpuevent_free(end);
+  GpuElemwise_free(ge);
+}
+
+/*
+ * Bandwidth in GB/s of a transposing GpuArray_copy() of an n x n
+ * array, which uses the tiled kernel, against the same copy through
+ * the basic kernel.
+ */
+static void transpose(size_t n, unsigned int reps) {
+  size_t dims[2];
+  gpuelemwise_arg gargs[2];
+  GpuElemwise *ge;
+  GpuArray a, t, d;
+  gpuevent *start, *end;
+  void *args[2];
+  unsigned int r;
+  double tms, bms, gb;
+
+  dims[0] = dims[1] = n;
+  CHECK(GpuArray_empty(&a, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  CHECK(GpuArray_memset(&a, 0));
+  CHECK(GpuArray_view(&t, &a));
+  CHECK(GpuArray_transpose_inplace(&t, NULL));
+  CHECK(GpuArray_empty(&d, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+
+  gargs[0].name = "src";
+  gargs[0].typecode = GA_FLOAT;
+  gargs[0].flags = GE_READ;
+  gargs[1].name = "dst";
+  gargs[1].typecode = GA_FLOAT;
+  gargs[1].flags = GE_WRITE;
+  ge = GpuElemwise_new(ctx, "", "dst = src", 2, gargs, 2, 0);
+  if (ge == NULL) exit(1);
+  args[0] = &t;
+  args[1] = &d;
+
+  start = gpuevent_alloc(ctx, NULL);
+  end = gpuevent_alloc(ctx, NULL);
+  if (start == NULL || end == NULL) exit(1);
+
+  GpuArray_clear(&d);
+  CHECK(GpuArray_copy(&d, &t, GA_C_ORDER));
+  CHECK(gpuevent_record(start, NULL));
+  for (r = 0; r < reps; r++) {
+    GpuArray_clear(&d);
+    CHECK(GpuArray_copy(&d, &t, GA_C_ORDER));
+  }
+  CHECK(gpuevent_record(end, NULL));
+  CHECK(gpuevent_sync(end));
+  CHECK(gpuevent_elapsed(start, end, &tms));
+
+  CHECK(GpuElemwise_call(ge, args, GE_NOTILE));
+  CHECK(gpuevent_record(start, NULL));
+  for (r = 0; r < reps; r++)
+    CHECK(GpuElemwise_call(ge, args, GE_NOTILE));
+  CHECK(gpuevent_record(end, NULL));
+  CHECK(gpuevent_sync(end));
+  CHECK(gpuevent_elapsed(start, end, &bms));
+
+  /* Each element is read once and written once */
+  gb = 2.0 * n * n * sizeof(float) * reps / 1e9;
+  printf("transpose %5llux%-5llu tiled %8.1f GB/s basic %8.1f GB/s\n",
+         (unsigned long long)n, (unsigned long long)n,
+         gb / (tms / 1000.0), gb / (bms / 1000.0));
+  gpuevent_free(start);
+  gpuevent_free(end);
+  GpuElemwise_free(ge);
+  GpuArray_clear(&a);
+  GpuArray_clear(&t);
+  GpuArray_clear(&d);
+}
+
+#define MULTI_SETS 500
+
+/*
+ * Average time of an update of MULTI_SETS pairs of arrays of 1 to
+ * 100k elements, one call per pair against a single multi call.
+ */
+static void multi(unsigned int reps) {
+  gpuelemwise_arg gargs[2];
+  GpuElemwise *ge;
+  GpuArray *x, *y;
+  void *args[MULTI_SETS][2];
+  void **sets[MULTI_SETS];
+  gpuevent *start, *end;
+  size_t n, total = 0;
+  unsigned int i, r;
+  double cms, mms;
+
+  gargs[0].name = "y";
+  gargs[0].typecode = GA_FLOAT;
+  gargs[0].flags = GE_READ | GE_WRITE;
+  gargs[1].name = "x";
+  gargs[1].typecode = GA_FLOAT;
+  gargs[1].flags = GE_READ;
+  ge = GpuElemwise_new(ctx, "", "y = y * 0.5f + x", 2, gargs, 1, 0);
+  if (ge == NULL) exit(1);
+
+  x = calloc(MULTI_SETS, sizeof(*x));
+  y = calloc(MULTI_SETS, sizeof(*y));
+  if (x == NULL || y == NULL) exit(1);
+  for (i = 0; i < MULTI_SETS; i++) {
+    /* Spread the sizes over the range in a fixed order */
+    n = 1 + (i * (size_t)7919) % 100000;
+    total += n;
+    CHECK(GpuArray_empty(&x[i], ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+    CHECK(GpuArray_empty(&y[i], ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+    CHECK(GpuArray_memset(&x[i], 0));
+    CHECK(GpuArray_memset(&y[i], 0));
+    args[i][0] = &y[i];
+    args[i][1] = &x[i];
+    sets[i] = args[i];
+  }
+
+  start = gpuevent_alloc(ctx, NULL);
+  end = gpuevent_alloc(ctx, NULL);
+  if (start == NULL || end == NULL) exit(1);
+  for (i = 0; i < MULTI_SETS; i++)
+    CHECK(GpuElemwise_call(ge, sets[i], 0));
+  CHECK(gpuevent_record(start, NULL));
+  for (r = 0; r < reps; r++)
+    for (i = 0; i < MULTI_SETS; i++)
+      CHECK(GpuElemwise_call(ge, sets[i], 0));
+  CHECK(gpuevent_record(end, NULL));
+  CHECK(gpuevent_sync(end));
+  CHECK(gpuevent_elapsed(start, end, &cms));
+
+  CHECK(GpuElemwise_call_multi(ge, MULTI_SETS, sets, 0));
+  CHECK(gpuevent_record(start, NULL));
+  for (r = 0; r < reps; r++)
+    CHECK(GpuElemwise_call_multi(ge, MULTI_SETS, sets, 0));
+  CHECK(gpuevent_record(end, NULL));
+  CHECK(gpuevent_sync(end));
+  CHECK(gpuevent_elapsed(start, end, &mms));
+
+  printf("multi    %4u arrays %10llu call %10.2f multi %10.2f\n",
+         MULTI_SETS, (unsigned long long)total,
+         cms * 1000.0 / reps, mms * 1000.0 / reps);
+  gpuevent_free(start);
+  gpuevent_free(end);
+  for (i = 0; i < MULTI_SETS; i++) {
+    GpuArray_clear(&x[i]);
+    GpuArray_clear(&y[i]);
+  }
+  free(x);
+  free(y);
+  GpuElemwise_free(ge);
+}
+
+int main(int argc, char *argv[]) {
+  const int types[] = {GA_BUFFER, GA_BUFFER_RO, GA_BUFFER_RO, GA_SIZE};
+  const char *name = NULL;
+  gpucontext_props *p;
+  GpuKernel axpb, gather, tiny;
+  GpuArray a, b, c, ind;
+  int64_t *hind;
+  void *args[4];
+  size_t n, i;
+  unsigned int reps = argc > 1 ? (unsigned int)atoi(argv[1]) : 100;
+
+  if (reps == 0) reps = 1;
+  if (gpucontext_props_new(&p) != GA_NO_ERROR || get_env_dev(&name, p) != 0)
+    return 1;
+  if (gpucontext_init(&ctx, name, p) != GA_NO_ERROR)
+    return 1;
+
+  CHECK(GpuKernel_init(&axpb, ctx, 1, &src, NULL, "axpb", 4, types, 0,
+                       NULL));
+  CHECK(GpuKernel_init(&gather, ctx, 1, &src, NULL, "gather", 4, types, 0,
+                       NULL));
+  CHECK(GpuKernel_init(&tiny, ctx, 1, &src, NULL, "tiny", 4, types, 0,
+                       NULL));
+
+  printf("%-8s %10s %12s %10s %12s %10s\n", "kernel", "n",
+         "fixed gs*ls", "us", "sched gs*ls", "us");
+  for (n = (size_t)1 << 10; n <= (size_t)1 << 24; n <<= 2) {
+    CHECK(GpuArray_empty(&a, ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+    CHECK(GpuArray_empty(&b, ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+    CHECK(GpuArray_empty(&c, ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+    CHECK(GpuArray_memset(&a, 0));
+    CHECK(GpuArray_memset(&b, 0));
+    hind = malloc(n * sizeof(*hind));
+    if (hind == NULL) return 1;
+    /* A fixed permutation so the gather is not just a copy */
+    for (i = 0; i < n; i++)
+      hind[i] = (int64_t)((i * 7919) % n);
+    CHECK(GpuArray_empty(&ind, ctx, GA_LONG, 1, &n, GA_C_ORDER));
+    CHECK(GpuArray_write(&ind, hind, n * sizeof(*hind)));
+    free(hind);
+
+    args[0] = c.data;
+    args[1] = a.data;
+    args[2] = b.data;
+    args[3] = &n;
+    compare("axpb", &axpb, n, args, reps);
+    args[2] = ind.data;
+    compare("gather", &gather, n, args, reps);
+    library(&a, &b, &c, &ind, n, reps);
+    if (n == (size_t)1 << 10) {
+      args[2] = b.data;
+      launch_rate(&tiny, args, reps);
+    }
+
+    GpuArray_clear(&a);
+    GpuArray_clear(&b);
+    GpuArray_clear(&c);
+    GpuArray_clear(&ind);
+  }
+  multi(reps);
+  for (n = 1024; n <= 8192; n <<= 1)
+    transpose(n, reps);
+
+  GpuKernel_clear(&axpb);
+  GpuKernel_clear(&gather);
+  GpuKernel_clear(&tiny);
+  gpucontext_deref(ctx);
+  return 0;
+}
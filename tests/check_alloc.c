@@ -0,0 +1,101 @@
+#include <stdlib.h>
+
+#include <check.h>
+
+#include "gpuarray/array.h"
+#include "gpuarray/error.h"
+
+extern void *ctx;
+
+void setup(void);
+void teardown(void);
+
+#define ga_assert_ok(e) ck_assert_int_eq(e, GA_NO_ERROR)
+
+/*
+ * Count the heap allocations made by this thread while `counting` is
+ * set.  Other threads (like the ones of the driver) are not counted.
+ */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+static __thread int counting;
+static __thread unsigned long nallocs;
+
+void *malloc(size_t sz) {
+  if (counting) nallocs++;
+  return __libc_malloc(sz);
+}
+
+void *calloc(size_t n, size_t sz) {
+  if (counting) nallocs++;
+  return __libc_calloc(n, sz);
+}
+
+void *realloc(void *p, size_t sz) {
+  if (counting) nallocs++;
+  return __libc_realloc(p, sz);
+}
+
+#define ITERS 1000
+
+/*
+ * Slice, transpose and reshape views of `a` like indexing code does
+ * and return the number of allocations that took.
+ */
+static unsigned long slicing(GpuArray *a) {
+  const ssize_t starts[3] = {1, 0, 0};
+  const ssize_t stops[3] = {3, 6, 8};
+  const ssize_t steps[3] = {1, 2, 1};
+  const size_t flat[2] = {24, 8};
+  GpuArray v;
+  unsigned int i;
+
+  nallocs = 0;
+  counting = 1;
+  for (i = 0; i < ITERS; i++) {
+    ga_assert_ok(GpuArray_index(&v, a, starts, stops, steps));
+    ga_assert_ok(GpuArray_transpose_inplace(&v, NULL));
+    GpuArray_clear(&v);
+    ga_assert_ok(GpuArray_view(&v, a));
+    ga_assert_ok(GpuArray_reshape_inplace(&v, 2, flat, GA_C_ORDER));
+    GpuArray_clear(&v);
+  }
+  counting = 0;
+  return nallocs;
+}
+
+START_TEST(test_slicing_allocs) {
+  const size_t dims[3] = {4, 6, 8};
+  const size_t big[9] = {4, 6, 8, 1, 1, 1, 1, 1, 1};
+  GpuArray a;
+  GpuArray v;
+  unsigned int i;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_FLOAT, 3, dims, GA_C_ORDER));
+  /* Small shapes stay inside the structures */
+  ck_assert_int_eq(slicing(&a), 0);
+
+  /* Past GA_INLINE_ND each view costs its dimensions and strides */
+  ga_assert_ok(GpuArray_reshape_inplace(&a, 9, big, GA_C_ORDER));
+  nallocs = 0;
+  counting = 1;
+  for (i = 0; i < ITERS; i++) {
+    ga_assert_ok(GpuArray_view(&v, &a));
+    GpuArray_clear(&v);
+  }
+  counting = 0;
+  ck_assert_int_eq(nallocs, 2 * ITERS);
+  GpuArray_clear(&a);
+}
+END_TEST
+
+Suite *get_suite(void) {
+  Suite *s = suite_create("alloc");
+  TCase *tc = tcase_create("shape");
+  tcase_add_checked_fixture(tc, setup, teardown);
+  tcase_add_test(tc, test_slicing_allocs);
+  suite_add_tcase(s, tc);
+  return s;
+}
@@ -1,16 +1,21 @@
 #include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <check.h>
 
 #include "gpuarray/array.h"
 #include "gpuarray/error.h"
+#include "gpuarray/trace.h"
 #include "gpuarray/types.h"
 
 extern void *ctx;
 
 void setup(void);
 void teardown(void);
+int get_env_dev(const char **name, gpucontext_props *p);
 
 #define ga_assert_ok(e) ck_assert_int_eq(e, GA_NO_ERROR)
 
@@ -277,6 +282,237 @@ START_TEST(test_take1_offset) {
 }
 END_TEST
 
+START_TEST(test_scatter) {
+  const float vals[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+  const size_t adims[2] = {5, 2};
+  const size_t vdims[2] = {4, 2};
+  const size_t idims[1] = {4};
+  const size_t rdims[2] = {100, 2};
+  int64_t put_idx[4] = {3, 0, -1, 1};
+  int64_t add_idx[4] = {1, 3, 1, -4};
+  int64_t sorted_idx[4] = {1, 1, 1, 4};
+  int64_t run_idx[100];
+  float ones[200];
+  float buf[10];
+  float zero = 0.0f;
+  GpuArray a, v, i;
+  unsigned int j;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_FLOAT, 2, adims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&v, ctx, GA_FLOAT, 2, vdims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&v, vals, sizeof(vals)));
+  ga_assert_ok(GpuArray_empty(&i, ctx, GA_LONG, 1, idims, GA_C_ORDER));
+
+  /* a[[3, 0, -1, 1]] = v */
+  ga_assert_ok(GpuArray_fill(&a, &zero));
+  ga_assert_ok(GpuArray_write(&i, put_idx, sizeof(put_idx)));
+  ga_assert_ok(GpuArray_put1(&a, &v, &i, 1));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &a));
+  ck_assert(buf[6] == 1 && buf[7] == 2);
+  ck_assert(buf[0] == 3 && buf[1] == 4);
+  ck_assert(buf[8] == 5 && buf[9] == 6);
+  ck_assert(buf[2] == 7 && buf[3] == 8);
+  ck_assert(buf[4] == 0 && buf[5] == 0);
+
+  /* Repeated indices accumulate: 1 gets rows 0 and 2, 3 rows 1 and 3 */
+  ga_assert_ok(GpuArray_fill(&a, &zero));
+  ga_assert_ok(GpuArray_write(&i, add_idx, sizeof(add_idx)));
+  ga_assert_ok(GpuArray_scatter_add(&a, &v, &i, 1));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &a));
+  ck_assert(buf[2] == 6 && buf[3] == 8);
+  ck_assert(buf[6] == 10 && buf[7] == 12);
+  for (j = 0; j < 2; j++)
+    ck_assert(buf[j] == 0 && buf[4 + j] == 0 && buf[8 + j] == 0);
+
+  /* Grouped indices add on top of the previous values */
+  ga_assert_ok(GpuArray_write(&i, sorted_idx, sizeof(sorted_idx)));
+  ga_assert_ok(GpuArray_scatter_add_sorted(&a, &v, &i, 1));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &a));
+  ck_assert(buf[2] == 15 && buf[3] == 20);
+  ck_assert(buf[8] == 7 && buf[9] == 8);
+  ck_assert(buf[6] == 10 && buf[7] == 12);
+
+  put_idx[0] = 5;
+  ga_assert_ok(GpuArray_write(&i, put_idx, sizeof(put_idx)));
+  ck_assert_int_eq(GpuArray_put1(&a, &v, &i, 1), GA_VALUE_ERROR);
+  GpuArray_clear(&i);
+  GpuArray_clear(&v);
+
+  /* A run over several pieces, and -1 next to the index it wraps to */
+  run_idx[0] = 0;
+  for (j = 1; j < 98; j++)
+    run_idx[j] = 2;
+  run_idx[98] = -1;
+  run_idx[99] = 4;
+  for (j = 0; j < 200; j++)
+    ones[j] = 1.0f;
+  ga_assert_ok(GpuArray_empty(&v, ctx, GA_FLOAT, 2, rdims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&v, ones, sizeof(ones)));
+  ga_assert_ok(GpuArray_empty(&i, ctx, GA_LONG, 1, rdims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&i, run_idx, sizeof(run_idx)));
+  ga_assert_ok(GpuArray_fill(&a, &zero));
+  ga_assert_ok(GpuArray_scatter_add_sorted(&a, &v, &i, 1));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &a));
+  for (j = 0; j < 2; j++) {
+    ck_assert(buf[j] == 1);
+    ck_assert(buf[2 + j] == 0 && buf[6 + j] == 0);
+    ck_assert(buf[4 + j] == 97);
+    ck_assert(buf[8 + j] == 2);
+  }
+
+  GpuArray_clear(&i);
+  GpuArray_clear(&v);
+  GpuArray_clear(&a);
+}
+END_TEST
+
+#define NPIECES 20
+
+/* Width of piece i, zero for every fourth one */
+#define PIECE_W(i) ((i) % 4)
+
+START_TEST(test_concat_split) {
+  GpuArray pieces[NPIECES], outs[NPIECES];
+  const GpuArray *as[NPIECES];
+  GpuArray *rs[NPIECES];
+  GpuArray r, t, tr;
+  int32_t host[3 * 2 * NPIECES], buf[3 * 2 * NPIECES], pbuf[9];
+  size_t dims[2], p[NPIECES - 1];
+  size_t total = 0;
+  unsigned int i, j, k, col;
+
+  /* Piece i is 3 x PIECE_W(i) with values i*100 + row*10 + col */
+  for (i = 0; i < NPIECES; i++) {
+    dims[0] = 3;
+    dims[1] = PIECE_W(i);
+    for (j = 0; j < 3; j++)
+      for (k = 0; k < dims[1]; k++)
+        pbuf[j * dims[1] + k] = i * 100 + j * 10 + k;
+    ga_assert_ok(GpuArray_empty(&pieces[i], ctx, GA_INT, 2, dims,
+                                GA_C_ORDER));
+    if (dims[1] != 0)
+      ga_assert_ok(GpuArray_write(&pieces[i], pbuf,
+                                  3 * dims[1] * sizeof(int32_t)));
+    as[i] = &pieces[i];
+    total += dims[1];
+    if (i < NPIECES - 1)
+      p[i] = total;
+  }
+  for (j = 0; j < 3; j++) {
+    col = 0;
+    for (i = 0; i < NPIECES; i++)
+      for (k = 0; k < PIECE_W(i); k++)
+        host[j * total + col++] = i * 100 + j * 10 + k;
+  }
+
+  /* More pieces than one launch takes, some of them empty */
+  ga_assert_ok(GpuArray_concatenate(&r, as, NPIECES, 1, GA_INT));
+  ck_assert_int_eq(r.dimensions[0], 3);
+  ck_assert_int_eq(r.dimensions[1], total);
+  ga_assert_ok(GpuArray_read(buf, 3 * total * sizeof(int32_t), &r));
+  for (i = 0; i < 3 * total; i++)
+    ck_assert_int_eq(buf[i], host[i]);
+
+  /* And back */
+  for (i = 0; i < NPIECES; i++)
+    rs[i] = &outs[i];
+  ga_assert_ok(GpuArray_split_copy(rs, &r, NPIECES - 1, p, 1));
+  for (i = 0; i < NPIECES; i++) {
+    ck_assert(GpuArray_IS_C_CONTIGUOUS(&outs[i]));
+    ck_assert_int_eq(outs[i].dimensions[1], PIECE_W(i));
+    if (PIECE_W(i) == 0) continue;
+    ga_assert_ok(GpuArray_read(pbuf, 3 * PIECE_W(i) * sizeof(int32_t),
+                               &outs[i]));
+    for (j = 0; j < 3; j++)
+      for (k = 0; k < PIECE_W(i); k++)
+        ck_assert_int_eq(pbuf[j * PIECE_W(i) + k], i * 100 + j * 10 + k);
+  }
+  for (i = 0; i < NPIECES; i++)
+    GpuArray_clear(&outs[i]);
+  GpuArray_clear(&r);
+
+  /* A non-contiguous piece makes everything go through single copies */
+  dims[0] = PIECE_W(3);
+  dims[1] = 3;
+  ga_assert_ok(GpuArray_empty(&t, ctx, GA_INT, 2, dims, GA_C_ORDER));
+  for (j = 0; j < 3; j++)
+    for (k = 0; k < PIECE_W(3); k++)
+      pbuf[k * 3 + j] = 300 + j * 10 + k;
+  ga_assert_ok(GpuArray_write(&t, pbuf, 3 * PIECE_W(3) * sizeof(int32_t)));
+  ga_assert_ok(GpuArray_transpose(&tr, &t, NULL));
+  ck_assert(!GpuArray_IS_C_CONTIGUOUS(&tr));
+  as[3] = &tr;
+  ga_assert_ok(GpuArray_concatenate(&r, as, NPIECES, 1, GA_INT));
+  ga_assert_ok(GpuArray_read(buf, 3 * total * sizeof(int32_t), &r));
+  for (i = 0; i < 3 * total; i++)
+    ck_assert_int_eq(buf[i], host[i]);
+
+  /* Same for splitting a non-contiguous array */
+  GpuArray_clear(&t);
+  ga_assert_ok(GpuArray_transpose(&t, &r, NULL));
+  for (i = 0; i < NPIECES - 1; i++)
+    p[i] = i + 1;
+  ga_assert_ok(GpuArray_split_copy(rs, &t, 2, p, 0));
+  for (i = 0; i < 3; i++) {
+    ck_assert(GpuArray_IS_C_CONTIGUOUS(&outs[i]));
+    ck_assert_int_eq(outs[i].dimensions[0], i < 2 ? 1 : total - 2);
+    ga_assert_ok(GpuArray_read(pbuf, 3 * sizeof(int32_t), &outs[i]));
+    for (j = 0; j < 3; j++)
+      ck_assert_int_eq(pbuf[j], host[j * total + i]);
+    GpuArray_clear(&outs[i]);
+  }
+
+  GpuArray_clear(&t);
+  GpuArray_clear(&tr);
+  GpuArray_clear(&r);
+  for (i = 0; i < NPIECES; i++)
+    GpuArray_clear(&pieces[i]);
+}
+END_TEST
+
+START_TEST(test_split_copy_cleanup) {
+  const char *name = NULL;
+  const size_t mb = 1024 * 1024;
+  const size_t n = 6 * mb;
+  const size_t p[2] = {2 * mb, 4 * mb};
+  gpucontext_props *props;
+  gpucontext *c;
+  GpuArray a, b1, b2;
+  GpuArray outs[3];
+  GpuArray *rs[3];
+  unsigned int i;
+
+  ga_assert_ok(gpucontext_props_new(&props));
+  ck_assert_int_eq(get_env_dev(&name, props), 0);
+  /* Only CUDA enforces the limit of the allocation cache */
+  if (strcmp(name, "cuda") != 0) {
+    gpucontext_props_del(props);
+    return;
+  }
+  /* Room for the 24MB array and two of its three 8MB pieces */
+  ga_assert_ok(gpucontext_props_alloc_cache(props, 0, 44 * mb));
+  ga_assert_ok(gpucontext_init(&c, name, props));
+
+  ga_assert_ok(GpuArray_empty(&a, c, GA_FLOAT, 1, &n, GA_C_ORDER));
+  memset(outs, 0, sizeof(outs));
+  for (i = 0; i < 3; i++)
+    rs[i] = &outs[i];
+  ck_assert_int_ne(GpuArray_split_copy(rs, &a, 2, (size_t *)p, 0),
+                   GA_NO_ERROR);
+  /* The pieces that were made are cleared */
+  for (i = 0; i < 3; i++)
+    ck_assert(outs[i].data == NULL);
+  /* And their memory can be used again */
+  ga_assert_ok(GpuArray_empty(&b1, c, GA_FLOAT, 1, &p[0], GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&b2, c, GA_FLOAT, 1, &p[0], GA_C_ORDER));
+
+  GpuArray_clear(&b1);
+  GpuArray_clear(&b2);
+  GpuArray_clear(&a);
+  gpucontext_deref(c);
+}
+END_TEST
+
 START_TEST(test_reshape_0) {
   /* This tests that we don't segfault when reshaping 0-sized arrays */
   const size_t odims[3] = {24, 0, 33};
@@ -291,6 +527,279 @@ START_TEST(test_reshape_0) {
 }
 END_TEST
 
+START_TEST(test_inline_shape) {
+  const size_t dims[3] = {4, 6, 2};
+  const size_t big[10] = {2, 1, 3, 1, 4, 1, 2, 1, 1, 1};
+  const size_t small[2] = {12, 4};
+  const ssize_t starts[3] = {1, 0, 1};
+  const ssize_t stops[3] = {3, 6, -1};
+  const ssize_t steps[3] = {1, 2, 0};
+  GpuArray a;
+  GpuArray v;
+
+  /* Small arrays and their views keep their shape inline */
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_FLOAT, 3, dims, GA_C_ORDER));
+  ck_assert(a.dimensions == a.inline_dims && a.strides == a.inline_strides);
+  ga_assert_ok(GpuArray_index(&v, &a, starts, stops, steps));
+  ck_assert(v.dimensions == v.inline_dims && v.strides == v.inline_strides);
+  ck_assert_int_eq(v.nd, 2);
+  ck_assert_int_eq(v.dimensions[0], 2);
+  ck_assert_int_eq(v.dimensions[1], 3);
+  ck_assert_int_eq(v.strides[1], 2 * a.strides[1]);
+  ga_assert_ok(GpuArray_transpose_inplace(&v, NULL));
+  ck_assert(v.dimensions == v.inline_dims);
+  ck_assert_int_eq(v.dimensions[0], 3);
+  ck_assert_int_eq(v.strides[1], a.strides[0]);
+  GpuArray_clear(&v);
+
+  /* Bigger ones go to the heap and come back */
+  ga_assert_ok(GpuArray_reshape_inplace(&a, 10, big, GA_C_ORDER));
+  ck_assert(a.dimensions != a.inline_dims);
+  ck_assert_int_eq(a.dimensions[4], 4);
+  ga_assert_ok(GpuArray_view(&v, &a));
+  ck_assert_int_eq(v.strides[9], a.strides[9]);
+  GpuArray_clear(&v);
+  ga_assert_ok(GpuArray_reshape_inplace(&a, 2, small, GA_C_ORDER));
+  ck_assert(a.dimensions == a.inline_dims);
+  ck_assert_int_eq(a.dimensions[1], 4);
+  ck_assert_int_eq(a.strides[0], 4 * a.strides[1]);
+  GpuArray_clear(&a);
+}
+END_TEST
+
+START_TEST(test_move_rect) {
+  /* Column block of a 4x6 matrix, which is copied as 4 rows of 3 */
+  const uint32_t data[24] = { 0,  1,  2,  3,  4,  5,
+                              6,  7,  8,  9, 10, 11,
+                             12, 13, 14, 15, 16, 17,
+                             18, 19, 20, 21, 22, 23};
+  const size_t dims[2] = {4, 6};
+  const ssize_t starts[2] = {0, 2};
+  const ssize_t stops[2] = {4, 5};
+  const ssize_t steps[2] = {1, 1};
+  uint32_t buf[12];
+  GpuArray base;
+  GpuArray col;
+  GpuArray res;
+  unsigned int i;
+
+  ga_assert_ok(GpuArray_empty(&base, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&base, data, sizeof(data)));
+  ga_assert_ok(GpuArray_index(&col, &base, starts, stops, steps));
+  ck_assert(!GpuArray_ISONESEGMENT(&col));
+
+  ga_assert_ok(GpuArray_copy(&res, &col, GA_C_ORDER));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &res));
+  for (i = 0; i < 12; i++)
+    ck_assert_int_eq(buf[i], data[(i / 3) * 6 + 2 + i % 3]);
+
+  /* Strided read and write of the block itself */
+  memset(buf, 0, sizeof(buf));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &col));
+  for (i = 0; i < 12; i++)
+    ck_assert_int_eq(buf[i], data[(i / 3) * 6 + 2 + i % 3]);
+  for (i = 0; i < 12; i++)
+    buf[i] = 100 + i;
+  ga_assert_ok(GpuArray_write(&col, buf, sizeof(buf)));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &col));
+  for (i = 0; i < 12; i++)
+    ck_assert_int_eq(buf[i], 100 + i);
+
+  GpuArray_clear(&res);
+  GpuArray_clear(&col);
+  GpuArray_clear(&base);
+}
+END_TEST
+
+START_TEST(test_write_strided) {
+  /* Every other row of a 6x5 host matrix, columns reversed */
+  uint32_t host[30];
+  uint32_t buf[15];
+  const size_t dims[2] = {3, 5};
+  const ssize_t hstr[2] = {2 * 5 * sizeof(uint32_t), -(ssize_t)sizeof(uint32_t)};
+  GpuArray a;
+  unsigned int i;
+
+  for (i = 0; i < 30; i++)
+    host[i] = i;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write_strided(&a, &host[4], hstr));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &a));
+  for (i = 0; i < 15; i++)
+    ck_assert_int_eq(buf[i], (i / 5) * 10 + 4 - i % 5);
+
+  memset(host, 0, sizeof(host));
+  ga_assert_ok(GpuArray_read_strided(&host[4], hstr, &a));
+  for (i = 0; i < 30; i++) {
+    if ((i / 5) % 2 == 0)
+      ck_assert_int_eq(host[i], i);
+    else
+      ck_assert_int_eq(host[i], 0);
+  }
+
+  GpuArray_clear(&a);
+}
+END_TEST
+
+START_TEST(test_npy) {
+  uint32_t data[12];
+  uint32_t buf[12];
+  char hdr[128 + 8];
+  const size_t dims[2] = {3, 4};
+  GpuArray a, b;
+  FILE *f, *g;
+  unsigned int i;
+
+  for (i = 0; i < 12; i++)
+    data[i] = i;
+
+  f = tmpfile();
+  ck_assert(f != NULL);
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 2, dims, GA_F_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data, sizeof(data)));
+  ga_assert_ok(GpuArray_save_npy(f, &a));
+  /* The data starts on a 64 byte boundary */
+  ck_assert_int_eq(ftell(f) % 64, 0);
+  ck_assert_int_eq(ftell(f), 128 + sizeof(data));
+
+  rewind(f);
+  ga_assert_ok(GpuArray_load_npy(&b, ctx, f));
+  ck_assert_int_eq(b.nd, 2);
+  ck_assert_int_eq(b.dimensions[0], 3);
+  ck_assert(GpuArray_IS_F_CONTIGUOUS(&b));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &b));
+  for (i = 0; i < 12; i++)
+    ck_assert_int_eq(buf[i], i);
+  GpuArray_clear(&b);
+
+  /* Into a C-ordered array of the same shape */
+  rewind(f);
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_load_npy_into(&b, f));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &b));
+  for (i = 0; i < 12; i++)
+    ck_assert_int_eq(buf[i], (i % 4) * 3 + i / 4);
+  GpuArray_clear(&b);
+
+  /* Truncated data */
+  rewind(f);
+  g = tmpfile();
+  ck_assert(g != NULL);
+  ck_assert_int_eq(fread(hdr, 1, sizeof(hdr), f), sizeof(hdr));
+  ck_assert_int_eq(fwrite(hdr, 1, sizeof(hdr), g), sizeof(hdr));
+  rewind(g);
+  ck_assert_int_eq(GpuArray_load_npy(&b, ctx, g), GA_VALUE_ERROR);
+
+  fclose(g);
+  fclose(f);
+  GpuArray_clear(&a);
+}
+END_TEST
+
+START_TEST(test_fill) {
+  const size_t dims[2] = {5, 4};
+  const ssize_t starts[2] = {0, 1};
+  const ssize_t stops[2] = {5, 4};
+  const ssize_t steps[2] = {2, 2};
+  float fbuf[20];
+  double cbuf[6];
+  float fv = 1.5f;
+  double cv[2] = {2.0, -3.0};
+  int32_t start = 7, step = -2;
+  int32_t ibuf[6];
+  size_t n = 3;
+  GpuArray a, v;
+  unsigned int i;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_fill(&a, &fv));
+  ga_assert_ok(GpuArray_read(fbuf, sizeof(fbuf), &a));
+  for (i = 0; i < 20; i++)
+    ck_assert(fbuf[i] == 1.5f);
+
+  /* Strided views go through the kernel */
+  fv = -4.0f;
+  ga_assert_ok(GpuArray_index(&v, &a, starts, stops, steps));
+  ga_assert_ok(GpuArray_fill(&v, &fv));
+  GpuArray_clear(&v);
+  ga_assert_ok(GpuArray_read(fbuf, sizeof(fbuf), &a));
+  for (i = 0; i < 20; i++) {
+    if ((i / 4) % 2 == 0 && (i % 4) % 2 == 1)
+      ck_assert(fbuf[i] == -4.0f);
+    else
+      ck_assert(fbuf[i] == 1.5f);
+  }
+  GpuArray_clear(&a);
+
+  /* Patterns wider than 64 bits */
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_CDOUBLE, 1, &n, GA_C_ORDER));
+  ga_assert_ok(GpuArray_fill(&a, cv));
+  ga_assert_ok(GpuArray_read(cbuf, sizeof(cbuf), &a));
+  for (i = 0; i < 3; i++) {
+    ck_assert(cbuf[2 * i] == 2.0);
+    ck_assert(cbuf[2 * i + 1] == -3.0);
+  }
+  GpuArray_clear(&a);
+
+  ga_assert_ok(GpuArray_arange(&a, ctx, GA_INT, &start, &step, 6));
+  ck_assert_int_eq(a.dimensions[0], 6);
+  ga_assert_ok(GpuArray_read(ibuf, sizeof(ibuf), &a));
+  for (i = 0; i < 6; i++)
+    ck_assert_int_eq(ibuf[i], 7 - 2 * (int)i);
+  GpuArray_clear(&a);
+
+  ga_assert_ok(GpuArray_linspace(&a, ctx, GA_DOUBLE, 0.0, 1.0, 6, 1));
+  ga_assert_ok(GpuArray_read(cbuf, sizeof(cbuf), &a));
+  for (i = 0; i < 5; i++)
+    ck_assert(cbuf[i] > i * 0.2 - 1e-12 && cbuf[i] < i * 0.2 + 1e-12);
+  ck_assert(cbuf[5] == 1.0);
+  GpuArray_clear(&a);
+
+  ck_assert_int_eq(GpuArray_arange(&a, ctx, GA_CFLOAT, &start, &step, 6),
+                   GA_VALUE_ERROR);
+  ck_assert_int_eq(GpuArray_linspace(&a, ctx, GA_LONGLONG, 0.0, 1.0, 6, 1),
+                   GA_VALUE_ERROR);
+}
+END_TEST
+
+START_TEST(test_trace_device) {
+  char path[] = "/tmp/gputraceXXXXXX";
+  char buf[512];
+  const char *name = NULL;
+  gpucontext_props *p;
+  int32_t start = 0, step = 1;
+  GpuArray a;
+  FILE *f;
+  int fd, found = 0;
+
+  ga_assert_ok(gpucontext_props_new(&p));
+  ck_assert_int_eq(get_env_dev(&name, p), 0);
+  gpucontext_props_del(p);
+
+  fd = mkstemp(path);
+  ck_assert_int_ne(fd, -1);
+  close(fd);
+
+  ga_assert_ok(gputrace_start(path));
+  ga_assert_ok(GpuArray_arange(&a, ctx, GA_INT, &start, &step, 1000));
+  /* The launch may still be running, stopping must wait for it */
+  ga_assert_ok(gputrace_stop());
+  GpuArray_clear(&a);
+
+  f = fopen(path, "r");
+  ck_assert_ptr_ne(f, NULL);
+  while (fgets(buf, sizeof(buf), f) != NULL)
+    if (strstr(buf, "\"cat\":\"device\"") != NULL &&
+        strstr(buf, "\"kernel\":") != NULL)
+      found = 1;
+  fclose(f);
+  unlink(path);
+  /* Only CUDA measures device time */
+  ck_assert_int_eq(found, strcmp(name, "cuda") == 0);
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("array");
   TCase *tc = tcase_create("take1");
@@ -298,7 +807,16 @@ Suite *get_suite(void) {
   tcase_set_timeout(tc, 8.0);
   tcase_add_test(tc, test_take1_ok);
   tcase_add_test(tc, test_take1_offset);
+  tcase_add_test(tc, test_scatter);
+  tcase_add_test(tc, test_concat_split);
+  tcase_add_test(tc, test_split_copy_cleanup);
   tcase_add_test(tc, test_reshape_0);
+  tcase_add_test(tc, test_inline_shape);
+  tcase_add_test(tc, test_move_rect);
+  tcase_add_test(tc, test_write_strided);
+  tcase_add_test(tc, test_npy);
+  tcase_add_test(tc, test_fill);
+  tcase_add_test(tc, test_trace_device);
   suite_add_tcase(s, tc);
   return s;
 }
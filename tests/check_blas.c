@@ -111,6 +111,41 @@ START_TEST(test_gemmBatch_3d_S) {
 }
 END_TEST
 
+START_TEST(test_gemm_capture) {
+  GpuArray A;
+  GpuArray B;
+  GpuArray C;
+  gpugraph *g;
+  int err;
+
+  size_t dims[2] = {3, 3};
+  float data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  const float res[] = {30, 36, 42, 66, 81, 96, 102, 126, 150};
+
+  ga_assert_ok(GpuArray_empty(&A, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&B, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&C, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+
+  ga_assert_ok(GpuArray_write(&A, data, sizeof(data)));
+  ga_assert_ok(GpuArray_write(&B, data, sizeof(data)));
+
+  /* Library calls can't be recorded, they fail and drop the capture */
+  ga_assert_ok(gpucontext_capture_begin(GpuArray_context(&A)));
+  ck_assert_int_eq(GpuArray_rgemm(cb_no_trans, cb_no_trans, 1, &A, &B, 0, &C, 1),
+                   GA_UNSUPPORTED_ERROR);
+  g = gpucontext_capture_end(GpuArray_context(&A), &err);
+  ck_assert(g == NULL);
+  ck_assert_int_eq(err, GA_UNSUPPORTED_ERROR);
+
+  /* They work again once the capture is over */
+  ga_assert_ok(GpuArray_rgemm(cb_no_trans, cb_no_trans, 1, &A, &B, 0, &C, 1));
+
+  ga_assert_ok(GpuArray_read(data, sizeof(data), &C));
+
+  ck_assert_fbuf_eq(data, res, sizeof(res)/sizeof(float));
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("blas");
   TCase *tc = tcase_create("all");
@@ -119,6 +154,7 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_gemmBatch_3d_C);
   tcase_add_test(tc, test_gemmBatch_3d_F);
   tcase_add_test(tc, test_gemmBatch_3d_S);
+  tcase_add_test(tc, test_gemm_capture);
   suite_add_tcase(s, tc);
   return s;
 }
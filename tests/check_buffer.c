@@ -1,14 +1,20 @@
+#include <stdio.h>
+#include <string.h>
+
 #include <check.h>
 
 #include "gpuarray/buffer.h"
 #include "gpuarray/error.h"
+#include "gpuarray/kernel.h"
 
 #include "private.h"
+#include "private_cuda.h"
 
 extern void *ctx;
 
 void setup(void);
 void teardown(void);
+int get_env_dev(const char **name, gpucontext_props *p);
 
 static unsigned int refcnt(gpudata *b) {
   unsigned int res;
@@ -176,6 +182,718 @@ START_TEST(test_buffer_move) {
 }
 END_TEST
 
+START_TEST(test_buffer_stream) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  int32_t buf[nelems(data)];
+  gpustream *s1;
+  gpustream *s2;
+  gpudata *d;
+  gpudata *d2;
+  int err;
+  unsigned int i;
+
+  /* Without a stream there is no context to report on */
+  err = gpustream_wait(NULL, NULL);
+  ck_assert_int_eq(err, GA_VALUE_ERROR);
+  ck_assert_str_eq(gpucontext_error(NULL, err),
+                   "At least one stream must be given");
+
+  s1 = gpustream_alloc(ctx, &err);
+  if (s1 == NULL) {
+    /* single stream contexts can't have extra streams */
+    ck_assert_int_eq(err, GA_UNSUPPORTED_ERROR);
+    return;
+  }
+  ck_assert(gpustream_context(s1) == ctx);
+  s2 = gpustream_alloc(ctx, NULL);
+  ck_assert(s2 != NULL);
+
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+  d2 = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d2 != NULL);
+
+  err = gpudata_write_s(d, 0, data, sizeof(data), s1);
+  ck_assert(err == GA_NO_ERROR);
+
+  /* The buffers order the move after the write on the other stream */
+  err = gpudata_move_s(d2, 0, d, 0, sizeof(data), s2);
+  ck_assert(err == GA_NO_ERROR);
+
+  err = gpustream_wait(NULL, s2);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpustream_sync(s2);
+  ck_assert(err == GA_NO_ERROR);
+
+  err = gpudata_read_s(buf, d2, 0, sizeof(data), s1);
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++) {
+    ck_assert_int_eq(buf[i], data[i]);
+  }
+
+  gpudata_release(d);
+  gpudata_release(d2);
+  gpustream_free(s1);
+  gpustream_free(s2);
+}
+END_TEST
+
+static const char *spin_src =
+  "KERNEL void spin(GLOBAL_MEM float *r, ga_size n) {\n"
+  "  ga_size i;\n"
+  "  float v = r[0];\n"
+  "  for (i = 0; i < n; i++) v = v * 0.999f + 1.0f;\n"
+  "  r[0] = v;\n"
+  "}\n";
+
+START_TEST(test_buffer_stream_reuse) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  const int types[] = {GA_BUFFER, GA_SIZE};
+  int32_t buf[nelems(data)];
+  const char *name = NULL;
+  gpucontext_props *p;
+  gpustream *s1;
+  gpuevent *e;
+  gpudata *d;
+  GpuKernel k;
+  CUdeviceptr ptr;
+  size_t n = (size_t)1 << 24;
+  size_t one = 1;
+  void *args[2];
+  int err, done;
+  unsigned int i;
+
+  s1 = gpustream_alloc(ctx, &err);
+  if (s1 == NULL) {
+    ck_assert_int_eq(err, GA_UNSUPPORTED_ERROR);
+    return;
+  }
+
+  /* Blocks freed after use on a stream can be handed out again */
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+  ck_assert_int_eq(gpudata_write_s(d, 0, data, sizeof(data), s1),
+                   GA_NO_ERROR);
+  gpudata_release(d);
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+  ck_assert_int_eq(gpudata_write_s(d, 0, data, sizeof(data), s1),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(gpudata_read(buf, d, 0, sizeof(buf)), GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++)
+    ck_assert_int_eq(buf[i], data[i]);
+  gpudata_release(d);
+
+  /* And so are the ones left behind by a freed stream */
+  gpustream_free(s1);
+  d = gpudata_alloc(ctx, sizeof(data), (void *)data, GA_BUFFER_INIT, NULL);
+  ck_assert(d != NULL);
+  ck_assert_int_eq(gpudata_read(buf, d, 0, sizeof(buf)), GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++)
+    ck_assert_int_eq(buf[i], data[i]);
+  gpudata_release(d);
+
+  /* The pools are only in the CUDA backend */
+  ck_assert_int_eq(gpucontext_props_new(&p), GA_NO_ERROR);
+  ck_assert_int_eq(get_env_dev(&name, p), 0);
+  gpucontext_props_del(p);
+  if (strcmp(name, "cuda") != 0 ||
+      ((cuda_context *)ctx)->max_cache_size == 0)
+    return;
+
+  /* A block freed on the context stream comes back as is */
+  d = gpudata_alloc(ctx, sizeof(data), (void *)data, GA_BUFFER_INIT, NULL);
+  ck_assert(d != NULL);
+  ptr = d->ptr;
+  gpudata_release(d);
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+  ck_assert(d->ptr == ptr);
+
+  /* But not while it is busy on another stream */
+  s1 = gpustream_alloc(ctx, &err);
+  ck_assert(s1 != NULL);
+  e = gpuevent_alloc(ctx, &err);
+  ck_assert(e != NULL);
+  ck_assert_int_eq(GpuKernel_init(&k, ctx, 1, &spin_src, NULL, "spin", 2,
+                                  types, 0, NULL), GA_NO_ERROR);
+  args[0] = d;
+  args[1] = &n;
+  ck_assert_int_eq(GpuKernel_call_s(&k, 1, &one, &one, 0, args, s1),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(gpuevent_record(e, s1), GA_NO_ERROR);
+  gpudata_release(d);
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+  ck_assert_int_eq(gpuevent_query(e, &done), GA_NO_ERROR);
+  /* Only meaningful if the kernel outlived the allocation */
+  if (!done)
+    ck_assert(d->ptr != ptr);
+  gpudata_release(d);
+
+  ck_assert_int_eq(gpuevent_sync(e), GA_NO_ERROR);
+  gpuevent_free(e);
+  GpuKernel_clear(&k);
+  gpustream_free(s1);
+}
+END_TEST
+
+START_TEST(test_buffer_stream_readers) {
+  const size_t n = 4 * 1024 * 1024;
+  int32_t *data, *buf;
+  gpustream *s1;
+  gpustream *s2;
+  gpudata *d, *a, *b;
+  int err;
+  size_t i;
+
+  s1 = gpustream_alloc(ctx, &err);
+  if (s1 == NULL) {
+    ck_assert_int_eq(err, GA_UNSUPPORTED_ERROR);
+    return;
+  }
+  s2 = gpustream_alloc(ctx, NULL);
+  ck_assert(s2 != NULL);
+
+  data = malloc(n * sizeof(int32_t));
+  buf = malloc(n * sizeof(int32_t));
+  ck_assert(data != NULL && buf != NULL);
+  for (i = 0; i < n; i++)
+    data[i] = (int32_t)i;
+
+  d = gpudata_alloc(ctx, n * sizeof(int32_t), data, GA_BUFFER_INIT, NULL);
+  ck_assert(d != NULL);
+  a = gpudata_alloc(ctx, n * sizeof(int32_t), NULL, 0, NULL);
+  ck_assert(a != NULL);
+  b = gpudata_alloc(ctx, n * sizeof(int32_t), NULL, 0, NULL);
+  ck_assert(b != NULL);
+
+  /* Two readers on different streams, then a writer on the stream
+     of the second one.  The write must also wait for the first
+     reader. */
+  ck_assert_int_eq(gpudata_move_s(a, 0, d, 0, n * sizeof(int32_t), s1),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(gpudata_move_s(b, 0, d, 0, n * sizeof(int32_t), s2),
+                   GA_NO_ERROR);
+  memset(buf, 0, n * sizeof(int32_t));
+  ck_assert_int_eq(gpudata_write_s(d, 0, buf, n * sizeof(int32_t), s2),
+                   GA_NO_ERROR);
+
+  ck_assert_int_eq(gpudata_read(buf, a, 0, n * sizeof(int32_t)),
+                   GA_NO_ERROR);
+  for (i = 0; i < n; i++)
+    ck_assert_int_eq(buf[i], data[i]);
+  ck_assert_int_eq(gpudata_read(buf, b, 0, n * sizeof(int32_t)),
+                   GA_NO_ERROR);
+  for (i = 0; i < n; i++)
+    ck_assert_int_eq(buf[i], data[i]);
+  ck_assert_int_eq(gpudata_read(buf, d, 0, n * sizeof(int32_t)),
+                   GA_NO_ERROR);
+  for (i = 0; i < n; i++)
+    ck_assert_int_eq(buf[i], 0);
+
+  gpudata_release(d);
+  gpudata_release(a);
+  gpudata_release(b);
+  gpustream_free(s1);
+  gpustream_free(s2);
+  free(data);
+  free(buf);
+}
+END_TEST
+
+START_TEST(test_buffer_graph) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  const int32_t data2[] = {8, 9, 10, 11, 12, 13, 14, 15};
+  int32_t buf[nelems(data)];
+  gpugraph *g;
+  gpudata *d;
+  gpudata *d2;
+  gpudata *d3;
+  int err;
+  unsigned int i;
+
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+  d2 = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d2 != NULL);
+  d3 = gpudata_alloc(ctx, sizeof(data2), NULL, 0, NULL);
+  ck_assert(d3 != NULL);
+
+  err = gpudata_write(d, 0, data, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_write(d3, 0, data2, sizeof(data2));
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_memset(d2, 0, 0);
+  ck_assert(err == GA_NO_ERROR);
+
+  err = gpucontext_capture_begin(ctx);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_move(d2, 0, d, 0, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  g = gpucontext_capture_end(ctx, &err);
+  ck_assert(g != NULL);
+
+  /* Nothing ran yet */
+  err = gpudata_read(buf, d2, 0, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++) {
+    ck_assert_int_eq(buf[i], 0);
+  }
+
+  err = gpugraph_launch(g, NULL);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_read(buf, d2, 0, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++) {
+    ck_assert_int_eq(buf[i], data[i]);
+  }
+
+  err = gpugraph_update(g, d, d3);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpugraph_launch(g, NULL);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_read(buf, d2, 0, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++) {
+    ck_assert_int_eq(buf[i], data2[i]);
+  }
+  gpugraph_free(g);
+
+  /* Host operations make the capture fail */
+  err = gpucontext_capture_begin(ctx);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_read(buf, d2, 0, sizeof(data));
+  ck_assert_int_eq(err, GA_UNSUPPORTED_ERROR);
+  g = gpucontext_capture_end(ctx, &err);
+  ck_assert(g == NULL);
+  ck_assert_int_eq(err, GA_UNSUPPORTED_ERROR);
+
+  gpudata_release(d);
+  gpudata_release(d2);
+  gpudata_release(d3);
+}
+END_TEST
+
+START_TEST(test_buffer_event) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  int32_t res[8];
+  gpuevent *e1;
+  gpuevent *e2;
+  gpuevent *e3;
+  gpudata *d;
+  unsigned int i;
+  double ms;
+  int done;
+  int err;
+
+  e1 = gpuevent_alloc(ctx, &err);
+  ck_assert(e1 != NULL);
+  ck_assert(gpuevent_context(e1) == ctx);
+  e2 = gpuevent_alloc(ctx, NULL);
+  ck_assert(e2 != NULL);
+
+  /* Events that were never recorded are done */
+  err = gpuevent_sync(e1);
+  ck_assert(err == GA_NO_ERROR);
+
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+
+  err = gpuevent_record(e1, NULL);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_write(d, 0, data, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_memset(d, 0, 0);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpuevent_record(e2, NULL);
+  ck_assert(err == GA_NO_ERROR);
+
+  err = gpuevent_sync(e2);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpuevent_query(e2, &done);
+  ck_assert(err == GA_NO_ERROR);
+  ck_assert_int_eq(done, 1);
+
+  err = gpuevent_elapsed(e1, e2, &ms);
+  if (err != GA_DEVSUP_ERROR) {
+    ck_assert(err == GA_NO_ERROR);
+    ck_assert(ms >= 0.0);
+  }
+
+  /* Events on the default stream come after transfers too */
+  e3 = gpuevent_alloc(ctx, NULL);
+  ck_assert(e3 != NULL);
+  err = gpudata_read_async(res, d, 0, sizeof(res), NULL, e3);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpuevent_record(e2, NULL);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpuevent_sync(e2);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpuevent_query(e3, &done);
+  ck_assert(err == GA_NO_ERROR);
+  ck_assert_int_eq(done, 1);
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(res[i], 0);
+
+  gpudata_release(d);
+  gpuevent_free(e1);
+  gpuevent_free(e2);
+  gpuevent_free(e3);
+}
+END_TEST
+
+START_TEST(test_buffer_async) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  int32_t res[8];
+  gpuevent *e;
+  gpudata *d;
+  unsigned int i;
+  int err;
+
+  e = gpuevent_alloc(ctx, NULL);
+  ck_assert(e != NULL);
+  d = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d != NULL);
+
+  err = gpudata_write_async(d, 0, data, sizeof(data), NULL, NULL);
+  ck_assert(err == GA_VALUE_ERROR);
+
+  err = gpudata_write_async(d, 0, data, sizeof(data), NULL, e);
+  ck_assert(err == GA_NO_ERROR);
+  memset(res, 0, sizeof(res));
+  err = gpudata_read_async(res, d, 0, sizeof(res), NULL, e);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpuevent_sync(e);
+  ck_assert(err == GA_NO_ERROR);
+
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(res[i], data[i]);
+
+  gpudata_release(d);
+  gpuevent_free(e);
+}
+END_TEST
+
+START_TEST(test_buffer_host) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  int32_t res[8];
+  int32_t *p;
+  gpudata *d, *d2;
+  unsigned int i;
+  int err;
+
+  d = gpudata_alloc(ctx, sizeof(data), NULL, GA_BUFFER_HOST, &err);
+  ck_assert(d != NULL);
+  err = gpudata_property(d, GA_BUFFER_PROP_HOSTPOINTER, &p);
+  if (err == GA_DEVSUP_ERROR) {
+    gpudata_release(d);
+    return;
+  }
+  ck_assert(err == GA_NO_ERROR);
+
+  memcpy(p, data, sizeof(data));
+  err = gpudata_read(res, d, 0, sizeof(res));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(res[i], data[i]);
+
+  err = gpudata_memset(d, 0, 0);
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_sync(d);
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(p[i], 0);
+
+  /* A plain write is done with its page-locked source on return */
+  d2 = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d2 != NULL);
+  memcpy(p, data, sizeof(data));
+  err = gpudata_write(d2, 0, p, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  memset(p, 0, sizeof(data));
+  err = gpudata_read(res, d2, 0, sizeof(res));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(res[i], data[i]);
+  gpudata_release(d2);
+  gpudata_release(d);
+
+  /* This one should come from the pool */
+  d = gpudata_alloc(ctx, sizeof(data), (void *)data,
+                    GA_BUFFER_HOST|GA_BUFFER_INIT, &err);
+  ck_assert(d != NULL);
+  err = gpudata_read(res, d, 0, sizeof(res));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(res[i], data[i]);
+  gpudata_release(d);
+}
+END_TEST
+
+START_TEST(test_buffer_transfer) {
+  int32_t data[100];
+  int32_t res[100];
+  const char *name = NULL;
+  gpucontext_props *p;
+  gpucontext *ctx2;
+  gpudata *d1, *d2;
+  unsigned int i;
+  int err;
+
+  for (i = 0; i < 100; i++)
+    data[i] = i;
+
+  ck_assert_int_eq(gpucontext_props_new(&p), GA_NO_ERROR);
+  ck_assert_int_eq(get_env_dev(&name, p), 0);
+  /* Small chunks to go through the staging buffers many times */
+  ck_assert_int_eq(gpucontext_props_transfer_chunk(p, 0), GA_VALUE_ERROR);
+  ck_assert_int_eq(gpucontext_props_transfer_chunk(p, 48), GA_NO_ERROR);
+  ck_assert_int_eq(gpucontext_init(&ctx2, name, p), GA_NO_ERROR);
+
+  d1 = gpudata_alloc(ctx2, sizeof(data), data, GA_BUFFER_INIT, NULL);
+  ck_assert(d1 != NULL);
+  d2 = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d2 != NULL);
+
+  err = gpudata_transfer(d2, 0, d1, 0, sizeof(data));
+  ck_assert(err == GA_NO_ERROR);
+  err = gpudata_read(res, d2, 0, sizeof(res));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < 100; i++)
+    ck_assert_int_eq(res[i], data[i]);
+
+  gpudata_release(d1);
+  gpudata_release(d2);
+  gpucontext_deref(ctx2);
+}
+END_TEST
+
+START_TEST(test_buffer_transfer_host) {
+  int32_t data[100];
+  int32_t res[100];
+  const char *name = NULL;
+  gpucontext_props *p;
+  gpucontext *ctx2;
+  gpudata *d1, *d2;
+  size_t nchunks;
+  unsigned int i;
+  int err;
+
+  for (i = 0; i < 100; i++)
+    data[i] = i;
+
+  ck_assert_int_eq(gpucontext_props_new(&p), GA_NO_ERROR);
+  ck_assert_int_eq(get_env_dev(&name, p), 0);
+  /* Chunks that are not a multiple of the element size */
+  ck_assert_int_eq(gpucontext_props_transfer_chunk(p, 54), GA_NO_ERROR);
+  ck_assert_int_eq(gpucontext_init(&ctx2, name, p), GA_NO_ERROR);
+
+  d1 = gpudata_alloc(ctx2, sizeof(data), data, GA_BUFFER_INIT, NULL);
+  ck_assert(d1 != NULL);
+  d2 = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d2 != NULL);
+  ck_assert_int_eq(gpudata_memset(d2, 0, 0), GA_NO_ERROR);
+
+  /* Go through the host even if the devices can copy directly */
+  err = gpudata_transfer_host(d2, 0, d1, 0, sizeof(data), &nchunks);
+  ck_assert_int_eq(err, GA_NO_ERROR);
+  ck_assert_int_eq(nchunks, (sizeof(data) + 53) / 54);
+  err = gpudata_read(res, d2, 0, sizeof(res));
+  ck_assert(err == GA_NO_ERROR);
+  for (i = 0; i < 100; i++)
+    ck_assert_int_eq(res[i], data[i]);
+
+  /* With offsets and a single chunk */
+  err = gpudata_transfer_host(d2, 4, d1, 8, 40, &nchunks);
+  ck_assert_int_eq(err, GA_NO_ERROR);
+  ck_assert_int_eq(nchunks, 1);
+  err = gpudata_read(res, d2, 0, sizeof(res));
+  ck_assert(err == GA_NO_ERROR);
+  ck_assert_int_eq(res[0], 0);
+  for (i = 0; i < 10; i++)
+    ck_assert_int_eq(res[i + 1], data[i + 2]);
+  for (i = 11; i < 100; i++)
+    ck_assert_int_eq(res[i], data[i]);
+
+  err = gpudata_transfer_host(d2, 0, d1, 0, 0, &nchunks);
+  ck_assert_int_eq(err, GA_NO_ERROR);
+  ck_assert_int_eq(nchunks, 0);
+
+  gpudata_release(d1);
+  gpudata_release(d2);
+  gpucontext_deref(ctx2);
+}
+END_TEST
+
+START_TEST(test_buffer_scratch) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  int32_t res[8];
+  gpudata *a, *b, *c;
+  size_t offa, offb, offc;
+  unsigned int i;
+
+  ck_assert_int_eq(gpudata_scratch_alloc(ctx, NULL, sizeof(data), data,
+                                         &a, &offa), GA_NO_ERROR);
+  ck_assert_int_eq(gpudata_scratch_alloc(ctx, NULL, 3, NULL,
+                                         &b, &offb), GA_NO_ERROR);
+  ck_assert(a == b);
+  ck_assert(offb > offa);
+  ck_assert_int_eq(gpudata_read(res, a, offa, sizeof(res)), GA_NO_ERROR);
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(res[i], data[i]);
+
+  /* Freeing rewinds the arena */
+  gpudata_scratch_free(ctx, NULL, b, offb);
+  ck_assert_int_eq(gpudata_scratch_alloc(ctx, NULL, 16, NULL,
+                                         &c, &offc), GA_NO_ERROR);
+  ck_assert(c == b);
+  ck_assert_int_eq(offc, offb);
+  gpudata_scratch_free(ctx, NULL, c, offc);
+
+  /* Too big for the block, a new one replaces it */
+  ck_assert_int_eq(gpudata_scratch_alloc(ctx, NULL, 1024 * 1024, NULL,
+                                         &c, &offc), GA_NO_ERROR);
+  ck_assert(c != a);
+  ck_assert_int_eq(offc, 0);
+  /* The old block lives as long as its temporaries */
+  ck_assert_int_eq(gpudata_read(res, a, offa, sizeof(res)), GA_NO_ERROR);
+  for (i = 0; i < 8; i++)
+    ck_assert_int_eq(res[i], data[i]);
+  gpudata_scratch_free(ctx, NULL, c, offc);
+  gpudata_scratch_free(ctx, NULL, a, offa);
+}
+END_TEST
+
+START_TEST(test_kernel_occupancy) {
+  static const char *src =
+    "KERNEL void occ(GLOBAL_MEM float *a, ga_size n) {\n"
+    "  LOCAL_MEM float buf[256];\n"
+    "  ga_size i;\n"
+    "  for (i = LDIM_0 * GID_0 + LID_0; i < n; i += LDIM_0 * GDIM_0) {\n"
+    "    buf[LID_0 % 256] = a[i];\n"
+    "    a[i] = buf[LID_0 % 256] * 2;\n"
+    "  }\n"
+    "}\n";
+  const int types[] = {GA_BUFFER, GA_SIZE};
+  GpuKernel k;
+  size_t lmem, shared, max_l, pref_l, gs, ls;
+  unsigned int regs, numprocs, blocks, blocks2;
+  int err;
+
+  ck_assert_int_eq(GpuKernel_init(&k, ctx, 1, &src, NULL, "occ", 2, types,
+                                  0, NULL), GA_NO_ERROR);
+  ck_assert_int_eq(gpukernel_property(k.k, GA_KERNEL_PROP_MAXLSIZE, &max_l),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(gpukernel_property(k.k, GA_KERNEL_PROP_PREFLSIZE,
+                                      &pref_l), GA_NO_ERROR);
+  ck_assert_int_eq(gpukernel_property(k.k, GA_CTX_PROP_NUMPROCS, &numprocs),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(gpucontext_property(ctx, GA_CTX_PROP_LMEMSIZE, &lmem),
+                   GA_NO_ERROR);
+  ck_assert(pref_l > 0 && pref_l <= max_l);
+
+  err = gpukernel_property(k.k, GA_KERNEL_PROP_NUMREGS, &regs);
+  if (err != GA_DEVSUP_ERROR) {
+    ck_assert_int_eq(err, GA_NO_ERROR);
+    ck_assert(regs > 0 && regs <= 255);
+  }
+  ck_assert_int_eq(gpukernel_property(k.k, GA_KERNEL_PROP_SHAREDSIZE,
+                                      &shared), GA_NO_ERROR);
+  ck_assert(shared >= 256 * sizeof(float) && shared <= lmem);
+
+  ck_assert_int_eq(gpukernel_occupancy(k.k, pref_l, 0, &blocks),
+                   GA_NO_ERROR);
+  ck_assert(blocks >= 1);
+  /* Dynamic shared memory can only lower the occupancy */
+  ck_assert_int_eq(gpukernel_occupancy(k.k, pref_l, (lmem - shared) / 2,
+                                       &blocks2), GA_NO_ERROR);
+  ck_assert(blocks2 <= blocks);
+  ck_assert_int_eq(gpukernel_occupancy(k.k, pref_l, lmem, &blocks2),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(blocks2, 0);
+
+  /* The grid covers one wave of resident blocks */
+  gs = ls = 0;
+  ck_assert_int_eq(GpuKernel_sched_shared(&k, 1 << 24, 0, &gs, &ls),
+                   GA_NO_ERROR);
+  ck_assert(ls >= pref_l && ls <= max_l && ls % pref_l == 0);
+  ck_assert(k.sched_ls == ls && k.sched_blocks >= 1);
+  ck_assert(gs >= 1 && gs <= (size_t)k.sched_blocks * numprocs);
+
+  /* Small sizes don't launch idle blocks */
+  gs = ls = 0;
+  ck_assert_int_eq(GpuKernel_sched_shared(&k, 1, 0, &gs, &ls), GA_NO_ERROR);
+  ck_assert_int_eq(gs, 1);
+  ck_assert_int_eq(ls, pref_l);
+
+  /* Given sizes are kept */
+  gs = 3;
+  ls = pref_l;
+  ck_assert_int_eq(GpuKernel_sched_shared(&k, 1 << 24, 0, &gs, &ls),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(gs, 3);
+  ck_assert_int_eq(ls, pref_l);
+
+  GpuKernel_clear(&k);
+}
+END_TEST
+
+/* More buffers than the launch wait lists keep inline */
+#define MANY_ARGS 20
+
+START_TEST(test_kernel_many_args) {
+  char src[2048];
+  const char *psrc = src;
+  int types[MANY_ARGS + 1];
+  gpudata *bufs[MANY_ARGS + 1];
+  void *args[MANY_ARGS + 1];
+  float v, res;
+  size_t one = 1;
+  size_t len;
+  GpuKernel k;
+  unsigned int i;
+
+  len = sprintf(src, "KERNEL void many(GLOBAL_MEM float *r");
+  for (i = 0; i < MANY_ARGS; i++)
+    len += sprintf(src + len, ", GLOBAL_MEM const float *a%u", i);
+  len += sprintf(src + len, ") {\n  r[0] = 0");
+  for (i = 0; i < MANY_ARGS; i++)
+    len += sprintf(src + len, " + a%u[0]", i);
+  sprintf(src + len, ";\n}\n");
+
+  types[0] = GA_BUFFER_WO;
+  for (i = 1; i <= MANY_ARGS; i++)
+    types[i] = GA_BUFFER_RO;
+  ck_assert_int_eq(GpuKernel_init(&k, ctx, 1, &psrc, NULL, "many",
+                                  MANY_ARGS + 1, types, 0, NULL),
+                   GA_NO_ERROR);
+
+  for (i = 0; i <= MANY_ARGS; i++) {
+    v = (float)i;
+    bufs[i] = gpudata_alloc(ctx, sizeof(float), &v, GA_BUFFER_INIT, NULL);
+    ck_assert(bufs[i] != NULL);
+    args[i] = bufs[i];
+  }
+
+  ck_assert_int_eq(GpuKernel_call(&k, 1, &one, &one, 0, args), GA_NO_ERROR);
+  /* Writing an input after the launch must not change what it read */
+  v = 1000.0f;
+  ck_assert_int_eq(gpudata_write(bufs[1], 0, &v, sizeof(v)), GA_NO_ERROR);
+  ck_assert_int_eq(gpudata_read(&res, bufs[0], 0, sizeof(res)), GA_NO_ERROR);
+  ck_assert(res == (float)(MANY_ARGS * (MANY_ARGS + 1) / 2));
+
+  /* And the next launch sees the write */
+  ck_assert_int_eq(GpuKernel_call(&k, 1, &one, &one, 0, args), GA_NO_ERROR);
+  ck_assert_int_eq(gpudata_read(&res, bufs[0], 0, sizeof(res)), GA_NO_ERROR);
+  ck_assert(res == (float)(MANY_ARGS * (MANY_ARGS + 1) / 2 - 1 + 1000));
+
+  for (i = 0; i <= MANY_ARGS; i++)
+    gpudata_release(bufs[i]);
+  GpuKernel_clear(&k);
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("buffer");
   TCase *tc = tcase_create("API");
@@ -185,6 +903,18 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_buffer_share);
   tcase_add_test(tc, test_buffer_read_write);
   tcase_add_test(tc, test_buffer_move);
+  tcase_add_test(tc, test_buffer_stream);
+  tcase_add_test(tc, test_buffer_stream_reuse);
+  tcase_add_test(tc, test_buffer_stream_readers);
+  tcase_add_test(tc, test_buffer_graph);
+  tcase_add_test(tc, test_buffer_event);
+  tcase_add_test(tc, test_buffer_async);
+  tcase_add_test(tc, test_buffer_host);
+  tcase_add_test(tc, test_buffer_transfer);
+  tcase_add_test(tc, test_buffer_transfer_host);
+  tcase_add_test(tc, test_buffer_scratch);
+  tcase_add_test(tc, test_kernel_occupancy);
+  tcase_add_test(tc, test_kernel_many_args);
   suite_add_tcase(s, tc);
   return s;
 }
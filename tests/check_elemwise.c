@@ -834,6 +834,194 @@ START_TEST(test_basic_neg_strides) {
 }
 END_TEST
 
+START_TEST(test_basic_transpose) {
+  GpuArray a;
+  GpuArray b;
+  GpuArray c;
+
+  GpuElemwise *ge;
+
+  static uint32_t data1[45 * 70];
+  static uint32_t data2[70 * 45];
+  static uint32_t data3[70 * 45];
+
+  size_t dims[2];
+  unsigned int i, j;
+
+  gpuelemwise_arg args[3] = {{0}};
+  void *rargs[3];
+
+  for (i = 0; i < 45 * 70; i++) {
+    data1[i] = i;
+    data2[i] = 10000 * i;
+  }
+
+  dims[0] = 45;
+  dims[1] = 70;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+  /* a is now (70, 45) and contiguous along the first axis */
+  ga_assert_ok(GpuArray_transpose_inplace(&a, NULL));
+
+  dims[0] = 70;
+  dims[1] = 45;
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_UINT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "b";
+  args[1].typecode = GA_UINT;
+  args[1].flags = GE_READ;
+
+  args[2].name = "c";
+  args[2].typecode = GA_UINT;
+  args[2].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "", "c = a + b", 3, args, 2, 0);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &c;
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+
+  for (i = 0; i < 70; i++)
+    for (j = 0; j < 45; j++)
+      ck_assert_int_eq(data3[i * 45 + j], j * 70 + i + 10000 * (i * 45 + j));
+}
+END_TEST
+
+START_TEST(test_basic_grid) {
+  GpuArray a;
+  GpuArray b;
+  GpuArray c;
+
+  GpuElemwise *ge;
+
+  static uint32_t data1[3 * 40 * 200];
+  static uint32_t data2[3 * 40 * 100];
+  static uint32_t data3[3 * 40 * 100];
+
+  size_t dims[3];
+  ssize_t starts[3];
+  ssize_t stops[3];
+  ssize_t steps[3];
+  unsigned int i, j;
+
+  gpuelemwise_arg args[3] = {{0}};
+  void *rargs[3];
+
+  for (i = 0; i < 3 * 40 * 200; i++)
+    data1[i] = i;
+  for (i = 0; i < 3 * 40 * 100; i++)
+    data2[i] = 100000 * i;
+
+  dims[0] = 3;
+  dims[1] = 40;
+  dims[2] = 200;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 3, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  /* a[:, :, ::2] is not contiguous but long enough along its rows */
+  starts[0] = 0;
+  stops[0] = 3;
+  steps[0] = 1;
+  starts[1] = 0;
+  stops[1] = 40;
+  steps[1] = 1;
+  starts[2] = 0;
+  stops[2] = 200;
+  steps[2] = 2;
+  ga_assert_ok(GpuArray_index_inplace(&a, starts, stops, steps));
+
+  dims[2] = 100;
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 3, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_UINT, 3, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_UINT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "b";
+  args[1].typecode = GA_UINT;
+  args[1].flags = GE_READ;
+
+  args[2].name = "c";
+  args[2].typecode = GA_UINT;
+  args[2].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "", "c = a + b", 3, args, 3, 0);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &c;
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+
+  for (i = 0; i < 3 * 40; i++)
+    for (j = 0; j < 100; j++)
+      ck_assert_int_eq(data3[i * 100 + j],
+                       i * 200 + 2 * j + 100000 * (i * 100 + j));
+}
+END_TEST
+
+START_TEST(test_basic_index) {
+  GpuArray r;
+
+  GpuElemwise *ge;
+
+  uint32_t data1[3 * 4];
+
+  size_t dims[2] = {3, 4};
+  unsigned int i, j;
+
+  gpuelemwise_arg args[1] = {{0}};
+  void *rargs[1];
+
+  /* Fortran order so that memory order differs from ga_i */
+  ga_assert_ok(GpuArray_empty(&r, ctx, GA_UINT, 2, dims, GA_F_ORDER));
+
+  args[0].name = "r";
+  args[0].typecode = GA_UINT;
+  args[0].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "",
+                       "r = ga_idx0 * 100 + ga_idx1 * 10 + (ga_i % 10)",
+                       1, args, 2, GE_INDEX);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &r;
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data1, sizeof(data1), &r));
+
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 4; j++)
+      ck_assert_int_eq(data1[j * 3 + i], i * 100 + j * 10 + (i * 4 + j) % 10);
+}
+END_TEST
+
 START_TEST(test_basic_0) {
   GpuArray a;
   GpuArray b;
@@ -879,6 +1067,403 @@ START_TEST(test_basic_0) {
 }
 END_TEST
 
+START_TEST(test_multi_simple) {
+  GpuArray a[5];
+  GpuArray c[5];
+
+  GpuElemwise *ge;
+
+  static uint32_t data1[1000];
+  static uint32_t data3[1000];
+  static const size_t sizes[5] = {3, 1000, 0, 70, 500};
+  uint32_t scal[5] = {2, 3, 4, 5, 6};
+
+  size_t dims[1];
+  ssize_t start, stop, step;
+  unsigned int i, j;
+
+  gpuelemwise_arg args[3] = {{0}};
+  void *rargs[5][3];
+  void **sets[5];
+
+  for (i = 0; i < 1000; i++)
+    data1[i] = i;
+
+  for (i = 0; i < 4; i++) {
+    dims[0] = sizes[i];
+    ga_assert_ok(GpuArray_empty(&a[i], ctx, GA_UINT, 1, dims, GA_C_ORDER));
+    if (sizes[i] != 0)
+      ga_assert_ok(GpuArray_write(&a[i], data1, sizes[i] * sizeof(uint32_t)));
+  }
+
+  /* The last set is not contiguous and goes through GpuElemwise_call */
+  ga_assert_ok(GpuArray_view(&a[4], &a[1]));
+  start = 0;
+  stop = 1000;
+  step = 2;
+  ga_assert_ok(GpuArray_index_inplace(&a[4], &start, &stop, &step));
+
+  for (i = 0; i < 5; i++) {
+    dims[0] = sizes[i];
+    ga_assert_ok(GpuArray_empty(&c[i], ctx, GA_UINT, 1, dims, GA_C_ORDER));
+    rargs[i][0] = &a[i];
+    rargs[i][1] = &scal[i];
+    rargs[i][2] = &c[i];
+    sets[i] = rargs[i];
+  }
+
+  args[0].name = "a";
+  args[0].typecode = GA_UINT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "s";
+  args[1].typecode = GA_UINT;
+  args[1].flags = GE_SCALAR;
+
+  args[2].name = "c";
+  args[2].typecode = GA_UINT;
+  args[2].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "", "c = a * s", 3, args, 1, 0);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  ga_assert_ok(GpuElemwise_call_multi(ge, 5, sets, 0));
+
+  for (i = 0; i < 4; i++) {
+    if (sizes[i] == 0)
+      continue;
+    ga_assert_ok(GpuArray_read(data3, sizes[i] * sizeof(uint32_t), &c[i]));
+    for (j = 0; j < sizes[i]; j++)
+      ck_assert_int_eq(data3[j], j * scal[i]);
+  }
+  ga_assert_ok(GpuArray_read(data3, sizes[4] * sizeof(uint32_t), &c[4]));
+  for (j = 0; j < sizes[4]; j++)
+    ck_assert_int_eq(data3[j], 2 * j * scal[4]);
+}
+END_TEST
+
+START_TEST(test_capture_replay) {
+  GpuArray a, a2, b, c, r, ind;
+  GpuElemwise *ge;
+  gpugraph *g;
+
+  static uint32_t data1[100];
+  static uint32_t data2[100];
+  static uint32_t data3[100];
+  static int64_t idx[100];
+  const uint32_t seven = 7;
+  size_t dims[1] = {100};
+  unsigned int i;
+  int err;
+
+  gpuelemwise_arg args[3] = {{0}};
+  void *rargs[3];
+
+  for (i = 0; i < 100; i++) {
+    data1[i] = i;
+    data2[i] = 3 * i;
+    data3[i] = seven;
+    idx[i] = 99 - i;
+  }
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+  ga_assert_ok(GpuArray_empty(&a2, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a2, data2, sizeof(data2)));
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data3, sizeof(data3)));
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&r, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_memset(&r, 0));
+  ga_assert_ok(GpuArray_empty(&ind, ctx, GA_LONG, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&ind, idx, sizeof(idx)));
+
+  args[0].name = "a";
+  args[0].typecode = GA_UINT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "b";
+  args[1].typecode = GA_UINT;
+  args[1].flags = GE_READ;
+
+  args[2].name = "c";
+  args[2].typecode = GA_UINT;
+  args[2].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "", "c = a * 2 + b", 3, args, 1, 0);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &c;
+
+  /* r = (a * 2 + b)[::-1] */
+  ga_assert_ok(gpucontext_capture_begin(ctx));
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+  ga_assert_ok(GpuArray_take1(&r, &c, &ind, 0));
+  g = gpucontext_capture_end(ctx, &err);
+  ck_assert_ptr_ne(g, NULL);
+
+  /* Nothing ran yet */
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &r));
+  for (i = 0; i < 100; i++)
+    ck_assert_int_eq(data3[i], 0);
+
+  ga_assert_ok(gpugraph_launch(g, NULL));
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &r));
+  for (i = 0; i < 100; i++)
+    ck_assert_int_eq(data3[i], data1[99 - i] * 2 + seven);
+
+  /* The replay reads the new input */
+  ga_assert_ok(gpugraph_update(g, a.data, a2.data));
+  ga_assert_ok(gpugraph_launch(g, NULL));
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &r));
+  for (i = 0; i < 100; i++)
+    ck_assert_int_eq(data3[i], data2[99 - i] * 2 + seven);
+
+  gpugraph_free(g);
+  GpuElemwise_free(ge);
+  GpuArray_clear(&a);
+  GpuArray_clear(&a2);
+  GpuArray_clear(&b);
+  GpuArray_clear(&c);
+  GpuArray_clear(&r);
+  GpuArray_clear(&ind);
+}
+END_TEST
+
+START_TEST(test_reduce_sum) {
+  GpuArray a;
+  GpuArray b;
+  GpuArray r;
+
+  GpuElemwise *ge;
+
+  static float data1[4 * 50];
+  static float data2[4 * 50];
+  float data3[4];
+  float ref;
+
+  size_t dims[2];
+  unsigned int i, j;
+
+  gpuelemwise_arg args[3] = {{0}};
+  gpuelemwise_reduce red;
+  void *rargs[3];
+
+  for (i = 0; i < 4 * 50; i++) {
+    data1[i] = (float)(i % 7);
+    data2[i] = (float)(i % 3);
+  }
+
+  dims[0] = 4;
+  dims[1] = 50;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  /* Reduce over the second axis */
+  dims[1] = 1;
+  ga_assert_ok(GpuArray_empty(&r, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_FLOAT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "b";
+  args[1].typecode = GA_FLOAT;
+  args[1].flags = GE_READ;
+
+  args[2].name = "r";
+  args[2].typecode = GA_FLOAT;
+  args[2].flags = GE_WRITE;
+
+  red.arg = 2;
+  red.op = GE_REDUCE_SUM;
+  red.neutral = NULL;
+
+  ge = GpuElemwise_new_reduce(ctx, "", "r = (a - b) * (a - b)", 3, args, 2,
+                              0, &red);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &r;
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &r));
+
+  for (i = 0; i < 4; i++) {
+    ref = 0;
+    for (j = 0; j < 50; j++)
+      ref += (data1[i * 50 + j] - data2[i * 50 + j]) *
+        (data1[i * 50 + j] - data2[i * 50 + j]);
+    ck_assert_float_eq(data3[i], ref);
+  }
+
+  /* Reduce over everything */
+  GpuArray_clear(&r);
+  dims[0] = 1;
+  ga_assert_ok(GpuArray_empty(&r, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data3, sizeof(float), &r));
+
+  ref = 0;
+  for (i = 0; i < 4 * 50; i++)
+    ref += (data1[i] - data2[i]) * (data1[i] - data2[i]);
+  ck_assert_float_eq(data3[0], ref);
+}
+END_TEST
+
+START_TEST(test_reduce_split) {
+  GpuArray a;
+  GpuArray r;
+
+  GpuElemwise *ge;
+
+  static float data1[4 * 262144];
+  float data3[4];
+  float ref;
+
+  size_t dims[2];
+  unsigned int i, j;
+
+  gpuelemwise_arg args[2] = {{0}};
+  gpuelemwise_reduce red;
+  void *rargs[2];
+
+  /* Small integers keep the float sums exact in any order */
+  for (i = 0; i < 4 * 262144; i++)
+    data1[i] = (float)(i % 5);
+
+  dims[0] = 4;
+  dims[1] = 262144;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  /* Few outputs and long rows, so each row is split in parts that
+     elem_reduce_fin sums up */
+  dims[1] = 1;
+  ga_assert_ok(GpuArray_empty(&r, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_FLOAT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "r";
+  args[1].typecode = GA_FLOAT;
+  args[1].flags = GE_WRITE;
+
+  red.arg = 1;
+  red.op = GE_REDUCE_SUM;
+  red.neutral = NULL;
+
+  ge = GpuElemwise_new_reduce(ctx, "", "r = a", 2, args, 2, 0, &red);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &r;
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &r));
+
+  for (i = 0; i < 4; i++) {
+    ref = 0;
+    for (j = 0; j < 262144; j++)
+      ref += data1[i * 262144 + j];
+    ck_assert_float_eq(data3[i], ref);
+  }
+
+  /* A single output */
+  GpuArray_clear(&r);
+  dims[0] = 1;
+  ga_assert_ok(GpuArray_empty(&r, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data3, sizeof(float), &r));
+
+  ref = 0;
+  for (i = 0; i < 4 * 262144; i++)
+    ref += data1[i];
+  ck_assert_float_eq(data3[0], ref);
+
+  GpuElemwise_free(ge);
+  GpuArray_clear(&a);
+  GpuArray_clear(&r);
+}
+END_TEST
+
+START_TEST(test_reduce_max) {
+  GpuArray a;
+  GpuArray r;
+
+  GpuElemwise *ge;
+
+  static const int32_t data1[6] = {3, -1, 7, 2, 9, -4};
+  int32_t data2[3];
+
+  size_t dims[2];
+
+  gpuelemwise_arg args[2] = {{0}};
+  gpuelemwise_reduce red;
+  void *rargs[2];
+
+  dims[0] = 2;
+  dims[1] = 3;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_INT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  /* Reduce over the first axis */
+  dims[0] = 1;
+  ga_assert_ok(GpuArray_empty(&r, ctx, GA_INT, 2, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_INT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "r";
+  args[1].typecode = GA_INT;
+  args[1].flags = GE_WRITE;
+
+  red.arg = 1;
+  red.op = GE_REDUCE_MAX;
+  red.neutral = NULL;
+
+  /* max has no default neutral */
+  ge = GpuElemwise_new_reduce(ctx, "", "r = a", 2, args, 2, 0, &red);
+  ck_assert_ptr_eq(ge, NULL);
+
+  red.neutral = "-2147483647 - 1";
+  ge = GpuElemwise_new_reduce(ctx, "", "r = a", 2, args, 2, 0, &red);
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &r;
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+
+  ga_assert_ok(GpuArray_read(data2, sizeof(data2), &r));
+
+  ck_assert_int_eq(data2[0], 3);
+  ck_assert_int_eq(data2[1], 9);
+  ck_assert_int_eq(data2[2], 7);
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("elemwise");
   TCase *tc = tcase_create("contig");
@@ -901,7 +1486,27 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_basic_padshape);
   tcase_add_test(tc, test_basic_collapse);
   tcase_add_test(tc, test_basic_neg_strides);
+  tcase_add_test(tc, test_basic_transpose);
+  tcase_add_test(tc, test_basic_grid);
+  tcase_add_test(tc, test_basic_index);
   tcase_add_test(tc, test_basic_0);
   suite_add_tcase(s, tc);
+  tc = tcase_create("multi");
+  tcase_set_timeout(tc, 8.0);
+  tcase_add_checked_fixture(tc, setup, teardown);
+  tcase_add_test(tc, test_multi_simple);
+  suite_add_tcase(s, tc);
+  tc = tcase_create("capture");
+  tcase_set_timeout(tc, 8.0);
+  tcase_add_checked_fixture(tc, setup, teardown);
+  tcase_add_test(tc, test_capture_replay);
+  suite_add_tcase(s, tc);
+  tc = tcase_create("reduce");
+  tcase_set_timeout(tc, 8.0);
+  tcase_add_checked_fixture(tc, setup, teardown);
+  tcase_add_test(tc, test_reduce_sum);
+  tcase_add_test(tc, test_reduce_split);
+  tcase_add_test(tc, test_reduce_max);
+  suite_add_tcase(s, tc);
   return s;
 }
@@ -1,8 +1,12 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <check.h>
 
 #include "gpuarray/buffer.h"
+#include "gpuarray/error.h"
+#include "gpuarray/trace.h"
 #include "gpuarray/util.h"
 
 START_TEST(test_register_type) {
@@ -147,6 +151,30 @@ START_TEST(test_float2half) {
 }
 END_TEST
 
+START_TEST(test_trace) {
+  char path[] = "/tmp/gputraceXXXXXX";
+  char buf[16];
+  FILE *f;
+  int fd;
+
+  fd = mkstemp(path);
+  ck_assert_int_ne(fd, -1);
+  close(fd);
+
+  ck_assert_int_eq(gputrace_stop(), GA_VALUE_ERROR);
+  ck_assert_int_eq(gputrace_start(path), GA_NO_ERROR);
+  ck_assert_int_eq(gputrace_start(path), GA_VALUE_ERROR);
+  ck_assert_int_eq(gputrace_stop(), GA_NO_ERROR);
+
+  f = fopen(path, "r");
+  ck_assert_ptr_ne(f, NULL);
+  ck_assert_ptr_ne(fgets(buf, sizeof(buf), f), NULL);
+  ck_assert_str_eq(buf, "{\"traceEvents\":");
+  fclose(f);
+  unlink(path);
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("util");
   TCase *tc = tcase_create("All");
@@ -154,6 +182,7 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_type_flags);
   tcase_add_test(tc, test_elemwise_collapse);
   tcase_add_test(tc, test_float2half);
+  tcase_add_test(tc, test_trace);
   suite_add_tcase(s, tc);
   return s;
 }